@@ -53,6 +53,10 @@ static int inject_size_set;
  */
 static int offset_rma_start = 0;
 
+/* Per-iteration round trip times, in ns, recorded when -L is set. */
+static int lat_percentiles;
+static uint64_t *lat_samples;
+
 void ft_parse_benchmark_opts(int op, char *optarg)
 {
 	switch (op) {
@@ -73,6 +77,9 @@ void ft_parse_benchmark_opts(int op, char *optarg)
 	case 'r':
 		opts.options |= FT_OPT_NO_PRE_POSTED_RX;
 		break;
+	case 'L':
+		lat_percentiles = 1;
+		break;
 	default:
 		break;
 	}
@@ -91,17 +98,64 @@ void ft_benchmark_usage(void)
 	FT_PRINT_OPTS_USAGE("", "Only the following tests support this option for now:");
 	FT_PRINT_OPTS_USAGE("", "\tfi_rdm_tagged_pingpong");
 	FT_PRINT_OPTS_USAGE("", "\tfi_rdm_pingpong");
+	FT_PRINT_OPTS_USAGE("-L", "report latency percentiles (pingpong tests)");
+}
+
+static inline uint64_t pingpong_lat_start(void)
+{
+	return lat_samples ? ft_gettime_ns() : 0;
+}
+
+static inline void pingpong_lat_end(int i, uint64_t lat_start)
+{
+	if (lat_samples && i >= opts.warmup_iterations)
+		lat_samples[i - opts.warmup_iterations] =
+			ft_gettime_ns() - lat_start;
+}
+
+static int pingpong_lat_cmp(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+
+	return (x > y) - (x < y);
+}
+
+static double pingpong_lat_pct(double pct)
+{
+	int idx = (int) (pct / 100.0 * opts.iterations + 0.5);
+
+	if (idx > 0)
+		idx--;
+	if (idx >= opts.iterations)
+		idx = opts.iterations - 1;
+
+	/* Report half the round trip, matching usec/xfer */
+	return lat_samples[idx] / 2000.0;
+}
+
+static void show_lat_percentiles(void)
+{
+	qsort(lat_samples, opts.iterations, sizeof(*lat_samples),
+	      pingpong_lat_cmp);
+	printf("%-8s usec/xfer: min %.2f p50 %.2f p90 %.2f p99 %.2f "
+	       "p99.9 %.2f max %.2f\n", "latency",
+	       lat_samples[0] / 2000.0, pingpong_lat_pct(50),
+	       pingpong_lat_pct(90), pingpong_lat_pct(99),
+	       pingpong_lat_pct(99.9),
+	       lat_samples[opts.iterations - 1] / 2000.0);
 }
 
 /* Pingpong latency test with pre-posted receive buffers. */
 static int pingpong_pre_posted_rx(size_t inject_size)
 {
+	uint64_t lat_start;
 	int ret, i;
 
 	if (opts.dst_addr) {
 		for (i = 0; i < opts.iterations + opts.warmup_iterations; i++) {
 			if (i == opts.warmup_iterations)
 				ft_start();
+			lat_start = pingpong_lat_start();
 
 			if (opts.transfer_size <= inject_size)
 				ret = ft_inject(ep, remote_fi_addr,
@@ -115,11 +169,13 @@ static int pingpong_pre_posted_rx(size_t inject_size)
 			ret = ft_rx(ep, opts.transfer_size);
 			if (ret)
 				return ret;
+			pingpong_lat_end(i, lat_start);
 		}
 	} else {
 		for (i = 0; i < opts.iterations + opts.warmup_iterations; i++) {
 			if (i == opts.warmup_iterations)
 				ft_start();
+			lat_start = pingpong_lat_start();
 
 			ret = ft_rx(ep, opts.transfer_size);
 			if (ret)
@@ -133,6 +189,7 @@ static int pingpong_pre_posted_rx(size_t inject_size)
 					    opts.transfer_size, &tx_ctx);
 			if (ret)
 				return ret;
+			pingpong_lat_end(i, lat_start);
 		}
 	}
 	ft_stop();
@@ -143,12 +200,14 @@ static int pingpong_pre_posted_rx(size_t inject_size)
 /* Pingpong latency test without pre-posted receive buffers. */
 static int pingpong_no_pre_posted_rx(size_t inject_size)
 {
+	uint64_t lat_start;
 	int ret, i;
 
 	if (opts.dst_addr) {
 		for (i = 0; i < opts.iterations + opts.warmup_iterations; i++) {
 			if (i == opts.warmup_iterations)
 				ft_start();
+			lat_start = pingpong_lat_start();
 
 			if (opts.transfer_size <= inject_size)
 				ret = ft_inject(ep, remote_fi_addr,
@@ -166,11 +225,13 @@ static int pingpong_no_pre_posted_rx(size_t inject_size)
 			ret = ft_get_rx_comp(rx_seq);
 			if (ret)
 				return ret;
+			pingpong_lat_end(i, lat_start);
 		}
 	} else {
 		for (i = 0; i < opts.iterations + opts.warmup_iterations; i++) {
 			if (i == opts.warmup_iterations)
 				ft_start();
+			lat_start = pingpong_lat_start();
 
 			ret = ft_post_rx(ep, opts.transfer_size, &rx_ctx);
 			if (ret)
@@ -195,6 +256,7 @@ static int pingpong_no_pre_posted_rx(size_t inject_size)
 					    opts.transfer_size, &tx_ctx);
 			if (ret)
 				return ret;
+			pingpong_lat_end(i, lat_start);
 		}
 	}
 	ft_stop();
@@ -220,33 +282,39 @@ int pingpong(void)
 	if (opts.options & FT_OPT_ENABLE_HMEM)
 		inject_size = 0;
 
+	if (lat_percentiles && opts.iterations > 0) {
+		lat_samples = calloc(opts.iterations, sizeof(*lat_samples));
+		if (!lat_samples)
+			return -FI_ENOMEM;
+	}
+
 	if (ft_check_opts(FT_OPT_NO_PRE_POSTED_RX)) {
 		if (ft_check_opts(FT_OPT_OOB_SYNC)) {
 			ret = ft_sync_oob();
 			if (ret)
-				return ret;
+				goto out;
 		} else {
 			/* Repost RX buffers to support inband sync. */
 			ret = ft_post_rx(ep, rx_size, &rx_ctx);
 			if (ret)
-				return ret;
+				goto out;
 
 			ret = ft_sync_inband(false);
 			if (ret)
-				return ret;
+				goto out;
 		}
 
 		ret = pingpong_no_pre_posted_rx(inject_size);
 		if (ret)
-			return ret;
+			goto out;
 	} else {
 		ret = ft_sync();
 		if (ret)
-			return ret;
+			goto out;
 
 		ret = pingpong_pre_posted_rx(inject_size);
 		if (ret)
-			return ret;
+			goto out;
 	}
 
 	if (opts.machr)
@@ -255,7 +323,12 @@ int pingpong(void)
 	else
 		show_perf(NULL, opts.transfer_size, opts.iterations, &start, &end, 2);
 
-	return 0;
+	if (lat_samples)
+		show_lat_percentiles();
+out:
+	free(lat_samples);
+	lat_samples = NULL;
+	return ret;
 }
 
 int run_pingpong(void)
@@ -0,0 +1,401 @@
+/*
+ * Copyright (c) Intel Corporation.  All rights reserved.
+ *
+ * This software is available to you under the BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Measures the completion rate of a single CQ shared by several endpoints.
+ * Each producer thread owns an endpoint that issues RMA writes to a sink
+ * endpoint in the same process.  All endpoints are bound to one CQ, which
+ * the main thread drains.  The test runs with 1, 2, 4, ... producers, up
+ * to the requested maximum, and reports completions per second for each.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <rdma/fi_cm.h>
+#include <rdma/fi_errno.h>
+#include <rdma/fi_rma.h>
+
+#include <shared.h>
+#include "benchmark_shared.h"
+
+#define CQ_MT_DEF_PRODUCERS	8
+#define CQ_MT_BATCH		64
+
+struct cq_mt_producer;
+
+struct cq_mt_ctx {
+	struct fi_context2	ctx;
+	struct cq_mt_producer	*prod;
+};
+
+struct cq_mt_producer {
+	pthread_t		thread;
+	struct fid_ep		*ep;
+	struct fid_mr		*mr;
+	void			*desc;
+	char			*buf;
+	struct cq_mt_ctx	*ctx;
+	int			iters;
+	volatile int		done;
+	int			ret;
+};
+
+static struct cq_mt_producer *producers;
+static int max_producers = CQ_MT_DEF_PRODUCERS;
+static int cq_mt_window;
+static size_t xfer_size = 8;
+static pthread_barrier_t cq_mt_barrier;
+static volatile bool cq_mt_failed;
+
+static fi_addr_t sink_addr;
+static uint64_t sink_raddr;
+static uint64_t sink_key;
+static char *sink_buf;
+
+static void *cq_mt_produce(void *arg)
+{
+	struct cq_mt_producer *prod = arg;
+	int i, ret = 0;
+
+	pthread_barrier_wait(&cq_mt_barrier);
+	for (i = 0; i < prod->iters && !cq_mt_failed; i++) {
+		while (i - prod->done >= cq_mt_window && !cq_mt_failed)
+			sched_yield();
+
+		/* Progress is driven by the thread reading the CQ */
+		do {
+			ret = fi_write(prod->ep, prod->buf, xfer_size,
+				       prod->desc, sink_addr, sink_raddr,
+				       sink_key, &prod->ctx[i % cq_mt_window]);
+			if (ret == -FI_EAGAIN)
+				sched_yield();
+		} while (ret == -FI_EAGAIN && !cq_mt_failed);
+
+		if (ret) {
+			FT_PRINTERR("fi_write", ret);
+			prod->ret = ret;
+			cq_mt_failed = true;
+			break;
+		}
+	}
+	return NULL;
+}
+
+static int cq_mt_consume(int total)
+{
+	struct fi_cq_entry comp[CQ_MT_BATCH];
+	struct cq_mt_ctx *ctx;
+	int cnt = 0, i, ret;
+
+	while (cnt < total && !cq_mt_failed) {
+		ret = fi_cq_read(txcq, comp, CQ_MT_BATCH);
+		if (ret > 0) {
+			for (i = 0; i < ret; i++) {
+				ctx = comp[i].op_context;
+				ctx->prod->done++;
+			}
+			cnt += ret;
+		} else if (ret == -FI_EAVAIL) {
+			ret = ft_cq_readerr(txcq);
+			cq_mt_failed = true;
+			return ret;
+		} else if (ret == -FI_EAGAIN) {
+			sched_yield();
+		} else {
+			FT_PRINTERR("fi_cq_read", ret);
+			cq_mt_failed = true;
+			return ret;
+		}
+	}
+	return 0;
+}
+
+static int cq_mt_run(int nprod)
+{
+	uint64_t begin, nsec = 0;
+	int i, ret, err;
+
+	ret = pthread_barrier_init(&cq_mt_barrier, NULL, nprod + 1);
+	if (ret)
+		return -ret;
+
+	for (i = 0; i < nprod; i++) {
+		producers[i].iters = opts.iterations;
+		producers[i].done = 0;
+		producers[i].ret = 0;
+		ret = pthread_create(&producers[i].thread, NULL,
+				     cq_mt_produce, &producers[i]);
+		if (ret) {
+			cq_mt_failed = true;
+			nprod = i;
+			ret = -ret;
+			break;
+		}
+	}
+
+	if (!cq_mt_failed) {
+		pthread_barrier_wait(&cq_mt_barrier);
+		begin = ft_gettime_ns();
+		ret = cq_mt_consume(nprod * opts.iterations);
+		nsec = ft_gettime_ns() - begin;
+	}
+
+	for (i = 0; i < nprod; i++) {
+		pthread_join(producers[i].thread, NULL);
+		if (producers[i].ret && !ret)
+			ret = producers[i].ret;
+	}
+
+	err = pthread_barrier_destroy(&cq_mt_barrier);
+	if (ret || err)
+		return ret ? ret : -err;
+
+	printf("%-10d %14d %12.2f %14.2f\n", nprod, nprod * opts.iterations,
+	       nsec / 1000.0, (double) nprod * opts.iterations * 1000.0 / nsec);
+	return 0;
+}
+
+static int cq_mt_init_producer(struct cq_mt_producer *prod, int id)
+{
+	struct fid_ep *sink_ep;
+	int i, ret;
+
+	ret = fi_endpoint(domain, fi, &prod->ep, NULL);
+	if (ret) {
+		FT_PRINTERR("fi_endpoint", ret);
+		return ret;
+	}
+
+	ret = ft_enable_ep(prod->ep, eq, av, txcq, txcq, NULL, NULL, NULL);
+	if (ret)
+		return ret;
+
+	prod->ctx = calloc(cq_mt_window, sizeof(*prod->ctx));
+	prod->buf = calloc(1, xfer_size);
+	if (!prod->ctx || !prod->buf)
+		return -FI_ENOMEM;
+
+	for (i = 0; i < cq_mt_window; i++)
+		prod->ctx[i].prod = prod;
+
+	/* ft_reg_mr() binds to the global ep when FI_MR_ENDPOINT is set */
+	sink_ep = ep;
+	ep = prod->ep;
+	ret = ft_reg_mr(fi, prod->buf, xfer_size, FI_WRITE, FT_MR_KEY + 1 + id,
+			FI_HMEM_SYSTEM, 0, &prod->mr, &prod->desc);
+	ep = sink_ep;
+	if (ret)
+		FT_PRINTERR("ft_reg_mr", ret);
+	return ret;
+}
+
+static void cq_mt_free_producers(void)
+{
+	int i;
+
+	for (i = 0; i < max_producers; i++) {
+		FT_CLOSE_FID(producers[i].mr);
+		FT_CLOSE_FID(producers[i].ep);
+		free(producers[i].ctx);
+		free(producers[i].buf);
+	}
+	free(producers);
+}
+
+static int cq_mt_init_sink(void)
+{
+	size_t addrlen = FT_MAX_CTRL_MSG;
+	char addr[FT_MAX_CTRL_MSG];
+	int ret;
+
+	ret = fi_endpoint(domain, fi, &ep, NULL);
+	if (ret) {
+		FT_PRINTERR("fi_endpoint", ret);
+		return ret;
+	}
+
+	ret = ft_enable_ep(ep, eq, av, txcq, txcq, NULL, NULL, NULL);
+	if (ret)
+		return ret;
+
+	ret = fi_getname(&ep->fid, addr, &addrlen);
+	if (ret) {
+		FT_PRINTERR("fi_getname", ret);
+		return ret;
+	}
+
+	ret = fi_av_insert(av, addr, 1, &sink_addr, 0, NULL);
+	if (ret != 1) {
+		FT_PRINTERR("fi_av_insert", ret);
+		return ret < 0 ? ret : -FI_EINVAL;
+	}
+
+	sink_buf = calloc(1, xfer_size);
+	if (!sink_buf)
+		return -FI_ENOMEM;
+
+	ret = ft_reg_mr(fi, sink_buf, xfer_size, FI_REMOTE_WRITE, FT_MR_KEY,
+			FI_HMEM_SYSTEM, 0, &mr, NULL);
+	if (ret) {
+		FT_PRINTERR("ft_reg_mr", ret);
+		return ret;
+	}
+
+	sink_key = mr ? fi_mr_key(mr) : 0;
+	sink_raddr = (fi->domain_attr->mr_mode & FI_MR_VIRT_ADDR) ?
+		     (uintptr_t) sink_buf : 0;
+	return 0;
+}
+
+static int run(void)
+{
+	struct fi_cq_attr attr = {
+		.format = FI_CQ_FORMAT_CONTEXT,
+		.wait_obj = FI_WAIT_NONE,
+	};
+	struct fi_av_attr av_attr = {
+		.type = FI_AV_UNSPEC,
+	};
+	int i, nprod, ret;
+
+	ret = ft_getinfo(hints, &fi);
+	if (ret)
+		return ret;
+
+	ret = ft_open_fabric_res();
+	if (ret)
+		return ret;
+
+	attr.size = MAX(fi->tx_attr->size, (size_t) cq_mt_window) *
+		    max_producers;
+	ret = fi_cq_open(domain, &attr, &txcq, &txcq);
+	if (ret) {
+		FT_PRINTERR("fi_cq_open", ret);
+		return ret;
+	}
+
+	av_attr.count = max_producers + 1;
+	ret = fi_av_open(domain, &av_attr, &av, NULL);
+	if (ret) {
+		FT_PRINTERR("fi_av_open", ret);
+		return ret;
+	}
+
+	ret = cq_mt_init_sink();
+	if (ret)
+		return ret;
+
+	producers = calloc(max_producers, sizeof(*producers));
+	if (!producers)
+		return -FI_ENOMEM;
+
+	for (i = 0; i < max_producers; i++) {
+		ret = cq_mt_init_producer(&producers[i], i);
+		if (ret)
+			goto out;
+	}
+
+	printf("%-10s %14s %12s %14s\n", "producers", "completions",
+	       "usec", "Mcomps/sec");
+	for (nprod = 1; ; nprod = MIN(nprod << 1, max_producers)) {
+		ret = cq_mt_run(nprod);
+		if (ret || nprod == max_producers)
+			break;
+	}
+
+out:
+	cq_mt_free_producers();
+	free(sink_buf);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	int op, ret;
+
+	opts = INIT_OPTS;
+	/* All endpoints are local, let the provider pick unique addresses */
+	opts.options |= FT_OPT_SKIP_MSG_ALLOC | FT_OPT_ADDR_IS_OOB;
+	opts.iterations = 100000;
+	opts.threading = FI_THREAD_SAFE;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt_long(argc, argv, "n:h" CS_OPTS INFO_OPTS
+				 BENCHMARK_OPTS, long_opts,
+				 &lopt_idx)) != -1) {
+		switch (op) {
+		default:
+			if (!ft_parse_long_opts(op, optarg))
+				continue;
+			ft_parse_benchmark_opts(op, optarg);
+			ft_parseinfo(op, optarg, hints, &opts);
+			ft_parsecsopts(op, optarg, &opts);
+			break;
+		case 'n':
+			max_producers = atoi(optarg);
+			break;
+		case '?':
+		case 'h':
+			ft_usage(argv[0], "Completion rate of a CQ shared by "
+				 "multiple producer endpoints.");
+			ft_benchmark_usage();
+			FT_PRINT_OPTS_USAGE("-n <producers>", "maximum number "
+					    "of producer endpoints (default 8)");
+			ft_longopts_usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (max_producers < 1) {
+		fprintf(stderr, "invalid producer count %d\n", max_producers);
+		return EXIT_FAILURE;
+	}
+
+	if (opts.options & FT_OPT_SIZE)
+		xfer_size = opts.transfer_size;
+	cq_mt_window = opts.window_size;
+
+	hints->ep_attr->type = FI_EP_RDM;
+	hints->caps = FI_RMA | FI_WRITE | FI_REMOTE_WRITE;
+	hints->mode |= FI_CONTEXT | FI_CONTEXT2;
+	hints->domain_attr->mr_mode = opts.mr_mode;
+	hints->addr_format = opts.address_format;
+
+	ret = run();
+
+	ft_free_res();
+	return ft_exit_code(ret);
+}
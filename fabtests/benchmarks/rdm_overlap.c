@@ -0,0 +1,249 @@
+/*
+ * Copyright (c) Intel Corporation.  All rights reserved.
+ *
+ * This software is available to you under the BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Measures how much of a message transfer can be hidden behind
+ * computation.  For each size, the client first times sends on their own,
+ * then starts each send, computes for the same amount of time while
+ * polling the CQ every few microseconds, as an application calling a test
+ * function would, and waits for the send to complete.  Overlap is the
+ * fraction of the shorter of the two phases that was hidden: 0% when the
+ * overlapped iteration takes as long as both phases back to back, and 100%
+ * when it takes only as long as the longer one.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+#include <rdma/fi_errno.h>
+
+#include "shared.h"
+#include "benchmark_shared.h"
+
+#define OVERLAP_MIN_SIZE	(64 * 1024)
+
+static uint64_t compute_usec;
+static uint64_t poll_usec = 10;
+static volatile double compute_sink;
+
+static int overlap_poll(void)
+{
+	struct fi_cq_err_entry comp;
+	int ret;
+
+	ret = fi_cq_read(txcq, &comp, 1);
+	if (ret == 1) {
+		tx_cq_cntr++;
+		return 0;
+	}
+	if (ret == -FI_EAVAIL)
+		return ft_cq_readerr(txcq);
+	return ret == -FI_EAGAIN ? 0 : ret;
+}
+
+static int compute(uint64_t usec, bool poll)
+{
+	uint64_t now, end, next_poll;
+	double x = 1.0;
+	int i, ret;
+
+	now = ft_gettime_us();
+	end = now + usec;
+	next_poll = now + poll_usec;
+	while (now < end) {
+		for (i = 0; i < 256; i++)
+			x = x * 1.000001 + 0.000001;
+
+		now = ft_gettime_us();
+		if (poll && now >= next_poll) {
+			ret = overlap_poll();
+			if (ret)
+				return ret;
+			next_poll = now + poll_usec;
+		}
+	}
+	compute_sink = x;
+	return 0;
+}
+
+/* Returns the average time per iteration in usec */
+static int overlap_phase(uint64_t usec, double *avg)
+{
+	uint64_t start;
+	int i, ret;
+
+	ret = ft_sync();
+	if (ret)
+		return ret;
+
+	start = ft_gettime_us();
+	for (i = 0; i < opts.iterations; i++) {
+		if (!opts.dst_addr) {
+			ret = ft_rx(ep, opts.transfer_size);
+			if (ret)
+				return ret;
+			continue;
+		}
+
+		ret = ft_post_tx(ep, remote_fi_addr, opts.transfer_size,
+				 NO_CQ_DATA, &tx_ctx);
+		if (ret)
+			return ret;
+
+		if (usec) {
+			ret = compute(usec, true);
+			if (ret)
+				return ret;
+		}
+
+		ret = ft_get_tx_comp(tx_seq);
+		if (ret)
+			return ret;
+	}
+	*avg = (double) (ft_gettime_us() - start) / opts.iterations;
+	return 0;
+}
+
+static int overlap_test(void)
+{
+	double comm, busy, both, overlap;
+	int ret;
+
+	ret = overlap_phase(0, &comm);
+	if (ret)
+		return ret;
+
+	/* Only the client computes, the server just receives */
+	busy = compute_usec ? compute_usec : (uint64_t) comm;
+	ret = overlap_phase(opts.dst_addr ? (uint64_t) busy : 0, &both);
+	if (ret || !opts.dst_addr)
+		return ret;
+
+	overlap = (comm + busy - both) / MIN(comm, busy) * 100.0;
+	if (overlap < 0)
+		overlap = 0;
+	printf("%-10zu %-8d %12.2f %12.2f %14.2f %10.1f\n",
+	       opts.transfer_size, opts.iterations, comm, busy, both,
+	       overlap);
+	return 0;
+}
+
+static int run(void)
+{
+	char test_name[50];
+	int i, ret;
+
+	ret = ft_init_fabric();
+	if (ret)
+		return ret;
+
+	if (opts.dst_addr)
+		printf("%-10s %-8s %12s %12s %14s %10s\n", "bytes", "iters",
+		       "comm(us)", "compute(us)", "overlapped(us)",
+		       "overlap(%)");
+
+	if (!(opts.options & FT_OPT_SIZE)) {
+		for (i = 0; i < TEST_CNT; i++) {
+			if (!ft_use_size(i, opts.sizes_enabled) ||
+			    test_size[i].size < OVERLAP_MIN_SIZE)
+				continue;
+			opts.transfer_size = test_size[i].size;
+			init_test(&opts, test_name, sizeof(test_name));
+			ret = overlap_test();
+			if (ret)
+				return ret;
+		}
+	} else {
+		init_test(&opts, test_name, sizeof(test_name));
+		ret = overlap_test();
+		if (ret)
+			return ret;
+	}
+
+	return ft_finalize();
+}
+
+int main(int argc, char **argv)
+{
+	int op, ret;
+
+	opts = INIT_OPTS;
+	opts.options |= FT_OPT_BW;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt_long(argc, argv, "T:x:h" CS_OPTS INFO_OPTS
+				 BENCHMARK_OPTS, long_opts,
+				 &lopt_idx)) != -1) {
+		switch (op) {
+		default:
+			if (!ft_parse_long_opts(op, optarg))
+				continue;
+			ft_parse_benchmark_opts(op, optarg);
+			ft_parseinfo(op, optarg, hints, &opts);
+			ft_parsecsopts(op, optarg, &opts);
+			break;
+		case 'T':
+			compute_usec = strtoull(optarg, NULL, 10);
+			break;
+		case 'x':
+			poll_usec = strtoull(optarg, NULL, 10);
+			break;
+		case '?':
+		case 'h':
+			ft_csusage(argv[0], "Communication and computation "
+				   "overlap test for RDM endpoints.");
+			ft_benchmark_usage();
+			FT_PRINT_OPTS_USAGE("-T <usec>", "compute time per "
+				"message (default: the time of a send)");
+			FT_PRINT_OPTS_USAGE("-x <usec>", "CQ poll interval "
+				"while computing (default 10)");
+			ft_longopts_usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind < argc)
+		opts.dst_addr = argv[optind];
+
+	hints->ep_attr->type = FI_EP_RDM;
+	hints->caps = FI_MSG;
+	hints->mode |= FI_CONTEXT | FI_CONTEXT2;
+	hints->domain_attr->mr_mode = opts.mr_mode;
+	hints->tx_attr->tclass = FI_TC_BULK_DATA;
+	hints->addr_format = opts.address_format;
+
+	ret = run();
+
+	ft_free_res();
+	return ft_exit_code(ret);
+}
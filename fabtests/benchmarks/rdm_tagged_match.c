@@ -0,0 +1,471 @@
+/*
+ * Copyright (c) Intel Corporation.  All rights reserved.
+ *
+ * This software is available to you under the BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Measures tag matching cost as a function of queue depth.  For each
+ * depth the server either pre-posts receives (expected test) or lets the
+ * client's messages queue as unexpected before posting receives
+ * (unexpected test).  Messages are matched in the reverse of posting
+ * order, which is the worst case for a linear queue search.
+ *
+ * With -n, the client sends from that many additional endpoints, each a
+ * separate peer of the server, in turn, and the server posts receives
+ * from any source.  Unexpected messages are then spread across peers.
+ * The peer addresses are inserted into the server's AV, so that a provider
+ * may queue more than one unexpected message from each peer.
+ *
+ * With -c, the server locates each unexpected message with FI_PEEK |
+ * FI_CLAIM and then receives it with FI_CLAIM.  Claims follow sending
+ * order, as a peek only finds messages the provider has already read.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include <rdma/fi_cm.h>
+#include <rdma/fi_errno.h>
+#include <rdma/fi_tagged.h>
+
+#include <shared.h>
+#include "benchmark_shared.h"
+
+#define MATCH_TAG_BASE		(1ULL << 60)
+#define MATCH_DEF_MAX_DEPTH	4096
+#define MATCH_SETTLE_MS		100
+
+static struct fi_context2 *match_ctx;
+static size_t match_size = 4;
+static int match_max_depth = MATCH_DEF_MAX_DEPTH;
+static int match_peers;
+static bool match_claim;
+
+static int match_read_cq(struct fid_cq *cq, int *cnt)
+{
+	struct fi_cq_err_entry comp;
+	int ret;
+
+	ret = fi_cq_read(cq, &comp, 1);
+	if (ret > 0) {
+		(*cnt)++;
+		return 0;
+	}
+	if (ret == -FI_EAVAIL)
+		return ft_cq_readerr(cq);
+	if (ret != -FI_EAGAIN) {
+		FT_PRINTERR("fi_cq_read", ret);
+		return ret;
+	}
+	return 0;
+}
+
+static int match_wait_cq(struct fid_cq *cq, int total)
+{
+	int ret, cnt = 0;
+
+	while (cnt < total) {
+		ret = match_read_cq(cq, &cnt);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+static int match_post_recvs(int depth, bool reverse, int *cnt)
+{
+	uint64_t tag;
+	int i, ret;
+
+	for (i = 0; i < depth; i++) {
+		tag = MATCH_TAG_BASE + (reverse ? depth - 1 - i : i);
+		do {
+			ret = fi_trecv(ep, rx_buf,
+				       match_size + ft_rx_prefix_size(),
+				       mr_desc, match_peers ? FI_ADDR_UNSPEC :
+				       remote_fi_addr, tag, 0, &match_ctx[i]);
+			if (ret == -FI_EAGAIN) {
+				ret = match_read_cq(rxcq, cnt);
+				if (!ret)
+					ret = -FI_EAGAIN;
+			}
+		} while (ret == -FI_EAGAIN);
+		if (ret) {
+			FT_PRINTERR("fi_trecv", ret);
+			return ret;
+		}
+	}
+	return 0;
+}
+
+/* Peeks until the message has arrived, then receives it by claim. */
+static int match_claim_recv(int i, uint64_t tag)
+{
+	struct fi_cq_err_entry comp;
+	struct fi_msg_tagged msg;
+	struct iovec iov;
+	void *desc = mr_desc;
+	int ret;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.addr = match_peers ? FI_ADDR_UNSPEC : remote_fi_addr;
+	msg.tag = tag;
+	msg.context = &match_ctx[i];
+
+	do {
+		ret = fi_trecvmsg(ep, &msg, FI_PEEK | FI_CLAIM);
+		if (ret) {
+			FT_PRINTERR("fi_trecvmsg", ret);
+			return ret;
+		}
+
+		do {
+			ret = fi_cq_read(rxcq, &comp, 1);
+		} while (ret == -FI_EAGAIN);
+		if (ret == -FI_EAVAIL) {
+			memset(&comp, 0, sizeof(comp));
+			ret = fi_cq_readerr(rxcq, &comp, 0);
+			if (ret < 0) {
+				FT_PRINTERR("fi_cq_readerr", ret);
+				return ret;
+			}
+			if (comp.err != FI_ENOMSG) {
+				FT_CQ_ERR(rxcq, comp, NULL, 0);
+				return -comp.err;
+			}
+			ret = -FI_ENOMSG;
+		} else if (ret < 0) {
+			FT_PRINTERR("fi_cq_read", ret);
+			return ret;
+		}
+	} while (ret == -FI_ENOMSG);
+
+	iov.iov_base = rx_buf;
+	iov.iov_len = match_size + ft_rx_prefix_size();
+	msg.msg_iov = &iov;
+	msg.desc = &desc;
+	msg.iov_count = 1;
+	ret = fi_trecvmsg(ep, &msg, FI_CLAIM);
+	if (ret) {
+		FT_PRINTERR("fi_trecvmsg", ret);
+		return ret;
+	}
+	return match_wait_cq(rxcq, 1);
+}
+
+static int match_claim_recvs(int depth)
+{
+	int i, ret;
+
+	for (i = 0; i < depth; i++) {
+		ret = match_claim_recv(i, MATCH_TAG_BASE + i);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+static int match_send(int depth, bool reverse)
+{
+	uint64_t tag;
+	int i, cnt = 0, ret;
+
+	for (i = 0; i < depth; i++) {
+		tag = MATCH_TAG_BASE + (reverse ? depth - 1 - i : i);
+		do {
+			ret = fi_tsend(match_peers ?
+				       peer_eps[i % match_peers] : ep, tx_buf,
+				       match_size + ft_tx_prefix_size(),
+				       mr_desc, remote_fi_addr, tag,
+				       &match_ctx[i]);
+			if (ret == -FI_EAGAIN) {
+				ret = match_read_cq(txcq, &cnt);
+				if (!ret)
+					ret = -FI_EAGAIN;
+			}
+		} while (ret == -FI_EAGAIN);
+		if (ret) {
+			FT_PRINTERR("fi_tsend", ret);
+			return ret;
+		}
+	}
+	return match_wait_cq(txcq, depth - cnt);
+}
+
+/* Drive progress without reaping completions owned by ft_sync(). */
+static int match_settle(void)
+{
+	uint64_t end;
+	int ret;
+
+	end = ft_gettime_ms() + MATCH_SETTLE_MS;
+	do {
+		ret = ft_progress_cqs();
+		if (ret) {
+			FT_PRINTERR("fi_cq_read", ret);
+			return ret;
+		}
+	} while (ft_gettime_ms() < end);
+	return 0;
+}
+
+/* The client sends the peer addresses out of band. */
+static int match_exchange_peers(void)
+{
+	char buf[FT_MAX_CTRL_MSG];
+	size_t addrlen;
+	int i, ret;
+
+	for (i = 0; i < match_peers; i++) {
+		if (opts.dst_addr) {
+			addrlen = sizeof(buf);
+			ret = fi_getname(&peer_eps[i]->fid, buf, &addrlen);
+			if (ret) {
+				FT_PRINTERR("fi_getname", ret);
+				return ret;
+			}
+
+			ret = ft_sock_send(oob_sock, buf, sizeof(buf));
+		} else {
+			ret = ft_sock_recv(oob_sock, buf, sizeof(buf));
+			if (!ret)
+				ret = ft_av_insert(av, buf, 1, NULL, 0, NULL);
+		}
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+/* The server pre-posts all receives before the client starts sending. */
+static int match_expected(int depth, uint64_t *nsec)
+{
+	uint64_t begin;
+	int ret, cnt = 0;
+
+	if (opts.dst_addr) {
+		ret = ft_sync();
+		if (ret)
+			return ret;
+		return match_send(depth, true);
+	}
+
+	ret = match_post_recvs(depth, false, &cnt);
+	if (ret)
+		return ret;
+
+	ret = ft_sync();
+	if (ret)
+		return ret;
+
+	/* Start timing at the first arrival to exclude the sender's wakeup */
+	if (!cnt) {
+		ret = match_wait_cq(rxcq, 1);
+		if (ret)
+			return ret;
+		cnt++;
+	}
+
+	begin = ft_gettime_ns();
+	ret = match_wait_cq(rxcq, depth - cnt);
+	*nsec = ft_gettime_ns() - begin;
+	return ret;
+}
+
+/* All messages are queued as unexpected before the server posts receives. */
+static int match_unexpected(int depth, uint64_t *nsec)
+{
+	uint64_t begin;
+	int ret, cnt = 0;
+
+	if (opts.dst_addr) {
+		ret = match_send(depth, false);
+		if (ret)
+			return ret;
+		return ft_sync();
+	}
+
+	ret = ft_sync();
+	if (ret)
+		return ret;
+
+	/* Messages from other peers may still be in flight */
+	if (match_peers) {
+		ret = match_settle();
+		if (ret)
+			return ret;
+	}
+
+	begin = ft_gettime_ns();
+	if (match_claim) {
+		ret = match_claim_recvs(depth);
+	} else {
+		ret = match_post_recvs(depth, true, &cnt);
+		if (!ret)
+			ret = match_wait_cq(rxcq, depth - cnt);
+	}
+	*nsec = ft_gettime_ns() - begin;
+	return ret;
+}
+
+static int run(void)
+{
+	uint64_t exp_nsec = 0, unexp_nsec = 0;
+	int depth, max_depth, ret;
+
+	ret = ft_init_fabric();
+	if (ret)
+		return ret;
+
+	max_depth = MIN(match_max_depth, (int) fi->rx_attr->size);
+	match_ctx = calloc(max_depth, sizeof(*match_ctx));
+	if (!match_ctx)
+		return -FI_ENOMEM;
+
+	if (match_peers) {
+		ret = opts.dst_addr ?
+		      ft_open_peer_eps(match_peers, NULL, false) : 0;
+		if (!ret)
+			ret = match_exchange_peers();
+		if (ret)
+			goto out;
+	}
+
+	if (!opts.dst_addr) {
+		if (match_peers)
+			printf("%d peers\n", match_peers);
+		printf("%-10s %14s %14s\n", "depth", "expected(ns)",
+		       match_claim ? "claimed(ns)" : "unexpected(ns)");
+	}
+
+	for (depth = 1; depth <= max_depth; depth <<= 1) {
+		ret = match_expected(depth, &exp_nsec);
+		if (ret)
+			goto out;
+
+		ret = ft_sync();
+		if (ret)
+			goto out;
+
+		ret = match_unexpected(depth, &unexp_nsec);
+		if (ret)
+			goto out;
+
+		ret = ft_sync();
+		if (ret)
+			goto out;
+
+		if (!opts.dst_addr)
+			printf("%-10d %14.1f %14.1f\n", depth,
+			       (double) exp_nsec / MAX(depth - 1, 1),
+			       (double) unexp_nsec / depth);
+	}
+
+	ft_finalize();
+out:
+	ft_close_peer_eps();
+	free(match_ctx);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	int op, ret;
+
+	opts = INIT_OPTS;
+	opts.options |= FT_OPT_DISABLE_TAG_VALIDATION;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt_long(argc, argv, "q:n:ch" CS_OPTS INFO_OPTS BENCHMARK_OPTS,
+				 long_opts, &lopt_idx)) != -1) {
+		switch (op) {
+		default:
+			if (!ft_parse_long_opts(op, optarg))
+				continue;
+			ft_parse_benchmark_opts(op, optarg);
+			ft_parseinfo(op, optarg, hints, &opts);
+			ft_parsecsopts(op, optarg, &opts);
+			break;
+		case 'q':
+			match_max_depth = atoi(optarg);
+			break;
+		case 'n':
+			match_peers = atoi(optarg);
+			break;
+		case 'c':
+			match_claim = true;
+			break;
+		case '?':
+		case 'h':
+			ft_csusage(argv[0], "Tag matching cost versus posted "
+				   "and unexpected queue depth for RDM "
+				   "endpoints.");
+			ft_benchmark_usage();
+			FT_PRINT_OPTS_USAGE("-q <depth>", "maximum queue depth "
+					    "(default 4096)");
+			FT_PRINT_OPTS_USAGE("-n <peers>", "send from this many "
+					    "client endpoints (default 0)");
+			FT_PRINT_OPTS_USAGE("-c", "peek and claim unexpected "
+					    "messages before receiving them");
+			ft_longopts_usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (match_peers < 0) {
+		FT_ERR("invalid option value");
+		return EXIT_FAILURE;
+	}
+
+	if (optind < argc)
+		opts.dst_addr = argv[optind];
+
+	/* A provider may stop reading from a peer with many unexpected
+	 * messages queued, which would stall an in-band sync behind them.
+	 */
+	opts.options |= FT_OPT_OOB_CTRL;
+
+	if (opts.options & FT_OPT_SIZE)
+		match_size = opts.transfer_size;
+
+	hints->ep_attr->type = FI_EP_RDM;
+	hints->domain_attr->resource_mgmt = FI_RM_ENABLED;
+	hints->caps = FI_TAGGED;
+	hints->mode |= FI_CONTEXT | FI_CONTEXT2;
+	hints->domain_attr->mr_mode = opts.mr_mode;
+	hints->addr_format = opts.address_format;
+
+	ret = run();
+
+	ft_free_res();
+	return ft_exit_code(ret);
+}
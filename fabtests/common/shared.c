@@ -72,6 +72,13 @@ struct fid_av *av = NULL;
 struct fid_eq *eq;
 struct fid_mc *mc;
 
+struct fid_ep **peer_eps;
+fi_addr_t *peer_fi_addrs;
+int peer_cnt;
+void *peer_msgs, *peer_desc;
+struct fi_context2 *peer_ctx;
+struct fid_mr *peer_mr;
+
 struct fid_mr no_mr;
 struct fi_context2 tx_ctx, rx_ctx;
 struct ft_context *tx_ctx_arr = NULL, *rx_ctx_arr = NULL;
@@ -1505,6 +1512,123 @@ int ft_enable_ep(struct fid_ep *bind_ep, struct fid_eq *bind_eq, struct fid_av *
 	return 0;
 }
 
+/*
+ * Open count endpoints that share the domain, AV and CQs of the main
+ * endpoint.  Each one has its own address, so it is a separate peer of
+ * the others.  If bind_eq is set, it is bound to every endpoint.  If
+ * insert is set, the endpoint addresses are inserted into the AV and
+ * returned in peer_fi_addrs.
+ */
+int ft_open_peer_eps(int count, struct fid_eq *bind_eq, bool insert)
+{
+	struct fi_info *info;
+	char addr[FT_MAX_CTRL_MSG];
+	size_t addrlen;
+	int i, ret;
+
+	peer_eps = calloc(count, sizeof(*peer_eps));
+	peer_fi_addrs = calloc(count, sizeof(*peer_fi_addrs));
+	if (!peer_eps || !peer_fi_addrs)
+		return -FI_ENOMEM;
+	peer_cnt = count;
+
+	free(hints->src_addr);
+	hints->src_addr = NULL;
+	hints->src_addrlen = 0;
+
+	ret = fi_getinfo(FT_FIVERSION, opts.src_addr, NULL,
+			 opts.src_addr ? FI_SOURCE : 0, hints, &info);
+	if (ret) {
+		FT_PRINTERR("fi_getinfo", ret);
+		return ret;
+	}
+
+	for (i = 0; i < count; i++) {
+		ret = fi_endpoint(domain, info, &peer_eps[i], NULL);
+		if (ret) {
+			FT_PRINTERR("fi_endpoint", ret);
+			break;
+		}
+
+		if (bind_eq) {
+			ret = fi_ep_bind(peer_eps[i], &bind_eq->fid, 0);
+			if (ret) {
+				FT_PRINTERR("fi_ep_bind", ret);
+				break;
+			}
+		}
+
+		ret = ft_enable_ep(peer_eps[i], eq, av, txcq, rxcq,
+				   NULL, NULL, NULL);
+		if (ret)
+			break;
+
+		if (!insert)
+			continue;
+
+		addrlen = sizeof(addr);
+		ret = fi_getname(&peer_eps[i]->fid, addr, &addrlen);
+		if (ret) {
+			FT_PRINTERR("fi_getname", ret);
+			break;
+		}
+
+		ret = ft_av_insert(av, addr, 1, &peer_fi_addrs[i], 0, NULL);
+		if (ret)
+			break;
+	}
+
+	fi_freeinfo(info);
+	return ret;
+}
+
+/* Allocate count messages of size bytes, and a context for each, that
+ * all peer endpoints can send from and receive into.
+ */
+int ft_alloc_peer_msgs(size_t count, size_t size)
+{
+	peer_msgs = calloc(count, size);
+	peer_ctx = calloc(count, sizeof(*peer_ctx));
+	if (!peer_msgs || !peer_ctx)
+		return -FI_ENOMEM;
+
+	return ft_reg_mr(fi, peer_msgs, count * size, FI_SEND | FI_RECV,
+			 FT_PEER_MR_KEY, FI_HMEM_SYSTEM, 0, &peer_mr,
+			 &peer_desc);
+}
+
+void ft_close_peer_eps(void)
+{
+	int i;
+
+	for (i = 0; peer_eps && i < peer_cnt; i++)
+		FT_CLOSE_FID(peer_eps[i]);
+	FT_CLOSE_FID(peer_mr);
+	free(peer_eps);
+	free(peer_fi_addrs);
+	free(peer_msgs);
+	free(peer_ctx);
+	peer_eps = NULL;
+	peer_fi_addrs = NULL;
+	peer_msgs = NULL;
+	peer_ctx = NULL;
+	peer_cnt = 0;
+}
+
+/* Progress the shared CQs without reaping any completion */
+int ft_progress_cqs(void)
+{
+	int ret;
+
+	ret = fi_cq_read(txcq, NULL, 0);
+	if (ret && ret != -FI_EAGAIN)
+		return ret;
+	ret = fi_cq_read(rxcq, NULL, 0);
+	if (ret && ret != -FI_EAGAIN)
+		return ret;
+	return 0;
+}
+
 int ft_enable_ep_recv(void)
 {
 	int ret;
@@ -1865,6 +1989,7 @@ static void ft_cleanup_mr_array(struct ft_context *ctx_arr, char **mr_bufs)
 
 void ft_close_fids(void)
 {
+	ft_close_peer_eps();
 	FT_CLOSE_FID(mc);
 	FT_CLOSE_FID(alias_ep);
 	if (fi && fi->domain_attr->mr_mode & FI_MR_ENDPOINT) {
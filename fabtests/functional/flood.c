@@ -248,7 +248,7 @@ int main(int argc, char **argv)
 
 	hints->ep_attr->type = FI_EP_RDM;
 
-	while ((op = getopt(argc, argv, "UW:vT:h" CS_OPTS ADDR_OPTS INFO_OPTS)) != -1) {
+	while ((op = getopt(argc, argv, "UW:vT:Q:h" CS_OPTS ADDR_OPTS INFO_OPTS)) != -1) {
 		switch (op) {
 		default:
 			ft_parse_addr_opts(op, optarg, &opts);
@@ -267,6 +267,10 @@ int main(int argc, char **argv)
 		case 'T':
 			sleep_time = atoi(optarg);
 			break;
+		case 'Q':
+			opts.tx_cq_size = atoi(optarg);
+			opts.rx_cq_size = opts.tx_cq_size;
+			break;
 		case '?':
 		case 'h':
 			ft_usage(argv[0], "test to oversubscribe mr cache and receiver with unexpected msgs.");
@@ -275,6 +279,8 @@ int main(int argc, char **argv)
 			FT_PRINT_OPTS_USAGE("-v", "Enable data verification");
 			FT_PRINT_OPTS_USAGE("-W window_size",
 				"Set transmit window size before waiting for completion");
+			FT_PRINT_OPTS_USAGE("-Q cq_size",
+				"Set CQ size, below window_size to overrun the CQs");
 			return EXIT_FAILURE;
 		}
 	}
@@ -0,0 +1,311 @@
+/*
+ * Copyright (c) Intel Corporation.  All rights reserved.
+ *
+ * This software is available to you under the BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Connection storm test
+ *
+ * The client opens a number of additional RDM endpoints, each of which
+ * appears to the server as a separate peer.  In each round, the peers
+ * start sending to the server in steps of a few peers at a time, then
+ * all peers go idle for a while.  Every message carries the sending
+ * peer and a sequence number, which the server checks, so messages that
+ * are lost or reordered when a provider closes and reopens idle
+ * connections are detected.  Both sides report their resident memory
+ * after each step, to show the cost of each connection.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include <rdma/fi_cm.h>
+#include "shared.h"
+
+struct storm_msg {
+	uint32_t id;
+	uint32_t seq;
+};
+
+static int num_peers = 128;
+static int ramp_step = 16;
+static int msgs_per_peer = 4;
+static int idle_ms = 0;
+
+static struct storm_msg *msgs;
+static uint32_t *peer_seq;
+static size_t base_rss;
+
+static size_t get_rss(void)
+{
+	struct rusage usage;
+	unsigned long size, resident;
+	FILE *file;
+	int ret;
+
+	file = fopen("/proc/self/statm", "r");
+	if (file) {
+		ret = fscanf(file, "%lu %lu", &size, &resident);
+		fclose(file);
+		if (ret == 2)
+			return resident * sysconf(_SC_PAGESIZE);
+	}
+
+	if (getrusage(RUSAGE_SELF, &usage))
+		return 0;
+	return (size_t) usage.ru_maxrss * 1024;
+}
+
+static void report_mem(const char *phase, int round, int peers)
+{
+	size_t rss = get_rss();
+	ssize_t delta = (ssize_t) rss - (ssize_t) base_rss;
+
+	printf("%-6s round %d peers %5d: rss %8zu KB, %+8zd KB total, "
+	       "%+8zd bytes/peer\n", phase, round, peers, rss / 1024,
+	       delta / 1024, peers ? delta / peers : 0);
+}
+
+static int drive_progress(int ms)
+{
+	uint64_t end;
+	int ret;
+
+	end = ft_gettime_ms() + ms;
+	do {
+		ret = ft_progress_cqs();
+		if (ret)
+			return ret;
+		usleep(1000);
+	} while (ft_gettime_ms() < end);
+	return 0;
+}
+
+static int open_peers(void)
+{
+	int ret;
+
+	ret = ft_alloc_peer_msgs((size_t) num_peers * msgs_per_peer,
+				 sizeof(*msgs));
+	if (ret)
+		return ret;
+	msgs = peer_msgs;
+
+	return ft_open_peer_eps(num_peers, NULL, false);
+}
+
+static int send_step(int first, int last)
+{
+	struct storm_msg *msg;
+	int i, j, ret;
+
+	for (i = first; i < last; i++) {
+		for (j = 0; j < msgs_per_peer; j++) {
+			msg = &msgs[i * msgs_per_peer + j];
+			msg->id = i;
+			msg->seq = peer_seq[i]++;
+			while ((ret = fi_send(peer_eps[i], msg, sizeof(*msg),
+					      peer_desc, remote_fi_addr,
+					      &peer_ctx[i * msgs_per_peer + j]))
+			       == -FI_EAGAIN) {
+				ret = ft_progress(txcq, tx_seq, &tx_cq_cntr);
+				if (ret && ret != -FI_EAGAIN)
+					return ret;
+			}
+			if (ret) {
+				FT_PRINTERR("fi_send", ret);
+				return ret;
+			}
+			tx_seq++;
+		}
+	}
+
+	return ft_get_tx_comp(tx_seq);
+}
+
+static int recv_step(int first, int last)
+{
+	struct storm_msg *msg;
+	int i, ret;
+
+	msg = (struct storm_msg *) (rx_buf + ft_rx_prefix_size());
+	for (i = 0; i < (last - first) * msgs_per_peer; i++) {
+		ret = ft_get_rx_comp(rx_seq);
+		if (ret)
+			return ret;
+
+		if (msg->id >= (uint32_t) num_peers ||
+		    msg->seq != peer_seq[msg->id]) {
+			FT_ERR("peer %u sent seq %u, expected %u", msg->id,
+			       msg->seq, msg->id < (uint32_t) num_peers ?
+			       peer_seq[msg->id] : 0);
+			return -FI_EIO;
+		}
+		peer_seq[msg->id]++;
+
+		ret = ft_post_rx(ep, rx_size, &rx_ctx);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+static int run_round(int round)
+{
+	int first, last, ret;
+
+	for (first = 0; first < num_peers; first = last) {
+		last = MIN(first + ramp_step, num_peers);
+		ret = opts.dst_addr ? send_step(first, last) :
+				      recv_step(first, last);
+		if (ret)
+			return ret;
+
+		ret = ft_sync();
+		if (ret)
+			return ret;
+
+		report_mem("active", round, last);
+	}
+
+	if (idle_ms) {
+		ret = drive_progress(idle_ms);
+		if (ret)
+			return ret;
+
+		report_mem("idle", round, num_peers);
+	}
+
+	return ft_sync();
+}
+
+static int run(void)
+{
+	int i, ret;
+
+	ret = ft_init_fabric();
+	if (ret)
+		return ret;
+
+	peer_seq = calloc(num_peers, sizeof(*peer_seq));
+	if (!peer_seq)
+		return -FI_ENOMEM;
+
+	base_rss = get_rss();
+	if (opts.dst_addr) {
+		ret = open_peers();
+		if (ret)
+			goto out;
+	}
+
+	ret = ft_sync();
+	if (ret)
+		goto out;
+
+	for (i = 0; i < opts.iterations; i++) {
+		ret = run_round(i);
+		if (ret)
+			goto out;
+	}
+
+	printf("%d peers, %d rounds completed\n", num_peers, opts.iterations);
+out:
+	ft_close_peer_eps();
+	free(peer_seq);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	int op, ret;
+
+	opts = INIT_OPTS;
+	opts.iterations = 2;
+	opts.transfer_size = sizeof(struct storm_msg);
+	opts.options |= FT_OPT_SIZE | FT_OPT_OOB_CTRL;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt(argc, argv, "n:r:k:W:h" CS_OPTS INFO_OPTS)) != -1) {
+		switch (op) {
+		default:
+			ft_parsecsopts(op, optarg, &opts);
+			ft_parse_addr_opts(op, optarg, &opts);
+			ft_parseinfo(op, optarg, hints, &opts);
+			break;
+		case 'n':
+			num_peers = atoi(optarg);
+			break;
+		case 'r':
+			ramp_step = atoi(optarg);
+			break;
+		case 'k':
+			msgs_per_peer = atoi(optarg);
+			break;
+		case 'W':
+			idle_ms = atoi(optarg);
+			break;
+		case '?':
+		case 'h':
+			ft_csusage(argv[0], "RDM connection storm test.");
+			FT_PRINT_OPTS_USAGE("-n <peers>",
+				"number of client endpoints (default 128)");
+			FT_PRINT_OPTS_USAGE("-r <step>",
+				"peers added per step (default 16)");
+			FT_PRINT_OPTS_USAGE("-k <count>",
+				"messages per peer per round (default 4)");
+			FT_PRINT_OPTS_USAGE("-W <ms>",
+				"idle time after each round (default 0)");
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (num_peers <= 0 || ramp_step <= 0 || msgs_per_peer <= 0 ||
+	    idle_ms < 0) {
+		FT_ERR("invalid option value");
+		return EXIT_FAILURE;
+	}
+
+	if (optind < argc)
+		opts.dst_addr = argv[optind];
+
+	hints->ep_attr->type = FI_EP_RDM;
+	hints->caps = FI_MSG;
+	hints->mode = FI_CONTEXT | FI_CONTEXT2;
+	hints->domain_attr->mr_mode = opts.mr_mode;
+	hints->addr_format = opts.address_format;
+
+	ret = run();
+
+	ft_free_res();
+	return ft_exit_code(ret);
+}
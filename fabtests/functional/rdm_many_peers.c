@@ -0,0 +1,297 @@
+/*
+ * Copyright (c) Intel Corporation.  All rights reserved.
+ *
+ * This software is available to you under the BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Peer scaling stress test
+ *
+ * Opens a large number of RDM endpoints in one process, all sharing one
+ * AV, and checks that a single endpoint can talk to all of them.  Every
+ * endpoint sends its index to endpoint 0 (fan-in), then endpoint 0 sends
+ * each endpoint its index back (fan-out), for a number of rounds.  This
+ * exercises providers whose peer tables used to be limited to a fixed
+ * number of peers, such as shm.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+#include <rdma/fi_cm.h>
+#include "shared.h"
+
+static int num_peers = 512;
+static bool peers_set;
+static int num_rounds = 2;
+
+static uint32_t *rx_msgs;
+static uint32_t *tx_msgs;
+static uint8_t *seen;
+
+static int open_peers(void)
+{
+	int ret;
+
+	seen = calloc(num_peers, sizeof(*seen));
+	if (!seen)
+		return -FI_ENOMEM;
+
+	ret = ft_alloc_peer_msgs(num_peers * 2, sizeof(*rx_msgs));
+	if (ret)
+		return ret;
+	rx_msgs = peer_msgs;
+	tx_msgs = &rx_msgs[num_peers];
+
+	return ft_open_peer_eps(num_peers, NULL, true);
+}
+
+static int post_recv(int ep, int k)
+{
+	int ret;
+
+	rx_msgs[k] = UINT32_MAX;
+	ret = fi_recv(peer_eps[ep], &rx_msgs[k], sizeof(*rx_msgs), peer_desc,
+		      FI_ADDR_UNSPEC, &peer_ctx[k]);
+	if (ret)
+		FT_PRINTERR("fi_recv", ret);
+	return ret;
+}
+
+static int send_msg(int src, int dst, uint32_t value)
+{
+	int ret;
+
+	tx_msgs[dst] = value;
+	do {
+		ret = fi_inject(peer_eps[src], &tx_msgs[dst], sizeof(*tx_msgs),
+				peer_fi_addrs[dst]);
+		if (ret == -FI_EAGAIN)
+			(void) ft_progress_cqs();
+	} while (ret == -FI_EAGAIN);
+
+	if (ret)
+		FT_PRINTERR("fi_inject", ret);
+	return ret;
+}
+
+/* Wait for num_peers - 1 receives, returning the index of each in seen */
+static int wait_recvs(void)
+{
+	struct fi_cq_entry comp;
+	int rx_cnt, k, ret;
+
+	memset(seen, 0, num_peers * sizeof(*seen));
+	for (rx_cnt = 0; rx_cnt < num_peers - 1; ) {
+		ret = fi_cq_read(rxcq, &comp, 1);
+		if (ret == 1) {
+			k = (int) ((struct fi_context2 *) comp.op_context -
+				   peer_ctx);
+			if (rx_msgs[k] >= (uint32_t) num_peers ||
+			    seen[rx_msgs[k]]) {
+				FT_ERR("unexpected message %u", rx_msgs[k]);
+				return -FI_EOTHER;
+			}
+			seen[rx_msgs[k]] = 1;
+			rx_cnt++;
+		} else if (ret == -FI_EAVAIL) {
+			return ft_cq_readerr(rxcq);
+		} else if (ret != -FI_EAGAIN) {
+			FT_PRINTERR("fi_cq_read", ret);
+			return ret;
+		} else {
+			ret = fi_cq_read(txcq, NULL, 0);
+			if (ret && ret != -FI_EAGAIN)
+				return ret;
+		}
+	}
+
+	return 0;
+}
+
+static int fan_in(void)
+{
+	int i, ret;
+
+	for (i = 1; i < num_peers; i++) {
+		ret = post_recv(0, i);
+		if (ret)
+			return ret;
+	}
+
+	for (i = 1; i < num_peers; i++) {
+		ret = send_msg(i, 0, i);
+		if (ret)
+			return ret;
+	}
+
+	return wait_recvs();
+}
+
+static int fan_out(void)
+{
+	int i, ret;
+
+	for (i = 1; i < num_peers; i++) {
+		ret = post_recv(i, i);
+		if (ret)
+			return ret;
+	}
+
+	for (i = 1; i < num_peers; i++) {
+		ret = send_msg(0, i, i);
+		if (ret)
+			return ret;
+	}
+
+	ret = wait_recvs();
+	if (ret)
+		return ret;
+
+	/* Each endpoint must have received its own index */
+	for (i = 1; i < num_peers; i++) {
+		if (rx_msgs[i] != (uint32_t) i) {
+			FT_ERR("ep %d received %u", i, rx_msgs[i]);
+			return -FI_EOTHER;
+		}
+	}
+	return 0;
+}
+
+static int run(void)
+{
+	uint64_t start, opened, end;
+	int i, ret;
+
+	ret = ft_getinfo(hints, &fi);
+	if (ret)
+		return ret;
+
+	/* Unless asked for a given count, stay within the provider limit */
+	if (!peers_set && fi->domain_attr->ep_cnt &&
+	    fi->domain_attr->ep_cnt < (size_t) num_peers) {
+		num_peers = (int) fi->domain_attr->ep_cnt;
+		opts.av_size = num_peers;
+	}
+
+	ret = ft_open_fabric_res();
+	if (ret)
+		return ret;
+
+	ret = ft_alloc_ep_res(fi, &txcq, &rxcq, &txcntr, &rxcntr, &rma_cntr,
+			      &av);
+	if (ret)
+		return ret;
+
+	start = ft_gettime_us();
+	ret = open_peers();
+	if (ret)
+		goto out;
+	opened = ft_gettime_us();
+
+	for (i = 0; i < num_rounds; i++) {
+		ret = fan_in();
+		if (ret)
+			goto out;
+
+		ret = fan_out();
+		if (ret)
+			goto out;
+	}
+	end = ft_gettime_us();
+
+	printf("%d peers: open %.3f ms, %d rounds %.3f ms\n", num_peers,
+	       (opened - start) / 1000.0, num_rounds,
+	       (end - opened) / 1000.0);
+out:
+	ft_close_peer_eps();
+	free(seen);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	int op, ret;
+
+	opts = INIT_OPTS;
+	opts.options |= FT_OPT_SKIP_MSG_ALLOC;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt(argc, argv, "n:r:h" ADDR_OPTS INFO_OPTS)) != -1) {
+		switch (op) {
+		default:
+			ft_parse_addr_opts(op, optarg, &opts);
+			ft_parseinfo(op, optarg, hints, &opts);
+			break;
+		case 'n':
+			num_peers = atoi(optarg);
+			peers_set = true;
+			break;
+		case 'r':
+			num_rounds = atoi(optarg);
+			break;
+		case '?':
+		case 'h':
+			ft_usage(argv[0], "RDM peer scaling stress test.");
+			FT_PRINT_OPTS_USAGE("-n <peers>",
+				"number of endpoints (default 512, or the "
+				"provider endpoint limit if lower)");
+			FT_PRINT_OPTS_USAGE("-r <rounds>",
+				"number of fan-in/fan-out rounds (default 2)");
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (num_peers < 2 || num_rounds < 1) {
+		FT_ERR("invalid option value");
+		return EXIT_FAILURE;
+	}
+
+	/* Each endpoint needs its own address.  Without a source address,
+	 * let the provider pick one per endpoint.
+	 */
+	if (!opts.src_addr)
+		opts.options |= FT_OPT_ADDR_IS_OOB;
+	else if (!opts.src_port)
+		opts.src_port = "0";
+
+	opts.av_size = num_peers;
+
+	hints->ep_attr->type = FI_EP_RDM;
+	hints->caps = FI_MSG;
+	hints->mode = FI_CONTEXT | FI_CONTEXT2;
+	hints->domain_attr->mr_mode = opts.mr_mode;
+	hints->addr_format = opts.address_format;
+
+	ret = run();
+
+	ft_free_res();
+	return ft_exit_code(ret);
+}
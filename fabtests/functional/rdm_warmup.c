@@ -0,0 +1,309 @@
+/*
+ * Copyright (c) Intel Corporation.  All rights reserved.
+ *
+ * This software is available to you under the BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Connection warm-up test
+ *
+ * Opens a number of RDM endpoints in one process, each of which is a
+ * separate peer, and measures the time until every endpoint is connected
+ * to every other one.  By default, each endpoint asks the provider to
+ * connect to all of its peers with FI_CONNECT_PEERS, and the time until
+ * all FI_CONNECTED events are reported is measured, followed by a first
+ * all-to-all message exchange.  With -l, connections are made lazily by
+ * the exchange itself, as an application without warm-up would see it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <unistd.h>
+
+#include <rdma/fi_cm.h>
+#include "shared.h"
+
+static int num_peers = 16;
+static int max_pending = 0;
+static int warmup_timeout = 10000;
+static bool lazy = false;
+
+static uint32_t *rx_msgs;
+static uint32_t *tx_msgs;
+
+static int open_peers(void)
+{
+	size_t msg_cnt;
+	int ret;
+
+	msg_cnt = (size_t) num_peers * num_peers;
+	ret = ft_alloc_peer_msgs(msg_cnt * 2, sizeof(*rx_msgs));
+	if (ret)
+		return ret;
+	rx_msgs = peer_msgs;
+	tx_msgs = &rx_msgs[msg_cnt];
+
+	/* Warm-up events are reported to the EQ bound to the ep */
+	return ft_open_peer_eps(num_peers, eq, true);
+}
+
+static int warmup(void)
+{
+	struct fi_connect_peers attr;
+	struct fi_eq_err_entry err_entry;
+	struct fi_eq_entry entry;
+	uint32_t event;
+	int i, done, ret;
+
+	for (i = 0; i < num_peers; i++) {
+		/* Each ep connects to the peers that follow it in the
+		 * address array, so every pair is connected once.
+		 */
+		attr.addr = &peer_fi_addrs[i + 1];
+		attr.count = num_peers - i - 1;
+		attr.max_pending = max_pending;
+		attr.timeout = warmup_timeout;
+		attr.context = &peer_eps[i];
+		ret = fi_control(&peer_eps[i]->fid, FI_CONNECT_PEERS, &attr);
+		if (ret) {
+			FT_PRINTERR("fi_control(FI_CONNECT_PEERS)", ret);
+			return ret;
+		}
+	}
+
+	for (done = 0; done < num_peers; ) {
+		ret = fi_eq_read(eq, &event, &entry, sizeof(entry), 0);
+		if (ret == -FI_EAGAIN) {
+			ret = ft_progress_cqs();
+			if (ret)
+				return ret;
+			continue;
+		}
+
+		if (ret == -FI_EAVAIL) {
+			ret = fi_eq_readerr(eq, &err_entry, 0);
+			if (ret < 0)
+				return ret;
+			FT_ERR("unable to connect to peer %" PRIu64 ": %s",
+			       err_entry.data, fi_strerror(err_entry.err));
+			continue;
+		}
+
+		if (ret < 0) {
+			FT_PRINTERR("fi_eq_read", ret);
+			return ret;
+		}
+
+		if (event != FI_CONNECTED) {
+			FT_ERR("unexpected event %s",
+			       fi_tostr(&event, FI_TYPE_EQ_EVENT));
+			return -FI_EOTHER;
+		}
+
+		i = (int) ((struct fid_ep **) entry.context - peer_eps);
+		if (entry.data != (uint64_t) (num_peers - i - 1)) {
+			FT_ERR("ep %d connected to %" PRIu64 " of %d peers", i,
+			       entry.data, num_peers - i - 1);
+			return -FI_EOTHER;
+		}
+		done++;
+	}
+
+	return 0;
+}
+
+/* Every ep sends one message to every other ep */
+static int exchange(void)
+{
+	struct fi_cq_err_entry comp;
+	size_t msg_cnt, rx_cnt;
+	int i, j, k, ret;
+
+	msg_cnt = (size_t) num_peers * (num_peers - 1);
+	for (i = 0, k = 0; i < num_peers; i++) {
+		for (j = 0; j < num_peers - 1; j++, k++) {
+			ret = fi_recv(peer_eps[i], &rx_msgs[k],
+				      sizeof(*rx_msgs), peer_desc,
+				      FI_ADDR_UNSPEC, &peer_ctx[k]);
+			if (ret) {
+				FT_PRINTERR("fi_recv", ret);
+				return ret;
+			}
+		}
+	}
+
+	for (i = 0, k = 0; i < num_peers; i++) {
+		for (j = 0; j < num_peers; j++) {
+			if (i == j)
+				continue;
+
+			tx_msgs[k] = i;
+			do {
+				ret = fi_inject(peer_eps[i], &tx_msgs[k],
+						sizeof(*tx_msgs),
+						peer_fi_addrs[j]);
+				if (ret == -FI_EAGAIN)
+					(void) ft_progress_cqs();
+			} while (ret == -FI_EAGAIN);
+			if (ret) {
+				FT_PRINTERR("fi_inject", ret);
+				return ret;
+			}
+			k++;
+		}
+	}
+
+	for (rx_cnt = 0; rx_cnt < msg_cnt; ) {
+		ret = fi_cq_read(rxcq, &comp, 1);
+		if (ret == 1) {
+			rx_cnt++;
+		} else if (ret == -FI_EAVAIL) {
+			return ft_cq_readerr(rxcq);
+		} else if (ret != -FI_EAGAIN) {
+			FT_PRINTERR("fi_cq_read", ret);
+			return ret;
+		} else {
+			ret = fi_cq_read(txcq, NULL, 0);
+			if (ret && ret != -FI_EAGAIN)
+				return ret;
+		}
+	}
+
+	return 0;
+}
+
+static int run(void)
+{
+	uint64_t start, connected, end;
+	int ret;
+
+	ret = ft_getinfo(hints, &fi);
+	if (ret)
+		return ret;
+
+	ret = ft_open_fabric_res();
+	if (ret)
+		return ret;
+
+	ret = ft_alloc_ep_res(fi, &txcq, &rxcq, &txcntr, &rxcntr, &rma_cntr,
+			      &av);
+	if (ret)
+		return ret;
+
+	ret = open_peers();
+	if (ret)
+		goto out;
+
+	start = ft_gettime_us();
+	if (!lazy) {
+		ret = warmup();
+		if (ret)
+			goto out;
+	}
+	connected = ft_gettime_us();
+
+	ret = exchange();
+	if (ret)
+		goto out;
+	end = ft_gettime_us();
+
+	printf("%d peers, %s: connect %.3f ms, first exchange %.3f ms, "
+	       "total %.3f ms\n", num_peers, lazy ? "lazy" : "warm-up",
+	       (connected - start) / 1000.0, (end - connected) / 1000.0,
+	       (end - start) / 1000.0);
+out:
+	ft_close_peer_eps();
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	int op, ret;
+
+	opts = INIT_OPTS;
+	opts.options |= FT_OPT_SKIP_MSG_ALLOC;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt(argc, argv, "n:p:W:lh" ADDR_OPTS INFO_OPTS)) != -1) {
+		switch (op) {
+		default:
+			ft_parse_addr_opts(op, optarg, &opts);
+			ft_parseinfo(op, optarg, hints, &opts);
+			break;
+		case 'n':
+			num_peers = atoi(optarg);
+			break;
+		case 'p':
+			max_pending = atoi(optarg);
+			break;
+		case 'W':
+			warmup_timeout = atoi(optarg);
+			break;
+		case 'l':
+			lazy = true;
+			break;
+		case '?':
+		case 'h':
+			ft_usage(argv[0], "RDM connection warm-up test.");
+			FT_PRINT_OPTS_USAGE("-n <peers>",
+				"number of endpoints (default 16)");
+			FT_PRINT_OPTS_USAGE("-p <count>",
+				"connections in progress per endpoint "
+				"(default: provider)");
+			FT_PRINT_OPTS_USAGE("-W <ms>",
+				"warm-up timeout (default 10000)");
+			FT_PRINT_OPTS_USAGE("-l",
+				"connect lazily on first send");
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (num_peers < 2 || max_pending < 0) {
+		FT_ERR("invalid option value");
+		return EXIT_FAILURE;
+	}
+
+	/* All peers are local, and need an address the others can reach */
+	if (!opts.src_addr)
+		opts.src_addr = "127.0.0.1";
+	if (!opts.src_port)
+		opts.src_port = "0";
+
+	hints->ep_attr->type = FI_EP_RDM;
+	hints->caps = FI_MSG;
+	hints->mode = FI_CONTEXT | FI_CONTEXT2;
+	hints->domain_attr->mr_mode = opts.mr_mode;
+	hints->addr_format = opts.address_format;
+
+	ret = run();
+
+	ft_free_res();
+	return ft_exit_code(ret);
+}
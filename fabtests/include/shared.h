@@ -242,6 +242,13 @@ extern struct fid_av *av;
 extern struct fid_eq *eq;
 extern struct fid_mc *mc;
 
+extern struct fid_ep **peer_eps;
+extern fi_addr_t *peer_fi_addrs;
+extern int peer_cnt;
+extern void *peer_msgs, *peer_desc;
+extern struct fi_context2 *peer_ctx;
+extern struct fid_mr *peer_mr;
+
 extern fi_addr_t remote_fi_addr;
 extern char *buf, *tx_buf, *rx_buf;
 extern void *dev_host_buf;
@@ -339,6 +346,7 @@ extern char default_port[8];
 #define FT_MR_KEY 0xC0DE
 #define FT_TX_MR_KEY (FT_MR_KEY + 1)
 #define FT_RX_MR_KEY 0xFFFF
+#define FT_PEER_MR_KEY 0xBEEF
 #define FT_MSG_MR_ACCESS (FI_SEND | FI_RECV)
 #define FT_RMA_MR_ACCESS (FI_READ | FI_WRITE | FI_REMOTE_READ | FI_REMOTE_WRITE)
 
@@ -467,6 +475,10 @@ int ft_enable_ep(struct fid_ep *bind_ep, struct fid_eq *bind_eq, struct fid_av *
 		 struct fid_cq *bind_txcq, struct fid_cq *bind_rxcq,
 		 struct fid_cntr *bind_txcntr, struct fid_cntr *bind_rxcntr,
 		 struct fid_cntr *bind_rma_cntr);
+int ft_open_peer_eps(int count, struct fid_eq *bind_eq, bool insert);
+int ft_alloc_peer_msgs(size_t count, size_t size);
+void ft_close_peer_eps(void);
+int ft_progress_cqs(void);
 
 int ft_init_alias_ep(uint64_t flags);
 int ft_av_insert(struct fid_av *av, void *addr, size_t count, fi_addr_t *fi_addr,
@@ -520,6 +520,154 @@ struct coll_test tests[] = {
 	},
 };
 
+/*
+ * Performance mode (-T): times barrier, allreduce, allgather and broadcast
+ * on the group of all ranks for a range of sizes.  The latency reported is
+ * the slowest rank's average time per operation, and the bandwidth is the
+ * per-rank message size divided by that time.
+ */
+#define COLL_PERF_MIN_SIZE	8
+#define COLL_PERF_MAX_SIZE	(512 * 1024)
+
+struct coll_perf_buf {
+	uint64_t *src;
+	uint64_t *dst;
+};
+
+static int coll_perf_iters(size_t size)
+{
+	if (ft_check_opts(FT_OPT_ITER))
+		return opts.iterations;
+	if (size >= (1 << 20))
+		return 20;
+	if (size >= (1 << 16))
+		return 100;
+	return 1000;
+}
+
+static int coll_perf_post(enum fi_collective_op coll_op,
+			  struct coll_perf_buf *buf, size_t count,
+			  void *context)
+{
+	switch (coll_op) {
+	case FI_BARRIER:
+		return fi_barrier(ep, coll_addr, context);
+	case FI_ALLREDUCE:
+		return fi_allreduce(ep, buf->src, count, NULL, buf->dst, NULL,
+				    coll_addr, FI_UINT64, FI_SUM, 0, context);
+	case FI_ALLGATHER:
+		return fi_allgather(ep, buf->src, count, NULL, buf->dst, NULL,
+				    coll_addr, FI_UINT64, 0, context);
+	case FI_BROADCAST:
+		return fi_broadcast(ep, pm_job.my_rank ? buf->dst : buf->src,
+				    count, NULL, coll_addr, 0, FI_UINT64, 0,
+				    context);
+	default:
+		return -FI_ENOSYS;
+	}
+}
+
+static int coll_perf_size(enum fi_collective_op coll_op,
+			  struct coll_perf_buf *buf, size_t size)
+{
+	uint64_t done_flag, start, usec, *all_usec, max_usec = 0;
+	size_t count = size / sizeof(uint64_t), i;
+	int iters = coll_perf_iters(size), warmup = opts.warmup_iterations;
+	int k, ret;
+
+	all_usec = calloc(pm_job.num_ranks, sizeof(*all_usec));
+	if (!all_usec)
+		return -FI_ENOMEM;
+
+	pm_barrier();
+	start = ft_gettime_us();
+	for (k = -warmup; k < iters; k++) {
+		if (!k)
+			start = ft_gettime_us();
+
+		ret = coll_perf_post(coll_op, buf, count, &done_flag);
+		if (ret) {
+			FT_PRINTERR("collective", ret);
+			goto out;
+		}
+
+		ret = wait_for_comp(&done_flag);
+		if (ret)
+			goto out;
+	}
+	usec = ft_gettime_us() - start;
+
+	ret = pm_allgather(&usec, all_usec, sizeof(usec));
+	if (ret)
+		goto out;
+
+	for (i = 0; i < pm_job.num_ranks; i++)
+		max_usec = MAX(max_usec, all_usec[i]);
+
+	if (coll_op == FI_BARRIER)
+		PRINTF("%-12s %-10s %-8d %12.2f\n", fi_tostr(&coll_op,
+		       FI_TYPE_COLLECTIVE_OP), "-", iters,
+		       (double) max_usec / iters);
+	else
+		PRINTF("%-12s %-10zu %-8d %12.2f %12.2f\n", fi_tostr(&coll_op,
+		       FI_TYPE_COLLECTIVE_OP), size, iters,
+		       (double) max_usec / iters,
+		       max_usec ? (double) size * iters / max_usec : 0.0);
+out:
+	free(all_usec);
+	return ret;
+}
+
+static int coll_perf_run(void)
+{
+	enum fi_collective_op ops[] = {
+		FI_BARRIER, FI_ALLREDUCE, FI_ALLGATHER, FI_BROADCAST,
+	};
+	struct coll_perf_buf buf;
+	size_t size, i;
+	int ret;
+
+	buf.src = calloc(pm_job.num_ranks, COLL_PERF_MAX_SIZE);
+	buf.dst = calloc(pm_job.num_ranks, COLL_PERF_MAX_SIZE);
+	if (!buf.src || !buf.dst) {
+		ret = -FI_ENOMEM;
+		goto out;
+	}
+
+	ret = coll_setup();
+	if (ret)
+		goto out;
+
+	coll_addr = fi_mc_addr(coll_mc);
+	PRINTF("%-12s %-10s %-8s %12s %12s\n", "collective", "bytes",
+	       "iters", "usec/op", "MB/sec");
+
+	for (i = 0; i < ARRAY_SIZE(ops) && !ret; i++) {
+		if (test_query(ops[i], ops[i] == FI_ALLREDUCE ? FI_SUM : FI_NOOP,
+			       ops[i] == FI_BARRIER ? FI_VOID : FI_UINT64))
+			continue;
+
+		if (ops[i] == FI_BARRIER) {
+			ret = coll_perf_size(ops[i], &buf, 0);
+			continue;
+		}
+
+		for (size = COLL_PERF_MIN_SIZE;
+		     size <= COLL_PERF_MAX_SIZE && !ret; size <<= 2)
+			ret = coll_perf_size(ops[i], &buf, size);
+	}
+
+	pm_barrier();
+	if (!ret)
+		ret = coll_teardown();
+	else
+		(void) coll_teardown();
+out:
+	free(buf.src);
+	free(buf.dst);
+	return ret;
+}
+
 static inline void setup_hints(void)
 {
 	hints->ep_attr->type = FI_EP_RDM;
@@ -647,6 +795,9 @@ int multinode_run_tests(int argc, char **argv)
 		FT_DEBUG("Test Complete: %s", tests->name);
 	}
 
+	if (!ret && ft_check_opts(FT_OPT_PERF))
+		ret = coll_perf_run();
+
 out:
 	if (ret)
 		printf("failed\n");
@@ -152,9 +152,11 @@ functional_tests=(
 	"fi_inject_test -N -A inj_complete -v"
 	"fi_flood -e rdm -v -T 1"
 	"fi_flood -e rdm -v -T 1 -U"
+	"fi_flood -e rdm -v -Q 4 -S 16"
 	"fi_flood -e msg -v -T 1"
 	"fi_rdm_multi_client -C 10 -I 5"
 	"fi_rdm_multi_client -C 10 -I 5 -U"
+	"fi_rdm_conn_storm -n 32 -r 8"
 )
 
 short_tests=(
@@ -246,6 +248,9 @@ unit_tests=(
 	"fi_mr_test"
 	"fi_cntr_test"
 	"fi_setopt_test"
+	"fi_rdm_warmup -n 8"
+	"fi_rdm_warmup -n 8 -l"
+	"fi_rdm_many_peers -n 16"
 )
 
 regression_tests=(
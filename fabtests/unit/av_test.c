@@ -45,10 +45,12 @@
 #include "unit_common.h"
 
 #define MAX_ADDR 256
+#define AV_SCALE_BATCH 1024
 
 char *good_address;
 int num_good_addr;
 char *bad_address;
+int scale_count;
 
 static enum fi_av_type av_type;
 static char err_buf[512];
@@ -614,11 +616,118 @@ fail:
 	return TEST_RET_VAL(ret, testret);
 }
 
+/*
+ * Tests:
+ * - insert and reverse lookup rate as the AV grows to scale_count
+ *   addresses.  Inserting an address already in the AV resolves it
+ *   through the provider's address to fi_addr index, which is the
+ *   lookup done on receive for FI_SOURCE.
+ */
+static int
+av_scale(void)
+{
+	int testret, ret, i, batch;
+	struct fid_av *av;
+	struct fi_av_attr attr;
+	struct sockaddr_in *addrs = NULL;
+	fi_addr_t *fi_addr = NULL, *dup_addr = NULL;
+	uint64_t start, insert_ns, lookup_ns;
+	uint32_t ip;
+
+	testret = FAIL;
+	av = NULL;
+
+	if (!scale_count) {
+		sprintf(err_buf, "scale test requires -S");
+		return SKIPPED;
+	}
+
+	ret = av_get_addrlen(fi);
+	if (ret < 0)
+		goto fail;
+
+	addrs = calloc(scale_count, sizeof(*addrs));
+	fi_addr = calloc(scale_count, sizeof(*fi_addr));
+	dup_addr = calloc(scale_count, sizeof(*dup_addr));
+	if (!addrs || !fi_addr || !dup_addr) {
+		ret = -FI_ENOMEM;
+		sprintf(err_buf, "unable to allocate %d addresses", scale_count);
+		goto fail;
+	}
+
+	ret = av_create_addr_sockaddr_in(good_address, 0, &addrs[0]);
+	if (ret != 0)
+		goto fail;
+
+	ip = ntohl(addrs[0].sin_addr.s_addr);
+	for (i = 1; i < scale_count; ++i) {
+		addrs[i] = addrs[0];
+		addrs[i].sin_addr.s_addr = htonl(ip + i);
+	}
+
+	memset(&attr, 0, sizeof(attr));
+	attr.type = av_type;
+
+	ret = fi_av_open(domain, &attr, &av, NULL);
+	if (ret != 0) {
+		sprintf(err_buf, "fi_av_open(%s) = %d, %s",
+				fi_tostr(&av_type, FI_TYPE_AV_TYPE),
+				ret, fi_strerror(-ret));
+		goto fail;
+	}
+
+	start = ft_gettime_ns();
+	for (i = 0; i < scale_count; i += batch) {
+		batch = MIN(AV_SCALE_BATCH, scale_count - i);
+		ret = fi_av_insert(av, &addrs[i], batch, &fi_addr[i], 0, NULL);
+		if (ret != batch) {
+			sprintf(err_buf, "fi_av_insert ret=%d, %s", ret,
+					fi_strerror(-ret));
+			goto fail;
+		}
+	}
+	insert_ns = ft_gettime_ns() - start;
+
+	start = ft_gettime_ns();
+	for (i = 0; i < scale_count; i += batch) {
+		batch = MIN(AV_SCALE_BATCH, scale_count - i);
+		ret = fi_av_insert(av, &addrs[i], batch, &dup_addr[i], 0, NULL);
+		if (ret != batch) {
+			sprintf(err_buf, "fi_av_insert (duplicate) ret=%d, %s",
+					ret, fi_strerror(-ret));
+			goto fail;
+		}
+	}
+	lookup_ns = ft_gettime_ns() - start;
+
+	for (i = 0; i < scale_count; ++i) {
+		if (dup_addr[i] != fi_addr[i]) {
+			sprintf(err_buf, "address %d resolved to fi_addr %" PRIu64
+					", expected %" PRIu64, i, dup_addr[i],
+					fi_addr[i]);
+			ret = -FI_EOTHER;
+			goto fail;
+		}
+	}
+
+	printf("%d addrs: insert %.1f ns/addr, lookup %.1f ns/addr...",
+			scale_count, (double) insert_ns / scale_count,
+			(double) lookup_ns / scale_count);
+	testret = PASS;
+fail:
+	FT_CLOSE_FID(av);
+	free(dup_addr);
+	free(fi_addr);
+	free(addrs);
+	return TEST_RET_VAL(ret, testret);
+}
+
 struct test_entry test_array_good[] = {
 	TEST_ENTRY(av_open_close, "Test open and close AVs of varying sizes"),
 	TEST_ENTRY(av_good, "Test AV insert with good address"),
 	TEST_ENTRY(av_null_fi_addr, "Test AV insert without specifying fi_addr"),
 	TEST_ENTRY(av_insert_stages, "Test AV insert at various stages"),
+	TEST_ENTRY(av_scale, "Test AV insert and lookup rate at scale"),
 	{ NULL, "" }
 };
 
@@ -659,6 +768,8 @@ static void usage(char *name)
 	fprintf(stderr, FT_OPTS_USAGE_FORMAT " (max=%d)\n", "-n <num_good_addr>",
 			"Number of good addresses", MAX_ADDR - 1);
 	FT_PRINT_OPTS_USAGE("-s <source_address>", "");
+	FT_PRINT_OPTS_USAGE("-S <scale_count>",
+			"Number of addresses for the AV scale test");
 }
 
 int main(int argc, char **argv)
@@ -674,7 +785,7 @@ int main(int argc, char **argv)
 		return EXIT_FAILURE;
 
 	hints->ep_attr->type = FI_EP_RDM;
-	while ((op = getopt(argc, argv, INFO_OPTS "g:G:n:s:h")) != -1) {
+	while ((op = getopt(argc, argv, INFO_OPTS "g:G:n:s:S:h")) != -1) {
 		switch (op) {
 		case 'g':
 			good_address = optarg;
@@ -688,6 +799,9 @@ int main(int argc, char **argv)
 		case 's':
 			opts.src_addr = optarg;
 			break;
+		case 'S':
+			scale_count = atoi(optarg);
+			break;
 		default:
 			ft_parseinfo(op, optarg, hints, &opts);
 			break;
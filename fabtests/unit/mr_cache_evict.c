@@ -39,6 +39,7 @@
 #include <limits.h>
 #include <stdio.h>
 #include <malloc.h>
+#include <pthread.h>
 
 #include "unit_common.h"
 #include "shared.h"
@@ -56,6 +57,8 @@ enum alloc_type {
 static void *reuse_addr = NULL;
 static char err_buf[512];
 static size_t mr_buf_size = 16384;
+static int mt_thread_cnt = 8;
+static int mt_iterations = 10000;
 
 /* Given a time value, determine the expected cached time value. The assumption
  * is the cache value should at least have a CACHE_IMPROVEMENT_PERCENT time
@@ -436,6 +439,32 @@ static int mr_register(const void *buf, struct fid_mr **mr, int64_t *elapsed,
 	return 0;
 }
 
+/* Reallocate the domain to reset the MR cache. */
+static int mr_cache_reset_domain(void)
+{
+	int ret;
+
+	if (!domain) {
+		ret = -EINVAL;
+		FT_UNIT_STRERR(err_buf, "no domain allocated", ret);
+		return ret;
+	}
+
+	ret = fi_close(&domain->fid);
+	if (ret) {
+		FT_UNIT_STRERR(err_buf, "Failed to close the domain", ret);
+		domain = NULL;
+		return ret;
+	}
+
+	ret = fi_domain(fabric, fi, &domain, NULL);
+	if (ret) {
+		FT_UNIT_STRERR(err_buf, "fi_domain failed", ret);
+		domain = NULL;
+	}
+	return ret;
+}
+
 /* Run a test verifing the eviction MR cache entries. The following is how the
  * test works:
  * 1. Prime CPU caches by registering a priming MR. This MR is not used for
@@ -485,26 +514,9 @@ static int mr_cache_test(enum alloc_type type)
 	int testret = FAIL;
 	enum fi_hmem_iface iface = alloc_type_to_iface(type);
 
-	/* Reallocate the domain to reset the MR cache. */
-	if (!domain) {
-		ret = -EINVAL;
-		FT_UNIT_STRERR(err_buf, "no domain allocated", ret);
-		goto cleanup;
-	}
-
-	ret = fi_close(&domain->fid);
-	if (ret) {
-		FT_UNIT_STRERR(err_buf, "Failed to close the domain", ret);
-		domain = NULL;
-		goto cleanup;
-	}
-
-	ret = fi_domain(fabric, fi, &domain, NULL);
-	if (ret) {
-		FT_UNIT_STRERR(err_buf, "fi_domain failed", ret);
-		domain = NULL;
+	ret = mr_cache_reset_domain();
+	if (ret)
 		goto cleanup;
-	}
 
 	/* A priming MR registration is used to ensure the first timed MR
 	 * registration does not take into account the setting up of CPU caches.
@@ -669,6 +681,252 @@ cleanup:
 	return TEST_RET_VAL(ret, testret);
 }
 
+#define MT_BUF_CNT		16
+#define MT_MIN_HIT_PERCENT	90
+#define MT_KEY(idx)		(FT_MR_KEY + 1 + (idx))
+
+struct mt_ctx {
+	void		*bufs[MT_BUF_CNT];
+	int64_t		max_hit_time;
+	int		id;
+	int		ret;
+	size_t		hits;
+	pthread_barrier_t *barrier;
+	volatile bool	*done;
+};
+
+/* Thread safe variant of mr_register() for system memory. Each open MR
+ * needs a unique key for providers which do not select keys.
+ */
+static int mr_register_mt(void *buf, uint64_t key, struct fid_mr **mr,
+			  int64_t *elapsed)
+{
+	const struct iovec iov = {
+		.iov_base = buf,
+		.iov_len = mr_buf_size,
+	};
+	struct fi_mr_attr mr_attr = {
+		.mr_iov = &iov,
+		.iov_count = 1,
+		.access = ft_info_to_mr_access(fi),
+		.requested_key = key,
+		.iface = FI_HMEM_SYSTEM,
+	};
+	uint64_t begin;
+	int ret;
+
+	begin = ft_gettime_ns();
+	ret = fi_mr_regattr(domain, &mr_attr, 0, mr);
+	*elapsed = ft_gettime_ns() - begin;
+	return ret;
+}
+
+static void *mt_buf_alloc(void)
+{
+	void *buf;
+
+	buf = mmap(NULL, mr_buf_size, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buf == MAP_FAILED)
+		return NULL;
+
+	memset(buf, 0, mr_buf_size);
+	return buf;
+}
+
+/* Repeatedly register and close MRs for a set of buffers which are kept
+ * registered by the main thread, so every lookup should hit the cache.
+ */
+static void *mr_cache_mt_hit_thread(void *arg)
+{
+	struct mt_ctx *ctx = arg;
+	struct fid_mr *mr;
+	int64_t elapsed;
+	int i;
+
+	pthread_barrier_wait(ctx->barrier);
+	for (i = 0; i < mt_iterations; i++) {
+		ctx->ret = mr_register_mt(ctx->bufs[(i + ctx->id) % MT_BUF_CNT],
+					  MT_KEY(MT_BUF_CNT + 1 + ctx->id),
+					  &mr, &elapsed);
+		if (ctx->ret)
+			break;
+
+		if (elapsed <= ctx->max_hit_time)
+			ctx->hits++;
+
+		ctx->ret = fi_close(&mr->fid);
+		if (ctx->ret)
+			break;
+	}
+	return NULL;
+}
+
+/* Map, register and unmap a buffer to generate memory monitor
+ * invalidations while the hit threads are running.
+ */
+static void *mr_cache_mt_inval_thread(void *arg)
+{
+	struct mt_ctx *ctx = arg;
+	struct fid_mr *mr;
+	int64_t elapsed;
+	void *buf;
+
+	pthread_barrier_wait(ctx->barrier);
+	while (!*ctx->done) {
+		buf = mt_buf_alloc();
+		if (!buf) {
+			ctx->ret = -errno;
+			break;
+		}
+
+		ctx->ret = mr_register_mt(buf, MT_KEY(MT_BUF_CNT), &mr,
+					  &elapsed);
+		if (!ctx->ret)
+			ctx->ret = fi_close(&mr->fid);
+		munmap(buf, mr_buf_size);
+		if (ctx->ret)
+			break;
+	}
+	return NULL;
+}
+
+/* Run a multi-threaded MR cache hit rate test. The main thread registers a
+ * set of buffers and keeps the MRs open. Worker threads then register and
+ * close MRs for the same buffers concurrently, which should be served by the
+ * MR cache, while an additional thread maps, registers and unmaps a separate
+ * buffer to drive memory monitor invalidations. A registration is counted as
+ * a cache hit if it completes within the expected cached registration time.
+ */
+static int mr_cache_mt_hit_test(void)
+{
+	struct fid_mr *mrs[MT_BUF_CNT] = { 0 };
+	struct mt_ctx *ctxs = NULL, inval_ctx = { 0 };
+	pthread_t *threads = NULL, inval_thread;
+	pthread_barrier_t barrier;
+	void *bufs[MT_BUF_CNT] = { 0 };
+	struct fid_mr *cached_mr;
+	int64_t mr_reg_time, cached_mr_reg_time;
+	volatile bool done = false;
+	size_t hits = 0, total;
+	int i, started = 0, ret;
+	int testret = FAIL;
+
+	ret = mr_cache_reset_domain();
+	if (ret)
+		goto cleanup;
+
+	for (i = 0; i < MT_BUF_CNT; i++) {
+		bufs[i] = mt_buf_alloc();
+		if (!bufs[i]) {
+			ret = -ENOMEM;
+			FT_UNIT_STRERR(err_buf, "mmap failed", ret);
+			goto cleanup;
+		}
+
+		ret = mr_register_mt(bufs[i], MT_KEY(i), &mrs[i],
+				     &mr_reg_time);
+		if (ret) {
+			FT_UNIT_STRERR(err_buf, "fi_mr_regattr failed", ret);
+			goto cleanup;
+		}
+	}
+
+	ret = mr_register_mt(bufs[0], MT_KEY(MT_BUF_CNT), &cached_mr,
+			     &cached_mr_reg_time);
+	if (ret) {
+		FT_UNIT_STRERR(err_buf, "fi_mr_regattr failed", ret);
+		goto cleanup;
+	}
+	FT_CLOSE_FID(cached_mr);
+
+	if (cached_mr_reg_time > CACHE_TIME_MAX_VALUE(mr_reg_time)) {
+		ret = -FI_ENOSYS;
+		sprintf(err_buf, "Assuming MR cache not enabled by provider");
+		goto cleanup;
+	}
+
+	ctxs = calloc(mt_thread_cnt, sizeof(*ctxs));
+	threads = calloc(mt_thread_cnt, sizeof(*threads));
+	if (!ctxs || !threads) {
+		ret = -ENOMEM;
+		FT_UNIT_STRERR(err_buf, "calloc failed", ret);
+		goto cleanup;
+	}
+
+	pthread_barrier_init(&barrier, NULL, mt_thread_cnt + 1);
+	inval_ctx.barrier = &barrier;
+	inval_ctx.done = &done;
+	ret = pthread_create(&inval_thread, NULL, mr_cache_mt_inval_thread,
+			     &inval_ctx);
+	if (ret) {
+		FT_UNIT_STRERR(err_buf, "pthread_create failed", -ret);
+		ret = -ret;
+		goto destroy;
+	}
+
+	for (i = 0; i < mt_thread_cnt; i++) {
+		memcpy(ctxs[i].bufs, bufs, sizeof(bufs));
+		ctxs[i].max_hit_time = CACHE_TIME_MAX_VALUE(mr_reg_time);
+		ctxs[i].id = i;
+		ctxs[i].barrier = &barrier;
+		ret = pthread_create(&threads[i], NULL, mr_cache_mt_hit_thread,
+				     &ctxs[i]);
+		if (ret) {
+			FT_UNIT_STRERR(err_buf, "pthread_create failed", -ret);
+			ret = -ret;
+			break;
+		}
+		started++;
+	}
+
+	/* Release the waiting threads if not all of them could be started. */
+	for (i = started; i < mt_thread_cnt; i++)
+		pthread_barrier_wait(&barrier);
+
+	for (i = 0; i < started; i++) {
+		pthread_join(threads[i], NULL);
+		if (ctxs[i].ret && !ret) {
+			ret = ctxs[i].ret;
+			FT_UNIT_STRERR(err_buf, "MR registration failed", ret);
+		}
+		hits += ctxs[i].hits;
+	}
+
+	done = true;
+	pthread_join(inval_thread, NULL);
+	if (inval_ctx.ret && !ret) {
+		ret = inval_ctx.ret;
+		FT_UNIT_STRERR(err_buf, "MR invalidation thread failed", ret);
+	}
+
+	if (!ret) {
+		total = (size_t) started * mt_iterations;
+		FT_DEBUG("MT MR cache hits: %zu of %zu", hits, total);
+		if (hits * 100 < total * MT_MIN_HIT_PERCENT) {
+			ret = -EEXIST;
+			sprintf(err_buf, "MR cache hit rate too low: %zu of %zu",
+				hits, total);
+		} else {
+			testret = PASS;
+		}
+	}
+
+destroy:
+	pthread_barrier_destroy(&barrier);
+cleanup:
+	for (i = 0; i < MT_BUF_CNT; i++) {
+		if (mrs[i])
+			FT_CLOSE_FID(mrs[i]);
+		if (bufs[i])
+			munmap(bufs[i], mr_buf_size);
+	}
+	free(threads);
+	free(ctxs);
+
+	return TEST_RET_VAL(ret, testret);
+}
+
 /* Run tests using MMAP, BRK, and SBRK. */
 static int mr_cache_mmap_test(void)
 {
@@ -735,6 +993,7 @@ struct test_entry test_array[] = {
 	TEST_ENTRY(mr_cache_sbrk_test, "MR cache eviction test using SBRK"),
 	TEST_ENTRY(mr_cache_cuda_test, "MR cache eviction test using CUDA"),
 	TEST_ENTRY(mr_cache_rocr_test, "MR cache eviction test using ROCR"),
+	TEST_ENTRY(mr_cache_mt_hit_test, "Multi-threaded MR cache hit rate test"),
 	{ NULL, "" }
 };
 
@@ -750,8 +1009,15 @@ static void usage(char *name)
 		"allocation is returned. This can be used to verify the \n"
 		"underlying physical memory changes between MMAP, BRK, and \n"
 		"SBRK allocations. When running as non-root, the reported \n"
-		"physical address is always zero.");
+		"physical address is always zero.\n\n"
+		"The multi-threaded test registers the same buffers from\n"
+		"several threads while memory is being unmapped, and\n"
+		"verifies that registrations continue to hit the cache.");
 	FT_PRINT_OPTS_USAGE("-s <bytes>", "Memory region size to be tested.");
+	FT_PRINT_OPTS_USAGE("-t <threads>", "Threads used by the multi-threaded "
+			    "test (default 8).");
+	FT_PRINT_OPTS_USAGE("-n <iters>", "Registrations per thread in the "
+			    "multi-threaded test (default 10000).");
 	FT_PRINT_OPTS_USAGE("-H", "Enable provider FI_HMEM support");
 }
 
@@ -777,7 +1043,7 @@ int main(int argc, char **argv)
 	if (!hints)
 		return EXIT_FAILURE;
 
-	while ((op = getopt(argc, argv, FAB_OPTS "h" "s:")) != -1) {
+	while ((op = getopt(argc, argv, FAB_OPTS "h" "s:t:n:")) != -1) {
 		switch (op) {
 		default:
 			ft_parseinfo(op, optarg, hints, &opts);
@@ -797,6 +1063,22 @@ int main(int argc, char **argv)
 				goto out;
 			}
 			break;
+		case 't':
+			mt_thread_cnt = atoi(optarg);
+			if (mt_thread_cnt <= 0) {
+				ret = -EINVAL;
+				FT_PRINTERR("Invalid thread count", ret);
+				goto out;
+			}
+			break;
+		case 'n':
+			mt_iterations = atoi(optarg);
+			if (mt_iterations <= 0) {
+				ret = -EINVAL;
+				FT_PRINTERR("Invalid iteration count", ret);
+				goto out;
+			}
+			break;
 		case '?':
 		case 'h':
 			usage(argv[0]);
@@ -434,6 +434,8 @@ uint8_t ofi_lsb(uint64_t num);
 
 extern size_t ofi_universe_size;
 extern int ofi_av_remove_cleanup;
+extern int ofi_srx_tag_hash;
+extern int ofi_wait_spin_us;
 extern char *ofi_offload_coll_prov_name;
 extern int ofi_prefer_sysconfig;
 
@@ -456,6 +458,11 @@ uint64_t ofi_get_realtime_ns(void);
 uint64_t ofi_get_realtime_ms(void);
 uint64_t ofi_get_realtime_us(void);
 
+/* Small dense index assigned to each thread on first call */
+int ofi_thread_idx(void);
+
+int ofi_affinity_entry(const char *list, size_t index, char **cpuset);
+
 static inline uint64_t ofi_timeout_time(int timeout)
 {
 	return (timeout >= 0) ? ofi_gettime_ms() + timeout : 0;
@@ -86,6 +86,12 @@ extern void (*ofi_atomic_swap_handlers[OFI_SWAP_OP_CNT][OFI_DATATYPE_CNT])
 	ofi_atomic_swap_handlers[op - OFI_SWAP_OP_START][datatype](dst, src, \
 								cmp, res, cnt)
 
+/* Non-atomic variant of the write handlers for buffers private to the
+ * caller.  Takes any op and datatype supported by the write handlers.
+ */
+void ofi_atomic_reduce_handler(enum fi_op op, enum fi_datatype datatype,
+			       void *dst, const void *src, size_t cnt);
+
 int ofi_atomic_valid(const struct fi_provider *prov,
 		     enum fi_datatype datatype, enum fi_op op, uint64_t flags);
 
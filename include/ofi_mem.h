@@ -328,6 +328,31 @@ enum {
 	OFI_BUFPOOL_HUGEPAGES		= 1 << 3,
 	OFI_BUFPOOL_NONSHARED		= 1 << 4,
 	OFI_BUFPOOL_NO_ZERO		= 1 << 5,
+	OFI_BUFPOOL_THREAD_CACHE	= 1 << 6,
+};
+
+/*
+ * OFI_BUFPOOL_THREAD_CACHE makes the pool thread safe.  Each thread
+ * allocates from and frees to a magazine of cached buffers, which is
+ * refilled from or drained to the shared free list in batches under the
+ * pool lock.  Threads map onto OFI_BUFPOOL_MAG_CNT magazines; a magazine
+ * lock is only contended if more threads than magazines use the pool.
+ * ofi_ibuf_alloc_at() is not supported with a thread cache.
+ */
+#define OFI_BUFPOOL_MAG_CNT	64
+#define OFI_BUFPOOL_MAG_SIZE	64
+#define OFI_BUFPOOL_MAG_BATCH	(OFI_BUFPOOL_MAG_SIZE / 2)
+
+struct ofi_bufpool_mag {
+	ofi_spin_t		lock;
+	struct slist		entries;
+	size_t			cnt;
+};
+
+/* Pad magazines to avoid false sharing between threads */
+union ofi_bufpool_mag_slot {
+	struct ofi_bufpool_mag	mag;
+	char			pad[128];
 };
 
 struct ofi_bufpool_region;
@@ -358,6 +383,12 @@ struct ofi_bufpool {
 	size_t				alloc_size;
 	size_t				region_size;
 	struct ofi_bufpool_attr		attr;
+
+	/* OFI_BUFPOOL_THREAD_CACHE only */
+	ofi_mutex_t			lock;
+	union ofi_bufpool_mag_slot	*mags;
+	struct ofi_bufpool_region	***retired_tables;
+	size_t				retired_cnt;
 };
 
 struct ofi_bufpool_region {
@@ -409,6 +440,8 @@ ofi_bufpool_create(struct ofi_bufpool **buf_pool,
 void ofi_bufpool_destroy(struct ofi_bufpool *pool);
 
 int ofi_bufpool_grow(struct ofi_bufpool *pool);
+void *ofi_bufpool_mag_alloc(struct ofi_bufpool *pool);
+void ofi_bufpool_mag_free(struct ofi_bufpool *pool, void *buf);
 
 static inline struct ofi_bufpool_hdr *ofi_buf_hdr(void *buf)
 {
@@ -460,6 +493,11 @@ static inline void ofi_buf_free(void *buf)
 	assert(ofi_buf_hdr(buf)->ftr->magic == OFI_MAGIC_SIZE_T);
 	assert(ofi_buf_is_valid(buf));
 
+	if (ofi_buf_pool(buf)->attr.flags & OFI_BUFPOOL_THREAD_CACHE) {
+		ofi_bufpool_mag_free(ofi_buf_pool(buf), buf);
+		return;
+	}
+
 	slist_insert_head(&ofi_buf_hdr(buf)->entry.slist,
 			  &ofi_buf_pool(buf)->free_list.entries);
 }
@@ -467,6 +505,17 @@ static inline void ofi_buf_free(void *buf)
 int ofi_ibuf_is_lower(struct dlist_entry *item, const void *arg);
 int ofi_ibufpool_region_is_lower(struct dlist_entry *item, const void *arg);
 
+static inline void ofi_ibuf_release(struct ofi_bufpool_hdr *buf_hdr)
+{
+	dlist_insert_order(&buf_hdr->region->free_list,
+			   ofi_ibuf_is_lower, &buf_hdr->entry.dlist);
+	if (dlist_empty(&buf_hdr->region->entry)) {
+		dlist_insert_order(&buf_hdr->region->pool->free_list.regions,
+				   ofi_ibufpool_region_is_lower,
+				   &buf_hdr->region->entry);
+	}
+}
+
 static inline void ofi_ibuf_free(void *buf)
 {
 	struct ofi_bufpool_hdr *buf_hdr;
@@ -479,13 +528,12 @@ static inline void ofi_ibuf_free(void *buf)
 	assert(buf_hdr->ftr->magic == OFI_MAGIC_SIZE_T);
 	assert(ofi_buf_is_valid(buf));
 
-	dlist_insert_order(&buf_hdr->region->free_list,
-			   ofi_ibuf_is_lower, &buf_hdr->entry.dlist);
-	if (dlist_empty(&buf_hdr->region->entry)) {
-		dlist_insert_order(&buf_hdr->region->pool->free_list.regions,
-				   ofi_ibufpool_region_is_lower,
-				   &buf_hdr->region->entry);
+	if (buf_hdr->region->pool->attr.flags & OFI_BUFPOOL_THREAD_CACHE) {
+		ofi_bufpool_mag_free(buf_hdr->region->pool, buf);
+		return;
 	}
+
+	ofi_ibuf_release(buf_hdr);
 }
 
 static inline size_t ofi_buf_index(void *buf)
@@ -522,6 +570,9 @@ static inline void *ofi_buf_alloc(struct ofi_bufpool *pool)
 	struct ofi_bufpool_hdr *buf_hdr;
 
 	assert(!(pool->attr.flags & OFI_BUFPOOL_INDEXED));
+	if (pool->attr.flags & OFI_BUFPOOL_THREAD_CACHE)
+		return ofi_bufpool_mag_alloc(pool);
+
 	if (ofi_bufpool_empty(pool)) {
 		if (ofi_bufpool_grow(pool))
 			return NULL;
@@ -556,6 +607,9 @@ static inline void *ofi_ibuf_alloc(struct ofi_bufpool *pool)
 	struct ofi_bufpool_region *buf_region;
 
 	assert(pool->attr.flags & OFI_BUFPOOL_INDEXED);
+	if (pool->attr.flags & OFI_BUFPOOL_THREAD_CACHE)
+		return ofi_bufpool_mag_alloc(pool);
+
 	if (ofi_ibufpool_empty(pool)) {
 		if (ofi_bufpool_grow(pool))
 			return NULL;
@@ -583,6 +637,7 @@ static inline void *ofi_ibuf_alloc_at(struct ofi_bufpool *pool, size_t index)
 	size_t region_index = index / pool->attr.chunk_cnt;
 
 	assert(pool->attr.flags & OFI_BUFPOOL_INDEXED);
+	assert(!(pool->attr.flags & OFI_BUFPOOL_THREAD_CACHE));
 	while (region_index >= pool->region_cnt) {
 		if (ofi_bufpool_grow(pool))
 			return NULL;
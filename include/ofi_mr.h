@@ -156,6 +156,13 @@ struct ofi_mr_entry {
 	int				use_cnt;
 	struct dlist_entry		list_entry;
 	union ofi_mr_hmem_info		hmem_info;
+
+	/* Eviction policy state */
+	uint64_t			reg_time;
+	uint32_t			reuse_cnt;
+	double				priority;
+	struct ofi_rbnode		*evict_node;
+
 	uint8_t				data[];
 };
 
@@ -330,6 +337,9 @@ static inline bool ofi_mr_all_host(struct ofi_mr **mr, size_t count)
 {
 	int i;
 
+	if (!mr)
+		return true;
+
 	for (i = 0; i < count; i++) {
 		if (mr[i] && mr[i]->iface != FI_HMEM_SYSTEM)
 			return false;
@@ -387,6 +397,7 @@ struct ofi_mr_cache_params {
 	size_t				max_cnt;
 	size_t				max_size;
 	char *				monitor;
+	char *				policy;
 	int				cuda_monitor_enabled;
 	int				rocr_monitor_enabled;
 	int				ze_monitor_enabled;
@@ -396,6 +407,41 @@ extern struct ofi_mr_cache_params	cache_params;
 
 #define OFI_HMEM_MAX 6
 
+/*
+ * Cache hits on in-use entries, and releasing references other than the
+ * last, are handled without taking mm_lock.
+ * Lookups hold the read lock of one shard, selected by thread, while
+ * changes to the tree take the write lock of every shard.
+ */
+#define OFI_MR_CACHE_SHARD_CNT	16
+
+struct ofi_mr_cache_shard {
+	pthread_rwlock_t		lock;
+	size_t				hit_cnt;
+	size_t				delete_cnt;
+};
+
+union ofi_mr_cache_shard_slot {
+	struct ofi_mr_cache_shard	shard;
+	char				pad[128];
+};
+
+/*
+ * Eviction policies order the cached entries that have no references.
+ * insert() is called when the last reference to an entry is released,
+ * remove() when the entry is referenced again or invalidated, and
+ * evict() removes and returns the next entry to flush, or NULL.  All
+ * calls are made with mm_lock held.
+ */
+struct ofi_mr_cache_policy {
+	const char			*name;
+	void				(*insert)(struct ofi_mr_cache *cache,
+						  struct ofi_mr_entry *entry);
+	void				(*remove)(struct ofi_mr_cache *cache,
+						  struct ofi_mr_entry *entry);
+	struct ofi_mr_entry		*(*evict)(struct ofi_mr_cache *cache);
+};
+
 struct ofi_mr_cache {
 	struct util_domain		*domain;
 	const struct fi_provider	*prov;
@@ -408,6 +454,11 @@ struct ofi_mr_cache {
 	struct dlist_entry		dead_region_list;
 	pthread_mutex_t			lock;
 
+	const struct ofi_mr_cache_policy *policy;
+	struct ofi_rbmap		evict_tree;
+	struct dlist_entry		evict_overflow;
+	double				evict_clock;
+
 	size_t				cached_cnt;
 	size_t				cached_size;
 	size_t				cached_max_cnt;
@@ -419,6 +470,7 @@ struct ofi_mr_cache {
 	size_t				hit_cnt;
 	size_t				notify_cnt;
 	struct ofi_bufpool		*entry_pool;
+	union ofi_mr_cache_shard_slot	*shards;
 
 	int				(*add_region)(struct ofi_mr_cache *cache,
 						      struct ofi_mr_entry *entry);
@@ -440,6 +440,9 @@ ofi_sockctx_uring_poll_add(struct ofi_sockapi_uring *uring,
 
 /*
  * Byte queue - streaming socket staging buffer
+ *
+ * The data buffer is allocated by ofi_byteq_alloc() the first time it is
+ * needed, so that sockets that never stage data do not hold the memory.
  */
 enum {
 	OFI_BYTEQ_SIZE = 9000, /* Hard-coded max, good for 6 1500B buffers */
@@ -449,7 +452,7 @@ struct ofi_byteq {
 	size_t size;
 	unsigned int head;
 	unsigned int tail;
-	uint8_t data[OFI_BYTEQ_SIZE];
+	uint8_t *data;
 };
 
 static inline void ofi_byteq_init(struct ofi_byteq *byteq, ssize_t size)
@@ -463,6 +466,22 @@ static inline void ofi_byteq_init(struct ofi_byteq *byteq, ssize_t size)
 		byteq->size = 0;
 }
 
+/* Returns false if the byteq has no buffer and one cannot be allocated */
+static inline bool ofi_byteq_alloc(struct ofi_byteq *byteq)
+{
+	if (!byteq->data && byteq->size)
+		byteq->data = malloc(byteq->size);
+	return byteq->data != NULL;
+}
+
+static inline void ofi_byteq_free(struct ofi_byteq *byteq)
+{
+	free(byteq->data);
+	byteq->data = NULL;
+	byteq->head = 0;
+	byteq->tail = 0;
+}
+
 static inline void ofi_byteq_discard(struct ofi_byteq *byteq)
 {
 	byteq->head = 0;
@@ -527,6 +546,33 @@ size_t ofi_byteq_readv(struct ofi_byteq *byteq, struct iovec *iov,
 		       size_t cnt, size_t offset);
 
 
+/*
+ * Zero copy send selection.  Sends larger than the bsock zerocopy_size
+ * use MSG_ZEROCOPY while it is measured to be cheaper than copying, and
+ * the kernel is not copying the data anyway.  The method not in use is
+ * sampled periodically so that the selection adapts to the current
+ * traffic.  Costs are tracked in ns per KiB.
+ */
+enum {
+	OFI_ZC_PROBE_MIN = 64,
+	OFI_ZC_PROBE_MAX = 8192,
+};
+
+struct ofi_bsock_zc {
+	uint64_t copy_cost;
+	uint64_t send_cost;
+	uint64_t harvest_cost;
+	size_t pending;		/* zero copy bytes not yet harvested */
+	uint32_t probe;		/* sends until the other method is sampled */
+	uint32_t backoff;	/* probe interval while the kernel copies */
+	bool enabled;
+	bool copying;
+
+	/* statistics, counted in sends */
+	uint64_t hits;
+	uint64_t copied;
+};
+
 /*
  * Buffered socket - socket with send/receive staging buffers.
  */
@@ -539,6 +585,7 @@ struct ofi_bsock {
 	struct ofi_byteq sq;
 	struct ofi_byteq rq;
 	size_t zerocopy_size;
+	struct ofi_bsock_zc zc;
 	uint32_t async_index;
 	uint32_t done_index;
 	bool async_prefetch;
@@ -556,6 +603,10 @@ ofi_bsock_init(struct ofi_bsock *bsock, struct ofi_sockapi *sockapi,
 	ofi_byteq_init(&bsock->sq, sbuf_size);
 	ofi_byteq_init(&bsock->rq, rbuf_size);
 	bsock->zerocopy_size = SIZE_MAX;
+	memset(&bsock->zc, 0, sizeof(bsock->zc));
+	bsock->zc.probe = OFI_ZC_PROBE_MIN;
+	bsock->zc.backoff = OFI_ZC_PROBE_MIN;
+	bsock->zc.enabled = true;
 	bsock->async_prefetch = false;
 
 	/* first async op will wrap back to 0 as the starting index */
@@ -569,6 +620,12 @@ static inline void ofi_bsock_discard(struct ofi_bsock *bsock)
 	ofi_byteq_discard(&bsock->sq);
 }
 
+static inline void ofi_bsock_free(struct ofi_bsock *bsock)
+{
+	ofi_byteq_free(&bsock->rq);
+	ofi_byteq_free(&bsock->sq);
+}
+
 static inline size_t ofi_bsock_readable(struct ofi_bsock *bsock)
 {
 	return ofi_byteq_readable(&bsock->rq);
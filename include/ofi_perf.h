@@ -36,6 +36,7 @@
 #include "config.h"
 
 #include <assert.h>
+#include <stdio.h>
 #include <string.h>
 #include <ofi_osd.h>
 #include <rdma/providers/fi_prov.h>
@@ -77,10 +78,23 @@ enum {
 
 /* NIC counters TBD */
 
+/*
+ * Samples are recorded into a log-linear histogram: each power of two is
+ * split into OFI_PERF_HIST_SUB linear sub-buckets, which bounds the relative
+ * error of a reported percentile to 1 / OFI_PERF_HIST_SUB over the full
+ * 64-bit range.
+ */
+#define OFI_PERF_HIST_SUB_BITS	4
+#define OFI_PERF_HIST_SUB	(1 << OFI_PERF_HIST_SUB_BITS)
+#define OFI_PERF_HIST_SIZE	((64 - OFI_PERF_HIST_SUB_BITS + 1) * \
+				 OFI_PERF_HIST_SUB)
+
 struct ofi_perf_data {
 	uint64_t	start;
 	uint64_t	sum;
 	uint64_t	events;
+	uint64_t	max;
+	uint64_t	hist[OFI_PERF_HIST_SIZE];
 };
 
 
@@ -88,6 +102,8 @@ void ofi_perf_init(void);
 extern enum ofi_perf_domain	perf_domain;
 extern uint32_t			perf_cntr;
 extern uint32_t			perf_flags;
+extern char			*perf_dump_file;
+extern int			perf_dump_interval;
 
 
 /*
@@ -144,13 +160,33 @@ static inline void ofi_perf_start(struct ofi_perf_ctx *ctx,
 	data->start = ofi_pmu_read(ctx);
 }
 
+static inline size_t ofi_perf_hist_index(uint64_t value)
+{
+	int shift;
+
+	if (value < OFI_PERF_HIST_SUB)
+		return (size_t) value;
+
+	shift = 63 - __builtin_clzll(value) - OFI_PERF_HIST_SUB_BITS;
+	return ((size_t) (shift + 1) << OFI_PERF_HIST_SUB_BITS) +
+	       (size_t) ((value >> shift) & (OFI_PERF_HIST_SUB - 1));
+}
+
 static inline void ofi_perf_end(struct ofi_perf_ctx *ctx,
 				struct ofi_perf_data *data)
 {
-	data->sum += ofi_pmu_read(ctx) - data->start;
+	uint64_t delta;
+
+	delta = ofi_pmu_read(ctx) - data->start;
+	data->sum += delta;
 	data->events++;
+	if (delta > data->max)
+		data->max = delta;
+	data->hist[ofi_perf_hist_index(delta)]++;
 }
 
+uint64_t ofi_perf_percentile(const struct ofi_perf_data *data, double pct);
+
 
 struct ofi_perfset {
 	const struct fi_provider *prov;
@@ -166,6 +202,7 @@ int ofi_perfset_create(const struct fi_provider *prov,
 void ofi_perfset_close(struct ofi_perfset *set);
 
 void ofi_perfset_log(struct ofi_perfset *set, const char **names);
+void ofi_perfset_dump(struct ofi_perfset *set, const char **names, FILE *file);
 
 static inline void ofi_perfset_start(struct ofi_perfset *set, size_t index)
 {
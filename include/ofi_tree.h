@@ -87,6 +87,7 @@ int ofi_rbmap_foreach(struct ofi_rbmap *map, struct ofi_rbnode *root,
 void ofi_rbmap_cleanup(struct ofi_rbmap *map);
 
 struct ofi_rbnode *ofi_rbmap_get_root(struct ofi_rbmap *map);
+struct ofi_rbnode *ofi_rbmap_get_min(struct ofi_rbmap *map);
 struct ofi_rbnode *ofi_rbmap_find(struct ofi_rbmap *map, void *key);
 struct ofi_rbnode *ofi_rbmap_search(struct ofi_rbmap *map, void *key,
 		int (*compare)(struct ofi_rbmap *map, void *key, void *data));
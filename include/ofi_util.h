@@ -60,6 +60,7 @@
 #include <ofi_list.h>
 #include <ofi_mem.h>
 #include <ofi_rbuf.h>
+#include <ofi_atomic_queue.h>
 #include <ofi_signal.h>
 #include <ofi_enosys.h>
 #include <ofi_osd.h>
@@ -418,12 +419,41 @@ struct util_wait {
 
 	struct dlist_entry	fid_list;
 	ofi_mutex_t		lock;
+
+	/* Adaptive spinning before blocking, see ofi_wait_spin_time() */
+	uint64_t		spin_max_ns;
+	uint64_t		spin_avg_ns;
 };
 
 int ofi_wait_init(struct util_fabric *fabric, struct fi_wait_attr *attr,
 		  struct util_wait *wait);
 int fi_wait_cleanup(struct util_wait *wait);
 
+/*
+ * Blocking reads spin polling for up to the returned time before they
+ * sleep on the wait object.  The budget follows a moving average of how
+ * long recent waits took to be satisfied: spinning covers twice that
+ * average while it stays under FI_WAIT_SPIN, and stops once waits
+ * routinely take longer.
+ */
+static inline uint64_t ofi_wait_spin_time(struct util_wait *wait)
+{
+	return wait->spin_avg_ns > wait->spin_max_ns ? 0 :
+	       MIN(wait->spin_avg_ns * 2, wait->spin_max_ns);
+}
+
+static inline void ofi_wait_spin_update(struct util_wait *wait,
+					uint64_t wait_ns)
+{
+	if (!wait->spin_max_ns)
+		return;
+
+	/* Samples past the limit only need to push the average over it */
+	wait_ns = MIN(wait_ns, wait->spin_max_ns * 4);
+	wait->spin_avg_ns += ((int64_t) wait_ns -
+			      (int64_t) wait->spin_avg_ns) / 8;
+}
+
 struct util_wait_fd {
 	struct util_wait	util_wait;
 	struct fd_signal	signal;
@@ -497,6 +527,13 @@ struct util_cq_aux_entry {
 
 OFI_DECLARE_CIRQUE(struct fi_cq_tagged_entry, util_comp_cirq);
 
+struct util_cq_mpsc_entry {
+	struct fi_cq_tagged_entry	comp;
+	fi_addr_t			src;
+};
+
+OFI_DECLARE_ATOMIC_Q(struct util_cq_mpsc_entry, util_comp_mpscq);
+
 typedef void (*ofi_cq_progress_func)(struct util_cq *cq);
 
 struct util_cq {
@@ -525,11 +562,29 @@ struct util_cq {
 	fi_addr_t		*src;
 	struct slist		aux_queue;
 	fi_cq_read_func		read_entry;
+
+	/* Replaces cirq and src if opened with ofi_cq_init_mpsc().  Producers
+	 * write to the ring without cq_lock.  Once the ring overflows or
+	 * an error is queued, writes go to aux_queue under cq_lock until
+	 * it drains.  Readers take aux_queue only after every claimed ring
+	 * slot, which keeps each producer's completions in order.
+	 */
+	struct util_comp_mpscq	*mpscq;
+	ofi_atomic32_t		aux_cnt;
 };
 
 int ofi_cq_init(const struct fi_provider *prov, struct fid_domain *domain,
 		 struct fi_cq_attr *attr, struct util_cq *cq,
 		 ofi_cq_progress_func progress, void *context);
+/* Completions are written by multiple threads and are stored in a
+ * lock-free ring rather than a cirque protected by cq_lock.  Only valid
+ * for providers that write completions through ofi_cq_write*() and the
+ * util peer CQ, and never access util_cq->cirq directly.
+ */
+int ofi_cq_init_mpsc(const struct fi_provider *prov,
+		     struct fid_domain *domain, struct fi_cq_attr *attr,
+		     struct util_cq *cq, ofi_cq_progress_func progress,
+		     void *context);
 int ofi_check_bind_cq_flags(struct util_ep *ep, struct util_cq *cq,
 			    uint64_t flags);
 void ofi_cq_progress(struct util_cq *cq);
@@ -552,6 +607,11 @@ const char *ofi_cq_strerror(struct fid_cq *cq, int prov_errno,
 int ofi_cq_write_overflow(struct util_cq *cq, void *context, uint64_t flags,
 			  size_t len, void *buf, uint64_t data, uint64_t tag,
 			  fi_addr_t src);
+int ofi_cq_write_mpsc_overflow(struct util_cq *cq, void *context,
+			       uint64_t flags, size_t len, void *buf,
+			       uint64_t data, uint64_t tag, fi_addr_t src);
+ssize_t ofi_cq_read_mpsc(struct util_cq *cq, void *buf, size_t count,
+			 fi_addr_t *src_addr);
 
 static inline
 ssize_t ofi_cq_read_entries(struct util_cq *cq, void *buf, size_t count,
@@ -561,6 +621,9 @@ ssize_t ofi_cq_read_entries(struct util_cq *cq, void *buf, size_t count,
 	struct util_cq_aux_entry *aux_entry;
 	ssize_t i;
 
+	if (cq->mpscq)
+		return ofi_cq_read_mpsc(cq, buf, count, src_addr);
+
 	ofi_genlock_lock(&cq->cq_lock);
 
 	if (cq->err_data) {
@@ -640,12 +703,40 @@ ofi_cq_write_src_entry(struct util_cq *cq, void *context, uint64_t flags,
 	ofi_cq_write_entry(cq, context, flags, len, buf, data, tag);
 }
 
+static inline int
+ofi_cq_write_mpsc(struct util_cq *cq, void *context, uint64_t flags,
+		  size_t len, void *buf, uint64_t data, uint64_t tag,
+		  fi_addr_t src)
+{
+	struct util_cq_mpsc_entry *entry;
+	int64_t pos;
+
+	if (ofi_atomic_get32(&cq->aux_cnt) ||
+	    util_comp_mpscq_next(cq->mpscq, &entry, &pos))
+		return ofi_cq_write_mpsc_overflow(cq, context, flags, len,
+						  buf, data, tag, src);
+
+	entry->comp.op_context = context;
+	entry->comp.flags = flags;
+	entry->comp.len = len;
+	entry->comp.buf = buf;
+	entry->comp.data = data;
+	entry->comp.tag = tag;
+	entry->src = src;
+	util_comp_mpscq_commit(entry, pos);
+	return 0;
+}
+
 static inline int
 ofi_cq_write(struct util_cq *cq, void *context, uint64_t flags, size_t len,
 	     void *buf, uint64_t data, uint64_t tag)
 {
 	int ret;
 
+	if (cq->mpscq)
+		return ofi_cq_write_mpsc(cq, context, flags, len, buf, data,
+					 tag, FI_ADDR_NOTAVAIL);
+
 	ofi_genlock_lock(&cq->cq_lock);
 	if (ofi_cirque_freecnt(cq->cirq) > 1) {
 		ofi_cq_write_entry(cq, context, flags, len, buf, data, tag);
@@ -664,6 +755,10 @@ ofi_cq_write_src(struct util_cq *cq, void *context, uint64_t flags, size_t len,
 {
 	int ret;
 
+	if (cq->mpscq)
+		return ofi_cq_write_mpsc(cq, context, flags, len, buf, data,
+					 tag, src);
+
 	ofi_genlock_lock(&cq->cq_lock);
 	if (ofi_cirque_freecnt(cq->cirq) > 1) {
 		ofi_cq_write_src_entry(cq, context, flags, len, buf, data,
@@ -677,6 +772,10 @@ ofi_cq_write_src(struct util_cq *cq, void *context, uint64_t flags, size_t len,
 	return ret;
 }
 
+ssize_t ofi_cq_write_batch(struct util_cq *cq,
+			   const struct fi_cq_tagged_entry *comp,
+			   const fi_addr_t *src, size_t count);
+
 int ofi_cq_write_error(struct util_cq *cq,
 		       const struct fi_cq_err_entry *err_entry);
 int ofi_cq_write_error_peek(struct util_cq *cq, uint64_t tag, void *context);
@@ -692,6 +791,29 @@ ofi_peer_cq_write(struct util_cq *cq, void *context, uint64_t flags, size_t len,
 					     buf, data, tag, src);
 }
 
+static inline ssize_t
+ofi_peer_cq_write_batch(struct util_cq *cq,
+			const struct fi_cq_tagged_entry *comp,
+			const fi_addr_t *src, size_t count)
+{
+	struct fi_ops_cq_owner *ops = cq->peer_cq->owner_ops;
+	size_t i;
+	int ret;
+
+	if (FI_CHECK_OP(ops, struct fi_ops_cq_owner, write_batch))
+		return ops->write_batch(cq->peer_cq, comp, src, count);
+
+	for (i = 0; i < count; i++) {
+		ret = ops->write(cq->peer_cq, comp[i].op_context,
+				 comp[i].flags, comp[i].len, comp[i].buf,
+				 comp[i].data, comp[i].tag,
+				 src ? src[i] : FI_ADDR_NOTAVAIL);
+		if (ret)
+			return i ? i : ret;
+	}
+	return count;
+}
+
 static inline int ofi_peer_cq_write_error(struct util_cq *cq,
 		const struct fi_cq_err_entry *err_entry)
 {
@@ -866,7 +988,6 @@ struct util_av_set {
 
 struct util_av_entry {
 	ofi_atomic32_t	use_cnt;
-	UT_hash_handle	hh;
 	/*
 	 * data includes 'addr' and any other additional fields
 	 * associated with av_entry. 'addr' must be the first
@@ -876,6 +997,19 @@ struct util_av_entry {
 	char		data[];
 };
 
+/*
+ * Open-addressing index from address to fi_addr.  Each slot packs the
+ * upper 32 bits of the address hash with the entry index + 1, so a probe
+ * only touches an AV entry when those bits match.  Empty slots are 0;
+ * removed entries leave a tombstone with a zero index.
+ */
+struct util_av_index {
+	uint64_t		*slots;
+	size_t			size;
+	size_t			used;
+	size_t			tombs;
+};
+
 struct util_av {
 	struct fid_av		av_fid;
 	struct util_domain	*domain;
@@ -883,7 +1017,7 @@ struct util_av {
 	struct ofi_genlock	lock;
 	const struct fi_provider *prov;
 
-	struct util_av_entry	*hash;
+	struct util_av_index	index;
 	struct ofi_bufpool	*av_entry_pool;
 
 	struct util_av_set	*av_set;
@@ -972,6 +1106,47 @@ void rxm_ref_peer(struct util_peer_addr *peer);
 void *rxm_av_alloc_conn(struct rxm_av *av);
 void rxm_av_free_conn(struct rxm_av *av, void *conn_ctx);
 
+/* Asynchronous connection setup for FI_CONNECT_PEERS.  Warm-ups are
+ * tracked on a list owned by the endpoint and driven from its progress,
+ * with the endpoint lock held.  The connect callback returns 0 if the
+ * peer is connected, -FI_EAGAIN while a connection is in progress, and
+ * -FI_ENOTCONN if there is no connection.  It starts a connection only
+ * if 'start' is set.  Peers that refused or dropped the connection are
+ * retried every RXM_WARMUP_RETRY msec until the warm-up times out.
+ */
+#define RXM_WARMUP_RETRY	10
+
+typedef int (*rxm_warmup_connect_func)(struct util_ep *ep, fi_addr_t addr,
+				       bool start);
+
+struct rxm_warmup_slot {
+	size_t			index;
+	bool			idle;
+};
+
+struct rxm_warmup {
+	struct dlist_entry	entry;
+	struct util_ep		*ep;
+	void			*context;
+	fi_addr_t		*addr;
+	size_t			count;
+	size_t			next;
+	size_t			connected;
+
+	struct rxm_warmup_slot	*pending;
+	size_t			pending_cnt;
+	size_t			max_pending;
+
+	uint64_t		deadline;
+	uint64_t		retry_time;
+};
+
+int rxm_warmup_start(struct util_ep *ep, struct dlist_entry *list,
+		     const struct fi_connect_peers *attr);
+void rxm_warmup_progress(struct dlist_entry *list,
+			 rxm_warmup_connect_func connect);
+void rxm_warmup_cleanup(struct dlist_entry *list, struct util_ep *ep);
+
 
 typedef int (*ofi_av_apply_func)(struct util_av *av, void *addr,
 				 fi_addr_t fi_addr, void *arg);
@@ -988,6 +1163,7 @@ size_t ofi_av_size(struct util_av *av);
 int ofi_av_insert_addr_at(struct util_av *av, const void *addr, fi_addr_t fi_addr);
 int ofi_av_insert_addr(struct util_av *av, const void *addr, fi_addr_t *fi_addr);
 int ofi_av_remove_addr(struct util_av *av, fi_addr_t fi_addr);
+void ofi_av_index_remove(struct util_av *av, fi_addr_t fi_addr);
 fi_addr_t ofi_av_lookup_fi_addr_unsafe(struct util_av *av, const void *addr);
 fi_addr_t ofi_av_lookup_fi_addr(struct util_av *av, const void *addr);
 
@@ -1292,6 +1468,13 @@ struct util_rx_entry {
 	uint64_t		seq_no;
 	uint64_t		ignore;
 	int			multi_recv_ref;
+	/* Links used by UTIL_SRX_MATCH_HASH only.  hash_entry places the
+	 * entry in a (tag, source) bucket.  Unexpected entries are also
+	 * kept in a tag-only bucket and in arrival order.
+	 */
+	struct dlist_entry	hash_entry;
+	struct dlist_entry	tag_entry;
+	struct dlist_entry	order_entry;
 	/* extra memory allocated at the end of each entry to hold iovecs and
 	 * MR descriptors. The amount of memory is determined by the provider's
 	 * iov limit.
@@ -1305,6 +1488,24 @@ struct util_srx_ctx;
 typedef void(*ofi_update_func_t)(struct util_srx_ctx *srx,
 				 struct util_rx_entry *rx_entry);
 
+/*
+ * Tag matching engines for the shared receive context.  The list engine
+ * walks ordered queues.  The hash engine buckets receives posted with an
+ * exact tag (ignore == 0) and all unexpected tagged messages by tag and
+ * source, so matching cost is independent of queue depth.  Receives
+ * using ignore bits stay on the ordered lists, and sequence numbers are
+ * compared across both to preserve posting order.
+ */
+enum util_srx_match {
+	UTIL_SRX_MATCH_LIST,
+	UTIL_SRX_MATCH_HASH,
+};
+
+struct util_match_table {
+	struct dlist_entry	*buckets;
+	size_t			mask;
+};
+
 struct util_unexp_peer {
 	struct dlist_entry	entry;
 	struct slist		msg_queue;
@@ -1335,6 +1536,14 @@ struct util_srx_ctx {
 	struct dlist_entry	unexp_peers;
 	struct ofi_dyn_arr	src_unexp_peers;
 
+	enum util_srx_match	match_mode;
+	size_t			table_size;
+	uint64_t		unexp_seq_no;
+	struct util_match_table	exp_tag_table;
+	struct util_match_table	unexp_tag_table;
+	struct util_match_table	unexp_any_table;
+	struct dlist_entry	unexp_tag_list;
+
 	struct ofi_bufpool	*rx_pool;
 	struct ofi_genlock	*lock;
 };
@@ -1355,6 +1564,7 @@ int util_ep_srx_context(struct util_domain *domain, size_t rx_size,
 			ofi_update_func_t update_func,
 			struct ofi_genlock *lock, struct fid_ep **rx_ep);
 int util_srx_close(struct fid *fid);
+int util_srx_set_match(struct fid_ep *rx_ep, enum util_srx_match mode);
 int util_srx_bind(struct fid *fid, struct fid *bfid, uint64_t flags);
 ssize_t util_srx_generic_recv(struct fid_ep *ep_fid, const struct iovec *iov,
 			      void **desc, size_t iov_count, fi_addr_t addr,
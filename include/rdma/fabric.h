@@ -690,6 +690,7 @@ enum {
 	FI_GET_VAL,		/* struct fi_fid_var */
 	FI_SET_VAL,		/* struct fi_fid_var */
 	FI_EXPORT_FID,		/* struct fi_fid_export */
+	FI_CONNECT_PEERS,	/* struct fi_connect_peers */
 };
 
 static inline int fi_control(struct fid *fid, int command, void *arg)
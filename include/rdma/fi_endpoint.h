@@ -92,6 +92,15 @@ enum {
 	FI_HMEM_P2P_DISABLED	/* Do not use P2P */
 };
 
+/* Argument to fi_control FI_CONNECT_PEERS */
+struct fi_connect_peers {
+	const fi_addr_t		*addr;
+	size_t			count;
+	size_t			max_pending;	/* 0 for provider default */
+	int			timeout;	/* msec, < 0 for no timeout */
+	void			*context;
+};
+
 struct fi_ops_ep {
 	size_t	size;
 	ssize_t	(*cancel)(fid_t fid, void *context);
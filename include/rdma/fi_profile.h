@@ -51,6 +51,9 @@ enum {
 	FI_VAR_CONN_ACCEPT,        // datatype: FI_UNIT64
 	FI_VAR_CONN_REJECT,        // datatype: FI_UNIT64
 	FI_VAR_OFI_MEM,            // datatype: FI_UINT64
+	FI_VAR_MR_CACHE_HIT_BYTES,   // datatype: FI_UINT64
+	FI_VAR_MR_CACHE_MISS_BYTES,  // datatype: FI_UINT64
+	FI_VAR_MR_CACHE_EVICT_BYTES, // datatype: FI_UINT64
 };
 
 /*
@@ -103,6 +103,9 @@ struct fi_ops_cq_owner {
 			fi_addr_t src);
 	ssize_t	(*writeerr)(struct fid_peer_cq *cq,
 			const struct fi_cq_err_entry *err_entry);
+	ssize_t	(*write_batch)(struct fid_peer_cq *cq,
+			const struct fi_cq_tagged_entry *comp,
+			const fi_addr_t *src, size_t count);
 };
 
 struct fid_peer_cq {
@@ -92,8 +92,79 @@ struct coll_ep {
 	 */
 	struct fi_info *peer_info;
 	struct fid_ep *peer_ep;
+
+	/* collectives running through shared memory, in posting order */
+	struct dlist_entry shm_ops;
+	uint64_t shm_pass;
+};
+
+static inline struct coll_ep *coll_ep(struct fid_ep *ep_fid)
+{
+	return container_of(ep_fid, struct coll_ep, util_ep.ep_fid);
+}
+
+/*
+ * Shared memory collectives
+ *
+ * When all members of a joined group are on the same node, the group gets
+ * a shared segment with one data slot and one set of flags per rank, and
+ * its collectives are done through the segment instead of send/recv
+ * schedules.  The segment is created by rank 0 during the join, and its
+ * name is exchanged together with a key that identifies the node.
+ */
+#define COLL_SHM_SLOT_SIZE	(64 * 1024)
+#define COLL_SHM_NAME_MAX	64
+
+struct coll_shm;
+
+struct coll_shm_info {
+	uint64_t	node_key;
+	char		name[COLL_SHM_NAME_MAX];
 };
 
+struct coll_mc {
+	struct util_coll_mc	util_mc;
+	struct coll_shm		*shm;
+
+	/* only set while joining */
+	struct util_coll_mc	*join_mc;
+	struct coll_shm_info	*join_info;
+};
+
+/* the mc of an av set is not joined and never uses shared memory */
+static inline struct coll_shm *coll_mc_shm(struct util_coll_mc *util_mc)
+{
+	if (util_mc == &util_mc->av_set->coll_mc)
+		return NULL;
+	return container_of(util_mc, struct coll_mc, util_mc)->shm;
+}
+
+extern int coll_shm_enable;
+
+int coll_shm_join_info(struct coll_mc *mc, struct coll_shm_info *info);
+int coll_shm_attach(struct coll_mc *mc);
+void coll_shm_join_done(struct coll_mc *mc, bool success);
+void coll_shm_free(struct coll_shm *shm);
+void coll_shm_progress(struct coll_ep *ep);
+void coll_shm_ep_cleanup(struct coll_ep *ep);
+
+ssize_t coll_shm_barrier(struct coll_ep *ep, struct coll_shm *shm,
+			 void *context);
+ssize_t coll_shm_allreduce(struct coll_ep *ep, struct coll_shm *shm,
+			   const void *buf, void *result, size_t count,
+			   enum fi_datatype datatype, enum fi_op op,
+			   void *context);
+ssize_t coll_shm_allgather(struct coll_ep *ep, struct coll_shm *shm,
+			   const void *buf, void *result, size_t count,
+			   enum fi_datatype datatype, void *context);
+ssize_t coll_shm_scatter(struct coll_ep *ep, struct coll_shm *shm,
+			 const void *buf, void *result, size_t count,
+			 uint64_t root, enum fi_datatype datatype,
+			 void *context);
+ssize_t coll_shm_broadcast(struct coll_ep *ep, struct coll_shm *shm,
+			   void *buf, size_t count, uint64_t root,
+			   enum fi_datatype datatype, void *context);
+
 struct coll_mr {
 	struct fid_mr mr_fid;
 	struct fid_mr *msg_mr;
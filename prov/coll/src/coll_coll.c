@@ -647,11 +647,13 @@ static int coll_do_scatter(struct util_coll_operation *coll_op,
 
 static int coll_close(struct fid *fid)
 {
-	struct util_coll_mc *coll_mc;
+	struct coll_mc *coll_mc;
 
-	coll_mc = container_of(fid, struct util_coll_mc, mc_fid.fid);
+	coll_mc = container_of(fid, struct coll_mc, util_mc.mc_fid.fid);
 
-	ofi_atomic_dec32(&coll_mc->av_set->ref);
+	ofi_atomic_dec32(&coll_mc->util_mc.av_set->ref);
+	coll_shm_free(coll_mc->shm);
+	free(coll_mc->join_info);
 	free(coll_mc);
 
 	return FI_SUCCESS;
@@ -687,15 +689,85 @@ static int coll_find_local_rank(struct fid_ep *ep,
 	return FI_SUCCESS;
 }
 
-void coll_join_comp(struct util_coll_operation *coll_op)
+static void coll_join_report(struct fid_ep *ep_fid, struct util_coll_mc *mc,
+			     void *context)
 {
 	struct fi_eq_entry entry;
 	struct coll_ep *ep;
 	struct ofi_coll_eq *eq;
 
-	ep = container_of(coll_op->ep, struct coll_ep, util_ep.ep_fid);
+	ep = container_of(ep_fid, struct coll_ep, util_ep.ep_fid);
 	eq = container_of(ep->util_ep.eq, struct ofi_coll_eq, util_eq.eq_fid);
 
+	memset(&entry, 0, sizeof(entry));
+	entry.fid = &mc->mc_fid.fid;
+	entry.context = context;
+
+	if (fi_eq_write(eq->peer_eq, FI_JOIN_COMPLETE, &entry,
+			sizeof(struct fi_eq_entry), FI_COLLECTIVE) < 0)
+		FI_WARN(ep->util_ep.domain->fabric->prov, FI_LOG_DOMAIN,
+			"join collective - eq write failed\n");
+}
+
+static void coll_shm_join_comp(struct util_coll_operation *coll_op)
+{
+	struct coll_mc *mc;
+
+	mc = container_of(coll_op->mc, struct coll_mc, util_mc);
+	coll_shm_join_done(mc, coll_op->data.barrier.data != 0);
+	coll_join_report(coll_op->ep, mc->join_mc, coll_op->context);
+	mc->join_mc = NULL;
+}
+
+/*
+ * Every member must agree on using the shared segment, so the result of
+ * attaching to it is reduced over the new group before the join completes.
+ */
+static int coll_shm_join(struct util_coll_operation *coll_op)
+{
+	struct util_coll_operation *shm_op;
+	struct util_ep *util_ep;
+	struct coll_mc *mc;
+	uint64_t ok;
+	int ret;
+
+	mc = container_of(coll_op->data.join.new_mc, struct coll_mc, util_mc);
+	ok = coll_shm_attach(mc) ? 0 : 1;
+
+	shm_op = coll_create_op(coll_op->ep, &mc->util_mc, UTIL_COLL_JOIN_OP,
+				coll_op->flags, coll_op->context,
+				coll_shm_join_comp);
+	if (!shm_op)
+		return -FI_ENOMEM;
+
+	ret = coll_do_allreduce(shm_op, &ok, &shm_op->data.barrier.data,
+				&shm_op->data.barrier.tmp, 1, FI_UINT64,
+				FI_BAND);
+	if (ret)
+		goto err;
+
+	ret = coll_sched_comp(shm_op);
+	if (ret)
+		goto err;
+
+	mc->join_mc = coll_op->mc;
+	util_ep = container_of(coll_op->ep, struct util_ep, ep_fid);
+	coll_progress_work(util_ep, shm_op);
+	return FI_SUCCESS;
+err:
+	free(shm_op);
+	return ret;
+}
+
+void coll_join_comp(struct util_coll_operation *coll_op)
+{
+	struct coll_ep *ep;
+	struct coll_mc *new_mc;
+
+	ep = container_of(coll_op->ep, struct coll_ep, util_ep.ep_fid);
+	new_mc = container_of(coll_op->data.join.new_mc, struct coll_mc,
+			      util_mc);
+
 	coll_op->data.join.new_mc->seq = 0;
 	coll_op->data.join.new_mc->group_id =
 		(uint16_t) ofi_bitmask_get_lsbset(coll_op->data.join.data);
@@ -704,18 +776,16 @@ void coll_join_comp(struct util_coll_operation *coll_op)
 	ofi_bitmask_unset(ep->util_ep.coll_cid_mask,
 			  coll_op->data.join.new_mc->group_id);
 
-	/* write to the eq */
-	memset(&entry, 0, sizeof(entry));
-	entry.fid = &coll_op->mc->mc_fid.fid;
-	entry.context = coll_op->context;
-
-	if (fi_eq_write(eq->peer_eq, FI_JOIN_COMPLETE, &entry,
-			sizeof(struct fi_eq_entry), FI_COLLECTIVE) < 0)
-		FI_WARN(ep->util_ep.domain->fabric->prov, FI_LOG_DOMAIN,
-			"join collective - eq write failed\n");
-
 	ofi_bitmask_free(&coll_op->data.join.data);
 	ofi_bitmask_free(&coll_op->data.join.tmp);
+
+	if (new_mc->join_info) {
+		if (!coll_shm_join(coll_op))
+			return;
+		coll_shm_join_done(new_mc, false);
+	}
+
+	coll_join_report(coll_op->ep, coll_op->mc, coll_op->context);
 }
 
 void coll_collective_comp(struct util_coll_operation *coll_op)
@@ -759,10 +829,10 @@ static ssize_t coll_process_reduce_item(struct util_coll_reduce_item *reduce_ite
 	if (reduce_item->op < FI_MIN || reduce_item->op > FI_BXOR)
 		return -FI_ENOSYS;
 
-	ofi_atomic_write_handler(reduce_item->op, reduce_item->datatype,
-				 reduce_item->inout_buf,
-				 reduce_item->in_buf,
-				 reduce_item->count);
+	ofi_atomic_reduce_handler(reduce_item->op, reduce_item->datatype,
+				  reduce_item->inout_buf,
+				  reduce_item->in_buf,
+				  reduce_item->count);
 	return FI_SUCCESS;
 }
 
@@ -821,6 +891,8 @@ void coll_ep_progress(struct util_ep *util_ep)
 	struct util_coll_operation *coll_op;
 	ssize_t ret;
 
+	coll_shm_progress(container_of(util_ep, struct coll_ep, util_ep));
+
 	while (!slist_empty(&util_ep->coll_ready_queue)) {
 		slist_remove_head_container(&util_ep->coll_ready_queue,
 					    struct util_coll_work_item,
@@ -891,21 +963,54 @@ out:
 static struct util_coll_mc *coll_create_mc(struct util_av_set *av_set,
 					   void *context)
 {
-	struct util_coll_mc *coll_mc;
+	struct coll_mc *coll_mc;
 
 	coll_mc = calloc(1, sizeof(*coll_mc));
 	if (!coll_mc)
 		return NULL;
 
-	coll_mc->mc_fid.fid.fclass = FI_CLASS_MC;
-	coll_mc->mc_fid.fid.context = context;
-	coll_mc->mc_fid.fid.ops = &util_coll_fi_ops;
-	coll_mc->mc_fid.fi_addr = (uintptr_t) coll_mc;
+	coll_mc->util_mc.mc_fid.fid.fclass = FI_CLASS_MC;
+	coll_mc->util_mc.mc_fid.fid.context = context;
+	coll_mc->util_mc.mc_fid.fid.ops = &util_coll_fi_ops;
+	coll_mc->util_mc.mc_fid.fi_addr = (uintptr_t) &coll_mc->util_mc;
 
 	ofi_atomic_inc32(&av_set->ref);
-	coll_mc->av_set = av_set;
+	coll_mc->util_mc.av_set = av_set;
+
+	return &coll_mc->util_mc;
+}
+
+/*
+ * A group can use shared memory only if its members are the members of
+ * the group it is joined through, so that the node keys and the segment
+ * name can be exchanged as part of the join.
+ */
+static int coll_join_shm_info(struct util_coll_operation *join_op)
+{
+	struct coll_mc *mc;
+	size_t size;
+	int ret;
+
+	mc = container_of(join_op->data.join.new_mc, struct coll_mc, util_mc);
+	size = mc->util_mc.av_set->fi_addr_count;
+	if (!coll_shm_enable || mc->util_mc.av_set != join_op->mc->av_set ||
+	    mc->util_mc.local_rank == FI_ADDR_NOTAVAIL || size < 2)
+		return FI_SUCCESS;
+
+	mc->join_info = calloc(size + 1, sizeof(*mc->join_info));
+	if (!mc->join_info)
+		return -FI_ENOMEM;
 
-	return coll_mc;
+	/* rank 0 reports no name if it could not create the segment */
+	(void) coll_shm_join_info(mc, &mc->join_info[size]);
+
+	ret = coll_do_allgather(join_op, &mc->join_info[size], mc->join_info,
+				sizeof(*mc->join_info), FI_UINT8);
+	if (ret) {
+		coll_shm_join_done(mc, false);
+		return ret;
+	}
+	return FI_SUCCESS;
 }
 
 int coll_join_collective(struct fid_ep *ep, const void *addr,
@@ -973,6 +1078,10 @@ int coll_join_collective(struct fid_ep *ep, const void *addr,
 	if (ret)
 		goto err4;
 
+	ret = coll_join_shm_info(join_op);
+	if (ret)
+		goto err4;
+
 	ret = coll_sched_comp(join_op);
 	if (ret)
 		goto err4;
@@ -998,12 +1107,17 @@ ssize_t coll_ep_barrier2(struct fid_ep *ep, fi_addr_t coll_addr, uint64_t flags,
 {
 	struct util_coll_mc *coll_mc;
 	struct util_coll_operation *barrier_op;
+	struct coll_shm *shm;
 	struct util_ep *util_ep;
 	uint64_t send;
 	int ret;
 
 	coll_mc = (struct util_coll_mc*) ((uintptr_t) coll_addr);
 
+	shm = coll_mc_shm(coll_mc);
+	if (shm)
+		return coll_shm_barrier(coll_ep(ep), shm, context);
+
 	barrier_op = coll_create_op(ep, coll_mc, UTIL_COLL_BARRIER_OP,
 				    flags, context,
 				    coll_collective_comp);
@@ -1043,10 +1157,19 @@ ssize_t coll_ep_allreduce(struct fid_ep *ep, const void *buf, size_t count,
 {
 	struct util_coll_mc *coll_mc;
 	struct util_coll_operation *allreduce_op;
+	struct coll_shm *shm;
 	struct util_ep *util_ep;
 	int ret;
 
 	coll_mc = (struct util_coll_mc *) ((uintptr_t) coll_addr);
+	shm = coll_mc_shm(coll_mc);
+	if (shm) {
+		ret = coll_shm_allreduce(coll_ep(ep), shm, buf, result, count,
+					 datatype, op, context);
+		if (ret != -FI_ENOSYS)
+			return ret;
+	}
+
 	allreduce_op = coll_create_op(ep, coll_mc, UTIL_COLL_ALLREDUCE_OP,
 				      flags, context,
 				      coll_collective_comp);
@@ -1090,10 +1213,16 @@ ssize_t coll_ep_allgather(struct fid_ep *ep, const void *buf, size_t count,
 {
 	struct util_coll_mc *coll_mc;
 	struct util_coll_operation *allgather_op;
+	struct coll_shm *shm;
 	struct util_ep *util_ep;
 	int ret;
 
 	coll_mc = (struct util_coll_mc *) ((uintptr_t) coll_addr);
+	shm = coll_mc_shm(coll_mc);
+	if (shm)
+		return coll_shm_allgather(coll_ep(ep), shm, buf, result, count,
+					  datatype, context);
+
 	allgather_op = coll_create_op(ep, coll_mc, UTIL_COLL_ALLGATHER_OP,
 				      flags, context,
 				      coll_collective_comp);
@@ -1125,10 +1254,19 @@ ssize_t coll_ep_scatter(struct fid_ep *ep, const void *buf, size_t count,
 {
 	struct util_coll_mc *coll_mc;
 	struct util_coll_operation *scatter_op;
+	struct coll_shm *shm;
 	struct util_ep *util_ep;
 	int ret;
 
 	coll_mc = (struct util_coll_mc *) ((uintptr_t) coll_addr);
+	shm = coll_mc_shm(coll_mc);
+	if (shm) {
+		ret = coll_shm_scatter(coll_ep(ep), shm, buf, result, count,
+				       root_addr, datatype, context);
+		if (ret != -FI_ENOSYS)
+			return ret;
+	}
+
 	scatter_op = coll_create_op(ep, coll_mc, UTIL_COLL_SCATTER_OP,
 				    flags, context,
 				    coll_collective_comp);
@@ -1161,11 +1299,20 @@ ssize_t coll_ep_broadcast(struct fid_ep *ep, void *buf, size_t count,
 {
 	struct util_coll_mc *coll_mc;
 	struct util_coll_operation *broadcast_op;
+	struct coll_shm *shm;
 	struct util_ep *util_ep;
 	uint64_t chunk_cnt, numranks, local;
 	int ret;
 
 	coll_mc = (struct util_coll_mc *) ((uintptr_t) coll_addr);
+	shm = coll_mc_shm(coll_mc);
+	if (shm) {
+		ret = coll_shm_broadcast(coll_ep(ep), shm, buf, count,
+					 root_addr, datatype, context);
+		if (ret != -FI_ENOSYS)
+			return ret;
+	}
+
 	broadcast_op = coll_create_op(ep, coll_mc, UTIL_COLL_BROADCAST_OP,
 				      flags, context,
 				      coll_collective_comp);
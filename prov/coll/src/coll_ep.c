@@ -85,6 +85,7 @@ static int coll_ep_close(struct fid *fid)
 
 	ep = container_of(fid, struct coll_ep, util_ep.ep_fid.fid);
 
+	coll_shm_ep_cleanup(ep);
 	ofi_endpoint_close(&ep->util_ep);
 	fi_freeinfo(ep->peer_info);
 	fi_freeinfo(ep->coll_info);
@@ -150,6 +151,7 @@ int coll_endpoint(struct fid_domain *domain, struct fi_info *info,
 	}
 
 	ep->peer_ep = peer_context->ep;
+	dlist_init(&ep->shm_ops);
 
 	ret = ofi_endpoint_init(domain, &coll_util_prov, info,
 				&ep->util_ep, context,
@@ -60,5 +60,11 @@ struct fi_provider coll_prov = {
 
 COLL_INI
 {
+	fi_param_define(&coll_prov, "shm", FI_PARAM_BOOL,
+			"Run the collectives of groups whose members are all "
+			"on the same node through a shared memory segment "
+			"(default: true)");
+	fi_param_get_bool(&coll_prov, "shm", &coll_shm_enable);
+
 	return &coll_prov;
 }
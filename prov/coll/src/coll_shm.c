@@ -0,0 +1,601 @@
+/*
+ * Copyright (c) 2019-2022 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <sched.h>
+
+#include "coll.h"
+#include "ofi_mb.h"
+
+#define COLL_SHM_PREFIX		"fi_coll_"
+#define COLL_SHM_CACHE_LINE	64
+
+/*
+ * Every collective is done in rounds of at most one slot of data per rank.
+ * In round s, a rank that provides data waits until every rank has
+ * acknowledged round s - 1, so that nobody still reads its slot, copies
+ * its data in, and sets post to s.  Ranks that only consume data set post
+ * without waiting.  Once the ranks they read from have posted, they copy
+ * the data out and set ack to s.  Allreduce has a second step: each rank
+ * reduces its share of the chunk in place in its own slot and sets reduce
+ * to s, then all ranks gather the reduced shares.
+ */
+struct coll_shm_ctrl {
+	volatile uint64_t	post;
+	volatile uint64_t	reduce;
+	volatile uint64_t	ack;
+	uint8_t			pad[COLL_SHM_CACHE_LINE - 3 * sizeof(uint64_t)];
+};
+
+struct coll_shm_region {
+	uint64_t		size;
+	uint64_t		slot_size;
+	uint64_t		data_offset;
+	uint8_t			pad[COLL_SHM_CACHE_LINE - 3 * sizeof(uint64_t)];
+	struct coll_shm_ctrl	ctrl[];
+};
+
+struct coll_shm {
+	struct util_shm		map;
+	struct coll_shm_region	*region;
+	uint64_t		rank;
+	uint64_t		size;
+	uint64_t		seq;
+	uint64_t		pass;
+};
+
+enum coll_shm_state {
+	COLL_SHM_START,
+	COLL_SHM_WRITE,
+	COLL_SHM_READ,
+	COLL_SHM_GATHER,
+};
+
+struct coll_shm_op {
+	struct dlist_entry	entry;
+	struct coll_shm		*shm;
+	enum fi_collective_op	type;
+	const uint8_t		*buf;
+	uint8_t			*result;
+	size_t			bytes;
+	size_t			chunk_max;
+	size_t			offset;
+	size_t			chunk;
+	enum fi_datatype	datatype;
+	enum fi_op		op;
+	uint64_t		root;
+	uint64_t		seq;
+	enum coll_shm_state	state;
+	void			*context;
+};
+
+int coll_shm_enable = 1;
+static int coll_shm_idx = 0;
+
+static uint64_t coll_shm_node_key(void)
+{
+	char host[256];
+	uint64_t key = 14695981039346656037ULL;
+	size_t i;
+
+	/* FNV-1a of the host name */
+	if (gethostname(host, sizeof(host)))
+		host[0] = '\0';
+	host[sizeof(host) - 1] = '\0';
+	for (i = 0; host[i]; i++) {
+		key ^= (uint8_t) host[i];
+		key *= 1099511628211ULL;
+	}
+	return key;
+}
+
+static size_t coll_shm_total_size(uint64_t size, size_t *data_offset)
+{
+	*data_offset = ofi_get_aligned_size(sizeof(struct coll_shm_region) +
+					    size * sizeof(struct coll_shm_ctrl),
+					    ofi_get_page_size());
+	return *data_offset + size * COLL_SHM_SLOT_SIZE;
+}
+
+static int coll_shm_map(struct coll_mc *mc, const char *name)
+{
+	struct coll_shm *shm;
+	size_t total_size, data_offset;
+	void *addr;
+	int ret;
+
+	shm = calloc(1, sizeof(*shm));
+	if (!shm)
+		return -FI_ENOMEM;
+
+	shm->rank = mc->util_mc.local_rank;
+	shm->size = mc->util_mc.av_set->fi_addr_count;
+	total_size = coll_shm_total_size(shm->size, &data_offset);
+
+	ret = ofi_shm_map(&shm->map, name, total_size, 0, &addr);
+	if (ret) {
+		free(shm);
+		return ret;
+	}
+
+	shm->region = addr;
+	if (!shm->rank) {
+		memset(addr, 0, data_offset);
+		shm->region->size = shm->size;
+		shm->region->slot_size = COLL_SHM_SLOT_SIZE;
+		shm->region->data_offset = data_offset;
+	} else if (shm->region->size != shm->size ||
+		   shm->region->slot_size != COLL_SHM_SLOT_SIZE ||
+		   shm->region->data_offset != data_offset) {
+		/* not the segment of rank 0, which may be on another node */
+		coll_shm_free(shm);
+		return -FI_EINVAL;
+	}
+
+	mc->shm = shm;
+	return FI_SUCCESS;
+}
+
+int coll_shm_join_info(struct coll_mc *mc, struct coll_shm_info *info)
+{
+	int ret;
+
+	memset(info, 0, sizeof(*info));
+	info->node_key = coll_shm_node_key();
+
+	if (mc->util_mc.local_rank)
+		return FI_SUCCESS;
+
+	/* never reused, as other ranks unlink the name when they close */
+	snprintf(info->name, COLL_SHM_NAME_MAX, "%s%d_%d", COLL_SHM_PREFIX,
+		 getpid(), coll_shm_idx++);
+
+	ret = coll_shm_map(mc, info->name);
+	if (ret)
+		info->name[0] = '\0';
+	return ret;
+}
+
+int coll_shm_attach(struct coll_mc *mc)
+{
+	struct coll_shm_info *info = mc->join_info;
+	size_t i, size;
+
+	size = mc->util_mc.av_set->fi_addr_count;
+	if (!info[0].name[0])
+		return -FI_ENOSYS;
+
+	for (i = 1; i < size; i++) {
+		if (info[i].node_key != info[0].node_key)
+			return -FI_ENOSYS;
+	}
+
+	/* rank 0 mapped the segment before the exchange */
+	if (!mc->util_mc.local_rank)
+		return mc->shm ? FI_SUCCESS : -FI_ENOSYS;
+
+	return coll_shm_map(mc, info[0].name);
+}
+
+void coll_shm_free(struct coll_shm *shm)
+{
+	if (!shm)
+		return;
+
+	ofi_shm_unmap(&shm->map);
+	free(shm);
+}
+
+/* Every member has mapped the segment, or given up on it */
+void coll_shm_join_done(struct coll_mc *mc, bool success)
+{
+	if (!success) {
+		coll_shm_free(mc->shm);
+		mc->shm = NULL;
+	}
+
+	FI_INFO(&coll_prov, FI_LOG_EP_CTRL, "group %u %s shared memory\n",
+		mc->util_mc.group_id, mc->shm ? "uses" : "does not use");
+
+	free(mc->join_info);
+	mc->join_info = NULL;
+}
+
+static inline uint8_t *coll_shm_slot(struct coll_shm *shm, uint64_t rank)
+{
+	return (uint8_t *) shm->region + shm->region->data_offset +
+	       rank * shm->region->slot_size;
+}
+
+static inline struct coll_shm_ctrl *
+coll_shm_ctrl(struct coll_shm *shm, uint64_t rank)
+{
+	return &shm->region->ctrl[rank];
+}
+
+static bool coll_shm_all_acked(struct coll_shm *shm, uint64_t seq)
+{
+	uint64_t i;
+
+	for (i = 0; i < shm->size; i++) {
+		if (coll_shm_ctrl(shm, i)->ack < seq)
+			return false;
+	}
+	return true;
+}
+
+static bool coll_shm_all_posted(struct coll_shm *shm, uint64_t seq)
+{
+	uint64_t i;
+
+	for (i = 0; i < shm->size; i++) {
+		if (coll_shm_ctrl(shm, i)->post < seq)
+			return false;
+	}
+	return true;
+}
+
+static bool coll_shm_all_reduced(struct coll_shm *shm, uint64_t seq)
+{
+	uint64_t i;
+
+	for (i = 0; i < shm->size; i++) {
+		if (coll_shm_ctrl(shm, i)->reduce < seq)
+			return false;
+	}
+	return true;
+}
+
+/* Share of the elements of a chunk that a rank reduces */
+static void coll_shm_share(struct coll_shm_op *op, uint64_t rank,
+			   size_t *start, size_t *len)
+{
+	size_t dt_size = ofi_datatype_size(op->datatype);
+	size_t cnt = op->chunk / dt_size;
+	size_t base = cnt / op->shm->size, rem = cnt % op->shm->size;
+
+	*start = (rank * base + MIN(rank, rem)) * dt_size;
+	*len = (base + (rank < rem)) * dt_size;
+}
+
+static bool coll_shm_writes(struct coll_shm_op *op)
+{
+	switch (op->type) {
+	case FI_ALLREDUCE:
+	case FI_ALLGATHER:
+		return true;
+	case FI_BROADCAST:
+	case FI_SCATTER:
+		return op->shm->rank == op->root;
+	default:
+		return false;
+	}
+}
+
+static void coll_shm_write(struct coll_shm_op *op)
+{
+	struct coll_shm *shm = op->shm;
+	uint8_t *slot = coll_shm_slot(shm, shm->rank);
+	uint64_t i;
+
+	switch (op->type) {
+	case FI_ALLREDUCE:
+	case FI_ALLGATHER:
+	case FI_BROADCAST:
+		memcpy(slot, op->buf + op->offset, op->chunk);
+		break;
+	case FI_SCATTER:
+		for (i = 0; i < shm->size; i++) {
+			if (i == shm->rank)
+				memcpy(op->result + op->offset,
+				       op->buf + i * op->bytes + op->offset,
+				       op->chunk);
+			else
+				memcpy(slot + i * op->chunk_max,
+				       op->buf + i * op->bytes + op->offset,
+				       op->chunk);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+static bool coll_shm_ready(struct coll_shm_op *op)
+{
+	struct coll_shm *shm = op->shm;
+
+	switch (op->type) {
+	case FI_BROADCAST:
+	case FI_SCATTER:
+		return coll_shm_ctrl(shm, op->root)->post >= op->seq;
+	default:
+		return coll_shm_all_posted(shm, op->seq);
+	}
+}
+
+static void coll_shm_read(struct coll_shm_op *op)
+{
+	struct coll_shm *shm = op->shm;
+	uint64_t i;
+
+	switch (op->type) {
+	case FI_ALLGATHER:
+		for (i = 0; i < shm->size; i++)
+			memcpy(op->result + i * op->bytes + op->offset,
+			       coll_shm_slot(shm, i), op->chunk);
+		break;
+	case FI_BROADCAST:
+		if (shm->rank != op->root)
+			memcpy(op->result + op->offset,
+			       coll_shm_slot(shm, op->root), op->chunk);
+		break;
+	case FI_SCATTER:
+		if (shm->rank != op->root)
+			memcpy(op->result + op->offset,
+			       coll_shm_slot(shm, op->root) +
+			       shm->rank * op->chunk_max, op->chunk);
+		break;
+	default:
+		break;
+	}
+}
+
+/* Reduce this rank's share of every slot into its own slot, in place */
+static void coll_shm_reduce(struct coll_shm_op *op)
+{
+	struct coll_shm *shm = op->shm;
+	size_t start, len;
+	uint64_t i;
+
+	coll_shm_share(op, shm->rank, &start, &len);
+	if (!len)
+		return;
+
+	for (i = 0; i < shm->size; i++) {
+		if (i == shm->rank)
+			continue;
+		ofi_atomic_reduce_handler(op->op, op->datatype,
+				coll_shm_slot(shm, shm->rank) + start,
+				coll_shm_slot(shm, i) + start,
+				len / ofi_datatype_size(op->datatype));
+	}
+}
+
+static void coll_shm_gather(struct coll_shm_op *op)
+{
+	struct coll_shm *shm = op->shm;
+	size_t start, len;
+	uint64_t i;
+
+	for (i = 0; i < shm->size; i++) {
+		coll_shm_share(op, i, &start, &len);
+		memcpy(op->result + op->offset + start,
+		       coll_shm_slot(shm, i) + start, len);
+	}
+}
+
+static void coll_shm_finish_round(struct coll_shm_op *op)
+{
+	/* all reads of the round are done before the slots are released */
+	ofi_mb();
+	coll_shm_ctrl(op->shm, op->shm->rank)->ack = op->seq;
+	op->offset += op->chunk;
+	op->state = COLL_SHM_START;
+}
+
+/* Returns true once the operation has completed */
+static bool coll_shm_progress_op(struct coll_shm_op *op)
+{
+	struct coll_shm *shm = op->shm;
+
+	for (;;) {
+		switch (op->state) {
+		case COLL_SHM_START:
+			if (op->seq && op->offset >= op->bytes)
+				return true;
+			op->chunk = MIN(op->bytes - op->offset, op->chunk_max);
+			op->seq = ++shm->seq;
+			op->state = COLL_SHM_WRITE;
+			/* fall through */
+		case COLL_SHM_WRITE:
+			if (coll_shm_writes(op)) {
+				if (!coll_shm_all_acked(shm, op->seq - 1))
+					return false;
+				ofi_rmb();
+				coll_shm_write(op);
+				ofi_wmb();
+			}
+			coll_shm_ctrl(shm, shm->rank)->post = op->seq;
+			op->state = COLL_SHM_READ;
+			/* fall through */
+		case COLL_SHM_READ:
+			if (!coll_shm_ready(op))
+				return false;
+			ofi_rmb();
+			if (op->type != FI_ALLREDUCE) {
+				coll_shm_read(op);
+				coll_shm_finish_round(op);
+				break;
+			}
+			coll_shm_reduce(op);
+			ofi_wmb();
+			coll_shm_ctrl(shm, shm->rank)->reduce = op->seq;
+			op->state = COLL_SHM_GATHER;
+			/* fall through */
+		case COLL_SHM_GATHER:
+			if (!coll_shm_all_reduced(shm, op->seq))
+				return false;
+			ofi_rmb();
+			coll_shm_gather(op);
+			coll_shm_finish_round(op);
+			break;
+		}
+	}
+}
+
+static void coll_shm_comp(struct coll_ep *ep, struct coll_shm_op *op)
+{
+	struct ofi_coll_cq *cq;
+
+	cq = container_of(ep->util_ep.tx_cq, struct ofi_coll_cq, util_cq);
+	if (cq->peer_cq->owner_ops->write(cq->peer_cq, op->context,
+					  FI_COLLECTIVE, 0, 0, 0, 0, 0))
+		FI_WARN(&coll_prov, FI_LOG_DOMAIN,
+			"collective - cq write failed\n");
+}
+
+void coll_shm_progress(struct coll_ep *ep)
+{
+	struct coll_shm_op *op;
+	struct dlist_entry *tmp;
+	uint64_t pass = ++ep->shm_pass;
+
+	/* operations of a group run one at a time, in posting order */
+	dlist_foreach_container_safe(&ep->shm_ops, struct coll_shm_op, op,
+				     entry, tmp) {
+		if (op->shm->pass == pass)
+			continue;
+
+		if (!coll_shm_progress_op(op)) {
+			op->shm->pass = pass;
+			continue;
+		}
+
+		dlist_remove(&op->entry);
+		coll_shm_comp(ep, op);
+		free(op);
+	}
+
+	/* the ranks we wait for may need this cpu to make progress */
+	if (!dlist_empty(&ep->shm_ops))
+		sched_yield();
+}
+
+void coll_shm_ep_cleanup(struct coll_ep *ep)
+{
+	struct coll_shm_op *op;
+
+	while (!dlist_empty(&ep->shm_ops)) {
+		dlist_pop_front(&ep->shm_ops, struct coll_shm_op, op, entry);
+		free(op);
+	}
+}
+
+static ssize_t coll_shm_post(struct coll_ep *ep, struct coll_shm *shm,
+			     enum fi_collective_op type, const void *buf,
+			     void *result, size_t bytes, size_t chunk_max,
+			     enum fi_datatype datatype, enum fi_op reduce_op,
+			     uint64_t root, void *context)
+{
+	struct coll_shm_op *op;
+
+	op = calloc(1, sizeof(*op));
+	if (!op)
+		return -FI_ENOMEM;
+
+	op->shm = shm;
+	op->type = type;
+	op->buf = buf;
+	op->result = result;
+	op->bytes = bytes;
+	op->chunk_max = chunk_max;
+	op->datatype = datatype;
+	op->op = reduce_op;
+	op->root = root;
+	op->context = context;
+	op->state = COLL_SHM_START;
+	dlist_insert_tail(&op->entry, &ep->shm_ops);
+
+	coll_shm_progress(ep);
+	return FI_SUCCESS;
+}
+
+ssize_t coll_shm_barrier(struct coll_ep *ep, struct coll_shm *shm,
+			 void *context)
+{
+	return coll_shm_post(ep, shm, FI_BARRIER, NULL, NULL, 0, 0,
+			     FI_VOID, FI_NOOP, 0, context);
+}
+
+ssize_t coll_shm_allreduce(struct coll_ep *ep, struct coll_shm *shm,
+			   const void *buf, void *result, size_t count,
+			   enum fi_datatype datatype, enum fi_op op,
+			   void *context)
+{
+	size_t dt_size = ofi_datatype_size(datatype);
+
+	if (op < FI_MIN || op > FI_BXOR || !dt_size)
+		return -FI_ENOSYS;
+
+	return coll_shm_post(ep, shm, FI_ALLREDUCE, buf, result,
+			     count * dt_size,
+			     COLL_SHM_SLOT_SIZE / dt_size * dt_size,
+			     datatype, op, 0, context);
+}
+
+ssize_t coll_shm_allgather(struct coll_ep *ep, struct coll_shm *shm,
+			   const void *buf, void *result, size_t count,
+			   enum fi_datatype datatype, void *context)
+{
+	return coll_shm_post(ep, shm, FI_ALLGATHER, buf, result,
+			     count * ofi_datatype_size(datatype),
+			     COLL_SHM_SLOT_SIZE, datatype, FI_NOOP, 0,
+			     context);
+}
+
+ssize_t coll_shm_scatter(struct coll_ep *ep, struct coll_shm *shm,
+			 const void *buf, void *result, size_t count,
+			 uint64_t root, enum fi_datatype datatype,
+			 void *context)
+{
+	/* the root slot holds one piece per rank */
+	if (root >= shm->size || COLL_SHM_SLOT_SIZE / shm->size == 0)
+		return -FI_ENOSYS;
+
+	return coll_shm_post(ep, shm, FI_SCATTER, buf, result,
+			     count * ofi_datatype_size(datatype),
+			     COLL_SHM_SLOT_SIZE / shm->size, datatype,
+			     FI_NOOP, root, context);
+}
+
+ssize_t coll_shm_broadcast(struct coll_ep *ep, struct coll_shm *shm,
+			   void *buf, size_t count, uint64_t root,
+			   enum fi_datatype datatype, void *context)
+{
+	if (root >= shm->size)
+		return -FI_ENOSYS;
+
+	return coll_shm_post(ep, shm, FI_BROADCAST, buf, buf,
+			     count * ofi_datatype_size(datatype),
+			     COLL_SHM_SLOT_SIZE, datatype, FI_NOOP, root,
+			     context);
+}
@@ -41,6 +41,13 @@
 struct perf_fabric {
 	struct hook_fabric fabric_hook;
 	struct ofi_perfset perf_set;
+
+	FILE *dump_file;
+	pthread_t dump_thread;
+	pthread_mutex_t dump_lock;
+	pthread_cond_t dump_cond;
+	bool dump_thread_started;
+	bool dump_stop;
 };
 
 int hook_perf_destroy(struct fid *fabric);
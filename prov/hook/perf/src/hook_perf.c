@@ -851,11 +851,86 @@ static struct fi_ops perf_fabric_fid_ops = {
 	.ops_open = hook_ops_open,
 };
 
+/*
+ * Samples are written by the application threads without synchronization,
+ * so a periodic dump may observe a counter mid-update.  That only skews the
+ * snapshot by a single event, which is acceptable for monitoring.
+ */
+static void *perf_dump_thread(void *arg)
+{
+	struct perf_fabric *fab = arg;
+
+	pthread_mutex_lock(&fab->dump_lock);
+	while (!fab->dump_stop) {
+		ofi_wait_cond(&fab->dump_cond, &fab->dump_lock,
+			      perf_dump_interval * 1000);
+		if (fab->dump_stop)
+			break;
+
+		ofi_perfset_dump(&fab->perf_set, perf_counters_str,
+				 fab->dump_file);
+	}
+	pthread_mutex_unlock(&fab->dump_lock);
+	return NULL;
+}
+
+static void perf_dump_open(struct perf_fabric *fab)
+{
+	int ret;
+
+	if (!perf_dump_file || !*perf_dump_file)
+		return;
+
+	fab->dump_file = fopen(perf_dump_file, "a");
+	if (!fab->dump_file) {
+		FI_WARN(fab->fabric_hook.hprov, FI_LOG_FABRIC,
+			"Unable to open perf dump file %s: %s\n",
+			perf_dump_file, strerror(errno));
+		return;
+	}
+
+	if (!perf_dump_interval)
+		return;
+
+	pthread_mutex_init(&fab->dump_lock, NULL);
+	pthread_cond_init(&fab->dump_cond, NULL);
+	ret = pthread_create(&fab->dump_thread, NULL, perf_dump_thread, fab);
+	if (ret) {
+		FI_WARN(fab->fabric_hook.hprov, FI_LOG_FABRIC,
+			"Unable to start perf dump thread: %s\n",
+			strerror(ret));
+		pthread_cond_destroy(&fab->dump_cond);
+		pthread_mutex_destroy(&fab->dump_lock);
+		return;
+	}
+	fab->dump_thread_started = true;
+}
+
+static void perf_dump_close(struct perf_fabric *fab)
+{
+	if (fab->dump_thread_started) {
+		pthread_mutex_lock(&fab->dump_lock);
+		fab->dump_stop = true;
+		pthread_cond_signal(&fab->dump_cond);
+		pthread_mutex_unlock(&fab->dump_lock);
+		pthread_join(fab->dump_thread, NULL);
+		pthread_cond_destroy(&fab->dump_cond);
+		pthread_mutex_destroy(&fab->dump_lock);
+	}
+
+	if (fab->dump_file) {
+		ofi_perfset_dump(&fab->perf_set, perf_counters_str,
+				 fab->dump_file);
+		fclose(fab->dump_file);
+	}
+}
+
 int hook_perf_destroy(struct fid *fid)
 {
 	struct perf_fabric *fab;
 
 	fab = container_of(fid, struct perf_fabric, fabric_hook);
+	perf_dump_close(fab);
 	ofi_perfset_log(&fab->perf_set, perf_counters_str);
 	ofi_perfset_close(&fab->perf_set);
 	hook_close(fid);
@@ -892,6 +967,7 @@ static int hook_perf_fabric(struct fi_fabric_attr *attr,
 	 */
 	hook_fabric_init(&fab->fabric_hook, HOOK_PERF, attr->fabric, hprov,
 			 &perf_fabric_fid_ops, &hook_perf_ctx);
+	perf_dump_open(fab);
 	*fabric = &fab->fabric_hook.fabric;
 	return 0;
 }
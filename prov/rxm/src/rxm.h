@@ -206,6 +206,7 @@ extern int rxm_passthru;
 extern int force_auto_progress;
 extern int rxm_use_write_rndv;
 extern int rxm_detect_hmem_iface;
+extern int rxm_srx_tag_hash;
 extern enum fi_wait_obj def_wait_obj, def_tcp_wait_obj;
 
 struct rxm_ep;
@@ -643,6 +644,8 @@ struct rxm_ep {
 	int			connecting_cnt;
 	struct index_map	conn_idx_map;
 	struct dlist_entry	loopback_list;
+	/* Active FI_CONNECT_PEERS requests */
+	struct dlist_entry	warmup_list;
 	union ofi_sock_ip	addr;
 
 	pthread_t		cm_thread;
@@ -696,6 +699,7 @@ struct rxm_ep {
 int rxm_start_listen(struct rxm_ep *ep);
 void rxm_stop_listen(struct rxm_ep *ep);
 void rxm_conn_progress(struct rxm_ep *ep);
+int rxm_warmup_connect(struct util_ep *util_ep, fi_addr_t addr, bool start);
 
 
 extern struct fi_provider rxm_prov;
@@ -360,6 +360,7 @@ void rxm_freeall_conns(struct rxm_ep *ep)
 
 	av = container_of(ep->util_ep.av, struct rxm_av, util_av);
 	ofi_genlock_lock(&ep->util_ep.lock);
+	rxm_warmup_cleanup(&ep->warmup_list, &ep->util_ep);
 
 	/* We can't have more connections than the current number of
 	 * possible peers.
@@ -474,6 +475,50 @@ ssize_t rxm_get_conn(struct rxm_ep *ep, fi_addr_t addr, struct rxm_conn **conn)
 	return ret;
 }
 
+/* Connect callback for FI_CONNECT_PEERS, see rxm_warmup_progress().
+ * Unlike rxm_get_conn(), this is called from progress, so must not
+ * drive progress itself.
+ */
+int rxm_warmup_connect(struct util_ep *util_ep, fi_addr_t addr, bool start)
+{
+	struct util_peer_addr **peer;
+	struct rxm_conn *conn;
+	struct rxm_ep *ep;
+	int ret;
+
+	ep = container_of(util_ep, struct rxm_ep, util_ep);
+	assert(ofi_genlock_held(&ep->util_ep.lock));
+	peer = ofi_av_addr_context(ep->util_ep.av, addr);
+	conn = ofi_idm_lookup(&ep->conn_idx_map, (*peer)->index);
+	if (conn) {
+		switch (conn->state) {
+		case RXM_CM_CONNECTED:
+			return 0;
+		case RXM_CM_CONNECTING:
+		case RXM_CM_ACCEPTING:
+			return -FI_EAGAIN;
+		default:
+			break;
+		}
+	}
+
+	if (!start)
+		return -FI_ENOTCONN;
+
+	if ((*peer)->firewall_addr)
+		return -FI_EHOSTUNREACH;
+
+	if (!conn) {
+		conn = rxm_add_conn(ep, *peer);
+		if (!conn)
+			return -FI_ENOMEM;
+	}
+
+	/* A peer that refuses may not be listening yet, retry it */
+	ret = rxm_connect(conn);
+	return ret == -FI_ECONNREFUSED ? -FI_ENOTCONN : ret;
+}
+
 static void rxm_set_peer_flow_ctrl(struct rxm_conn *conn, int cm_flow_ctrl_flag)
 {
 	switch (cm_flow_ctrl_flag) {
@@ -911,11 +956,14 @@ static void *rxm_cm_progress(void *arg)
 	struct rxm_eq_cm_entry cm_entry;
 	uint32_t event;
 	ssize_t ret;
+	int timeout;
 
 	FI_INFO(&rxm_prov, FI_LOG_EP_CTRL, "Starting auto-progress thread\n");
 
 	ofi_genlock_lock(&ep->util_ep.lock);
 	while (ep->do_progress) {
+		/* Wake up to retry connections being warmed up */
+		timeout = dlist_empty(&ep->warmup_list) ? -1 : RXM_WARMUP_RETRY;
 		ofi_genlock_unlock(&ep->util_ep.lock);
 
 		/* We must retrieve any event after we acquire the ep lock.
@@ -929,7 +977,7 @@ static void *rxm_cm_progress(void *arg)
 		 * avoids processing the stale event.
 		 */
 		ret = fi_eq_sread(ep->msg_eq, &event, &cm_entry,
-				  sizeof(cm_entry), -1, FI_PEEK);
+				  sizeof(cm_entry), timeout, FI_PEEK);
 
 		ofi_genlock_lock(&ep->util_ep.lock);
 		if (ret > 0) {
@@ -944,6 +992,10 @@ static void *rxm_cm_progress(void *arg)
 			RXM_WARN_ERR(FI_LOG_EP_CTRL, "fi_eq_read", ret);
 			break;
 		}
+
+		if (!dlist_empty(&ep->warmup_list))
+			rxm_warmup_progress(&ep->warmup_list,
+					    rxm_warmup_connect);
 	}
 	ofi_genlock_unlock(&ep->util_ep.lock);
 
@@ -963,7 +1015,7 @@ static void *rxm_cm_atomic_progress(void *arg)
 		{.events = POLLIN},
 		{.events = POLLIN},
 	};
-	int ret;
+	int ret, timeout;
 
 	fabric = container_of(ep->util_ep.domain->fabric,
 			      struct rxm_fabric, util_fabric);
@@ -982,11 +1034,12 @@ static void *rxm_cm_atomic_progress(void *arg)
 	FI_INFO(&rxm_prov, FI_LOG_EP_CTRL, "Starting auto-progress thread\n");
 	ofi_genlock_lock(&ep->util_ep.lock);
 	while (ep->do_progress) {
+		timeout = dlist_empty(&ep->warmup_list) ? -1 : RXM_WARMUP_RETRY;
 		ofi_genlock_unlock(&ep->util_ep.lock);
 		ret = fi_trywait(fabric->msg_fabric, fids, 2);
 
 		if (!ret) {
-			ret = poll(fds, 2, -1);
+			ret = poll(fds, 2, timeout);
 			if (ret == -1) {
 				RXM_WARN_ERR(FI_LOG_EP_CTRL, "poll", -errno);
 			}
@@ -218,6 +218,24 @@ rxm_cq_write_tx_comp(struct rxm_ep *rxm_ep, uint64_t comp_flags,
 	}
 }
 
+/* Sends posted by the collective provider complete through its peer ops */
+static void
+rxm_cq_write_send_comp(struct rxm_ep *rxm_ep, uint64_t comp_flags,
+		       void *app_context, uint64_t flags, uint64_t tag)
+{
+	if (rxm_ep->util_coll_ep && (tag & RXM_PEER_XFER_TAG_FLAG)) {
+		struct fi_cq_tagged_entry cqe = {
+			.tag = tag,
+			.op_context = app_context,
+		};
+		rxm_ep->util_coll_peer_xfer_ops->
+			complete(rxm_ep->util_coll_ep, &cqe, 0);
+		return;
+	}
+
+	rxm_cq_write_tx_comp(rxm_ep, comp_flags, app_context, flags);
+}
+
 static void rxm_finish_rma(struct rxm_ep *rxm_ep, struct rxm_tx_buf *rma_buf,
 			  uint64_t comp_flags)
 {
@@ -276,16 +294,17 @@ static void rxm_handle_sar_comp(struct rxm_ep *rxm_ep,
 				struct rxm_tx_buf *tx_buf)
 {
 	void *app_context;
-	uint64_t comp_flags, tx_flags;
+	uint64_t comp_flags, tx_flags, tag;
 
 	app_context = tx_buf->app_context;
 	comp_flags = ofi_tx_cq_flags(tx_buf->pkt.hdr.op);
 	tx_flags = tx_buf->flags;
+	tag = tx_buf->pkt.hdr.tag;
 
 	if (!rxm_complete_sar(rxm_ep, tx_buf))
 		return;
 
-	rxm_cq_write_tx_comp(rxm_ep, comp_flags, app_context, tx_flags);
+	rxm_cq_write_send_comp(rxm_ep, comp_flags, app_context, tx_flags, tag);
 	ofi_ep_peer_tx_cntr_inc(&rxm_ep->util_ep, ofi_op_msg);
 }
 
@@ -316,8 +335,9 @@ static void rxm_rndv_tx_finish(struct rxm_ep *rxm_ep,
 	if (!rxm_ep->rdm_mr_local)
 		rxm_msg_mr_closev(tx_buf->rma.mr, tx_buf->rma.count);
 
-	rxm_cq_write_tx_comp(rxm_ep, ofi_tx_cq_flags(tx_buf->pkt.hdr.op),
-			     tx_buf->app_context, tx_buf->flags);
+	rxm_cq_write_send_comp(rxm_ep, ofi_tx_cq_flags(tx_buf->pkt.hdr.op),
+			       tx_buf->app_context, tx_buf->flags,
+			       tx_buf->pkt.hdr.tag);
 
 	if (rxm_ep->rndv_ops == &rxm_rndv_ops_write &&
 	    tx_buf->write_rndv.done_buf) {
@@ -1900,6 +1920,9 @@ void rxm_ep_do_progress(struct util_ep *util_ep)
 			rxm_ep_progress_deferred_queue(rxm_ep, rxm_conn);
 		}
 	}
+
+	if (!dlist_empty(&rxm_ep->warmup_list))
+		rxm_warmup_progress(&rxm_ep->warmup_list, rxm_warmup_connect);
 }
 
 void rxm_ep_progress(struct util_ep *util_ep)
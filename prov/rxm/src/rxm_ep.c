@@ -1328,6 +1328,22 @@ static void rxm_update(struct util_srx_ctx *srx, struct util_rx_entry *rx_entry)
 	//no update needed
 }
 
+static int rxm_ep_connect_peers(struct rxm_ep *ep,
+				struct fi_connect_peers *attr)
+{
+	int ret;
+
+	if (!ep->msg_cq)
+		return -FI_EOPBADSTATE;
+
+	ofi_genlock_lock(&ep->util_ep.lock);
+	ret = rxm_warmup_start(&ep->util_ep, &ep->warmup_list, attr);
+	if (!ret)
+		rxm_warmup_progress(&ep->warmup_list, rxm_warmup_connect);
+	ofi_genlock_unlock(&ep->util_ep.lock);
+	return ret;
+}
+
 static int rxm_ep_ctrl(struct fid *fid, int command, void *arg)
 {
 	struct rxm_ep *ep;
@@ -1380,6 +1396,16 @@ static int rxm_ep_ctrl(struct fid *fid, int command, void *arg)
 			if (ret)
 				return ret;
 
+			if (rxm_srx_tag_hash >= 0) {
+				ret = util_srx_set_match(srx, rxm_srx_tag_hash ?
+							 UTIL_SRX_MATCH_HASH :
+							 UTIL_SRX_MATCH_LIST);
+				if (ret) {
+					(void) util_srx_close(&srx->fid);
+					return ret;
+				}
+			}
+
 			ep->srx = container_of(srx, struct fid_peer_srx,
 					       ep_fid.fid);
 			ep->srx->peer_ops = &rxm_srx_peer_ops;
@@ -1405,6 +1431,8 @@ static int rxm_ep_ctrl(struct fid *fid, int command, void *arg)
 			goto err;
 
 		break;
+	case FI_CONNECT_PEERS:
+		return rxm_ep_connect_peers(ep, arg);
 	default:
 		return -FI_ENOSYS;
 	}
@@ -1781,6 +1809,7 @@ int rxm_endpoint(struct fid_domain *domain, struct fi_info *info,
 		(*ep_fid)->atomic = &rxm_ops_atomic;
 
 	dlist_init(&rxm_ep->loopback_list);
+	dlist_init(&rxm_ep->warmup_list);
 
 	return 0;
 err2:
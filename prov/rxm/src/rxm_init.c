@@ -59,6 +59,7 @@ int rxm_passthru = 0; /* disable by default, need to analyze performance */
 int force_auto_progress;
 int rxm_use_write_rndv;
 int rxm_detect_hmem_iface;
+int rxm_srx_tag_hash = -1;
 enum fi_wait_obj def_wait_obj = FI_WAIT_FD, def_tcp_wait_obj = FI_WAIT_UNSPEC;
 
 char *rxm_proto_state_str[] = {
@@ -698,6 +699,12 @@ RXM_INI
 			"to the tcp provider, depending on the capabilities "
 			"requested by the application.");
 
+	fi_param_define(&rxm_prov, "srx_tag_hash", FI_PARAM_BOOL,
+			"Match tagged receives in the receive contexts "
+			"created by rxm through hash tables keyed by tag and "
+			"source instead of walking the receive queues.  "
+			"(default: FI_SRX_TAG_HASH)");
+
 	fi_param_define(&rxm_prov, "detect_hmem_iface", FI_PARAM_BOOL,
 			"Detect iface for user buffers with NULL desc passed "
 			"in. This allows such buffers be copied or registered "
@@ -729,6 +736,7 @@ RXM_INI
 			"level would be set to FI_THREAD_SAFE\n");
 
 	fi_param_get_bool(&rxm_prov, "detect_hmem_iface", &rxm_detect_hmem_iface);
+	fi_param_get_bool(&rxm_prov, "srx_tag_hash", &rxm_srx_tag_hash);
 
 #if HAVE_RXM_DL
 	ofi_mem_init();
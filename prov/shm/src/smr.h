@@ -78,11 +78,19 @@ struct smr_env {
 	int use_dsa_sar;
 	size_t max_gdrcopy_size;
 	int use_xpmem;
+	size_t max_peers;
+	size_t copy_threads;
+	char *copy_thread_affinity;
+	size_t iov_threshold;
+	int calibrate;
+	char *calibration_file;
+	int adapt_proto;
 };
 
 extern struct smr_env smr_env;
 extern struct fi_provider smr_prov;
 extern struct fi_info smr_info;
+extern struct fi_info smr_hmem_info;
 extern struct util_prov smr_util_prov;
 extern int smr_global_ep_idx; //protected by the ep_list_lock
 
@@ -125,6 +133,7 @@ struct smr_tx_entry {
 	void		*map_ptr;
 	struct smr_ep_name *map_name;
 	struct ofi_mr	*mr[SMR_IOV_LIMIT];
+	uint64_t	start;
 };
 
 struct smr_pend_entry {
@@ -173,6 +182,16 @@ struct smr_domain {
 #define smr_fast_rma_enabled(mode, order) ((mode & FI_MR_VIRT_ADDR) && \
 			!(order & SMR_RMA_ORDER))
 
+/* SAR buffers are shared by all peers, but each one is allowed at least one
+ * so that no peer is starved when there are more peers than buffers.
+ */
+static inline uint32_t smr_sar_buf_per_peer(int num_peers)
+{
+	if (num_peers <= 0)
+		return SMR_BUF_BATCH_MAX;
+	return MAX(SMR_SAR_BUF_CNT / num_peers, 1);
+}
+
 static inline uint64_t smr_get_offset(void *base, void *addr)
 {
 	return (uintptr_t) ((char *) addr - (char *) base);
@@ -207,7 +226,7 @@ struct smr_sock_info {
 	pthread_t		listener_thread;
 	int			*my_fds;
 	int			nfds;
-	struct smr_cmap_entry	peers[SMR_MAX_PEERS];
+	struct smr_cmap_entry	*peers;
 };
 
 struct smr_unexp_buf {
@@ -215,6 +234,65 @@ struct smr_unexp_buf {
 	char buf[SMR_SAR_SIZE];
 };
 
+/* Completions gathered during a progress pass and written to the CQ in
+ * a single call.  Protected by the endpoint lock.
+ */
+#define SMR_COMP_BATCH		32
+
+struct smr_comp_batch {
+	size_t			count;
+	struct fi_cq_tagged_entry comp[SMR_COMP_BATCH];
+	fi_addr_t		src[SMR_COMP_BATCH];
+};
+
+/*
+ * Asynchronous copy engine for SAR transfers of host memory.  A copy is
+ * started with the SAR status set to SMR_STATUS_BUSY, and progress updates
+ * the entry and releases the SAR buffers to the peer once it completes.
+ */
+struct smr_ep;
+
+struct smr_copy_engine {
+	size_t	(*copy_to_sar)(struct smr_ep *ep,
+			       struct smr_freestack *sar_pool,
+			       struct smr_resp *resp, struct smr_cmd *cmd,
+			       const struct iovec *iov, size_t count,
+			       size_t *bytes_done, void *entry_ptr);
+	size_t	(*copy_from_sar)(struct smr_ep *ep,
+				 struct smr_freestack *sar_pool,
+				 struct smr_resp *resp, struct smr_cmd *cmd,
+				 const struct iovec *iov, size_t count,
+				 size_t *bytes_done, void *entry_ptr);
+	void	(*progress)(struct smr_ep *ep);
+	void	(*context_cleanup)(struct smr_ep *ep);
+};
+
+/*
+ * Per endpoint choice between SAR and CMA/XPMEM (iov) for host memory.
+ * Messages larger than iov_threshold use iov.  With online adjustment,
+ * every SMR_PROTO_PROBE_INTERVAL message within a factor of two of the
+ * threshold is sent with the other protocol, and the threshold moves by a
+ * factor of two when the other protocol turns out to be faster on either
+ * side of it.
+ */
+#define SMR_PROTO_PROBE_INTERVAL	16
+#define SMR_PROTO_MIN_SAMPLES		8
+#define SMR_PROTO_MAX_IOV_THRESHOLD	(4 * 1024 * 1024)
+
+struct smr_proto_sample {
+	uint64_t	ns;
+	uint64_t	bytes;
+	uint32_t	cnt;
+};
+
+struct smr_proto_tuner {
+	size_t			iov_threshold;
+	bool			adapt;
+	uint32_t		probe_cnt;
+	/* [below/above the threshold][sar/iov] */
+	struct smr_proto_sample	samples[2][2];
+};
+
 struct smr_ep {
 	struct util_ep		util_ep;
 	size_t			tx_size;
@@ -237,7 +315,13 @@ struct smr_ep {
 	enum ofi_shm_p2p_type	p2p_type;
 	struct smr_sock_info	*sock_info;
 	void			*dsa_context;
+	void			*cpu_copy_context;
+	const struct smr_copy_engine *copy_engine;
+	struct smr_proto_tuner	proto_tuner;
 	void 			(*smr_progress_ipc_list)(struct smr_ep *ep);
+
+	struct smr_comp_batch	tx_comps;
+	struct smr_comp_batch	rx_comps;
 };
 
 #define smr_ep_rx_flags(smr_ep) ((smr_ep)->util_ep.rx_op_flags)
@@ -277,7 +361,34 @@ size_t smr_copy_from_sar(struct smr_freestack *sar_pool, struct smr_resp *resp,
 			 size_t *bytes_done);
 int smr_select_proto(void **desc, size_t iov_count, bool cma_avail,
 		     bool ipc_valid, uint32_t op, uint64_t total_len,
-		     uint64_t op_flags);
+		     uint64_t op_flags, size_t iov_threshold);
+void smr_proto_tuner_init(struct smr_ep *ep);
+void smr_proto_record(struct smr_ep *ep, struct smr_tx_entry *pending);
+
+/* Smaller messages are always injected, and larger ones would skip CMA
+ * for the mmap protocol
+ */
+static inline size_t smr_max_iov_threshold(void)
+{
+	return MAX(MIN(smr_env.sar_threshold, SMR_PROTO_MAX_IOV_THRESHOLD),
+		   SMR_INJECT_SIZE);
+}
+
+static inline size_t smr_iov_threshold(struct smr_ep *ep, size_t len)
+{
+	struct smr_proto_tuner *tuner = &ep->proto_tuner;
+	size_t thresh = tuner->iov_threshold;
+
+	if (!tuner->adapt || len <= MAX(thresh / 2, SMR_INJECT_SIZE) ||
+	    len > thresh * 2)
+		return thresh;
+
+	if (++tuner->probe_cnt % SMR_PROTO_PROBE_INTERVAL)
+		return thresh;
+
+	/* Probe with the protocol the threshold would not pick */
+	return len > thresh ? SIZE_MAX : 0;
+}
 typedef ssize_t (*smr_proto_func)(struct smr_ep *ep, struct smr_region *peer_smr,
 		int64_t id, int64_t peer_id, uint32_t op, uint64_t tag,
 		uint64_t data, uint64_t op_flags, struct ofi_mr **desc,
@@ -292,6 +403,12 @@ int smr_complete_tx(struct smr_ep *ep, void *context, uint32_t op,
 int smr_complete_rx(struct smr_ep *ep, void *context, uint32_t op,
 		    uint64_t flags, size_t len, void *buf, int64_t id,
 		    uint64_t tag, uint64_t data);
+int smr_queue_tx_comp(struct smr_ep *ep, void *context, uint32_t op,
+		      uint64_t flags);
+int smr_queue_rx_comp(struct smr_ep *ep, void *context, uint32_t op,
+		      uint64_t flags, size_t len, void *buf, int64_t id,
+		      uint64_t tag, uint64_t data);
+int smr_flush_comps(struct smr_ep *ep);
 
 static inline uint64_t smr_rx_cq_flags(uint64_t rx_flags, uint16_t op_flags)
 {
@@ -316,7 +433,7 @@ static inline bool smr_vma_enabled(struct smr_ep *ep,
 static inline void smr_set_ipc_valid(struct smr_region *region, uint64_t id)
 {
 	if (ofi_hmem_is_initialized(FI_HMEM_ZE) &&
-	    region->map->peers[id].pid_fd == -1)
+	    smr_map_peer(region->map, id)->pid_fd == -1)
 		smr_peer_data(region)[id].ipc_valid = 0;
         else
         	smr_peer_data(region)[id].ipc_valid = 1;
@@ -32,31 +32,34 @@
 
 #include "smr.h"
 
-static void smr_peer_addr_init(struct smr_addr *peer)
-{
-	memset(peer->name, 0, SMR_NAME_MAX);
-	peer->id = -1;
-}
-
 static int smr_name_compare(struct ofi_rbmap *map, void *key, void *data)
 {
 	struct smr_map *smr_map;
 
 	smr_map = container_of(map, struct smr_map, rbmap);
 
-	return strncmp(smr_map->peers[(uintptr_t) data].peer.name,
+	return strncmp(smr_map_peer(smr_map, (uintptr_t) data)->peer.name,
 		       (char *) key, SMR_NAME_MAX);
 }
 
 static int smr_map_init(const struct fi_provider *prov, struct smr_map *map,
-		 int peer_count, uint16_t flags)
+		 size_t peer_count, uint16_t flags)
 {
-	int i;
-
-	for (i = 0; i < peer_count; i++) {
-		smr_peer_addr_init(&map->peers[i].peer);
-		map->peers[i].fiaddr = FI_ADDR_NOTAVAIL;
+	peer_count = ofi_get_aligned_size(peer_count, SMR_PEER_CHUNK_SIZE);
+	if (peer_count > INT_MAX) {
+		FI_WARN(prov, FI_LOG_AV, "peer count %zu too large\n",
+			peer_count);
+		return -FI_EINVAL;
 	}
+
+	/* Only the chunk array is allocated up front */
+	map->peers = calloc(peer_count >> SMR_PEER_CHUNK_SHIFT,
+			    sizeof(*map->peers));
+	if (!map->peers)
+		return -FI_ENOMEM;
+
+	map->max_peers = (int) peer_count;
+	ofi_atomic_initialize64(&map->size, 0);
 	map->flags = flags;
 
 	ofi_rbmap_init(&map->rbmap, smr_name_compare);
@@ -67,15 +70,20 @@ static int smr_map_init(const struct fi_provider *prov, struct smr_map *map,
 
 static void smr_map_cleanup(struct smr_map *map)
 {
-	int64_t i;
+	int64_t i, size = smr_map_size(map);
 
-	for (i = 0; i < SMR_MAX_PEERS; i++) {
-		if (map->peers[i].peer.id < 0)
+	for (i = 0; i < size; i++) {
+		if (smr_map_peer(map, i)->peer.id < 0)
 			continue;
 
 		smr_map_del(map, i);
 	}
 	ofi_rbmap_cleanup(&map->rbmap);
+
+	for (i = 0; i < size; i += SMR_PEER_CHUNK_SIZE)
+		free(map->peers[i >> SMR_PEER_CHUNK_SHIFT]);
+	free(map->peers);
+	ofi_spin_destroy(&map->lock);
 }
 
 static int smr_av_close(struct fid *fid)
@@ -101,7 +109,8 @@ static fi_addr_t smr_get_addr(struct fi_peer_rx_entry *rx_entry)
 {
 	struct smr_cmd_ctx *cmd_ctx = rx_entry->peer_context;
 
-	return cmd_ctx->ep->region->map->peers[cmd_ctx->cmd.msg.hdr.id].fiaddr;
+	return smr_map_peer(cmd_ctx->ep->region->map,
+			    cmd_ctx->cmd.msg.hdr.id)->fiaddr;
 }
 
 
@@ -118,7 +127,7 @@ static int smr_av_insert(struct fid_av *av_fid, const void *addr, size_t count,
 	struct smr_ep *smr_ep;
 	struct dlist_entry *av_entry;
 	fi_addr_t util_addr;
-	int64_t shm_id = -1;
+	int64_t shm_id;
 	int i, ret;
 	int succ_count = 0;
 
@@ -129,7 +138,8 @@ static int smr_av_insert(struct fid_av *av_fid, const void *addr, size_t count,
 		FI_INFO(&smr_prov, FI_LOG_AV, "%s\n", (const char *) addr);
 
 		util_addr = FI_ADDR_NOTAVAIL;
-		if (smr_av->used < SMR_MAX_PEERS) {
+		shm_id = -1;
+		if (smr_av->used < smr_av->smr_map.max_peers) {
 			ret = smr_map_add(&smr_prov, &smr_av->smr_map,
 					  addr, &shm_id);
 			if (!ret) {
@@ -155,12 +165,14 @@ static int smr_av_insert(struct fid_av *av_fid, const void *addr, size_t count,
 			continue;
 		}
 
-		assert(shm_id >= 0 && shm_id < SMR_MAX_PEERS);
+		assert(shm_id >= 0 && shm_id < smr_map_size(&smr_av->smr_map));
 		if (flags & FI_AV_USER_ID) {
 			assert(fi_addr);
-			smr_av->smr_map.peers[shm_id].fiaddr = fi_addr[i];
+			smr_map_peer(&smr_av->smr_map, shm_id)->fiaddr =
+				fi_addr[i];
 		} else {
-			smr_av->smr_map.peers[shm_id].fiaddr = util_addr;
+			smr_map_peer(&smr_av->smr_map, shm_id)->fiaddr =
+				util_addr;
 		}
 		succ_count++;
 		smr_av->used++;
@@ -174,7 +186,7 @@ static int smr_av_insert(struct fid_av *av_fid, const void *addr, size_t count,
 					       av_entry);
         		smr_ep = container_of(util_ep, struct smr_ep, util_ep);
 			smr_ep->region->max_sar_buf_per_peer =
-				SMR_MAX_PEERS / smr_av->smr_map.num_peers;
+				smr_sar_buf_per_peer(smr_av->smr_map.num_peers);
 			smr_ep->srx->owner_ops->foreach_unspec_addr(smr_ep->srx,
 								&smr_get_addr);
 		}
@@ -213,13 +225,8 @@ static int smr_av_remove(struct fid_av *av_fid, fi_addr_t *fi_addr, size_t count
 		dlist_foreach(&util_av->ep_list, av_entry) {
 			util_ep = container_of(av_entry, struct util_ep, av_entry);
 			smr_ep = container_of(util_ep, struct smr_ep, util_ep);
-			if (smr_av->smr_map.num_peers > 0)
-				smr_ep->region->max_sar_buf_per_peer =
-					SMR_MAX_PEERS /
-					smr_av->smr_map.num_peers;
-			else
-				smr_ep->region->max_sar_buf_per_peer =
-					SMR_BUF_BATCH_MAX;
+			smr_ep->region->max_sar_buf_per_peer =
+				smr_sar_buf_per_peer(smr_av->smr_map.num_peers);
 		}
 		smr_av->used--;
 	}
@@ -240,7 +247,7 @@ static int smr_av_lookup(struct fid_av *av, fi_addr_t fi_addr, void *addr,
 	smr_av = container_of(util_av, struct smr_av, util_av);
 
 	id = smr_addr_lookup(util_av, fi_addr);
-	name = smr_av->smr_map.peers[id].peer.name;
+	name = smr_map_peer(&smr_av->smr_map, id)->peer.name;
 
 	strncpy((char *) addr, name, *addrlen);
 
@@ -308,13 +315,6 @@ int smr_av_open(struct fid_domain *domain, struct fi_av_attr *attr,
 	util_attr.addrlen = sizeof(int64_t);
 	util_attr.context_len = 0;
 	util_attr.flags = 0;
-	if (attr->count > SMR_MAX_PEERS) {
-		FI_INFO(&smr_prov, FI_LOG_AV,
-			"count %d exceeds max peers\n", (int) attr->count);
-		ret = -FI_ENOSYS;
-		goto out;
-	}
-
 	ret = ofi_av_init(util_domain, attr, &util_attr, &smr_av->util_av, context);
 	if (ret)
 		goto out;
@@ -324,7 +324,17 @@ int smr_av_open(struct fid_domain *domain, struct fi_av_attr *attr,
 	(*av)->fid.ops = &smr_av_fi_ops;
 	(*av)->ops = &smr_av_ops;
 
-	ret = smr_map_init(&smr_prov, &smr_av->smr_map, SMR_MAX_PEERS,
+	/* Every endpoint bound to the AV reserves shared memory for each map
+	 * entry, so the map is sized from the local peer limit rather than
+	 * from the AV count, which usually covers remote peers as well.
+	 */
+	if (attr->count > smr_env.max_peers)
+		FI_INFO(&smr_prov, FI_LOG_AV,
+			"AV count %zu exceeds the shm peer limit %zu, "
+			"increase FI_SHM_MAX_PEERS to reach more peers\n",
+			attr->count, smr_env.max_peers);
+
+	ret = smr_map_init(&smr_prov, &smr_av->smr_map, smr_env.max_peers,
 			   util_domain->info_domain_caps & FI_HMEM ?
 			   SMR_FLAG_HMEM_ENABLED : 0);
 	if (ret)
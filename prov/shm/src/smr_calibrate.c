@@ -0,0 +1,374 @@
+/*
+ * Copyright (c) Intel Corporation. All rights reserved
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Protocol selection tuning
+ *
+ * Host memory messages above the inject size are sent either with SAR,
+ * which copies through shared buffers on both sides, or with CMA, which
+ * copies once with a system call per message.  Where one starts to win
+ * over the other depends on the CPU and kernel, so the threshold between
+ * them can be calibrated at startup: memcpy and process_vm_readv on this
+ * process are timed, and the crossover of the two cost models
+ *
+ *	SAR: 2 * n * memcpy_cost
+ *	CMA: cma_fixed + n * cma_cost
+ *
+ * is used as the threshold, rounded up to a power of two.  The result can
+ * be cached in a file with one line per host, so that only the first
+ * process on each node pays for the measurement.  Endpoints can also adjust
+ * their threshold online from the completion times of their own transfers.
+ */
+
+#include "ofi_cma.h"
+#include "smr.h"
+
+#define SMR_CALIBRATE_SMALL	SMR_INJECT_SIZE
+#define SMR_CALIBRATE_LARGE	(1024 * 1024)
+#define SMR_CALIBRATE_REPS	8
+#define SMR_CALIBRATE_HOST_MAX	256
+#define SMR_CALIBRATE_LINE_MAX	(SMR_CALIBRATE_HOST_MAX + 128)
+
+struct smr_calibration {
+	uint64_t	copy_ns;
+	uint64_t	cma_small_ns;
+	uint64_t	cma_large_ns;
+	size_t		iov_threshold;
+};
+
+static pthread_once_t smr_calibrate_once = PTHREAD_ONCE_INIT;
+static size_t smr_cma_threshold;
+
+static uint64_t smr_time_memcpy(void *dst, const void *src, size_t len)
+{
+	uint64_t start, ns, min_ns = UINT64_MAX;
+	int i;
+
+	for (i = 0; i < SMR_CALIBRATE_REPS; i++) {
+		start = ofi_gettime_ns();
+		memcpy(dst, src, len);
+		ns = ofi_gettime_ns() - start;
+		min_ns = MIN(min_ns, ns);
+	}
+	return MAX(min_ns, 1);
+}
+
+static int smr_time_cma(void *dst, void *src, size_t len, uint64_t *min_ns)
+{
+	struct iovec local = { .iov_base = dst, .iov_len = len };
+	struct iovec remote = { .iov_base = src, .iov_len = len };
+	uint64_t start, ns;
+	ssize_t ret;
+	int i;
+
+	*min_ns = UINT64_MAX;
+	for (i = 0; i < SMR_CALIBRATE_REPS; i++) {
+		start = ofi_gettime_ns();
+		ret = ofi_process_vm_readv(getpid(), &local, 1, &remote, 1, 0);
+		ns = ofi_gettime_ns() - start;
+		if (ret != (ssize_t) len)
+			return ret < 0 ? -errno : -FI_EIO;
+		*min_ns = MIN(*min_ns, ns);
+	}
+	return 0;
+}
+
+static size_t smr_calibration_threshold(struct smr_calibration *cal)
+{
+	double copy_cost, cma_cost, cma_fixed, thresh;
+
+	copy_cost = (double) cal->copy_ns / SMR_CALIBRATE_LARGE;
+	cma_cost = (double) (cal->cma_large_ns - MIN(cal->cma_small_ns,
+						      cal->cma_large_ns)) /
+		   (SMR_CALIBRATE_LARGE - SMR_CALIBRATE_SMALL);
+	cma_fixed = cal->cma_small_ns - SMR_CALIBRATE_SMALL * cma_cost;
+	if (cma_fixed < 0)
+		cma_fixed = 0;
+
+	if (2 * copy_cost <= cma_cost)
+		return SMR_PROTO_MAX_IOV_THRESHOLD;
+
+	thresh = cma_fixed / (2 * copy_cost - cma_cost);
+	if (thresh >= SMR_PROTO_MAX_IOV_THRESHOLD)
+		return SMR_PROTO_MAX_IOV_THRESHOLD;
+	if (thresh <= SMR_INJECT_SIZE)
+		return SMR_INJECT_SIZE;
+	return roundup_power_of_two((uint64_t) thresh);
+}
+
+static int smr_calibration_measure(struct smr_calibration *cal)
+{
+	uint8_t *src, *dst;
+	int ret;
+
+	src = malloc(SMR_CALIBRATE_LARGE);
+	dst = malloc(SMR_CALIBRATE_LARGE);
+	if (!src || !dst) {
+		ret = -FI_ENOMEM;
+		goto out;
+	}
+
+	/* Fault in both buffers so that neither method pays for it */
+	memset(src, 0xa5, SMR_CALIBRATE_LARGE);
+	memset(dst, 0, SMR_CALIBRATE_LARGE);
+
+	cal->copy_ns = smr_time_memcpy(dst, src, SMR_CALIBRATE_LARGE);
+	ret = smr_time_cma(dst, src, SMR_CALIBRATE_SMALL, &cal->cma_small_ns);
+	if (ret)
+		goto out;
+	ret = smr_time_cma(dst, src, SMR_CALIBRATE_LARGE, &cal->cma_large_ns);
+	if (ret)
+		goto out;
+
+	cal->iov_threshold = smr_calibration_threshold(cal);
+out:
+	free(src);
+	free(dst);
+	return ret;
+}
+
+/* The same bounds as an explicit FI_SHM_IOV_THRESHOLD.  The cost model
+ * does not know the SAR threshold, and the file may have been edited.
+ */
+static size_t smr_calibration_clamp(size_t thresh)
+{
+	size_t max_iov = smr_max_iov_threshold();
+
+	if (thresh >= SMR_INJECT_SIZE && thresh <= max_iov)
+		return thresh;
+
+	FI_WARN(&smr_prov, FI_LOG_CORE,
+		"calibrated iov threshold %zu is outside %d to %zu\n",
+		thresh, SMR_INJECT_SIZE, max_iov);
+	return MIN(MAX(thresh, SMR_INJECT_SIZE), max_iov);
+}
+
+/* Each host has one line in the file:
+ *	host=<name> iov_threshold=<size> memcpy_1m_ns=<ns> cma_4k_ns=<ns> ...
+ * Only the threshold is read back, the timings are kept for reference.
+ */
+static int smr_calibration_load(const char *path, const char *host,
+				size_t *iov_threshold)
+{
+	char line[SMR_CALIBRATE_LINE_MAX];
+	char file_host[SMR_CALIBRATE_HOST_MAX];
+	size_t thresh;
+	int ret = -FI_ENODATA;
+	FILE *file;
+
+	file = fopen(path, "r");
+	if (!file)
+		return -errno;
+
+	while (fgets(line, sizeof(line), file)) {
+		if (sscanf(line, "host=%255s iov_threshold=%zu", file_host,
+			   &thresh) == 2 && !strcmp(file_host, host)) {
+			*iov_threshold = smr_calibration_clamp(thresh);
+			ret = 0;
+		}
+	}
+	fclose(file);
+	return ret;
+}
+
+static void smr_calibration_save(const char *path, const char *host,
+				 struct smr_calibration *cal)
+{
+	char line[SMR_CALIBRATE_LINE_MAX];
+	char file_host[SMR_CALIBRATE_HOST_MAX];
+	char tmp_path[PATH_MAX];
+	FILE *file, *old_file;
+	int ret;
+
+	/* Write to a private file first, readers only see complete files */
+	ret = snprintf(tmp_path, sizeof(tmp_path), "%s.%d", path, getpid());
+	if (ret < 0 || ret >= (int) sizeof(tmp_path))
+		return;
+
+	file = fopen(tmp_path, "w");
+	if (!file)
+		goto err;
+
+	ret = fprintf(file, "# libfabric shm protocol calibration\n");
+
+	/* Keep the lines of other hosts.  If two hosts save at the same
+	 * time, one of them loses its line and measures again next time.
+	 */
+	old_file = fopen(path, "r");
+	if (old_file) {
+		while (ret >= 0 && fgets(line, sizeof(line), old_file)) {
+			if (sscanf(line, "host=%255s", file_host) == 1 &&
+			    strcmp(file_host, host))
+				ret = fputs(line, file);
+		}
+		fclose(old_file);
+	}
+
+	if (ret >= 0)
+		ret = fprintf(file, "host=%s iov_threshold=%zu "
+			      "memcpy_1m_ns=%" PRIu64 " cma_4k_ns=%" PRIu64
+			      " cma_1m_ns=%" PRIu64 "\n", host,
+			      cal->iov_threshold, cal->copy_ns,
+			      cal->cma_small_ns, cal->cma_large_ns);
+	if (fclose(file) || ret < 0 || rename(tmp_path, path)) {
+		unlink(tmp_path);
+		goto err;
+	}
+	return;
+err:
+	FI_WARN(&smr_prov, FI_LOG_CORE,
+		"unable to save calibration to %s (%s)\n", path,
+		strerror(errno));
+}
+
+static void smr_calibrate(void)
+{
+	struct smr_calibration cal;
+	char host[SMR_CALIBRATE_HOST_MAX];
+	int ret;
+
+	smr_cma_threshold = smr_env.iov_threshold;
+
+	if (gethostname(host, sizeof(host)))
+		strcpy(host, "localhost");
+	host[sizeof(host) - 1] = '\0';
+
+	if (smr_env.calibration_file &&
+	    !smr_calibration_load(smr_env.calibration_file, host,
+				  &smr_cma_threshold)) {
+		FI_INFO(&smr_prov, FI_LOG_CORE,
+			"using iov threshold %zu from %s\n",
+			smr_cma_threshold, smr_env.calibration_file);
+		return;
+	}
+
+	ret = smr_calibration_measure(&cal);
+	if (ret) {
+		FI_WARN(&smr_prov, FI_LOG_CORE,
+			"calibration failed (%s), using iov threshold %zu\n",
+			fi_strerror(-ret), smr_cma_threshold);
+		return;
+	}
+
+	cal.iov_threshold = smr_calibration_clamp(cal.iov_threshold);
+	smr_cma_threshold = cal.iov_threshold;
+	FI_INFO(&smr_prov, FI_LOG_CORE,
+		"calibrated iov threshold %zu (memcpy 1M %" PRIu64 " ns, "
+		"CMA 4K %" PRIu64 " ns, 1M %" PRIu64 " ns), set "
+		"FI_SHM_IOV_THRESHOLD to reproduce\n", smr_cma_threshold,
+		cal.copy_ns, cal.cma_small_ns, cal.cma_large_ns);
+
+	if (smr_env.calibration_file)
+		smr_calibration_save(smr_env.calibration_file, host, &cal);
+}
+
+void smr_proto_tuner_init(struct smr_ep *ep)
+{
+	struct smr_proto_tuner *tuner = &ep->proto_tuner;
+
+	memset(tuner, 0, sizeof(*tuner));
+	tuner->iov_threshold = smr_env.iov_threshold;
+	tuner->adapt = smr_env.adapt_proto;
+
+	/* The calibration times CMA, XPMEM keeps the configured value */
+	if (smr_env.calibrate && ep->p2p_type == FI_SHM_P2P_CMA) {
+		pthread_once(&smr_calibrate_once, smr_calibrate);
+		tuner->iov_threshold = smr_cma_threshold;
+	}
+}
+
+static void smr_proto_adjust(struct smr_proto_tuner *tuner, int side)
+{
+	struct smr_proto_sample *sar = &tuner->samples[side][0];
+	struct smr_proto_sample *iov = &tuner->samples[side][1];
+	size_t thresh = tuner->iov_threshold;
+	uint64_t sar_cost, iov_cost;
+
+	if (sar->cnt < SMR_PROTO_MIN_SAMPLES ||
+	    iov->cnt < SMR_PROTO_MIN_SAMPLES)
+		return;
+
+	/* Time per byte of each protocol, compared without dividing.  The
+	 * other protocol has to be at least 1/8 faster to move the threshold.
+	 */
+	sar_cost = sar->ns * iov->bytes;
+	iov_cost = iov->ns * sar->bytes;
+	if (side && sar_cost / 7 * 8 < iov_cost &&
+	    thresh < SMR_PROTO_MAX_IOV_THRESHOLD) {
+		tuner->iov_threshold = thresh * 2;
+	} else if (!side && iov_cost / 7 * 8 < sar_cost &&
+		   thresh / 2 >= SMR_INJECT_SIZE) {
+		tuner->iov_threshold = thresh / 2;
+	} else {
+		memset(sar, 0, sizeof(*sar));
+		memset(iov, 0, sizeof(*iov));
+		return;
+	}
+
+	FI_INFO(&smr_prov, FI_LOG_EP_DATA, "iov threshold %zu -> %zu\n",
+	       thresh, tuner->iov_threshold);
+	memset(tuner->samples, 0, sizeof(tuner->samples));
+}
+
+void smr_proto_record(struct smr_ep *ep, struct smr_tx_entry *pending)
+{
+	struct smr_proto_tuner *tuner = &ep->proto_tuner;
+	struct smr_proto_sample *sample;
+	size_t len = pending->cmd.msg.hdr.size;
+	int side, proto;
+
+	if (pending->cmd.msg.hdr.op == ofi_op_read_req)
+		return;
+
+	switch (pending->cmd.msg.hdr.op_src) {
+	case smr_src_sar:
+		proto = 0;
+		break;
+	case smr_src_iov:
+		proto = 1;
+		break;
+	default:
+		return;
+	}
+
+	if (len <= tuner->iov_threshold / 2 ||
+	    len > tuner->iov_threshold * 2)
+		return;
+
+	side = len > tuner->iov_threshold;
+	sample = &tuner->samples[side][proto];
+	sample->ns += ofi_gettime_ns() - pending->start;
+	sample->bytes += len;
+	sample->cnt++;
+
+	smr_proto_adjust(tuner, side);
+}
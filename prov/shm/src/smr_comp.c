@@ -76,5 +76,100 @@ int smr_complete_rx(struct smr_ep *ep, void *context, uint32_t op,
 	flags &= ~FI_COMPLETION;
 
 	return ofi_peer_cq_write(ep->util_ep.rx_cq, context, flags, len, buf,
-				 data, tag, ep->region->map->peers[id].fiaddr);
-}
\ No newline at end of file
+				 data, tag,
+				 smr_map_peer(ep->region->map, id)->fiaddr);
+}
+
+static int smr_flush_batch(struct util_cq *cq, struct smr_comp_batch *batch)
+{
+	struct fi_cq_tagged_entry *comp;
+	ssize_t written;
+	size_t i;
+	int ret = 0, err;
+
+	if (!batch->count)
+		return 0;
+
+	written = ofi_peer_cq_write_batch(cq, batch->comp, batch->src,
+					  batch->count);
+
+	/* Give each entry the owner did not take its own write, as if it
+	 * had never been batched.
+	 */
+	for (i = written < 0 ? 0 : written; i < batch->count; i++) {
+		comp = &batch->comp[i];
+		err = ofi_peer_cq_write(cq, comp->op_context, comp->flags,
+					comp->len, comp->buf, comp->data,
+					comp->tag, batch->src[i]);
+		if (err && !ret)
+			ret = err;
+	}
+	batch->count = 0;
+	return ret;
+}
+
+static int smr_batch_comp(struct util_cq *cq, struct smr_comp_batch *batch,
+			  void *context, uint64_t flags, size_t len,
+			  void *buf, uint64_t data, uint64_t tag,
+			  fi_addr_t src)
+{
+	struct fi_cq_tagged_entry *comp;
+	int ret = 0;
+
+	if (batch->count == SMR_COMP_BATCH)
+		ret = smr_flush_batch(cq, batch);
+
+	comp = &batch->comp[batch->count];
+	comp->op_context = context;
+	comp->flags = flags;
+	comp->len = len;
+	comp->buf = buf;
+	comp->data = data;
+	comp->tag = tag;
+	batch->src[batch->count++] = src;
+	return ret;
+}
+
+/* The queue variants may only be used with the ep lock held, and the
+ * caller must call smr_flush_comps() before releasing it.  Any error
+ * completion must also be preceded by a flush to keep CQ ordering.
+ */
+int smr_queue_tx_comp(struct smr_ep *ep, void *context, uint32_t op,
+		      uint64_t flags)
+{
+	assert(ofi_genlock_held(&ep->util_ep.lock));
+	ofi_ep_peer_tx_cntr_inc(&ep->util_ep, op);
+
+	if (!(flags & FI_COMPLETION))
+		return 0;
+
+	return smr_batch_comp(ep->util_ep.tx_cq, &ep->tx_comps, context,
+			      ofi_tx_cq_flags(op), 0, NULL, 0, 0,
+			      FI_ADDR_NOTAVAIL);
+}
+
+int smr_queue_rx_comp(struct smr_ep *ep, void *context, uint32_t op,
+		      uint64_t flags, size_t len, void *buf, int64_t id,
+		      uint64_t tag, uint64_t data)
+{
+	assert(ofi_genlock_held(&ep->util_ep.lock));
+	ofi_ep_peer_rx_cntr_inc(&ep->util_ep, op);
+
+	if (!(flags & (FI_REMOTE_CQ_DATA | FI_COMPLETION)))
+		return 0;
+
+	flags &= ~FI_COMPLETION;
+
+	return smr_batch_comp(ep->util_ep.rx_cq, &ep->rx_comps, context,
+			      flags, len, buf, data, tag,
+			      smr_map_peer(ep->region->map, id)->fiaddr);
+}
+
+int smr_flush_comps(struct smr_ep *ep)
+{
+	int ret, err;
+
+	ret = smr_flush_batch(ep->util_ep.tx_cq, &ep->tx_comps);
+	err = smr_flush_batch(ep->util_ep.rx_cq, &ep->rx_comps);
+	return ret ? ret : err;
+}
@@ -0,0 +1,644 @@
+/*
+ * Copyright (c) Intel Corporation. All rights reserved
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * CPU copy engine
+ *
+ * A software implementation of the asynchronous copy interface used for
+ * DSA.  Large SAR and CMA copies are split into segments that are executed
+ * by a process wide pool of helper threads, so several cores cooperate on
+ * one message.  SAR copies complete asynchronously: the SAR status stays
+ * SMR_STATUS_BUSY until all segments are done and the endpoint progress
+ * hands the buffers to the peer, leaving the application thread free to
+ * compute.  CMA copies are synchronous, with the calling thread copying
+ * segments alongside the helpers.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ofi_cma.h"
+#include "ofi_mb.h"
+#include "smr.h"
+#include "smr_cpu_copy.h"
+
+/* A SAR copy has at most one segment per SAR buffer and iov boundary */
+#define SMR_CPU_COPY_MAX_SEGS	(SMR_BUF_BATCH_MAX + SMR_IOV_LIMIT)
+
+struct smr_cpu_copy_seg {
+	char			*dst;
+	char			*src;
+	size_t			offset;
+	size_t			len;
+};
+
+struct smr_cpu_copy_job {
+	struct dlist_entry	entry;
+	struct dlist_entry	ep_entry;
+	int			(*copy)(struct smr_cpu_copy_job *job,
+					struct smr_cpu_copy_seg *seg);
+	struct smr_cpu_copy_seg	segs[SMR_CPU_COPY_MAX_SEGS];
+	int			seg_count;
+	/* Next segment to hand out, protected by the pool lock */
+	int			next_seg;
+	/* Segments not yet completed */
+	ofi_atomic32_t		pending;
+	int			error;
+
+	/* SAR copies */
+	int			dir;
+	uint32_t		op;
+	size_t			bytes;
+	void			*entry_ptr;
+
+	/* CMA copies */
+	struct iovec		*local;
+	unsigned long		local_cnt;
+	struct iovec		*remote;
+	unsigned long		remote_cnt;
+	pid_t			pid;
+	bool			write;
+};
+
+struct smr_cpu_copy_context {
+	struct ofi_bufpool	*job_pool;
+	struct dlist_entry	active_list;
+	uint64_t		copy_type_stats[OFI_COPY_BUF_TO_IOV + 1];
+	uint64_t		cma_stats;
+};
+
+static struct {
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;
+	/* Jobs with segments that have not been handed out */
+	struct dlist_entry	queue;
+	pthread_t		*threads;
+	int			*cpus;
+	size_t			thread_cnt;
+	bool			stop;
+} smr_cpu_copy_pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+/* Requires the pool lock */
+static struct smr_cpu_copy_seg *
+smr_cpu_copy_claim(struct smr_cpu_copy_job *job)
+{
+	struct smr_cpu_copy_seg *seg;
+
+	if (job->next_seg == job->seg_count)
+		return NULL;
+
+	seg = &job->segs[job->next_seg++];
+	if (job->next_seg == job->seg_count)
+		dlist_remove(&job->entry);
+	return seg;
+}
+
+static void smr_cpu_copy_run(struct smr_cpu_copy_job *job,
+			     struct smr_cpu_copy_seg *seg)
+{
+	int ret;
+
+	ret = job->copy(job, seg);
+	if (ret)
+		job->error = ret;
+	ofi_atomic_dec32(&job->pending);
+}
+
+static void smr_cpu_copy_submit(struct smr_cpu_copy_job *job)
+{
+	job->next_seg = 0;
+	ofi_atomic_initialize32(&job->pending, job->seg_count);
+
+	pthread_mutex_lock(&smr_cpu_copy_pool.lock);
+	dlist_insert_tail(&job->entry, &smr_cpu_copy_pool.queue);
+	if (job->seg_count > 1)
+		pthread_cond_broadcast(&smr_cpu_copy_pool.cond);
+	else
+		pthread_cond_signal(&smr_cpu_copy_pool.cond);
+	pthread_mutex_unlock(&smr_cpu_copy_pool.lock);
+}
+
+static void smr_cpu_copy_set_affinity(size_t index)
+{
+	char *cpuset;
+	int ret;
+
+	/* FI_SHM_COPY_THREAD_AFFINITY holds one CPU set per helper thread,
+	 * in the same format as FI_TCP_PROGRESS_AFFINITY.
+	 */
+	if (smr_env.copy_thread_affinity && *smr_env.copy_thread_affinity) {
+		ret = ofi_affinity_entry(smr_env.copy_thread_affinity, index,
+					 &cpuset);
+		if (!ret && !cpuset)
+			return;
+	} else {
+		if (!smr_cpu_copy_pool.cpus ||
+		    smr_cpu_copy_pool.cpus[index] < 0)
+			return;
+
+		if (asprintf(&cpuset, "%d", smr_cpu_copy_pool.cpus[index]) < 0)
+			cpuset = NULL;
+	}
+
+	if (!cpuset || ofi_set_thread_affinity(cpuset))
+		FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
+			"unable to set copy thread affinity to %s\n",
+			cpuset ? cpuset : "(null)");
+	free(cpuset);
+}
+
+static void *smr_cpu_copy_thread(void *arg)
+{
+	struct smr_cpu_copy_job *job;
+	struct smr_cpu_copy_seg *seg;
+
+	smr_cpu_copy_set_affinity((uintptr_t) arg);
+
+	pthread_mutex_lock(&smr_cpu_copy_pool.lock);
+	while (!smr_cpu_copy_pool.stop) {
+		if (dlist_empty(&smr_cpu_copy_pool.queue)) {
+			pthread_cond_wait(&smr_cpu_copy_pool.cond,
+					  &smr_cpu_copy_pool.lock);
+			continue;
+		}
+
+		job = container_of(smr_cpu_copy_pool.queue.next,
+				   struct smr_cpu_copy_job, entry);
+		seg = smr_cpu_copy_claim(job);
+		pthread_mutex_unlock(&smr_cpu_copy_pool.lock);
+
+		smr_cpu_copy_run(job, seg);
+
+		pthread_mutex_lock(&smr_cpu_copy_pool.lock);
+	}
+	pthread_mutex_unlock(&smr_cpu_copy_pool.lock);
+	return NULL;
+}
+
+/*
+ * Without an explicit affinity, pin each helper to its own CPU from the
+ * process affinity mask, starting from the highest one, and avoid the CPU
+ * the calling thread runs on.  Requires the pool lock.
+ */
+static void smr_cpu_copy_pick_cpus(void)
+{
+#ifndef __APPLE__
+	cpu_set_t mask;
+	int *allowed;
+	int cpu, self, cnt = 0;
+	size_t i;
+
+	if (sched_getaffinity(0, sizeof(mask), &mask))
+		return;
+
+	allowed = calloc(CPU_SETSIZE, sizeof(*allowed));
+	smr_cpu_copy_pool.cpus = calloc(smr_cpu_copy_pool.thread_cnt,
+					sizeof(*smr_cpu_copy_pool.cpus));
+	if (!allowed || !smr_cpu_copy_pool.cpus) {
+		free(allowed);
+		free(smr_cpu_copy_pool.cpus);
+		smr_cpu_copy_pool.cpus = NULL;
+		return;
+	}
+
+	self = sched_getcpu();
+	for (cpu = CPU_SETSIZE - 1; cpu >= 0; cpu--) {
+		if (CPU_ISSET(cpu, &mask) && cpu != self)
+			allowed[cnt++] = cpu;
+	}
+
+	for (i = 0; i < smr_cpu_copy_pool.thread_cnt; i++)
+		smr_cpu_copy_pool.cpus[i] = cnt ? allowed[i % cnt] : -1;
+	free(allowed);
+#endif
+}
+
+static int smr_cpu_copy_start(void)
+{
+	size_t i;
+	int ret = 0;
+
+	pthread_mutex_lock(&smr_cpu_copy_pool.lock);
+	if (smr_cpu_copy_pool.threads)
+		goto unlock;
+
+	smr_cpu_copy_pool.threads = calloc(smr_env.copy_threads,
+					   sizeof(*smr_cpu_copy_pool.threads));
+	if (!smr_cpu_copy_pool.threads) {
+		ret = -FI_ENOMEM;
+		goto unlock;
+	}
+
+	dlist_init(&smr_cpu_copy_pool.queue);
+	smr_cpu_copy_pool.stop = false;
+	smr_cpu_copy_pool.thread_cnt = smr_env.copy_threads;
+	smr_cpu_copy_pick_cpus();
+
+	for (i = 0; i < smr_cpu_copy_pool.thread_cnt; i++) {
+		ret = pthread_create(&smr_cpu_copy_pool.threads[i], NULL,
+				     smr_cpu_copy_thread, (void *) (uintptr_t) i);
+		if (ret) {
+			FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
+				"unable to start copy thread %zu\n", i);
+			ret = -ret;
+			break;
+		}
+	}
+
+	if (!ret)
+		goto unlock;
+
+	smr_cpu_copy_pool.stop = true;
+	pthread_cond_broadcast(&smr_cpu_copy_pool.cond);
+	pthread_mutex_unlock(&smr_cpu_copy_pool.lock);
+	while (i--)
+		pthread_join(smr_cpu_copy_pool.threads[i], NULL);
+	pthread_mutex_lock(&smr_cpu_copy_pool.lock);
+
+	free(smr_cpu_copy_pool.threads);
+	free(smr_cpu_copy_pool.cpus);
+	smr_cpu_copy_pool.threads = NULL;
+	smr_cpu_copy_pool.cpus = NULL;
+	smr_cpu_copy_pool.thread_cnt = 0;
+unlock:
+	pthread_mutex_unlock(&smr_cpu_copy_pool.lock);
+	return ret;
+}
+
+void smr_cpu_copy_cleanup(void)
+{
+	size_t i;
+
+	pthread_mutex_lock(&smr_cpu_copy_pool.lock);
+	if (!smr_cpu_copy_pool.threads) {
+		pthread_mutex_unlock(&smr_cpu_copy_pool.lock);
+		return;
+	}
+	smr_cpu_copy_pool.stop = true;
+	pthread_cond_broadcast(&smr_cpu_copy_pool.cond);
+	pthread_mutex_unlock(&smr_cpu_copy_pool.lock);
+
+	for (i = 0; i < smr_cpu_copy_pool.thread_cnt; i++)
+		pthread_join(smr_cpu_copy_pool.threads[i], NULL);
+
+	free(smr_cpu_copy_pool.threads);
+	free(smr_cpu_copy_pool.cpus);
+	smr_cpu_copy_pool.threads = NULL;
+	smr_cpu_copy_pool.cpus = NULL;
+	smr_cpu_copy_pool.thread_cnt = 0;
+}
+
+int smr_cpu_copy_context_init(struct smr_ep *ep)
+{
+	struct smr_cpu_copy_context *context;
+	int ret;
+
+	ret = smr_cpu_copy_start();
+	if (ret)
+		return ret;
+
+	context = calloc(1, sizeof(*context));
+	if (!context)
+		return -FI_ENOMEM;
+
+	ret = ofi_bufpool_create(&context->job_pool,
+				 sizeof(struct smr_cpu_copy_job), 16, 0, 4,
+				 OFI_BUFPOOL_NO_TRACK);
+	if (ret) {
+		free(context);
+		return ret;
+	}
+
+	dlist_init(&context->active_list);
+	ep->cpu_copy_context = context;
+	return FI_SUCCESS;
+}
+
+void smr_cpu_copy_context_cleanup(struct smr_ep *ep)
+{
+	struct smr_cpu_copy_context *context = ep->cpu_copy_context;
+	struct smr_cpu_copy_job *job;
+
+	if (!context)
+		return;
+
+	FI_INFO(&smr_prov, FI_LOG_EP_CTRL,
+		"copy engine stats: user to SAR %" PRIu64 ", SAR to user %"
+		PRIu64 ", CMA %" PRIu64 "\n",
+		context->copy_type_stats[OFI_COPY_IOV_TO_BUF],
+		context->copy_type_stats[OFI_COPY_BUF_TO_IOV],
+		context->cma_stats);
+
+	/* Helpers may still be writing to the buffers of outstanding jobs */
+	dlist_foreach_container(&context->active_list,
+				struct smr_cpu_copy_job, job, ep_entry) {
+		while (ofi_atomic_get32(&job->pending))
+			sched_yield();
+	}
+
+	ofi_bufpool_destroy(context->job_pool);
+	free(context);
+	ep->cpu_copy_context = NULL;
+}
+
+static int smr_cpu_copy_memcpy(struct smr_cpu_copy_job *job,
+			       struct smr_cpu_copy_seg *seg)
+{
+	memcpy(seg->dst, seg->src, seg->len);
+	return FI_SUCCESS;
+}
+
+/* Split the next SAR batch into one segment per SAR buffer and iov piece */
+static void smr_cpu_copy_sar_segs(struct smr_cpu_copy_job *job,
+				  struct smr_freestack *sar_pool,
+				  struct smr_cmd *cmd, const struct iovec *iov,
+				  size_t count, size_t bytes_done)
+{
+	struct smr_sar_buf *sar_buf;
+	struct smr_cpu_copy_seg *seg;
+	size_t iov_index, iov_offset = bytes_done;
+	size_t sar_offset = 0, len;
+	int sar_index = 0;
+	char *iov_buf, *sar_ptr;
+
+	for (iov_index = 0; iov_index < count; iov_index++) {
+		if (iov_offset < iov[iov_index].iov_len)
+			break;
+		iov_offset -= iov[iov_index].iov_len;
+	}
+
+	job->seg_count = 0;
+	job->bytes = 0;
+	while (iov_index < count &&
+	       sar_index < cmd->msg.data.buf_batch_size) {
+		sar_buf = smr_freestack_get_entry_from_index(
+			sar_pool, cmd->msg.data.sar[sar_index]);
+		iov_buf = (char *) iov[iov_index].iov_base + iov_offset;
+		sar_ptr = (char *) sar_buf->buf + sar_offset;
+		len = MIN(iov[iov_index].iov_len - iov_offset,
+			  SMR_SAR_SIZE - sar_offset);
+
+		if (len) {
+			seg = &job->segs[job->seg_count++];
+			if (job->dir == OFI_COPY_BUF_TO_IOV) {
+				seg->dst = iov_buf;
+				seg->src = sar_ptr;
+			} else {
+				seg->dst = sar_ptr;
+				seg->src = iov_buf;
+			}
+			seg->len = len;
+			job->bytes += len;
+		}
+
+		iov_offset += len;
+		sar_offset += len;
+		if (iov_offset == iov[iov_index].iov_len) {
+			iov_index++;
+			iov_offset = 0;
+		}
+		if (sar_offset == SMR_SAR_SIZE) {
+			sar_index++;
+			sar_offset = 0;
+		}
+	}
+}
+
+static size_t smr_cpu_copy_sar(struct smr_ep *ep,
+			       struct smr_freestack *sar_pool,
+			       struct smr_resp *resp, struct smr_cmd *cmd,
+			       const struct iovec *iov, size_t count,
+			       size_t *bytes_done, void *entry_ptr, int dir)
+{
+	struct smr_cpu_copy_context *context = ep->cpu_copy_context;
+	struct smr_cpu_copy_job *job;
+
+	/* Small copies are not worth a trip to the helpers */
+	if (cmd->msg.hdr.size - *bytes_done < SMR_CPU_COPY_MIN_SIZE) {
+		if (dir == OFI_COPY_IOV_TO_BUF)
+			smr_copy_to_sar(sar_pool, resp, cmd, NULL, iov, count,
+					bytes_done);
+		else
+			smr_copy_from_sar(sar_pool, resp, cmd, NULL, iov,
+					  count, bytes_done);
+		return FI_SUCCESS;
+	}
+
+	job = ofi_buf_alloc(context->job_pool);
+	if (!job)
+		return -FI_ENOMEM;
+
+	job->copy = smr_cpu_copy_memcpy;
+	job->dir = dir;
+	job->op = cmd->msg.hdr.op;
+	job->entry_ptr = entry_ptr;
+	job->error = 0;
+	smr_cpu_copy_sar_segs(job, sar_pool, cmd, iov, count, *bytes_done);
+	assert(job->seg_count > 0);
+
+	resp->status = SMR_STATUS_BUSY;
+	dlist_insert_tail(&job->ep_entry, &context->active_list);
+	context->copy_type_stats[dir]++;
+	smr_cpu_copy_submit(job);
+
+	return FI_SUCCESS;
+}
+
+size_t smr_cpu_copy_to_sar(struct smr_ep *ep, struct smr_freestack *sar_pool,
+		struct smr_resp *resp, struct smr_cmd *cmd,
+		const struct iovec *iov, size_t count, size_t *bytes_done,
+		void *entry_ptr)
+{
+	if (resp->status != SMR_STATUS_SAR_EMPTY)
+		return -FI_EAGAIN;
+
+	return smr_cpu_copy_sar(ep, sar_pool, resp, cmd, iov, count,
+				bytes_done, entry_ptr, OFI_COPY_IOV_TO_BUF);
+}
+
+size_t smr_cpu_copy_from_sar(struct smr_ep *ep, struct smr_freestack *sar_pool,
+		struct smr_resp *resp, struct smr_cmd *cmd,
+		const struct iovec *iov, size_t count, size_t *bytes_done,
+		void *entry_ptr)
+{
+	if (resp->status != SMR_STATUS_SAR_FULL)
+		return -FI_EAGAIN;
+
+	return smr_cpu_copy_sar(ep, sar_pool, resp, cmd, iov, count,
+				bytes_done, entry_ptr, OFI_COPY_BUF_TO_IOV);
+}
+
+/*
+ * The side of the transfer that owns the user buffer of a read request, or
+ * sends the data of any other operation, tracks it with a tx entry.  The
+ * other side tracks it with a SAR entry.
+ */
+static void smr_cpu_copy_complete(struct smr_ep *ep,
+				  struct smr_cpu_copy_job *job)
+{
+	struct smr_tx_entry *tx_entry;
+	struct smr_pend_entry *sar_entry;
+	struct smr_region *peer_smr;
+	struct smr_resp *resp;
+
+	if ((job->op == ofi_op_read_req) ==
+	    (job->dir == OFI_COPY_BUF_TO_IOV)) {
+		tx_entry = job->entry_ptr;
+		tx_entry->bytes_done += job->bytes;
+		resp = smr_get_ptr(ep->region, tx_entry->cmd.msg.hdr.src_data);
+	} else {
+		sar_entry = job->entry_ptr;
+		sar_entry->bytes_done += job->bytes;
+		peer_smr = smr_peer_region(ep->region,
+					   sar_entry->cmd.msg.hdr.id);
+		resp = smr_get_ptr(peer_smr, sar_entry->cmd.msg.hdr.src_data);
+	}
+
+	assert(resp->status == SMR_STATUS_BUSY);
+	ofi_wmb();
+	resp->status = (job->dir == OFI_COPY_IOV_TO_BUF ?
+			SMR_STATUS_SAR_FULL : SMR_STATUS_SAR_EMPTY);
+}
+
+void smr_cpu_copy_progress(struct smr_ep *ep)
+{
+	struct smr_cpu_copy_context *context = ep->cpu_copy_context;
+	struct smr_cpu_copy_job *job;
+	struct dlist_entry *tmp;
+
+	if (dlist_empty(&context->active_list))
+		return;
+
+	ofi_genlock_lock(&ep->util_ep.lock);
+	dlist_foreach_container_safe(&context->active_list,
+				     struct smr_cpu_copy_job, job,
+				     ep_entry, tmp) {
+		if (ofi_atomic_get32(&job->pending))
+			continue;
+
+		smr_cpu_copy_complete(ep, job);
+		dlist_remove(&job->ep_entry);
+		ofi_buf_free(job);
+	}
+	ofi_genlock_unlock(&ep->util_ep.lock);
+}
+
+static int smr_cpu_copy_cma_seg(struct smr_cpu_copy_job *job,
+				struct smr_cpu_copy_seg *seg)
+{
+	struct iovec local[SMR_IOV_LIMIT], remote[SMR_IOV_LIMIT];
+	size_t local_cnt = job->local_cnt, remote_cnt = job->remote_cnt;
+
+	memcpy(local, job->local, sizeof(*local) * local_cnt);
+	memcpy(remote, job->remote, sizeof(*remote) * remote_cnt);
+
+	ofi_consume_iov(local, &local_cnt, seg->offset);
+	ofi_consume_iov(remote, &remote_cnt, seg->offset);
+	(void) ofi_truncate_iov(local, &local_cnt, seg->len);
+	(void) ofi_truncate_iov(remote, &remote_cnt, seg->len);
+
+	return cma_copy(local, local_cnt, remote, remote_cnt, seg->len,
+			job->pid, job->write, NULL);
+}
+
+/*
+ * Split a CMA copy between the calling thread and the helpers.  The caller
+ * copies segments until there are none left, then waits for the helpers.
+ */
+int smr_cpu_copy_cma(struct smr_ep *ep, struct iovec *local,
+		unsigned long local_cnt, struct iovec *remote,
+		unsigned long remote_cnt, size_t total, pid_t pid, bool write)
+{
+	struct smr_cpu_copy_context *context = ep->cpu_copy_context;
+	struct smr_cpu_copy_job job;
+	struct smr_cpu_copy_seg *seg;
+	size_t seg_size, offset;
+	int seg_count;
+
+	assert(local_cnt <= SMR_IOV_LIMIT && remote_cnt <= SMR_IOV_LIMIT);
+
+	seg_count = MIN(smr_cpu_copy_pool.thread_cnt + 1,
+			SMR_CPU_COPY_MAX_SEGS);
+	seg_size = MAX(ofi_div_ceil(total, seg_count), SMR_CPU_COPY_MIN_SIZE);
+	seg_size = ofi_get_aligned_size(seg_size, SMR_SAR_SIZE);
+	if (seg_size >= total)
+		return cma_copy(local, local_cnt, remote, remote_cnt, total,
+				pid, write, NULL);
+
+	job.copy = smr_cpu_copy_cma_seg;
+	job.local = local;
+	job.local_cnt = local_cnt;
+	job.remote = remote;
+	job.remote_cnt = remote_cnt;
+	job.pid = pid;
+	job.write = write;
+	job.error = 0;
+	job.seg_count = 0;
+	for (offset = 0; offset < total; offset += seg_size) {
+		seg = &job.segs[job.seg_count++];
+		seg->offset = offset;
+		seg->len = MIN(seg_size, total - offset);
+	}
+
+	context->cma_stats++;
+	smr_cpu_copy_submit(&job);
+
+	for (;;) {
+		pthread_mutex_lock(&smr_cpu_copy_pool.lock);
+		seg = smr_cpu_copy_claim(&job);
+		pthread_mutex_unlock(&smr_cpu_copy_pool.lock);
+		if (!seg)
+			break;
+		smr_cpu_copy_run(&job, seg);
+	}
+
+	while (ofi_atomic_get32(&job.pending))
+		sched_yield();
+
+	return job.error;
+}
+
+const struct smr_copy_engine smr_cpu_copy_engine = {
+	.copy_to_sar = smr_cpu_copy_to_sar,
+	.copy_from_sar = smr_cpu_copy_from_sar,
+	.progress = smr_cpu_copy_progress,
+	.context_cleanup = smr_cpu_copy_context_cleanup,
+};
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) Intel Corporation. All rights reserved
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _SMR_CPU_COPY_H_
+#define _SMR_CPU_COPY_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "smr.h"
+
+/* Copies smaller than this are done inline by the calling thread */
+#define SMR_CPU_COPY_MIN_SIZE	(64 * 1024)
+
+/* SMR FUNCTIONS FOR CPU COPY ENGINE SUPPORT */
+extern const struct smr_copy_engine smr_cpu_copy_engine;
+
+void smr_cpu_copy_cleanup(void);
+size_t smr_cpu_copy_to_sar(struct smr_ep *ep, struct smr_freestack *sar_pool,
+		struct smr_resp *resp, struct smr_cmd *cmd,
+		const struct iovec *iov, size_t count, size_t *bytes_done,
+		void *entry_ptr);
+size_t smr_cpu_copy_from_sar(struct smr_ep *ep, struct smr_freestack *sar_pool,
+		struct smr_resp *resp, struct smr_cmd *cmd,
+		const struct iovec *iov, size_t count, size_t *bytes_done,
+		void *entry_ptr);
+int smr_cpu_copy_cma(struct smr_ep *ep, struct iovec *local,
+		unsigned long local_cnt, struct iovec *remote,
+		unsigned long remote_cnt, size_t total, pid_t pid, bool write);
+int smr_cpu_copy_context_init(struct smr_ep *ep);
+void smr_cpu_copy_context_cleanup(struct smr_ep *ep);
+void smr_cpu_copy_progress(struct smr_ep *ep);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* _SMR_CPU_COPY_H_ */
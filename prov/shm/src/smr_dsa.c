@@ -1091,3 +1091,10 @@ void smr_dsa_context_cleanup(struct smr_ep *ep) {}
 void smr_dsa_progress(struct smr_ep *ep) {}
 
 #endif /* SHM_HAVE_DSA */
+
+const struct smr_copy_engine smr_dsa_engine = {
+	.copy_to_sar = smr_dsa_copy_to_sar,
+	.copy_from_sar = smr_dsa_copy_from_sar,
+	.progress = smr_dsa_progress,
+	.context_cleanup = smr_dsa_context_cleanup,
+};
@@ -46,6 +46,8 @@ extern "C" {
 #include "smr.h"
 
 /* SMR FUNCTIONS FOR DSA SUPPORT */
+extern const struct smr_copy_engine smr_dsa_engine;
+
 void smr_dsa_init(void);
 void smr_dsa_cleanup(void);
 size_t smr_dsa_copy_to_sar(struct smr_ep *ep, struct smr_freestack *sar_pool,
@@ -42,6 +42,7 @@
 #include "smr_signal.h"
 #include "smr.h"
 #include "smr_dsa.h"
+#include "smr_cpu_copy.h"
 #include "ofi_xpmem.h"
 
 extern struct fi_ops_msg smr_msg_ops, smr_no_recv_msg_ops;
@@ -213,14 +214,14 @@ int64_t smr_verify_peer(struct smr_ep *ep, fi_addr_t fi_addr)
 	int ret;
 
 	id = smr_addr_lookup(ep->util_ep.av, fi_addr);
-	assert(id < SMR_MAX_PEERS);
+	assert(id < smr_map_size(ep->region->map));
 	if (id < 0)
 		return -1;
 
 	if (smr_peer_data(ep->region)[id].addr.id >= 0)
 		return id;
 
-	if (!ep->region->map->peers[id].region) {
+	if (!smr_peer_region(ep->region, id)) {
 		ofi_spin_lock(&ep->region->map->lock);
 		ret = smr_map_to_region(&smr_prov, ep->region->map, id);
 		ofi_spin_unlock(&ep->region->map->lock);
@@ -519,10 +520,11 @@ static int smr_format_sar(struct smr_ep *ep, struct smr_cmd *cmd,
 		goto out;
 
 	if (cmd->msg.hdr.op != ofi_op_read_req) {
-		if (smr_env.use_dsa_sar && ofi_mr_all_host(mr, count)) {
-			ret = smr_dsa_copy_to_sar(ep, smr_sar_pool(peer_smr),
-					resp, cmd, iov,	count,
-					&pending->bytes_done, pending);
+		if (ep->copy_engine && ofi_mr_all_host(mr, count)) {
+			ret = ep->copy_engine->copy_to_sar(ep,
+					smr_sar_pool(peer_smr), resp, cmd,
+					iov, count, &pending->bytes_done,
+					pending);
 			if (ret != FI_SUCCESS) {
 				for (i = cmd->msg.data.buf_batch_size - 1;
 				     i >= 0; i--) {
@@ -544,7 +546,7 @@ out:
 
 int smr_select_proto(void **desc, size_t iov_count, bool vma_avail,
 		     bool ipc_valid, uint32_t op, uint64_t total_len,
-		     uint64_t op_flags)
+		     uint64_t op_flags, size_t iov_threshold)
 {
 	struct ofi_mr *smr_desc;
 	enum fi_hmem_iface iface = FI_HMEM_SYSTEM;
@@ -587,7 +589,7 @@ int smr_select_proto(void **desc, size_t iov_count, bool vma_avail,
 	if (use_ipc)
 		return smr_src_ipc;
 
-	if (total_len > SMR_INJECT_SIZE && vma_avail)
+	if (total_len > iov_threshold && vma_avail)
 		return smr_src_iov;
 
 	if (op_flags & FI_DELIVERY_COMPLETE)
@@ -649,6 +651,8 @@ static ssize_t smr_do_iov(struct smr_ep *ep, struct smr_region *peer_smr, int64_
 
 	resp = ofi_cirque_next(smr_resp_queue(ep->region));
 	pend = ofi_freestack_pop(ep->tx_fs);
+	if (ep->proto_tuner.adapt)
+		pend->start = ofi_gettime_ns();
 
 	smr_generic_format(cmd, peer_id, op, tag, data, op_flags);
 	smr_format_iov(cmd, iov, iov_count, total_len, ep->region, resp);
@@ -674,6 +678,8 @@ static ssize_t smr_do_sar(struct smr_ep *ep, struct smr_region *peer_smr, int64_
 
 	resp = ofi_cirque_next(smr_resp_queue(ep->region));
 	pend = ofi_freestack_pop(ep->tx_fs);
+	if (ep->proto_tuner.adapt)
+		pend->start = ofi_gettime_ns();
 
 	smr_generic_format(cmd, peer_id, op, tag, data, op_flags);
 	ret = smr_format_sar(ep, cmd, desc, iov, iov_count, total_len,
@@ -776,13 +782,14 @@ static void smr_free_sock_info(struct smr_ep *ep)
 {
 	int i, j;
 
-	for (i = 0; i < SMR_MAX_PEERS; i++) {
+	for (i = 0; ep->sock_info->peers && i < ep->region->max_peers; i++) {
 		if (!ep->sock_info->peers[i].device_fds)
 			continue;
 		for (j = 0; j < ep->sock_info->nfds; j++)
 			close(ep->sock_info->peers[i].device_fds[j]);
 		free(ep->sock_info->peers[i].device_fds);
 	}
+	free(ep->sock_info->peers);
 	free(ep->sock_info);
 	ep->sock_info = NULL;
 }
@@ -795,8 +802,8 @@ static int smr_ep_close(struct fid *fid)
 
 	ep = container_of(fid, struct smr_ep, util_ep.ep_fid.fid);
 
-	if (smr_env.use_dsa_sar)
-		smr_dsa_context_cleanup(ep);
+	if (ep->copy_engine)
+		ep->copy_engine->context_cleanup(ep);
 
 	if (ep->sock_info) {
 		fd_signal_set(&ep->sock_info->signal);
@@ -1185,6 +1192,12 @@ static int smr_ep_ctrl(struct fid *fid, int command, void *arg)
 		if (smr_env.use_dsa_sar)
 			smr_dsa_context_init(ep);
 
+		if (smr_env.use_dsa_sar)
+			ep->copy_engine = &smr_dsa_engine;
+		else if (smr_env.copy_threads &&
+			 !smr_cpu_copy_context_init(ep))
+			ep->copy_engine = &smr_cpu_copy_engine;
+
 		/* if XPMEM is on after exchanging peer info, then set the
 		 * endpoint p2p to XPMEM so it can be used on the fast
 		 * path
@@ -1192,6 +1205,8 @@ static int smr_ep_ctrl(struct fid *fid, int command, void *arg)
 		if (ep->region->xpmem_cap_self == SMR_VMA_CAP_ON)
 			ep->p2p_type = FI_SHM_P2P_XPMEM;
 
+		smr_proto_tuner_init(ep);
+
 		break;
 	default:
 		return -FI_ENOSYS;
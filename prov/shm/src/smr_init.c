@@ -36,6 +36,7 @@
 #include "smr.h"
 #include "smr_signal.h"
 #include "smr_dsa.h"
+#include "smr_cpu_copy.h"
 #include <ofi_hmem.h>
 
 struct sigaction *old_action = NULL;
@@ -46,16 +47,58 @@ struct smr_env smr_env = {
 	.use_dsa_sar = false,
 	.max_gdrcopy_size = 3072,
 	.use_xpmem = false,
+	.iov_threshold = SMR_INJECT_SIZE,
+	.calibrate = false,
+	.adapt_proto = false,
 };
 
 static void smr_init_env(void)
 {
+	long num_of_core;
+	size_t max_iov;
+
+	/* Allow one endpoint per core by default */
+	num_of_core = ofi_sysconf(_SC_NPROCESSORS_ONLN);
+	smr_env.max_peers = MAX(SMR_DEF_MAX_PEERS, num_of_core);
+	fi_param_get_size_t(&smr_prov, "max_peers", &smr_env.max_peers);
+	if (!smr_env.max_peers) {
+		FI_WARN(&smr_prov, FI_LOG_CORE,
+			"invalid max_peers, using %d\n", SMR_DEF_MAX_PEERS);
+		smr_env.max_peers = SMR_DEF_MAX_PEERS;
+	}
+	smr_info.domain_attr->ep_cnt = smr_env.max_peers;
+	smr_hmem_info.domain_attr->ep_cnt = smr_env.max_peers;
+
 	fi_param_get_size_t(&smr_prov, "sar_threshold", &smr_env.sar_threshold);
 	fi_param_get_size_t(&smr_prov, "tx_size", &smr_info.tx_attr->size);
 	fi_param_get_size_t(&smr_prov, "rx_size", &smr_info.rx_attr->size);
 	fi_param_get_bool(&smr_prov, "disable_cma", &smr_env.disable_cma);
 	fi_param_get_bool(&smr_prov, "use_dsa_sar", &smr_env.use_dsa_sar);
 	fi_param_get_bool(&smr_prov, "use_xpmem", &smr_env.use_xpmem);
+	fi_param_get_size_t(&smr_prov, "copy_threads", &smr_env.copy_threads);
+	fi_param_get_str(&smr_prov, "copy_thread_affinity",
+			 &smr_env.copy_thread_affinity);
+	fi_param_get_bool(&smr_prov, "calibrate", &smr_env.calibrate);
+	fi_param_get_str(&smr_prov, "calibration_file",
+			 &smr_env.calibration_file);
+	fi_param_get_bool(&smr_prov, "adapt_proto", &smr_env.adapt_proto);
+
+	/* An explicit threshold takes precedence over calibration */
+	if (!fi_param_get_size_t(&smr_prov, "iov_threshold",
+				 &smr_env.iov_threshold)) {
+		smr_env.calibrate = false;
+
+		max_iov = smr_max_iov_threshold();
+		if (smr_env.iov_threshold < SMR_INJECT_SIZE ||
+		    smr_env.iov_threshold > max_iov) {
+			FI_WARN(&smr_prov, FI_LOG_CORE,
+				"iov_threshold must be between %d and %zu\n",
+				SMR_INJECT_SIZE, max_iov);
+			smr_env.iov_threshold = MIN(MAX(smr_env.iov_threshold,
+							SMR_INJECT_SIZE),
+						    max_iov);
+		}
+	}
 }
 
 static void smr_resolve_addr(const char *node, const char *service,
@@ -87,7 +130,7 @@ static void smr_resolve_addr(const char *node, const char *service,
 /*
  * The smr_shm_space_check is to check if there's enough shm space we
  * need under /dev/shm.
- * Here we use #core instead of SMR_MAX_PEERS, as it is the most likely
+ * Here we use #core instead of max_peers, as it is the most likely
  * value and has less possibility of failing fi_getinfo calls that are
  * currently passing, and breaking currently working app
  */
@@ -107,6 +150,7 @@ static int smr_shm_space_check(size_t tx_count, size_t rx_count)
 	}
 	shm_size_needed = num_of_core *
 			  smr_calculate_size_offsets(tx_count, rx_count,
+						     smr_env.max_peers,
 						     NULL, NULL, NULL,
 						     NULL, NULL, NULL,
 						     NULL);
@@ -181,6 +225,7 @@ static void smr_fini(void)
 	ofi_hmem_cleanup();
 #endif
 	smr_dsa_cleanup();
+	smr_cpu_copy_cleanup();
 	smr_cleanup();
 	free(old_action);
 }
@@ -222,6 +267,35 @@ SHM_INI
 	fi_param_define(&smr_prov, "use_xpmem", FI_PARAM_BOOL,
 			"Enable XPMEM over CMA when possible "
 			"(default: false)");
+	fi_param_define(&smr_prov, "max_peers", FI_PARAM_SIZE_T,
+			"Max number of peers an endpoint can communicate "
+			"with (default: the larger of 256 and the number "
+			"of cores)");
+	fi_param_define(&smr_prov, "copy_threads", FI_PARAM_SIZE_T,
+			"Number of helper threads that copy large SAR and CMA "
+			"transfers of host memory when DSA is not used "
+			"(default: 0, copies are done by the calling thread)");
+	fi_param_define(&smr_prov, "copy_thread_affinity", FI_PARAM_STRING,
+			"CPU sets to bind copy threads to, separated by ';' "
+			"(e.g. 4;5;6-7).  Thread N uses entry N modulo the "
+			"number of entries (default: one CPU per thread, "
+			"avoiding the CPU of the endpoint)");
+	fi_param_define(&smr_prov, "iov_threshold", FI_PARAM_SIZE_T,
+			"Messages larger than this use CMA or XPMEM instead "
+			"of SAR when available, between 4096 and the smaller "
+			"of 4 MiB and sar_threshold.  Disables calibration "
+			"(default: 4096)");
+	fi_param_define(&smr_prov, "calibrate", FI_PARAM_BOOL,
+			"Time memcpy and CMA when the first endpoint is "
+			"enabled and derive the iov threshold from them "
+			"(default: false)");
+	fi_param_define(&smr_prov, "calibration_file", FI_PARAM_STRING,
+			"File to cache the calibration in, one line per "
+			"host.  It is reused by later processes on the same "
+			"host (default: none)");
+	fi_param_define(&smr_prov, "adapt_proto", FI_PARAM_BOOL,
+			"Adjust the iov threshold of each endpoint from the "
+			"completion times of its transfers (default: false)");
 
 	smr_init_env();
 
@@ -41,7 +41,7 @@
 #include "ofi_mr.h"
 #include "ofi_shm_p2p.h"
 #include "smr.h"
-#include "smr_dsa.h"
+#include "smr_cpu_copy.h"
 
 static inline void
 smr_try_progress_to_sar(struct smr_ep *ep, struct smr_region *smr,
@@ -51,9 +51,10 @@ smr_try_progress_to_sar(struct smr_ep *ep, struct smr_region *smr,
                         size_t *bytes_done, void *entry_ptr)
 {
 	if (*bytes_done < cmd->msg.hdr.size) {
-		if (smr_env.use_dsa_sar && ofi_mr_all_host(mr, iov_count)) {
-			(void) smr_dsa_copy_to_sar(ep, sar_pool, resp, cmd, iov,
-					    iov_count, bytes_done, entry_ptr);
+		if (ep->copy_engine && ofi_mr_all_host(mr, iov_count)) {
+			(void) ep->copy_engine->copy_to_sar(ep, sar_pool, resp,
+					cmd, iov, iov_count, bytes_done,
+					entry_ptr);
 			return;
 		} else {
 			smr_copy_to_sar(sar_pool, resp, cmd, mr, iov, iov_count,
@@ -70,9 +71,10 @@ smr_try_progress_from_sar(struct smr_ep *ep, struct smr_region *smr,
                           size_t *bytes_done, void *entry_ptr)
 {
 	if (*bytes_done < cmd->msg.hdr.size) {
-		if (smr_env.use_dsa_sar && ofi_mr_all_host(mr, iov_count)) {
-			(void) smr_dsa_copy_from_sar(ep, sar_pool, resp, cmd,
-					iov, iov_count, bytes_done, entry_ptr);
+		if (ep->copy_engine && ofi_mr_all_host(mr, iov_count)) {
+			(void) ep->copy_engine->copy_from_sar(ep, sar_pool,
+					resp, cmd, iov, iov_count, bytes_done,
+					entry_ptr);
 			return;
 		} else {
 			smr_copy_from_sar(sar_pool, resp, cmd, mr,
@@ -223,11 +225,14 @@ static void smr_progress_resp(struct smr_ep *ep)
 			break;
 
 		if (resp->status) {
+			smr_flush_comps(ep);
 			ret = smr_write_err_comp(ep->util_ep.tx_cq, pending->context,
 					 pending->op_flags, pending->cmd.msg.hdr.tag,
 					 resp->status);
 		} else {
-			ret = smr_complete_tx(ep, pending->context,
+			if (ep->proto_tuner.adapt)
+				smr_proto_record(ep, pending);
+			ret = smr_queue_tx_comp(ep, pending->context,
 					  pending->cmd.msg.hdr.op, pending->op_flags);
 		}
 		if (ret) {
@@ -238,6 +243,9 @@ static void smr_progress_resp(struct smr_ep *ep)
 		ofi_freestack_push(ep->tx_fs, pending);
 		ofi_cirque_discard(smr_resp_queue(ep->region));
 	}
+	if (smr_flush_comps(ep))
+		FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
+			"unable to process tx completion\n");
 	ofi_genlock_unlock(&ep->util_ep.lock);
 }
 
@@ -317,10 +325,19 @@ static int smr_progress_iov(struct smr_cmd *cmd, struct iovec *iov,
 
 	xpmem = &smr_peer_data(ep->region)[cmd->msg.hdr.id].xpmem;
 
-	ret = ofi_shm_p2p_copy(ep->p2p_type, iov, iov_count, cmd->msg.data.iov,
-			       cmd->msg.data.iov_count, cmd->msg.hdr.size,
-			       peer_smr->pid, cmd->msg.hdr.op == ofi_op_read_req,
-			       xpmem);
+	if (ep->cpu_copy_context && ep->p2p_type == FI_SHM_P2P_CMA &&
+	    cmd->msg.hdr.size >= SMR_CPU_COPY_MIN_SIZE)
+		ret = smr_cpu_copy_cma(ep, iov, iov_count, cmd->msg.data.iov,
+				       cmd->msg.data.iov_count,
+				       cmd->msg.hdr.size, peer_smr->pid,
+				       cmd->msg.hdr.op == ofi_op_read_req);
+	else
+		ret = ofi_shm_p2p_copy(ep->p2p_type, iov, iov_count,
+				       cmd->msg.data.iov,
+				       cmd->msg.data.iov_count,
+				       cmd->msg.hdr.size, peer_smr->pid,
+				       cmd->msg.hdr.op == ofi_op_read_req,
+				       xpmem);
 	if (!ret)
 		*total_len = cmd->msg.hdr.size;
 
@@ -341,7 +358,8 @@ static int smr_mmap_peer_copy(struct smr_ep *ep, struct smr_cmd *cmd,
 	ssize_t hmem_copy_ret;
 
 	num = smr_mmap_name(shm_name,
-			ep->region->map->peers[cmd->msg.hdr.id].peer.name,
+			smr_map_peer(ep->region->map,
+				     cmd->msg.hdr.id)->peer.name,
 			cmd->msg.hdr.msg_id);
 	if (num < 0) {
 		FI_WARN(&smr_prov, FI_LOG_AV, "generating shm file name failed\n");
@@ -542,7 +560,8 @@ static struct smr_pend_entry *smr_progress_ipc(struct smr_cmd *cmd,
 
 	if (cmd->msg.data.ipc_info.iface == FI_HMEM_ZE)
 		ze_set_pid_fd((void **) &cmd->msg.data.ipc_info.ipc_handle,
-			      ep->region->map->peers[cmd->msg.hdr.id].pid_fd);
+			      smr_map_peer(ep->region->map,
+					   cmd->msg.hdr.id)->pid_fd);
 
 	//TODO disable IPC if more than 1 interface is initialized
 	ret = ofi_ipc_cache_search(domain->ipc_cache, cmd->msg.hdr.id,
@@ -712,7 +731,7 @@ out:
 }
 
 static int smr_start_common(struct smr_ep *ep, struct smr_cmd *cmd,
-		struct fi_peer_rx_entry *rx_entry)
+		struct fi_peer_rx_entry *rx_entry, bool batch)
 {
 	struct smr_pend_entry *pend = NULL;
 	size_t total_len = 0;
@@ -767,10 +786,17 @@ static int smr_start_common(struct smr_ep *ep, struct smr_cmd *cmd,
 		if (err) {
 			FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
 				"error processing op\n");
+			if (batch)
+				smr_flush_comps(ep);
 			ret = smr_write_err_comp(ep->util_ep.rx_cq,
 						 rx_entry->context,
 						 comp_flags, rx_entry->tag,
 						 -err);
+		} else if (batch) {
+			ret = smr_queue_rx_comp(ep, rx_entry->context,
+					cmd->msg.hdr.op, comp_flags, total_len,
+					comp_buf, cmd->msg.hdr.id,
+					cmd->msg.hdr.tag, cmd->msg.hdr.data);
 		} else {
 			ret = smr_complete_rx(ep, rx_entry->context, cmd->msg.hdr.op,
 					      comp_flags, total_len, comp_buf,
@@ -850,7 +876,8 @@ int smr_unexp_start(struct fi_peer_rx_entry *rx_entry)
 	    cmd_ctx->cmd.msg.hdr.op_src == smr_src_inject)
 		ret = smr_copy_saved(cmd_ctx, rx_entry);
 	else
-		ret = smr_start_common(cmd_ctx->ep, &cmd_ctx->cmd, rx_entry);
+		ret = smr_start_common(cmd_ctx->ep, &cmd_ctx->cmd, rx_entry,
+				       false);
 
 	dlist_remove(&cmd_ctx->entry);
 	ofi_buf_free(cmd_ctx);
@@ -874,6 +901,7 @@ static void smr_progress_connreq(struct smr_ep *ep, struct smr_cmd *cmd)
 	if (ret || idx < 0) {
 		FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
 			"Error processing mapping request\n");
+		smr_release_txbuf(ep->region, tx_buf);
 		return;
 	}
 
@@ -885,6 +913,7 @@ static void smr_progress_connreq(struct smr_ep *ep, struct smr_cmd *cmd)
 		if (ret) {
 			FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
 				"Could not map peer region\n");
+			smr_release_txbuf(ep->region, tx_buf);
 			return;
 		}
 		peer_smr = smr_peer_region(ep->region, idx);
@@ -902,14 +931,21 @@ static void smr_progress_connreq(struct smr_ep *ep, struct smr_cmd *cmd)
 		peer_smr = smr_peer_region(ep->region, idx);
 	}
 
+	if (cmd->msg.hdr.id < 0 || cmd->msg.hdr.id >= peer_smr->max_peers) {
+		FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
+			"Invalid peer id in mapping request\n");
+		smr_release_txbuf(ep->region, tx_buf);
+		return;
+	}
+
 	smr_set_ipc_valid(ep->region, idx);
 	smr_peer_data(peer_smr)[cmd->msg.hdr.id].addr.id = idx;
 	smr_peer_data(ep->region)[idx].addr.id = cmd->msg.hdr.id;
 
 	smr_release_txbuf(ep->region, tx_buf);
 	assert(ep->region->map->num_peers > 0);
-	ep->region->max_sar_buf_per_peer = SMR_MAX_PEERS /
-		ep->region->map->num_peers;
+	ep->region->max_sar_buf_per_peer =
+		smr_sar_buf_per_peer(ep->region->map->num_peers);
 }
 
 static int smr_alloc_cmd_ctx(struct smr_ep *ep,
@@ -989,7 +1025,7 @@ static int smr_progress_cmd_msg(struct smr_ep *ep, struct smr_cmd *cmd)
 	struct fi_peer_rx_entry *rx_entry;
 	int ret;
 
-	attr.addr = ep->region->map->peers[cmd->msg.hdr.id].fiaddr;
+	attr.addr = smr_map_peer(ep->region->map, cmd->msg.hdr.id)->fiaddr;
 	attr.msg_size = cmd->msg.hdr.size;
 	attr.tag = cmd->msg.hdr.tag;
 	if (cmd->msg.hdr.op == ofi_op_tagged) {
@@ -1029,7 +1065,7 @@ static int smr_progress_cmd_msg(struct smr_ep *ep, struct smr_cmd *cmd)
 		FI_WARN(&smr_prov, FI_LOG_EP_CTRL, "Error getting rx_entry\n");
 		return ret;
 	}
-	ret = smr_start_common(ep, cmd, rx_entry);
+	ret = smr_start_common(ep, cmd, rx_entry, true);
 
 out:
 	return ret < 0 ? ret : 0;
@@ -1108,11 +1144,12 @@ static int smr_progress_cmd_rma(struct smr_ep *ep, struct smr_cmd *cmd,
 	if (err) {
 		FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
 			"error processing rma op\n");
+		smr_flush_comps(ep);
 		ret = smr_write_err_comp(ep->util_ep.rx_cq, NULL,
 				smr_rx_cq_flags(0, cmd->msg.hdr.op_flags),
 				0, -err);
 	} else {
-		ret = smr_complete_rx(ep, (void *) cmd->msg.hdr.msg_id,
+		ret = smr_queue_rx_comp(ep, (void *) cmd->msg.hdr.msg_id,
 				cmd->msg.hdr.op, smr_rx_cq_flags(0,
 				cmd->msg.hdr.op_flags), total_len,
 				iov_count ? iov[0].iov_base : NULL,
@@ -1193,14 +1230,15 @@ static int smr_progress_cmd_atomic(struct smr_ep *ep, struct smr_cmd *cmd,
 	if (err) {
 		FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
 			"error processing atomic op\n");
+		smr_flush_comps(ep);
 		ret = smr_write_err_comp(ep->util_ep.rx_cq, NULL,
 				smr_rx_cq_flags(0, cmd->msg.hdr.op_flags),
 				0, err);
 	} else {
-		ret = smr_complete_rx(ep, NULL, cmd->msg.hdr.op,
-				      smr_rx_cq_flags(0, cmd->msg.hdr.op_flags),
-				      total_len, ioc_count ? ioc[0].addr : NULL,
-				      cmd->msg.hdr.id, 0, cmd->msg.hdr.data);
+		ret = smr_queue_rx_comp(ep, NULL, cmd->msg.hdr.op,
+					smr_rx_cq_flags(0, cmd->msg.hdr.op_flags),
+					total_len, ioc_count ? ioc[0].addr : NULL,
+					cmd->msg.hdr.id, 0, cmd->msg.hdr.data);
 	}
 	if (ret) {
 		FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
@@ -1273,6 +1311,9 @@ static void smr_progress_cmd(struct smr_ep *ep)
 			break;
 		}
 	}
+	if (smr_flush_comps(ep))
+		FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
+			"unable to process rx completion\n");
 	ofi_genlock_unlock(&ep->util_ep.lock);
 }
 
@@ -1430,7 +1471,7 @@ static void smr_progress_sar_list(struct smr_ep *ep)
 				comp_flags = smr_rx_cq_flags(0,
 						sar_entry->cmd.msg.hdr.op_flags);
 			}
-			ret = smr_complete_rx(ep, comp_ctx,
+			ret = smr_queue_rx_comp(ep, comp_ctx,
 					sar_entry->cmd.msg.hdr.op, comp_flags,
 					sar_entry->bytes_done,
 					sar_entry->iov[0].iov_base,
@@ -1448,6 +1489,9 @@ static void smr_progress_sar_list(struct smr_ep *ep)
 			ofi_buf_free(sar_entry);
 		}
 	}
+	if (smr_flush_comps(ep))
+		FI_WARN(&smr_prov, FI_LOG_EP_CTRL,
+			"unable to process rx completion\n");
 	ofi_genlock_unlock(&ep->util_ep.lock);
 }
 
@@ -1457,8 +1501,8 @@ void smr_ep_progress(struct util_ep *util_ep)
 
 	ep = container_of(util_ep, struct smr_ep, util_ep);
 
-	if (smr_env.use_dsa_sar)
-		smr_dsa_progress(ep);
+	if (ep->copy_engine)
+		ep->copy_engine->progress(ep);
 	smr_progress_resp(ep);
 	smr_progress_sar_list(ep);
 	smr_progress_cmd(ep);
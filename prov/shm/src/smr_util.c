@@ -90,7 +90,7 @@ void smr_cma_check(struct smr_region *smr, struct smr_region *peer_smr)
 }
 
 size_t smr_calculate_size_offsets(size_t tx_count, size_t rx_count,
-				  size_t *cmd_offset, size_t *resp_offset,
+				  size_t max_peers, size_t *cmd_offset, size_t *resp_offset,
 				  size_t *inject_offset, size_t *sar_offset,
 				  size_t *peer_offset, size_t *name_offset,
 				  size_t *sock_offset)
@@ -111,9 +111,9 @@ size_t smr_calculate_size_offsets(size_t tx_count, size_t rx_count,
 	sar_pool_offset = inject_pool_offset +
 		freestack_size(sizeof(struct smr_inject_buf), rx_size);
 	peer_data_offset = sar_pool_offset +
-		freestack_size(sizeof(struct smr_sar_buf), SMR_MAX_PEERS);
+		freestack_size(sizeof(struct smr_sar_buf), SMR_SAR_BUF_CNT);
 	ep_name_offset = peer_data_offset + sizeof(struct smr_peer_data) *
-		SMR_MAX_PEERS;
+		max_peers;
 
 	sock_name_offset = ep_name_offset + SMR_NAME_MAX;
 
@@ -201,7 +201,8 @@ int smr_create(const struct fi_provider *prov, struct smr_map *map,
 
 	tx_size = roundup_power_of_two(attr->tx_count);
 	rx_size = roundup_power_of_two(attr->rx_count);
-	total_size = smr_calculate_size_offsets(tx_size, rx_size, &cmd_queue_offset,
+	total_size = smr_calculate_size_offsets(tx_size, rx_size,
+					map->max_peers, &cmd_queue_offset,
 					&resp_queue_offset, &inject_pool_offset,
 					&sar_pool_offset, &peer_data_offset,
 					&name_offset, &sock_name_offset);
@@ -298,14 +299,15 @@ int smr_create(const struct fi_provider *prov, struct smr_map *map,
 	(*smr)->name_offset = name_offset;
 	(*smr)->sock_name_offset = sock_name_offset;
 	(*smr)->max_sar_buf_per_peer = SMR_BUF_BATCH_MAX;
+	(*smr)->max_peers = map->max_peers;
 
 	smr_cmd_queue_init(smr_cmd_queue(*smr), rx_size);
 	smr_resp_queue_init(smr_resp_queue(*smr), tx_size);
 	smr_freestack_init(smr_inject_pool(*smr), rx_size,
 			sizeof(struct smr_inject_buf));
-	smr_freestack_init(smr_sar_pool(*smr), SMR_MAX_PEERS,
+	smr_freestack_init(smr_sar_pool(*smr), SMR_SAR_BUF_CNT,
 			sizeof(struct smr_sar_buf));
-	for (i = 0; i < SMR_MAX_PEERS; i++) {
+	for (i = 0; i < map->max_peers; i++) {
 		smr_peer_data(*smr)[i].addr.id = -1;
 		smr_peer_data(*smr)[i].sar_status = 0;
 		smr_peer_data(*smr)[i].name_sent = 0;
@@ -345,7 +347,7 @@ static int smr_match_name(struct dlist_entry *item, const void *args)
 int smr_map_to_region(const struct fi_provider *prov, struct smr_map *map,
 		      int64_t id)
 {
-	struct smr_peer *peer_buf = &map->peers[id];
+	struct smr_peer *peer_buf = smr_map_peer(map, id);
 	struct smr_region *peer;
 	struct util_ep *util_ep;
 	struct smr_ep *smr_ep;
@@ -447,7 +449,7 @@ void smr_map_to_endpoint(struct smr_region *region, int64_t id)
 
 	assert(ofi_spin_held(&region->map->lock));
 	peer_smr = smr_peer_region(region, id);
-	if (region->map->peers[id].peer.id < 0 || !peer_smr)
+	if (smr_map_peer(region->map, id)->peer.id < 0 || !peer_smr)
 	    return;
 
 	local_peers = smr_peer_data(region);
@@ -488,11 +490,11 @@ void smr_unmap_region(const struct fi_provider *prov, struct smr_map *map,
 	int ret = 0;
 
 	assert(ofi_spin_held(&map->lock));
-	peer_region = map->peers[peer_id].region;
+	peer = smr_map_peer(map, peer_id);
+	peer_region = peer->region;
 	if (!peer_region)
 		return;
 
-	peer = &map->peers[peer_id];
 	av = container_of(map, struct smr_av, smr_map);
 	dlist_foreach_container(&av->util_av.ep_list, struct util_ep, util_ep,
 				av_entry) {
@@ -528,7 +530,7 @@ void smr_unmap_from_endpoint(struct smr_region *region, int64_t id)
 	struct smr_peer_data *local_peers, *peer_peers;
 	int64_t peer_id;
 
-	if (region->map->peers[id].peer.id < 0)
+	if (smr_map_peer(region->map, id)->peer.id < 0)
 		return;
 
 	peer_smr = smr_peer_region(region, id);
@@ -545,21 +547,54 @@ void smr_unmap_from_endpoint(struct smr_region *region, int64_t id)
 
 void smr_exchange_all_peers(struct smr_region *region)
 {
-	int64_t i;
+	int64_t i, size;
 
 	ofi_spin_lock(&region->map->lock);
-	for (i = 0; i < SMR_MAX_PEERS; i++)
+	size = smr_map_size(region->map);
+	for (i = 0; i < size; i++)
 		smr_map_to_endpoint(region, i);
 
 	ofi_spin_unlock(&region->map->lock);
 }
 
+/* Back another chunk of ids with peer entries.  Entries are never moved
+ * or freed until the map is closed, so lookups need no lock.
+ */
+static int smr_map_grow(struct smr_map *map)
+{
+	struct smr_peer *chunk;
+	int64_t size;
+	int i;
+
+	assert(ofi_spin_held(&map->lock));
+	size = smr_map_size(map);
+	if (size >= map->max_peers)
+		return -FI_ENOMEM;
+
+	chunk = calloc(SMR_PEER_CHUNK_SIZE, sizeof(*chunk));
+	if (!chunk)
+		return -FI_ENOMEM;
+
+	for (i = 0; i < SMR_PEER_CHUNK_SIZE; i++) {
+		chunk[i].peer.id = -1;
+		chunk[i].fiaddr = FI_ADDR_NOTAVAIL;
+	}
+
+	/* Lockless readers acquire the size before using the chunk */
+	map->peers[size >> SMR_PEER_CHUNK_SHIFT] = chunk;
+	map->cur_id = size;
+	ofi_atomic_store_explicit64(&map->size, size + SMR_PEER_CHUNK_SIZE,
+				    memory_order_release);
+	return FI_SUCCESS;
+}
+
 int smr_map_add(const struct fi_provider *prov, struct smr_map *map,
 		const char *name, int64_t *id)
 {
 	struct ofi_rbnode *node;
+	struct smr_peer *peer;
 	const char *shm_name = smr_no_prefix(name);
-	int tries = 0, ret = 0;
+	int ret = 0;
 
 	ofi_spin_lock(&map->lock);
 	ret = ofi_rbmap_insert(&map->rbmap, (void *) shm_name,
@@ -567,40 +602,52 @@ int smr_map_add(const struct fi_provider *prov, struct smr_map *map,
 	if (ret) {
 		assert(ret == -FI_EALREADY);
 		*id = (intptr_t) node->data;
+		ret = 0;
 		goto out;
 	}
 
-	while (map->peers[map->cur_id].peer.id != -1 && tries < SMR_MAX_PEERS) {
-		if (++map->cur_id == SMR_MAX_PEERS)
+	if (map->num_peers == smr_map_size(map)) {
+		ret = smr_map_grow(map);
+		if (ret) {
+			FI_WARN(prov, FI_LOG_AV, "peer map is full (%d peers), "
+				"increase FI_SHM_MAX_PEERS\n", map->max_peers);
+			ofi_rbmap_delete(&map->rbmap, node);
+			goto out;
+		}
+	}
+
+	/* There is a free entry, since num_peers < size */
+	while (smr_map_peer(map, map->cur_id)->peer.id != -1) {
+		if (++map->cur_id == smr_map_size(map))
 			map->cur_id = 0;
-		tries++;
 	}
 
-	assert(map->cur_id < SMR_MAX_PEERS && tries < SMR_MAX_PEERS);
 	*id = map->cur_id;
-	if (++map->cur_id == SMR_MAX_PEERS)
+	if (++map->cur_id == smr_map_size(map))
 		map->cur_id = 0;
 	node->data = (void *) (intptr_t) *id;
-	strncpy(map->peers[*id].peer.name, shm_name, SMR_NAME_MAX);
-	map->peers[*id].peer.name[SMR_NAME_MAX - 1] = '\0';
-	map->peers[*id].region = NULL;
+	peer = smr_map_peer(map, *id);
+	strncpy(peer->peer.name, shm_name, SMR_NAME_MAX);
+	peer->peer.name[SMR_NAME_MAX - 1] = '\0';
+	peer->region = NULL;
 	map->num_peers++;
-	map->peers[*id].peer.id = *id;
+	peer->peer.id = *id;
 
 out:
 	ofi_spin_unlock(&map->lock);
-	return FI_SUCCESS;
+	return ret;
 }
 
 void smr_map_del(struct smr_map *map, int64_t id)
 {
 	struct smr_ep_name *name;
+	struct smr_peer *peer;
 	bool local = false;
 
-	assert(id >= 0 && id < SMR_MAX_PEERS);
+	peer = smr_map_peer(map, id);
 	pthread_mutex_lock(&ep_list_lock);
 	dlist_foreach_container(&ep_name_list, struct smr_ep_name, name, entry) {
-		if (!strcmp(name->name, map->peers[id].peer.name)) {
+		if (!strcmp(name->name, peer->peer.name)) {
 			local = true;
 			break;
 		}
@@ -608,17 +655,17 @@ void smr_map_del(struct smr_map *map, int64_t id)
 	pthread_mutex_unlock(&ep_list_lock);
 	ofi_spin_lock(&map->lock);
 	smr_unmap_region(&smr_prov, map, id, local);
-	map->peers[id].fiaddr = FI_ADDR_NOTAVAIL;
-	map->peers[id].peer.id = -1;
+	peer->fiaddr = FI_ADDR_NOTAVAIL;
+	peer->peer.id = -1;
 	map->num_peers--;
-	ofi_rbmap_find_delete(&map->rbmap, map->peers[id].peer.name);
+	ofi_rbmap_find_delete(&map->rbmap, peer->peer.name);
 	ofi_spin_unlock(&map->lock);
 }
 
 struct smr_region *smr_map_get(struct smr_map *map, int64_t id)
 {
-	if (id < 0 || id >= SMR_MAX_PEERS)
+	if (id < 0 || id >= smr_map_size(map))
 		return NULL;
 
-	return map->peers[id].region;
+	return smr_map_peer(map, id)->region;
 }
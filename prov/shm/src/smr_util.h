@@ -54,7 +54,7 @@
 extern "C" {
 #endif
 
-#define SMR_VERSION	8
+#define SMR_VERSION	9
 
 #define SMR_FLAG_ATOMIC	(1 << 0)
 #define SMR_FLAG_DEBUG	(1 << 1)
@@ -212,17 +212,49 @@ struct smr_peer {
 	int			pid_fd;
 };
 
-#define SMR_MAX_PEERS	256
+/* Default number of peers an endpoint can address.  The actual limit is
+ * set by FI_SHM_MAX_PEERS or the AV count and defaults to at least the
+ * number of cores.
+ */
+#define SMR_DEF_MAX_PEERS	256
+#define SMR_SAR_BUF_CNT		256
+
+/* The peer table is a two-level array so that it can grow without moving
+ * entries that are read without the map lock.  Chunks are allocated as
+ * peers are added.
+ */
+#define SMR_PEER_CHUNK_SHIFT	6
+#define SMR_PEER_CHUNK_SIZE	(1 << SMR_PEER_CHUNK_SHIFT)
 
 struct smr_map {
 	ofi_spin_t		lock;
 	int64_t			cur_id;
 	int 			num_peers;
+	int			max_peers;
+	/* number of ids backed by allocated chunks, published with release
+	 * semantics after the chunk pointer is stored
+	 */
+	ofi_atomic64_t		size;
 	uint16_t		flags;
 	struct ofi_rbmap	rbmap;
-	struct smr_peer		peers[SMR_MAX_PEERS];
+	struct smr_peer		**peers;
 };
 
+static inline int64_t smr_map_size(struct smr_map *map)
+{
+	return ofi_atomic_load_explicit64(&map->size, memory_order_acquire);
+}
+
+static inline struct smr_peer *smr_map_peer(struct smr_map *map, int64_t id)
+{
+	int64_t size = smr_map_size(map);
+
+	assert(id >= 0 && id < size);
+	OFI_UNUSED(size);
+	return &map->peers[id >> SMR_PEER_CHUNK_SHIFT]
+			  [id & (SMR_PEER_CHUNK_SIZE - 1)];
+}
+
 struct smr_region {
 	uint8_t		version;
 	uint8_t		resv;
@@ -234,6 +266,8 @@ struct smr_region {
 	uint8_t		resv2;
 
 	uint32_t	max_sar_buf_per_peer;
+	/* number of entries in the peer data array */
+	uint32_t	max_peers;
 	struct ofi_xpmem_pinfo	xpmem_self;
 	struct ofi_xpmem_pinfo	xpmem_peer;
 	void		*base_addr;
@@ -302,7 +336,7 @@ OFI_DECLARE_ATOMIC_Q(struct smr_cmd_entry, smr_cmd_queue);
 
 static inline struct smr_region *smr_peer_region(struct smr_region *smr, int i)
 {
-	return smr->map->peers[i].region;
+	return smr_map_peer(smr->map, i)->region;
 }
 static inline struct smr_cmd_queue *smr_cmd_queue(struct smr_region *smr)
 {
@@ -347,7 +381,7 @@ struct smr_attr {
 };
 
 size_t smr_calculate_size_offsets(size_t tx_count, size_t rx_count,
-				  size_t *cmd_offset, size_t *resp_offset,
+				  size_t max_peers, size_t *cmd_offset, size_t *resp_offset,
 				  size_t *inject_offset, size_t *sar_offset,
 				  size_t *peer_offset, size_t *name_offset,
 				  size_t *sock_offset);
@@ -75,15 +75,22 @@
 #define SM2_IOV_LIMIT		4
 #define SM2_PREFIX		"fi_sm2://"
 #define SM2_PREFIX_NS		"fi_ns://"
-#define SM2_VERSION		1
+#define SM2_VERSION		2
 #define SM2_IOV_LIMIT		4
 #define SM2_INJECT_SIZE		(SM2_XFER_ENTRY_SIZE - sizeof(struct sm2_xfer_hdr))
 
 #define SM2_ATOMIC_INJECT_SIZE	    (SM2_INJECT_SIZE - sizeof(struct sm2_atomic_hdr))
 #define SM2_ATOMIC_COMP_INJECT_SIZE (SM2_ATOMIC_INJECT_SIZE / 2)
 
+struct sm2_env {
+	size_t max_universe_size;
+	size_t num_xfer_entries;
+};
+
+extern struct sm2_env sm2_env;
 extern struct fi_provider sm2_prov;
 extern struct fi_info sm2_info;
+extern struct fi_info sm2_hmem_info;
 extern struct util_prov sm2_util_prov;
 extern int sm2_global_ep_idx; // protected by the ep_list_lock
 
@@ -217,7 +224,7 @@ int sm2_fabric(struct fi_fabric_attr *attr, struct fid_fabric **fabric,
 
 struct sm2_av {
 	struct util_av util_av;
-	fi_addr_t reverse_lookup[SM2_MAX_UNIVERSE_SIZE];
+	fi_addr_t *reverse_lookup;
 	struct sm2_mmap mmap;
 };
 
@@ -322,7 +329,7 @@ int sm2_unexp_start(struct fi_peer_rx_entry *rx_entry);
 
 static inline struct sm2_region *sm2_peer_region(struct sm2_ep *ep, int id)
 {
-	assert(id < SM2_MAX_UNIVERSE_SIZE);
+	assert(id < sm2_mmap_universe_size(ep->mmap));
 	return sm2_mmap_ep_region(ep->mmap, id);
 }
 
@@ -106,7 +106,7 @@ struct fi_domain_attr sm2_domain_attr = {
 	.mr_key_size = sizeof_field(struct fi_rma_iov, key),
 	.cq_data_size = sizeof_field(struct sm2_xfer_hdr, cq_data),
 	.cq_cnt = (1 << 10),
-	.ep_cnt = SM2_MAX_UNIVERSE_SIZE,
+	.ep_cnt = SM2_DEF_UNIVERSE_SIZE,
 	.tx_ctx_cnt = (1 << 10),
 	.rx_ctx_cnt = (1 << 10),
 	.max_ep_tx_ctx = 1,
@@ -126,7 +126,7 @@ struct fi_domain_attr sm2_hmem_domain_attr = {
 	.mr_key_size = sizeof_field(struct fi_rma_iov, key),
 	.cq_data_size = sizeof_field(struct sm2_xfer_hdr, cq_data),
 	.cq_cnt = (1 << 10),
-	.ep_cnt = SM2_MAX_UNIVERSE_SIZE,
+	.ep_cnt = SM2_DEF_UNIVERSE_SIZE,
 	.tx_ctx_cnt = (1 << 10),
 	.rx_ctx_cnt = (1 << 10),
 	.max_ep_tx_ctx = 1,
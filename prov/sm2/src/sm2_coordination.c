@@ -102,68 +102,71 @@ out:
 }
 
 /*
- * Take a sm2_mmap, and re-map if necessary, ensuring size of at_least
- *
- * If the size of the current map or the size of the file are not sufficient
- * to address "at_least" bytes, then the file will be truncated() (extended)
- * to the required size and the memory munmap()ed and re mmap()'ed
+ * Map the address space for every region the file can hold.  The file may be
+ * shorter than the mapping; only the regions of allocated entries are backed
+ * by the file, see sm2_file_grow().  Because the mapping is never moved,
+ * pointers into peer regions stay valid as the universe grows.
  */
-static inline int sm2_mmap_remap(struct sm2_mmap *map, size_t at_least)
+static int sm2_mmap_reserve(struct sm2_mmap *map)
 {
-	struct stat st;
+	struct sm2_coord_file_header *header = (void *) map->base;
+	size_t size;
+	char *base;
 
-	assert(at_least > 0);
-	if (map->size >= at_least)
+	size = (size_t) header->ep_regions_offset +
+	       (size_t) header->ep_region_size *
+	       (size_t) header->max_universe_size;
+	if (map->size == size)
 		return 0;
 
-	if (fstat(map->fd, &st)) {
+	base = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, map->fd, 0);
+	if (base == MAP_FAILED) {
 		FI_WARN(&sm2_prov, FI_LOG_AV,
-			"Failed fstat of sm2_mmaps file: %s, at_least: %zu\n",
-			strerror(errno), at_least);
-		return -FI_EOTHER;
+			"Failed to map %zu bytes of the sm2_mmaps file: %s\n",
+			size, strerror(errno));
+		return -FI_ENOMEM;
 	}
 
-	if (st.st_size < at_least) {
-		if (ftruncate(map->fd, at_least)) {
-			FI_WARN(&sm2_prov, FI_LOG_AV,
-				"Failed ftruncate of sm2_mmaps file: %s, "
-				"at_least: %zu\n",
-				strerror(errno), at_least);
-			return -FI_ENOMEM;
-		}
-	} else if (st.st_size >= map->size) {
-		/* file has been extended by another process since
-		   last we checked.  Re-map the entire file. */
-		at_least = st.st_size;
-	} else {
+	if (munmap(map->base, map->size))
 		FI_WARN(&sm2_prov, FI_LOG_AV,
-			"Shm file has shrunk, re-mapping!\n");
-		at_least = st.st_size;
-	}
+			"Failed unmap of sm2_mmaps file: %s\n",
+			strerror(errno));
 
-	if (map->size != at_least) {
-		if (munmap(map->base, map->size)) {
-			FI_WARN(&sm2_prov, FI_LOG_AV,
-				"Failed unmap of sm2_mmaps file: %s, at_least: "
-				"%zu\n",
-				strerror(errno), at_least);
-			return -FI_EOTHER;
-			;
-		}
+	map->base = base;
+	map->size = size;
+	return 0;
+}
 
-		map->base = mmap(0, at_least, PROT_READ | PROT_WRITE,
-				 MAP_SHARED, map->fd, 0);
-		if (map->base == MAP_FAILED) {
-			FI_WARN(&sm2_prov, FI_LOG_AV,
-				"Failed to remap sm2_maps file when increasing "
-				"size to st.st_size=%ld, at_least, %zu, error: "
-				"%s\n",
-				st.st_size, at_least, strerror(errno));
-			return -FI_ENOMEM;
-		}
-		map->size = at_least;
+/*
+ * Extend the file to hold the regions of the first num_entries entries.
+ * Requires the lock.
+ */
+static int sm2_file_grow(struct sm2_mmap *map, int num_entries)
+{
+	struct sm2_coord_file_header *header = (void *) map->base;
+	struct stat st;
+	size_t size;
+
+	size = header->ep_regions_offset +
+	       header->ep_region_size * num_entries;
+	assert(size <= map->size);
+
+	if (fstat(map->fd, &st)) {
+		FI_WARN(&sm2_prov, FI_LOG_AV,
+			"Failed fstat of sm2_mmaps file: %s\n",
+			strerror(errno));
+		return -FI_EOTHER;
 	}
 
+	if (st.st_size >= size)
+		return 0;
+
+	if (ftruncate(map->fd, size)) {
+		FI_WARN(&sm2_prov, FI_LOG_AV,
+			"Failed ftruncate of sm2_mmaps file: %s, size: %zu\n",
+			strerror(errno), size);
+		return -FI_ENOMEM;
+	}
 	return 0;
 }
 
@@ -195,10 +198,9 @@ ssize_t sm2_file_open_or_create(struct sm2_mmap *map_shared)
 	char template[template_len];
 	struct sm2_coord_file_header *header, *tmp_header;
 	struct sm2_ep_allocation_entry *entries;
-	int fd, common_fd, err, tries, item;
+	int fd, common_fd, err, tries;
 	bool have_file_lock = false;
 	long int page_size;
-	long int max_file_size;
 
 	page_size = ofi_get_page_size();
 	if (page_size <= 0) {
@@ -233,26 +235,26 @@ ssize_t sm2_file_open_or_create(struct sm2_mmap *map_shared)
 	sm2_file_lock(&map_ours);
 
 	header->file_version = SM2_VERSION;
-	header->ep_region_size = sm2_calculate_size_offsets(NULL, NULL);
+	header->max_universe_size = (int) sm2_env.max_universe_size;
+	header->num_xfer_entries = (int) sm2_env.num_xfer_entries;
+	header->num_entries = 0;
+	header->ep_region_size =
+		sm2_calculate_size_offsets(header->num_xfer_entries, NULL, NULL);
 	header->ep_allocation_offset = sizeof(*header);
-	header->ep_regions_offset = header->ep_allocation_offset +
-				    (SM2_MAX_UNIVERSE_SIZE * sizeof(*entries));
+	header->ep_regions_offset =
+		header->ep_allocation_offset +
+		(header->max_universe_size * sizeof(*entries));
 	header->ep_regions_offset =
 		NEXT_MULTIPLE_OF(header->ep_regions_offset, page_size);
 
-	/* Allocate enough space in the file for all our allocations, but no
-	 * data exchange regions yet. We need to keep this allocation small b/c
-	 * every rank will try this on startup.
+	/* Size the file for the allocation entries, but no data exchange
+	 * regions yet.  The entries are zero filled by ftruncate(), and pages
+	 * are only allocated as entries are used.
 	 */
-	err = sm2_mmap_remap(&map_ours, header->ep_regions_offset);
+	err = ftruncate(fd, header->ep_regions_offset);
 	if (err)
 		goto early_exit;
 
-	header = (struct sm2_coord_file_header *) map_ours.base;
-	entries = sm2_mmap_entries(&map_ours);
-	for (item = 0; item < SM2_MAX_UNIVERSE_SIZE; item++)
-		entries[item].pid = 0;
-
 	/* Make sure the header is written before we link the file,
 	 * flush file
 	 */
@@ -272,6 +274,7 @@ ssize_t sm2_file_open_or_create(struct sm2_mmap *map_shared)
 			 * and leave the map open. */
 			memcpy(map_shared, &map_ours, sizeof(map_ours));
 			have_file_lock = true;
+			err = sm2_mmap_reserve(map_shared);
 			break;
 		}
 
@@ -288,9 +291,11 @@ ssize_t sm2_file_open_or_create(struct sm2_mmap *map_shared)
 			assert(map_shared->size >= sizeof(*tmp_header));
 			err = pthread_mutex_trylock(&tmp_header->write_lock);
 			if (err == 0) {
-				sm2_file_attempt_shrink(map_shared);
 				sm2_mmap_cleanup(&map_ours);
 				have_file_lock = true;
+				err = sm2_mmap_reserve(map_shared);
+				if (!err)
+					sm2_file_attempt_shrink(map_shared);
 				break;
 			}
 
@@ -312,18 +317,20 @@ ssize_t sm2_file_open_or_create(struct sm2_mmap *map_shared)
 		return -FI_EAVAIL;
 	}
 
-	/* Remap the file to be big enough to hold every region upfront.
-	 * This is required to get rid of race conditions that may have
-	 * previously occured when we tried to remap in sm2_av_insert(),
-	 * sm2_fifo_send() or sm2_fifo_recv().
-	 */
-	header = (struct sm2_coord_file_header *) map_shared->base;
-	max_file_size = header->ep_regions_offset +
-			header->ep_region_size * SM2_MAX_UNIVERSE_SIZE;
-	err = sm2_mmap_remap(map_shared, max_file_size);
-
 	/* File we created either became the shared file, or got unlinked */
 	sm2_file_unlock(map_shared);
+	if (err) {
+		sm2_mmap_cleanup(map_shared);
+		return err;
+	}
+
+	header = (struct sm2_coord_file_header *) map_shared->base;
+	if (header->max_universe_size != sm2_env.max_universe_size ||
+	    header->num_xfer_entries != sm2_env.num_xfer_entries)
+		FI_INFO(&sm2_prov, FI_LOG_AV,
+			"Using the coordination file universe size %d and "
+			"%d xfer entries per endpoint\n",
+			header->max_universe_size, header->num_xfer_entries);
 	return 0;
 
 early_exit:
@@ -345,9 +352,10 @@ early_exit:
 ssize_t sm2_entry_allocate(const char *name, struct sm2_mmap *map,
 			   sm2_gid_t *gid, bool self)
 {
+	struct sm2_coord_file_header *header = (void *) map->base;
 	struct sm2_ep_allocation_entry *entries;
 	struct sm2_region *peer_region = NULL;
-	int item, pid = getpid(), peer_pid;
+	int item, pid = getpid(), peer_pid, ret;
 
 	entries = sm2_mmap_entries(map);
 
@@ -422,7 +430,7 @@ retry_lookup:
 	}
 
 	/* fine, we could not find the entry, so now look for an empty slot */
-	for (item = 0; item < SM2_MAX_UNIVERSE_SIZE; item++) {
+	for (item = 0; item < header->num_entries; item++) {
 		peer_pid = entries[item].pid;
 		if (peer_pid == 0)
 			goto found;
@@ -448,10 +456,19 @@ retry_lookup:
 		}
 	}
 
+	/* No slot can be reused, so grow the file by one region */
+	if (header->num_entries < header->max_universe_size) {
+		ret = sm2_file_grow(map, header->num_entries + 1);
+		if (ret)
+			return ret;
+		item = header->num_entries++;
+		goto found;
+	}
+
 	FI_WARN(&sm2_prov, FI_LOG_AV,
 		"No available entries were found in the coordination file, all "
-		"%d were used\n",
-		SM2_MAX_UNIVERSE_SIZE);
+		"%d were used. Set FI_SM2_MAX_UNIVERSE_SIZE to allow more\n",
+		header->max_universe_size);
 	return -FI_EAVAIL;
 
 found:
@@ -481,12 +498,13 @@ found:
 
 int sm2_entry_lookup(const char *name, struct sm2_mmap *map)
 {
+	struct sm2_coord_file_header *header = (void *) map->base;
 	struct sm2_ep_allocation_entry *entries;
 	int item;
 
 	entries = sm2_mmap_entries(map);
 	/* TODO Optimize this lookup*/
-	for (item = 0; item < SM2_MAX_UNIVERSE_SIZE; item++) {
+	for (item = 0; item < header->num_entries; item++) {
 		if (0 == strncmp(name, entries[item].ep_name, OFI_NAME_MAX)) {
 			FI_DBG(&sm2_prov, FI_LOG_AV,
 			       "Found existing %s in slot %d\n", name, item);
@@ -533,51 +551,6 @@ void sm2_file_unlock(struct sm2_mmap *map)
 	pthread_mutex_unlock(&header->write_lock);
 }
 
-/*
- * TODO combine this logic with the remap function while keeping remaps()'s
- * short circuit logic
- */
-static void *sm2_mmap_shrink_to_size(struct sm2_mmap *map, size_t shrink_size)
-{
-	struct stat st;
-	int err;
-
-	err = fstat(map->fd, &st);
-	if (err)
-		goto out;
-
-	if (st.st_size > shrink_size) {
-		/* we need to shrink the file. */
-		FI_WARN(&sm2_prov, FI_LOG_AV,
-			"Shrinking SHM file to be of size %zu\n", shrink_size);
-		err = ftruncate(map->fd, shrink_size);
-		if (err)
-			goto out;
-
-		/* now un-map and re-map the file */
-		err = munmap(map->base, map->size);
-		if (err)
-			goto out;
-		map->base = mmap(0, shrink_size, PROT_READ | PROT_WRITE,
-				 MAP_SHARED, map->fd, 0);
-		if (map->base == MAP_FAILED) {
-			FI_WARN(&sm2_prov, FI_LOG_AV,
-				"Failed to remap when decreasing the map size. "
-				"st.st_size=%ld shrink_size=%ld\n",
-				st.st_size, shrink_size);
-			map->base = NULL;
-		}
-		map->size = shrink_size;
-	}
-
-out:
-	if (err) {
-		FI_WARN(&sm2_prov, FI_LOG_AV,
-			"Failed syscall during sm2_mmap_shrink_to_index()\n");
-	}
-	return map->base;
-}
-
 /*
  * If everything in the file is dead, shrink it to fit 0 entries.
  * This deals with peer pre-allocated entries by making the assumption that
@@ -592,7 +565,7 @@ static void sm2_file_attempt_shrink(struct sm2_mmap *map)
 	struct sm2_ep_allocation_entry *entries = sm2_mmap_entries(map);
 	int item;
 
-	for (item = 0; item < SM2_MAX_UNIVERSE_SIZE; item++) {
+	for (item = 0; item < header->num_entries; item++) {
 		if (entries[item].pid != 0 &&
 		    pid_lives(abs(entries[item].pid))) {
 			FI_INFO(&sm2_prov, FI_LOG_AV,
@@ -602,6 +575,16 @@ static void sm2_file_attempt_shrink(struct sm2_mmap *map)
 		}
 	}
 
-	memset(entries, 0, sizeof(*entries) * SM2_MAX_UNIVERSE_SIZE);
-	sm2_mmap_shrink_to_size(map, header->ep_regions_offset);
+	memset(entries, 0, sizeof(*entries) * header->num_entries);
+	header->num_entries = 0;
+
+	/* Drop the regions, the mapping stays reserved for regrowth */
+	if (ftruncate(map->fd, header->ep_regions_offset))
+		FI_WARN(&sm2_prov, FI_LOG_AV,
+			"Failed to shrink sm2_mmaps file: %s\n",
+			strerror(errno));
+	else
+		FI_INFO(&sm2_prov, FI_LOG_AV,
+			"Shrinking SHM file to be of size %zu\n",
+			header->ep_regions_offset);
 }
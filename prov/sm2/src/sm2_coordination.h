@@ -49,11 +49,14 @@
 #include <rdma/providers/fi_prov.h>
 
 #define SM2_XFER_ENTRY_SIZE   4096
-#define SM2_MAX_UNIVERSE_SIZE 256
+#define SM2_DEF_UNIVERSE_SIZE 256
+/* Address space for every region is reserved up front, about 4 MB each */
+#define SM2_MAX_UNIVERSE_SIZE 4096
 /* TODO: Tune max GDRCopy size for SM2 */
 #define SM2_MAX_GDRCOPY_SIZE 3072
-/* TODO: Make the number of XFER ENTRY's configurable */
-#define SM2_NUM_XFER_ENTRY_PER_PEER 1024
+#define SM2_DEF_XFER_ENTRY_PER_PEER 1024
+/* Freestack indices are 16 bit, and the count must be a power of two */
+#define SM2_MAX_XFER_ENTRY_PER_PEER (1 << 14)
 
 typedef unsigned int sm2_gid_t;
 
@@ -69,11 +72,21 @@ struct sm2_ep_allocation_entry {
 	bool startup_ready; /* TODO Do I need to make atomic */
 };
 
+/*
+ * The universe size and the number of xfer entries per endpoint are chosen by
+ * the process that creates the file, and every process maps enough address
+ * space for the whole universe.  The file itself only holds the regions of
+ * the first num_entries allocation entries, and is extended as entries are
+ * added, so the mapping never moves.
+ */
 struct sm2_coord_file_header {
 	int file_version;
 	pthread_mutex_t write_lock;
 	/* TODO enforce that all procs in the file use this */
 	int64_t ep_region_size;
+	int max_universe_size;
+	int num_xfer_entries;
+	int num_entries;
 
 	ptrdiff_t ep_allocation_offset; /* struct sm2_ep_allocation_entry */
 	ptrdiff_t ep_regions_offset; /* struct ep_region */
@@ -94,7 +107,8 @@ struct sm2_region {
 	ptrdiff_t freestack_offset;
 };
 
-size_t sm2_calculate_size_offsets(ptrdiff_t *rq_offset, ptrdiff_t *fs_offset);
+size_t sm2_calculate_size_offsets(size_t num_xfer_entries,
+				  ptrdiff_t *rq_offset, ptrdiff_t *fs_offset);
 int sm2_create(const struct fi_provider *prov, const struct sm2_attr *attr,
 	       struct sm2_mmap *sm2_mmap, sm2_gid_t *gid);
 
@@ -108,6 +122,12 @@ ssize_t sm2_file_open_or_create(struct sm2_mmap *map_shared);
 void sm2_file_lock(struct sm2_mmap *map);
 void sm2_file_unlock(struct sm2_mmap *map);
 
+static inline int sm2_mmap_universe_size(struct sm2_mmap *map)
+{
+	struct sm2_coord_file_header *header = (void *) map->base;
+	return header->max_universe_size;
+}
+
 static inline struct sm2_ep_allocation_entry *
 sm2_mmap_entries(struct sm2_mmap *map)
 {
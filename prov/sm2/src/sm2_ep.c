@@ -167,7 +167,7 @@ ssize_t sm2_verify_peer(struct sm2_ep *ep, fi_addr_t fi_addr, sm2_gid_t *gid)
 	struct sm2_ep_allocation_entry *entries;
 
 	*gid = *((sm2_gid_t *) ofi_av_get_addr(ep->util_ep.av, fi_addr));
-	assert(*gid < SM2_MAX_UNIVERSE_SIZE);
+	assert(*gid < sm2_mmap_universe_size(ep->mmap));
 
 	sm2_av = container_of(ep->util_ep.av, struct sm2_av, util_av);
 	if (sm2_av->reverse_lookup[*gid] == FI_ADDR_NOTAVAIL)
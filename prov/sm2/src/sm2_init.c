@@ -38,7 +38,45 @@
 #include <ofi_hmem.h>
 #include <ofi_prov.h>
 
-size_t sm2_calculate_size_offsets(ptrdiff_t *rq_offset, ptrdiff_t *fs_offset)
+struct sm2_env sm2_env = {
+	.max_universe_size = SM2_DEF_UNIVERSE_SIZE,
+	.num_xfer_entries = SM2_DEF_XFER_ENTRY_PER_PEER,
+};
+
+static void sm2_init_env(void)
+{
+	fi_param_get_size_t(&sm2_prov, "max_universe_size",
+			    &sm2_env.max_universe_size);
+	if (!sm2_env.max_universe_size) {
+		FI_WARN(&sm2_prov, FI_LOG_CORE,
+			"invalid max_universe_size, using %d\n",
+			SM2_DEF_UNIVERSE_SIZE);
+		sm2_env.max_universe_size = SM2_DEF_UNIVERSE_SIZE;
+	} else if (sm2_env.max_universe_size > SM2_MAX_UNIVERSE_SIZE) {
+		FI_WARN(&sm2_prov, FI_LOG_CORE,
+			"max_universe_size too large, using %d\n",
+			SM2_MAX_UNIVERSE_SIZE);
+		sm2_env.max_universe_size = SM2_MAX_UNIVERSE_SIZE;
+	}
+
+	fi_param_get_size_t(&sm2_prov, "num_xfer_entries",
+			    &sm2_env.num_xfer_entries);
+	if (!sm2_env.num_xfer_entries ||
+	    sm2_env.num_xfer_entries > SM2_MAX_XFER_ENTRY_PER_PEER) {
+		FI_WARN(&sm2_prov, FI_LOG_CORE,
+			"invalid num_xfer_entries, using %d\n",
+			SM2_DEF_XFER_ENTRY_PER_PEER);
+		sm2_env.num_xfer_entries = SM2_DEF_XFER_ENTRY_PER_PEER;
+	}
+	sm2_env.num_xfer_entries =
+		roundup_power_of_two(sm2_env.num_xfer_entries);
+
+	sm2_info.domain_attr->ep_cnt = sm2_env.max_universe_size;
+	sm2_hmem_info.domain_attr->ep_cnt = sm2_env.max_universe_size;
+}
+
+size_t sm2_calculate_size_offsets(size_t num_xfer_entries,
+				  ptrdiff_t *rq_offset, ptrdiff_t *fs_offset)
 {
 	size_t total_size;
 
@@ -51,7 +89,7 @@ size_t sm2_calculate_size_offsets(ptrdiff_t *rq_offset, ptrdiff_t *fs_offset)
 	if (fs_offset)
 		*fs_offset = total_size;
 	total_size += freestack_size(sizeof(struct sm2_xfer_entry),
-				     SM2_NUM_XFER_ENTRY_PER_PEER);
+				     num_xfer_entries);
 
 	return total_size;
 }
@@ -59,12 +97,15 @@ size_t sm2_calculate_size_offsets(ptrdiff_t *rq_offset, ptrdiff_t *fs_offset)
 int sm2_create(const struct fi_provider *prov, const struct sm2_attr *attr,
 	       struct sm2_mmap *sm2_mmap, sm2_gid_t *gid)
 {
+	struct sm2_coord_file_header *header;
 	ptrdiff_t recv_queue_offset, freestack_offset;
 	int ret;
 	void *mapped_addr;
 	struct sm2_region *smr;
 
-	sm2_calculate_size_offsets(&recv_queue_offset, &freestack_offset);
+	header = (void *) sm2_mmap->base;
+	sm2_calculate_size_offsets(header->num_xfer_entries,
+				   &recv_queue_offset, &freestack_offset);
 
 	FI_INFO(prov, FI_LOG_EP_CTRL, "Claiming an entry for (%s)\n",
 		attr->name);
@@ -95,7 +136,11 @@ int sm2_create(const struct fi_provider *prov, const struct sm2_attr *attr,
 	smr->freestack_offset = freestack_offset;
 
 	sm2_fifo_init(sm2_recv_queue(smr));
-	smr_freestack_init(sm2_freestack(smr), SM2_NUM_XFER_ENTRY_PER_PEER,
+	/* Entries are only written when used, and the freestack hands out
+	 * the most recently returned entry first, so the pages backing the
+	 * pool grow with the number of transfers in flight.
+	 */
+	smr_freestack_init(sm2_freestack(smr), header->num_xfer_entries,
 			   sizeof(struct sm2_xfer_entry));
 
 	/*
@@ -173,7 +218,9 @@ static int sm2_shm_space_check(size_t tx_count, size_t rx_count)
 			strerror(errno));
 		return -errno;
 	}
-	shm_size_needed = num_of_core * sm2_calculate_size_offsets(NULL, NULL);
+	shm_size_needed = num_of_core *
+			  sm2_calculate_size_offsets(sm2_env.num_xfer_entries,
+						     NULL, NULL);
 	err = statvfs(shm_fs, &stat);
 	if (err) {
 		FI_WARN(&sm2_prov, FI_LOG_CORE,
@@ -253,5 +300,16 @@ struct util_prov sm2_util_prov = {
 
 SM2_INI
 {
+	fi_param_define(&sm2_prov, "max_universe_size", FI_PARAM_SIZE_T,
+			"Max number of endpoints that can share the "
+			"coordination file, set by the first process that "
+			"creates it (default: 256, max: 4096)");
+	fi_param_define(&sm2_prov, "num_xfer_entries", FI_PARAM_SIZE_T,
+			"Number of transfer entries per endpoint, rounded up "
+			"to a power of two, set by the first process that "
+			"creates the coordination file (default: 1024)");
+
+	sm2_init_env();
+
 	return &sm2_prov;
 }
@@ -60,6 +60,7 @@
 #include <ofi_util.h>
 #include <ofi_proto.h>
 #include <ofi_net.h>
+#include <fasthash.h>
 
 #include "xnet_proto.h"
 
@@ -69,10 +70,18 @@
 #ifdef HAVE_FABRIC_PROFILE
 
 #include <ofi_profile.h>
+#include <rdma/fi_ext.h>
+
+enum {
+	XNET_VAR_ZEROCOPY_HITS = FI_PROV_SPECIFIC_TCP,
+	XNET_VAR_ZEROCOPY_COPIED,
+};
 
 typedef struct xnet_profile {
 	struct util_profile util_prof;
 	uint64_t unexp_msg_cnt;
+	uint64_t zerocopy_hits;
+	uint64_t zerocopy_copied;
 } xnet_profile_t;
 
 #define xnet_prof_unexp_msg(prof, delta)    \
@@ -86,9 +95,19 @@ do {    \
 	}    \
 } while (0)
 
+#define xnet_prof_zerocopy(prof, hits, copied)    \
+do {    \
+	if ((prof)) {    \
+		(prof)->zerocopy_hits += (hits);    \
+		(prof)->zerocopy_copied += (copied);    \
+	}    \
+} while (0)
+
 #else
 typedef void  xnet_profile_t;
 #define xnet_prof_unexp_msg(ep, delta)     do {} while (0)
+#define xnet_prof_zerocopy(prof, hits, copied)    \
+	do { (void) (hits); (void) (copied); } while (0)
 
 #endif
 
@@ -97,6 +116,7 @@ typedef void  xnet_profile_t;
 #define XNET_MAX_EVENTS		128
 #define XNET_MIN_MULTI_RECV	16384
 #define XNET_PORT_MAX_RANGE	(USHRT_MAX)
+#define XNET_MAX_STRIPES	8
 
 extern struct fi_provider	xnet_prov;
 extern struct util_prov		xnet_util_prov;
@@ -115,11 +135,21 @@ extern size_t xnet_zerocopy_size;
 extern int xnet_trace_msg;
 extern int xnet_disable_autoprog;
 extern int xnet_io_uring;
+extern int xnet_busy_poll;
 extern int xnet_max_saved;
 extern size_t xnet_max_saved_size;
+extern size_t xnet_rndv_size;
 extern size_t xnet_max_inject;
 extern size_t xnet_buf_size;
 extern int xnet_firewall_addr;
+extern int xnet_progress_shards;
+extern char *xnet_progress_affinity;
+extern int xnet_stripes;
+extern size_t xnet_stripe_size;
+extern size_t xnet_coalesce_size;
+extern int xnet_coalesce_delay;
+extern int xnet_conn_idle_timeout;
+extern int xnet_max_conns;
 
 struct xnet_xfer_entry;
 struct xnet_ep;
@@ -182,6 +212,10 @@ union xnet_hdrs {
 	struct xnet_tag_hdr	tag_hdr;
 	struct xnet_tag_rts_hdr	tag_rts_hdr;
 	struct xnet_tag_rts_data_hdr tag_rts_data_hdr;
+	struct xnet_msg_rts_hdr	msg_rts_hdr;
+	struct xnet_msg_rts_data_hdr msg_rts_data_hdr;
+	struct xnet_stripe_hdr	stripe_hdr;
+	struct xnet_coalesce_hdr coalesce_hdr;
 	uint8_t			max_hdr[XNET_MAX_HDR];
 };
 
@@ -193,6 +227,11 @@ struct xnet_active_rx {
 	struct xnet_xfer_entry	*entry;
 	int			(*handler)(struct xnet_ep *ep);
 	void			*claim_ctx;
+	/* bytes left in a coalesced frame, hdr is expanded from a
+	 * coalesce_hdr when set
+	 */
+	size_t			coalesce_left;
+	bool			coalesced;
 };
 
 struct xnet_active_tx {
@@ -204,6 +243,8 @@ struct xnet_saved_msg {
 	struct dlist_entry	entry;
 	struct slist		queue;
 	int			cnt;
+	/* untagged rts requests from this peer on xnet_srx::saved_rts */
+	int			rts_cnt;
 };
 
 struct xnet_srx {
@@ -213,6 +254,18 @@ struct xnet_srx {
 	struct slist		tag_queue;
 	struct ofi_dyn_arr	src_tag_queues;
 	struct ofi_dyn_arr	saved_msgs;
+	/* peers with saved tagged messages */
+	struct dlist_entry	saved_tag_list;
+	/* unexpected untagged rts requests, matched in arrival order */
+	struct slist		saved_rts;
+
+	/* Saved tagged messages, and endpoints holding an unexpected
+	 * tagged message, bucketed by tag in arrival order.  Receives
+	 * with an exact tag search only their bucket.  Receives using
+	 * ignore bits walk saved_tag_list and the progress unexp_tag_list.
+	 */
+	struct util_match_table	saved_tag_table;
+	struct util_match_table	unexp_tag_table;
 
 	struct xnet_xfer_entry	*(*match_tag_rx)(struct xnet_srx *srx,
 						 struct xnet_ep *ep,
@@ -235,6 +288,11 @@ int xnet_srx_context(struct fid_domain *domain, struct fi_rx_attr *attr,
 
 /* xnet_ep::util_ep::flags */
 #define XNET_EP_RENDEZVOUS (1 << 0)
+#define XNET_EP_STRIPE	   (1 << 1) /* additional stream of an rdm conn */
+#define XNET_EP_ACCEPTED   (1 << 2) /* rdm conn accepted from the peer */
+#define XNET_EP_RENDEZVOUS_MSG (1 << 3)
+#define XNET_EP_COALESCE   (1 << 4) /* peer accepts coalesced messages */
+#define XNET_EP_IDLE_CLOSE (1 << 5) /* peer accepts closing idle conns */
 
 struct xnet_ep {
 	struct util_ep		util_ep;
@@ -245,6 +303,8 @@ struct xnet_ep {
 	OFI_DBG_VAR(uint8_t, rx_id)
 
 	struct dlist_entry	unexp_entry;
+	/* bucket in xnet_srx::unexp_tag_table */
+	struct dlist_entry	unexp_tag_entry;
 	struct slist		rx_queue;
 	struct slist		tx_queue;
 	struct slist		priority_queue;
@@ -253,6 +313,12 @@ struct xnet_ep {
 	struct slist		rma_read_queue;
 	struct ofi_byte_idx	rts_queue;
 	struct ofi_byte_idx	cts_queue;
+	/* Open frame that small sends are coalesced into, listed on
+	 * xnet_progress::coalesce_list until it is queued for sending.
+	 */
+	struct xnet_xfer_entry	*coalesce;
+	struct dlist_entry	coalesce_entry;
+	uint64_t		coalesce_time;
 	struct xnet_saved_msg	*saved_msg;
 	int			rx_avail;
 	struct xnet_srx		*srx;
@@ -281,6 +347,10 @@ enum {
 	XNET_CONN_INDEXED = BIT(0),
 	XNET_CONN_TX_LOOPBACK = BIT(1),
 	XNET_CONN_RX_LOOPBACK = BIT(2),
+	/* Graceful close of an idle conn, see xnet_reap_conns() */
+	XNET_CONN_IDLE_REQ = BIT(3),
+	XNET_CONN_IDLE_ACK = BIT(4),
+	XNET_CONN_IDLE_ABORT = BIT(5),
 };
 
 struct xnet_conn {
@@ -289,6 +359,16 @@ struct xnet_conn {
 	struct util_peer_addr	*peer;
 	uint32_t		remote_pid;
 	int			flags;
+
+	/* Additional connections that carry striped rendezvous data,
+	 * leaving ep free for small messages.
+	 */
+	struct xnet_ep		*stripe_ep[XNET_MAX_STRIPES];
+	int			stripe_cnt;
+
+	/* xnet_progress::conn_lru, while ep is open and reaping is enabled */
+	struct dlist_entry	lru_entry;
+	uint64_t		active_time;
 };
 
 struct xnet_rdm {
@@ -301,6 +381,9 @@ struct xnet_rdm {
 	struct xnet_conn	*rx_loopback;
 	union ofi_sock_ip	addr;
 
+	/* Progress shard the endpoint was assigned to, if sharded */
+	struct xnet_domain	*shard;
+
 	xnet_profile_t *profile;
 };
 
@@ -310,6 +393,25 @@ ssize_t xnet_get_conn(struct xnet_rdm *rdm, fi_addr_t dest_addr,
 		      struct xnet_conn **conn);
 struct xnet_ep *xnet_get_rx_ep(struct xnet_rdm *rdm, fi_addr_t addr);
 void xnet_freeall_conns(struct xnet_rdm *rdm);
+int xnet_warmup_connect(struct util_ep *util_ep, fi_addr_t addr, bool start);
+
+/* msg endpoints opened by an rdm endpoint use their conn as context */
+static inline struct xnet_conn *xnet_ep2_conn(struct xnet_ep *ep)
+{
+	return (ep->srx && ep->srx->rdm) ?
+		ep->util_ep.ep_fid.fid.context : NULL;
+}
+
+static inline bool xnet_can_stripe(struct xnet_ep *ep, uint64_t msg_len)
+{
+	struct xnet_conn *conn;
+
+	if (!xnet_stripes || msg_len < xnet_stripe_size)
+		return false;
+
+	conn = xnet_ep2_conn(ep);
+	return conn && conn->stripe_cnt;
+}
 
 struct xnet_uring {
 	struct fid fid;
@@ -347,6 +449,20 @@ struct xnet_uring {
  * avoids complicated nested locking that would otherwise be needed to
  * handle event processing.
  */
+/* Successful completions gathered during a progress pass, all for the
+ * same CQ.  They are written when the pass ends, when a completion for
+ * another CQ arrives, or before an error is reported.
+ */
+#define XNET_COMP_BATCH		32
+
+struct xnet_comp_batch {
+	struct util_cq		*cq;
+	bool			active;
+	size_t			count;
+	struct fi_cq_tagged_entry comp[XNET_COMP_BATCH];
+	fi_addr_t		src[XNET_COMP_BATCH];
+};
+
 struct xnet_progress {
 	struct fid		fid;
 	struct ofi_genlock	ep_lock;
@@ -355,9 +471,17 @@ struct xnet_progress {
 
 	struct dlist_entry	unexp_msg_list;
 	struct dlist_entry	unexp_tag_list;
-	struct dlist_entry	saved_tag_list;
+	struct dlist_entry	coalesce_list;
 	struct fd_signal	signal;
 
+	/* Open rdm conns, least recently active first */
+	struct dlist_entry	conn_lru;
+	size_t			conn_cnt;
+	uint64_t		reap_time;
+
+	/* Active FI_CONNECT_PEERS requests of rdm endpoints */
+	struct dlist_entry	warmup_list;
+
 	struct slist		event_list;
 	struct ofi_bufpool	*xfer_pool;
 
@@ -370,14 +494,21 @@ struct xnet_progress {
 	struct ofi_dynpoll	epoll_fd;
 	struct ofi_epollfds_event events[XNET_MAX_EVENTS];
 
+	struct xnet_comp_batch	comps;
+
 	bool			auto_progress;
 	pthread_t		thread;
+	/* CPU set applied by the progress thread, if any */
+	char			*affinity;
+	struct xnet_fabric	*fabric;
 };
 
-int xnet_init_progress(struct xnet_progress *progress, struct fi_info *info);
+int xnet_init_progress(struct xnet_progress *progress,
+		       struct xnet_fabric *fabric, struct fi_info *info);
 void xnet_close_progress(struct xnet_progress *progress);
 int xnet_start_progress(struct xnet_progress *progress);
 void xnet_stop_progress(struct xnet_progress *progress);
+int xnet_set_progress_affinity(struct xnet_progress *progress, int index);
 int xnet_start_recv(struct xnet_ep *ep, struct xnet_xfer_entry *rx_entry);
 
 void xnet_progress(struct xnet_progress *progress, bool clear_signal);
@@ -410,6 +541,10 @@ static inline int xnet_progress_locked(struct xnet_progress *progress)
 struct xnet_fabric {
 	struct util_fabric	util_fabric;
 	struct dlist_entry	eq_list;
+	/* Busy poll progress threads started, used to spread them over
+	 * FI_TCP_PROGRESS_AFFINITY
+	 */
+	ofi_atomic32_t		progress_cnt;
 };
 
 static inline void xnet_signal_progress(struct xnet_progress *progress)
@@ -430,6 +565,9 @@ static inline void xnet_signal_progress(struct xnet_progress *progress)
 #define XNET_COPY_RECV		BIT(9)
 #define XNET_CLAIM_RECV		BIT(10)
 #define XNET_NEED_CTS		BIT(11)
+#define XNET_STRIPE_XFER	BIT(12)
+#define XNET_STRIPED		BIT(13)
+#define XNET_COALESCE_XFER	BIT(14)
 #define XNET_MULTI_RECV		FI_MULTI_RECV /* BIT(16) */
 
 struct xnet_mrecv {
@@ -446,6 +584,8 @@ struct xnet_xfer_entry {
 	struct util_cntr	*cntr;
 	uint64_t		tag_seq_no;
 	uint64_t		tag;
+	/* saved tagged message, bucket in xnet_srx::saved_tag_table */
+	struct dlist_entry	tag_entry;
 	union {
 		uint64_t		ignore;
 		size_t			rts_iov_cnt;
@@ -462,6 +602,29 @@ struct xnet_xfer_entry {
 	 */
 	struct xnet_xfer_entry  *resp_entry;
 
+	/* A rendezvous transfer that is XNET_STRIPED is split into
+	 * XNET_STRIPE_XFER chunks, one per stripe connection.  The
+	 * parent holds its rts/cts index and a reference per chunk.
+	 */
+	union {
+		struct {
+			struct xnet_xfer_entry	*parent;
+			/* ep holding the parent's rts/cts index */
+			struct xnet_ep		*ep;
+			size_t			len;
+		} chunk;
+		struct {
+			size_t			left;
+			int			ref;
+			int			err;
+		} stripe;
+		/* XNET_COALESCE_XFER frame, completes the queued sends */
+		struct {
+			struct slist		queue;
+			struct xnet_ep		*ep;
+		} coalesce;
+	};
+
 	/* hdr must be second to last, followed by msg_data.  msg_data
 	 * is sized dynamically based on the max_inject size
 	 */
@@ -493,10 +656,19 @@ struct xnet_domain {
 	 * progress an ep per thread, can have it's own
 	 * progress engine and avoid having a single
 	 * synchronization point among all eps.
+	 *
+	 * When FI_TCP_PROGRESS_SHARDS is set, rdm domains are
+	 * always multiplexed, but the number of subdomains is
+	 * capped.  Each subdomain is then a progress shard with
+	 * its own progress thread, and endpoints that do not
+	 * share a CQ or counter with an existing shard are placed
+	 * on the shard serving the fewest endpoints.
 	 */
 	 struct fi_info		*subdomain_info;
 	 struct ofi_genlock	subdomain_list_lock;
 	 struct dlist_entry	subdomain_list;
+	 int			subdomain_cnt;
+	 ofi_atomic32_t		shard_ep_cnt;
 };
 
 static inline struct xnet_progress *xnet_ep2_progress(struct xnet_ep *ep)
@@ -520,6 +692,26 @@ static inline struct xnet_progress *xnet_srx2_progress(struct xnet_srx *srx)
 	return &srx->domain->progress;
 }
 
+/* Idle rdm conns are checked for closing at this interval, in ms */
+#define XNET_REAP_INTERVAL	100
+
+static inline bool xnet_reap_enabled(void)
+{
+	return xnet_conn_idle_timeout > 0 || xnet_max_conns > 0;
+}
+
+/* Mark a conn as the most recently active */
+static inline void xnet_touch_conn(struct xnet_conn *conn)
+{
+	if (dlist_empty(&conn->lru_entry))
+		return;
+
+	dlist_remove(&conn->lru_entry);
+	dlist_insert_tail(&conn->lru_entry,
+			  &xnet_rdm2_progress(conn->rdm)->conn_lru);
+	conn->active_time = ofi_gettime_ms();
+}
+
 struct xnet_cq {
 	struct util_cq		util_cq;
 };
@@ -592,6 +784,8 @@ static inline struct xnet_cq *xnet_ep_tx_cq(struct xnet_ep *ep)
 int xnet_mplex_av_open(struct fid_domain *domain_fid, struct fi_av_attr *attr,
 		       struct fid_av **fid_av, void *context);
 int xnet_domain_multiplexed(struct fid_domain *domain_fid);
+int xnet_base_domain_open(struct fid_fabric *fabric, struct fi_info *info,
+			  struct fid_domain **domain, void *context);
 int xnet_domain_open(struct fid_fabric *fabric, struct fi_info *info,
 		     struct fid_domain **domain, void *context);
 int xnet_av_open(struct fid_domain *domain_fid, struct fi_av_attr *attr,
@@ -599,7 +793,12 @@ int xnet_av_open(struct fid_domain *domain_fid, struct fi_av_attr *attr,
 int xnet_cq_open(struct fid_domain *domain, struct fi_cq_attr *attr,
 		 struct fid_cq **cq_fid, void *context);
 void xnet_report_success(struct xnet_xfer_entry *xfer_entry);
+void xnet_stripe_done(struct xnet_xfer_entry *xfer, int err);
+void xnet_stripe_abort(struct xnet_progress *progress,
+		       struct xnet_xfer_entry *xfer);
 void xnet_report_error(struct xnet_xfer_entry *xfer_entry, int err);
+void xnet_coalesce_done(struct xnet_xfer_entry *xfer, int err);
+void xnet_flush_comps(struct xnet_progress *progress);
 int xnet_cntr_open(struct fid_domain *fid_domain, struct fi_cntr_attr *attr,
 		   struct fid_cntr **cntr_fid, void *context);
 void xnet_cntr_incerr(struct xnet_xfer_entry *xfer_entry);
@@ -758,17 +957,40 @@ static inline bool xnet_has_unexp(struct xnet_ep *ep)
 	return ep->cur_rx.handler && !ep->cur_rx.entry;
 }
 
+static inline struct dlist_entry *
+xnet_tag_bucket(struct util_match_table *table, uint64_t tag)
+{
+	return &table->buckets[fasthash64(&tag, sizeof(tag), 0) & table->mask];
+}
+
+static inline void xnet_clear_unexp(struct xnet_ep *ep)
+{
+	dlist_remove_init(&ep->unexp_entry);
+	dlist_remove_init(&ep->unexp_tag_entry);
+}
+
 void xnet_recv_saved(struct xnet_rdm *rdm,
 		     struct xnet_xfer_entry *saved_entry,
 		     struct xnet_xfer_entry *rx_entry);
 void xnet_complete_saved(struct xnet_xfer_entry *saved_entry,
 			 void *msg_data);
 
+void xnet_progress_saved_rts(struct xnet_srx *srx);
+
+static inline bool xnet_is_rts(union xnet_hdrs *hdr)
+{
+	return hdr->base_hdr.op == xnet_op_tag_rts ||
+	       hdr->base_hdr.op == xnet_op_msg_rts;
+}
+
 static inline uint64_t xnet_msg_len(union xnet_hdrs *hdr)
 {
 	if (hdr->base_hdr.op == xnet_op_tag_rts) {
 		return hdr->base_hdr.flags & XNET_REMOTE_CQ_DATA ?
 		       hdr->tag_rts_data_hdr.size : hdr->tag_rts_hdr.size;
+	} else if (hdr->base_hdr.op == xnet_op_msg_rts) {
+		return hdr->base_hdr.flags & XNET_REMOTE_CQ_DATA ?
+		       hdr->msg_rts_data_hdr.size : hdr->msg_rts_hdr.size;
 	} else {
 		return hdr->base_hdr.size - hdr->base_hdr.hdr_size;
 	}
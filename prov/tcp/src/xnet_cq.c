@@ -124,11 +124,86 @@ static void xnet_get_cq_info(struct xnet_xfer_entry *entry, uint64_t *flags,
 	}
 }
 
+void xnet_flush_comps(struct xnet_progress *progress)
+{
+	struct xnet_comp_batch *batch = &progress->comps;
+	struct util_cq *cq = batch->cq;
+	struct fi_cq_tagged_entry *comp;
+	ssize_t written;
+	size_t i;
+	int ret;
+
+	assert(xnet_progress_locked(progress));
+	if (!batch->count)
+		return;
+
+	written = ofi_cq_write_batch(cq, batch->comp, batch->src,
+				     batch->count);
+
+	/* Retry what the batch write could not queue one entry at a time,
+	 * as xnet_report_success() does when not batching.
+	 */
+	for (i = written < 0 ? 0 : written; i < batch->count; i++) {
+		comp = &batch->comp[i];
+		if (cq->src) {
+			ret = ofi_cq_write_src(cq, comp->op_context,
+					comp->flags, comp->len, comp->buf,
+					comp->data, comp->tag, batch->src[i]);
+		} else {
+			ret = ofi_cq_write(cq, comp->op_context, comp->flags,
+					   comp->len, comp->buf, comp->data,
+					   comp->tag);
+		}
+		if (ret)
+			FI_WARN(&xnet_prov, FI_LOG_CQ,
+				"Unable to write completion, cq overrun: %s\n",
+				fi_strerror(-ret));
+	}
+	if (batch->cq->wait)
+		batch->cq->wait->signal(batch->cq->wait);
+	batch->count = 0;
+}
+
+static void
+xnet_batch_comp(struct xnet_progress *progress, struct util_cq *cq,
+		void *context, uint64_t flags, size_t len, void *buf,
+		uint64_t data, uint64_t tag, fi_addr_t src)
+{
+	struct xnet_comp_batch *batch = &progress->comps;
+	struct fi_cq_tagged_entry *comp;
+
+	if (batch->count == XNET_COMP_BATCH ||
+	    (batch->count && batch->cq != cq))
+		xnet_flush_comps(progress);
+
+	batch->cq = cq;
+	comp = &batch->comp[batch->count];
+	comp->op_context = context;
+	comp->flags = flags;
+	comp->len = len;
+	comp->buf = buf;
+	comp->data = data;
+	comp->tag = tag;
+	batch->src[batch->count++] = src;
+}
+
 void xnet_report_success(struct xnet_xfer_entry *xfer_entry)
 {
+	struct xnet_progress *progress;
 	struct util_cq *cq;
 	uint64_t flags, data, tag;
 	size_t len;
+	int ret;
+
+	if (xfer_entry->ctrl_flags & XNET_STRIPE_XFER) {
+		xnet_stripe_done(xfer_entry, 0);
+		return;
+	}
+
+	if (xfer_entry->ctrl_flags & XNET_COALESCE_XFER) {
+		xnet_coalesce_done(xfer_entry, 0);
+		return;
+	}
 
 	if (xfer_entry->ctrl_flags & (XNET_INTERNAL_XFER | XNET_SAVED_XFER))
 		return;
@@ -171,14 +246,26 @@ void xnet_report_success(struct xnet_xfer_entry *xfer_entry)
 		tag = 0;
 	}
 
+	progress = xnet_cq2_progress(xfer_entry->cq);
+	if (progress->comps.active) {
+		xnet_batch_comp(progress, cq, xfer_entry->context, flags, len,
+				xfer_entry->user_buf, data, tag,
+				xfer_entry->src_addr);
+		return;
+	}
+
 	if (cq->src) {
-		ofi_cq_write_src(cq, xfer_entry->context, flags, len,
-				 xfer_entry->user_buf, data, tag,
-				 xfer_entry->src_addr);
+		ret = ofi_cq_write_src(cq, xfer_entry->context, flags, len,
+				       xfer_entry->user_buf, data, tag,
+				       xfer_entry->src_addr);
 	} else {
-		ofi_cq_write(cq, xfer_entry->context, flags, len,
-			     xfer_entry->user_buf, data, tag);
+		ret = ofi_cq_write(cq, xfer_entry->context, flags, len,
+				   xfer_entry->user_buf, data, tag);
 	}
+	if (ret)
+		FI_WARN(&xnet_prov, FI_LOG_CQ,
+			"Unable to write completion, cq overrun: %s\n",
+			fi_strerror(-ret));
 	if (cq->wait)
 		cq->wait->signal(cq->wait);
 }
@@ -187,6 +274,16 @@ void xnet_report_error(struct xnet_xfer_entry *xfer_entry, int err)
 {
 	struct fi_cq_err_entry err_entry;
 
+	if (xfer_entry->ctrl_flags & XNET_STRIPE_XFER) {
+		xnet_stripe_done(xfer_entry, err);
+		return;
+	}
+
+	if (xfer_entry->ctrl_flags & XNET_COALESCE_XFER) {
+		xnet_coalesce_done(xfer_entry, err);
+		return;
+	}
+
 	if (xfer_entry->ctrl_flags &
 	    (XNET_INTERNAL_XFER | XNET_SAVED_XFER | XNET_INJECT_OP)) {
 		if (xfer_entry->ctrl_flags &
@@ -232,6 +329,7 @@ void xnet_report_error(struct xnet_xfer_entry *xfer_entry, int err)
 	err_entry.err_data = NULL;
 	err_entry.err_data_size = 0;
 
+	xnet_flush_comps(xnet_cq2_progress(xfer_entry->cq));
 	ofi_cq_write_error(&xfer_entry->cq->util_cq, &err_entry);
 }
 
@@ -265,10 +363,13 @@ static struct fi_ops xnet_cq_fi_ops = {
 	.ops_open = fi_no_ops_open,
 };
 
+/* Don't block while coalesced sends are waiting to be sent */
 static int xnet_cq_wait_try_func(void *arg)
 {
-	OFI_UNUSED(arg);
-	return FI_SUCCESS;
+	struct xnet_cq *cq = arg;
+
+	return dlist_empty(&xnet_cq2_progress(cq)->coalesce_list) ?
+	       FI_SUCCESS : -FI_EAGAIN;
 }
 
 int xnet_cq_open(struct fid_domain *domain, struct fi_cq_attr *attr,
@@ -440,8 +541,10 @@ static struct fi_ops_cntr xnet_cntr_ops = {
 
 static int xnet_cntr_wait_try_func(void *arg)
 {
-	OFI_UNUSED(arg);
-	return FI_SUCCESS;
+	struct util_cntr *cntr = arg;
+
+	return dlist_empty(&xnet_cntr2_progress(cntr)->coalesce_list) ?
+	       FI_SUCCESS : -FI_EAGAIN;
 }
 
 int xnet_cntr_open(struct fid_domain *fid_domain, struct fi_cntr_attr *attr,
@@ -483,7 +586,7 @@ int xnet_cntr_open(struct fid_domain *fid_domain, struct fi_cntr_attr *attr,
 		if (attr->wait_obj == FI_WAIT_FD && ofi_have_epoll) {
 			ret = ofi_wait_add_fd(cntr->wait,
 					ofi_dynpoll_get_fd(&progress->epoll_fd),
-					POLLIN, xnet_cntr_wait_try_func, NULL,
+					POLLIN, xnet_cntr_wait_try_func, cntr,
 					&cntr->cntr_fid);
 		} else {
 			ret = xnet_start_progress(progress);
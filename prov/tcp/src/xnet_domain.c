@@ -426,20 +426,16 @@ static struct fi_ops_mr xnet_domain_fi_ops_mr = {
 	.regattr = xnet_mr_regattr,
 };
 
-int xnet_domain_open(struct fid_fabric *fabric_fid, struct fi_info *info,
-		     struct fid_domain **domain_fid, void *context)
+/* Opens a domain with its own progress engine.  This is also used to
+ * open the subdomains of a multiplexed domain.
+ */
+int xnet_base_domain_open(struct fid_fabric *fabric_fid, struct fi_info *info,
+			  struct fid_domain **domain_fid, void *context)
 {
+	struct xnet_fabric *fabric;
 	struct xnet_domain *domain;
 	int ret;
 
-	ret = ofi_prov_check_info(&xnet_util_prov, fabric_fid->api_version, info);
-	if (ret)
-		return ret;
-
-	if (info->ep_attr->type == FI_EP_RDM &&
-	    info->domain_attr->threading == FI_THREAD_COMPLETION)
-		return xnet_domain_mplex_open(fabric_fid, info, domain_fid, context);
-
 	domain = calloc(1, sizeof(*domain));
 	if (!domain)
 		return -FI_ENOMEM;
@@ -449,10 +445,13 @@ int xnet_domain_open(struct fid_fabric *fabric_fid, struct fi_info *info,
 	if (ret)
 		goto free;
 
-	ret = xnet_init_progress(&domain->progress, info);
+	fabric = container_of(fabric_fid, struct xnet_fabric,
+			      util_fabric.fabric_fid);
+	ret = xnet_init_progress(&domain->progress, fabric, info);
 	if (ret)
 		goto close;
 
+	ofi_atomic_initialize32(&domain->shard_ep_cnt, 0);
 	domain->ep_type = info->ep_attr->type;
 	domain->util_domain.domain_fid.fid.ops = &xnet_domain_fi_ops;
 	domain->util_domain.domain_fid.ops = &xnet_domain_ops;
@@ -467,3 +466,20 @@ free:
 	free(domain);
 	return ret;
 }
+
+int xnet_domain_open(struct fid_fabric *fabric_fid, struct fi_info *info,
+		     struct fid_domain **domain_fid, void *context)
+{
+	int ret;
+
+	ret = ofi_prov_check_info(&xnet_util_prov, fabric_fid->api_version, info);
+	if (ret)
+		return ret;
+
+	if (info->ep_attr->type == FI_EP_RDM &&
+	    (info->domain_attr->threading == FI_THREAD_COMPLETION ||
+	     xnet_progress_shards))
+		return xnet_domain_mplex_open(fabric_fid, info, domain_fid, context);
+
+	return xnet_base_domain_open(fabric_fid, info, domain_fid, context);
+}
@@ -53,6 +53,11 @@ static const char *const xnet_opstr[] = {
 	[xnet_op_tag_rts] = "tag rts",
 	[xnet_op_cts] = "cts",
 	[xnet_op_data] = "rndv data",
+	[xnet_op_data_stripe] = "rndv stripe data",
+	[xnet_op_stripe_done] = "rndv stripe done",
+	[xnet_op_msg_rts] = "msg rts",
+	[xnet_op_coalesced] = "coalesced",
+	[xnet_op_idle] = "idle",
 };
 
 static const char *xnet_op_str(uint8_t op)
@@ -156,6 +161,29 @@ static void xnet_set_no_port(SOCKET sock)
 #define xnet_set_no_port(sock)
 #endif
 
+#ifdef SO_BUSY_POLL
+static void xnet_set_busy_poll(SOCKET sock)
+{
+	int val = xnet_busy_poll;
+
+	/* Values above net.core.busy_read require CAP_NET_ADMIN */
+	if (setsockopt(sock, SOL_SOCKET, SO_BUSY_POLL, &val, sizeof(val))) {
+		FI_WARN_ONCE(&xnet_prov, FI_LOG_EP_CTRL,
+			     "setsockopt busy_poll failed (%s)\n",
+			     strerror(ofi_sockerr()));
+		return;
+	}
+
+#ifdef SO_PREFER_BUSY_POLL
+	val = 1;
+	(void) setsockopt(sock, SOL_SOCKET, SO_PREFER_BUSY_POLL,
+			  &val, sizeof(val));
+#endif
+}
+#else
+#define xnet_set_busy_poll(sock)
+#endif
+
 int xnet_setup_socket(SOCKET sock, struct fi_info *info)
 {
 	int ret, optval = 1;
@@ -183,6 +211,9 @@ int xnet_setup_socket(SOCKET sock, struct fi_info *info)
 		}
 	}
 
+	if (xnet_busy_poll)
+		xnet_set_busy_poll(sock);
+
 	ret = fi_fd_nonblock(sock);
 	if (ret) {
 		FI_WARN(&xnet_prov, FI_LOG_EP_CTRL,
@@ -337,7 +368,7 @@ xnet_flush_xfer_queue(struct xnet_progress *progress, struct slist *queue,
 					  entry);
 		if (xfer_entry->ctrl_flags & XNET_NEED_CTS) {
 			assert(idx);
-			assert(xfer_entry->hdr.base_hdr.op == xnet_op_tag_rts);
+			assert(xnet_is_rts(&xfer_entry->hdr));
 			ofi_byte_idx_remove(idx, xfer_entry->hdr.base_hdr.op_data);
 		}
 		slist_remove_head(queue);
@@ -346,8 +377,12 @@ xnet_flush_xfer_queue(struct xnet_progress *progress, struct slist *queue,
 	}
 }
 
+/* Entries are released from the index, as the queues are flushed both
+ * when the ep is disabled and again when it is closed.
+ */
 static void
-xnet_flush_byte_idx(struct xnet_progress *progress, struct ofi_byte_idx *idx)
+xnet_flush_byte_idx(struct xnet_progress *progress, struct ofi_byte_idx *idx,
+		    void *(*release)(struct ofi_byte_idx *idx, uint8_t index))
 {
 	struct xnet_xfer_entry *xfer_entry;
 	uint8_t i;
@@ -357,10 +392,17 @@ xnet_flush_byte_idx(struct xnet_progress *progress, struct ofi_byte_idx *idx)
 
 	for (i = 1; i < UINT8_MAX; i++) {
 		xfer_entry = ofi_byte_idx_lookup(idx, i);
-		if (xfer_entry) {
-			xnet_report_error(xfer_entry, FI_ECANCELED);
-			xnet_free_xfer(progress, xfer_entry);
+		if (!xfer_entry)
+			continue;
+
+		(void) release(idx, i);
+		/* Chunks on other connections may still reference it */
+		if (xfer_entry->ctrl_flags & XNET_STRIPED) {
+			xnet_stripe_abort(progress, xfer_entry);
+			continue;
 		}
+		xnet_report_error(xfer_entry, FI_ECANCELED);
+		xnet_free_xfer(progress, xfer_entry);
 	}
 }
 
@@ -390,10 +432,17 @@ static void xnet_ep_flush_all_queues(struct xnet_ep *ep)
 	if (ret)
 		FI_WARN(&xnet_prov, FI_LOG_EP_DATA, "Failed to cancel POLLIN uring\n");
 
+	if (ep->coalesce) {
+		dlist_remove_init(&ep->coalesce_entry);
+		xnet_report_error(ep->coalesce, FI_ECANCELED);
+		xnet_free_xfer(progress, ep->coalesce);
+		ep->coalesce = NULL;
+	}
+
 	if (ep->cur_tx.entry) {
 		ep->hdr_bswap(ep, &ep->cur_tx.entry->hdr.base_hdr);
 		if (ep->cur_tx.entry->ctrl_flags & XNET_NEED_CTS) {
-			assert(ep->cur_tx.entry->hdr.base_hdr.op == xnet_op_tag_rts);
+			assert(xnet_is_rts(&ep->cur_tx.entry->hdr));
 			ofi_byte_idx_remove(&ep->rts_queue,
 					    ep->cur_tx.entry->hdr.base_hdr.op_data);
 		}
@@ -407,8 +456,8 @@ static void xnet_ep_flush_all_queues(struct xnet_ep *ep)
 	xnet_flush_xfer_queue(progress, &ep->rma_read_queue, NULL);
 	xnet_flush_xfer_queue(progress, &ep->need_ack_queue, NULL);
 	xnet_flush_xfer_queue(progress, &ep->async_queue, NULL);
-	xnet_flush_byte_idx(progress, &ep->rts_queue);
-	xnet_flush_byte_idx(progress, &ep->cts_queue);
+	xnet_flush_byte_idx(progress, &ep->rts_queue, ofi_byte_idx_remove);
+	xnet_flush_byte_idx(progress, &ep->cts_queue, ofi_byte_idx_clear);
 
 	/* Saved messages are on the saved_msg queue and flushed by the srx */
 	if (ep->cur_rx.entry &&
@@ -416,6 +465,7 @@ static void xnet_ep_flush_all_queues(struct xnet_ep *ep)
 		xnet_report_error(ep->cur_rx.entry, FI_ECANCELED);
 		xnet_free_xfer(xnet_ep2_progress(ep), ep->cur_rx.entry);
 	}
+	ep->cur_rx.coalesce_left = 0;
 	xnet_reset_rx(ep);
 	xnet_flush_xfer_queue(progress, &ep->rx_queue, NULL);
 	ep->rx_avail = 0;
@@ -440,7 +490,7 @@ void xnet_ep_disable(struct xnet_ep *ep, int cm_err, void* err_data,
 	};
 
 	ep->state = XNET_DISCONNECTED;
-	dlist_remove_init(&ep->unexp_entry);
+	xnet_clear_unexp(ep);
 	if (!xnet_io_uring)
 		xnet_halt_sock(xnet_ep2_progress(ep), ep->bsock.sock);
 
@@ -529,8 +579,11 @@ void xnet_reset_rx(struct xnet_ep *ep)
 	ep->cur_rx.handler = NULL;
 	ep->cur_rx.entry = NULL;
 	ep->cur_rx.hdr_done = 0;
-	ep->cur_rx.hdr_len = sizeof(ep->cur_rx.hdr.base_hdr);
+	ep->cur_rx.hdr_len = ep->cur_rx.coalesce_left ?
+			     sizeof(ep->cur_rx.hdr.coalesce_hdr) :
+			     sizeof(ep->cur_rx.hdr.base_hdr);
 	ep->cur_rx.claim_ctx = NULL;
+	ep->cur_rx.coalesced = false;
 	OFI_DBG_SET(ep->cur_rx.hdr.base_hdr.version, 0);
 }
 
@@ -592,7 +645,7 @@ static int xnet_ep_close(struct fid *fid)
 	progress = xnet_ep2_progress(ep);
 	ofi_genlock_lock(&progress->ep_lock);
 	ep->state = XNET_DISCONNECTED;
-	dlist_remove_init(&ep->unexp_entry);
+	xnet_clear_unexp(ep);
 	if (!xnet_io_uring)
 		xnet_halt_sock(progress, ep->bsock.sock);
 	ofi_close_socket(ep->bsock.sock);
@@ -604,6 +657,7 @@ static int xnet_ep_close(struct fid *fid)
 	    ep->bsock.pollin_sockctx.uring_sqe_inuse)
 		return -FI_EBUSY;
 
+	ofi_bsock_free(&ep->bsock);
 	free(ep->cm_msg);
 	free(ep->addr);
 
@@ -807,6 +861,8 @@ int xnet_endpoint(struct fid_domain *domain, struct fi_info *info,
 	}
 
 	dlist_init(&ep->unexp_entry);
+	dlist_init(&ep->unexp_tag_entry);
+	dlist_init(&ep->coalesce_entry);
 	slist_init(&ep->rx_queue);
 	slist_init(&ep->tx_queue);
 	slist_init(&ep->priority_queue);
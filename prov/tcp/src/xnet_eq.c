@@ -216,7 +216,7 @@ int xnet_eq_create(struct fid_fabric *fabric_fid, struct fi_eq_attr *attr,
 	if (ret)
 		goto err2;
 
-	ret = xnet_init_progress(&eq->progress, NULL);
+	ret = xnet_init_progress(&eq->progress, fabric, NULL);
 	if (ret)
 		goto err3;
 
@@ -87,6 +87,7 @@ int xnet_create_fabric(struct fi_fabric_attr *attr,
 		return -FI_ENOMEM;
 
 	dlist_init(&fabric->eq_list);
+	ofi_atomic_initialize32(&fabric->progress_cnt, 0);
 
 	ret = ofi_fabric_init(&xnet_prov, &xnet_fabric_attr, attr,
 			      &fabric->util_fabric, context);
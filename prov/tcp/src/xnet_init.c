@@ -67,11 +67,21 @@ size_t xnet_zerocopy_size = SIZE_MAX;
 int xnet_trace_msg;
 int xnet_disable_autoprog;
 int xnet_io_uring;
+int xnet_busy_poll = 0;
 int xnet_max_saved = 64;
 size_t xnet_max_inject = XNET_DEF_INJECT;
 size_t xnet_buf_size = XNET_DEF_BUF_SIZE;
 size_t xnet_max_saved_size = SIZE_MAX;
+size_t xnet_rndv_size = SIZE_MAX;
 int xnet_firewall_addr = 0;
+int xnet_progress_shards = 0;
+char *xnet_progress_affinity = NULL;
+int xnet_stripes = 0;
+size_t xnet_stripe_size = 1048576;
+size_t xnet_coalesce_size = 0;
+int xnet_coalesce_delay = 0;
+int xnet_conn_idle_timeout = 0;
+int xnet_max_conns = 0;
 
 
 static void xnet_init_env(void)
@@ -141,6 +151,15 @@ static void xnet_init_env(void)
 			"overhead to handle unexpected messages, but may be "
 			"required by some applications to prevents hangs.");
 	fi_param_get_size_t(&xnet_prov, "max_saved_size", &xnet_max_saved_size);
+	fi_param_define(&xnet_prov, "rndv_size", FI_PARAM_SIZE_T,
+			"messages larger than this size are sent using a "
+			"rendezvous protocol, where the receiver pulls the "
+			"data into the matching application buffer.  "
+			"Unexpected rendezvous messages are queued without "
+			"buffering their data.  Applies to rdm endpoints "
+			"where the peer supports rendezvous.  Set to -1 to "
+			"disable (default: disabled)");
+	fi_param_get_size_t(&xnet_prov, "rndv_size", &xnet_rndv_size);
 
 	fi_param_define(&xnet_prov, "max_rx_size", FI_PARAM_SIZE_T,
 			"maximum size for message buffers. If set lower "
@@ -152,6 +171,8 @@ static void xnet_init_env(void)
 		xnet_buf_size = xnet_max_inject;
 	if (xnet_max_saved_size < xnet_buf_size)
 		xnet_max_saved_size = xnet_buf_size;
+	if (xnet_rndv_size < xnet_max_inject)
+		xnet_rndv_size = xnet_max_inject;
 
 	fi_param_define(&xnet_prov, "nodelay", FI_PARAM_BOOL,
 			"overrides default TCP_NODELAY socket setting "
@@ -166,9 +187,11 @@ static void xnet_init_env(void)
 			"size of buffer used to prefetch received data from "
 			"the kernel, set to 0 to disable");
 	fi_param_define(&xnet_prov, "zerocopy_size", FI_PARAM_SIZE_T,
-			"lower threshold where zero copy transfers will be "
-			"used, if supported by the platform, set to -1 to "
-			"disable (default: %zu)", xnet_zerocopy_size);
+			"lower threshold where zero copy transfers may be "
+			"used, if supported by the platform.  Larger "
+			"transfers use zero copy on a connection while it "
+			"is measured to be faster than copying.  Set to -1 "
+			"to disable (default: %zu)", xnet_zerocopy_size);
 	fi_param_get_int(&xnet_prov, "staging_sbuf_size",
 			 &xnet_staging_sbuf_size);
 	fi_param_get_int(&xnet_prov, "prefetch_rbuf_size",
@@ -188,8 +211,83 @@ static void xnet_init_env(void)
 	fi_param_get_bool(&xnet_prov, "io_uring",
 			 &xnet_io_uring);
 
+	fi_param_define(&xnet_prov, "busy_poll", FI_PARAM_INT,
+			"Low latency mode.  Sets SO_BUSY_POLL and "
+			"SO_PREFER_BUSY_POLL on sockets and the epoll busy "
+			"poll parameters to this many microseconds, and makes "
+			"progress threads spin rather than block "
+			"(default: %d, disabled)", xnet_busy_poll);
+	fi_param_get_int(&xnet_prov, "busy_poll", &xnet_busy_poll);
+	if (xnet_busy_poll < 0)
+		xnet_busy_poll = 0;
+
 	fi_param_define(&xnet_prov, "firewall_addr", FI_PARAM_BOOL, "if this node is behind firewall");
 	fi_param_get_bool(&xnet_prov, "firewall_addr", &xnet_firewall_addr);
+
+	fi_param_define(&xnet_prov, "progress_shards", FI_PARAM_INT,
+			"Number of progress shards used by each rdm domain.  "
+			"Each shard has its own progress thread and endpoints "
+			"are spread across the shards (default: 0, disabled)");
+	fi_param_get_int(&xnet_prov, "progress_shards", &xnet_progress_shards);
+	if (xnet_progress_shards < 0)
+		xnet_progress_shards = 0;
+
+	fi_param_define(&xnet_prov, "progress_affinity", FI_PARAM_STRING,
+			"CPU sets to bind progress threads to, separated by "
+			"';' (e.g. 0;1;2-3).  Shard N uses entry N modulo the "
+			"number of entries");
+	fi_param_get_str(&xnet_prov, "progress_affinity",
+			 &xnet_progress_affinity);
+
+	fi_param_define(&xnet_prov, "stripes", FI_PARAM_INT,
+			"Number of additional connections opened to each "
+			"peer of an rdm endpoint.  Large tagged transfers are "
+			"striped across them, while small messages use the "
+			"first connection.  Max %d (default: %d, disabled)",
+			XNET_MAX_STRIPES, xnet_stripes);
+	fi_param_get_int(&xnet_prov, "stripes", &xnet_stripes);
+	if (xnet_stripes < 0)
+		xnet_stripes = 0;
+	else if (xnet_stripes > XNET_MAX_STRIPES)
+		xnet_stripes = XNET_MAX_STRIPES;
+
+	fi_param_define(&xnet_prov, "stripe_size", FI_PARAM_SIZE_T,
+			"Minimum size of a message that is striped across "
+			"connections (default: %zu)", xnet_stripe_size);
+	fi_param_get_size_t(&xnet_prov, "stripe_size", &xnet_stripe_size);
+
+	fi_param_define(&xnet_prov, "coalesce_size", FI_PARAM_SIZE_T,
+			"Maximum number of bytes of small messages to the "
+			"same peer of an rdm endpoint that are coalesced "
+			"into a single frame.  Limited to max_rx_size "
+			"(default: %zu, disabled)", xnet_coalesce_size);
+	fi_param_get_size_t(&xnet_prov, "coalesce_size", &xnet_coalesce_size);
+	if (xnet_coalesce_size > xnet_buf_size)
+		xnet_coalesce_size = xnet_buf_size;
+
+	fi_param_define(&xnet_prov, "coalesce_delay", FI_PARAM_INT,
+			"Time in microseconds that a frame of coalesced "
+			"messages may be held open for more messages.  At 0, "
+			"the frame is sent by the next progress call "
+			"(default: %d)", xnet_coalesce_delay);
+	fi_param_get_int(&xnet_prov, "coalesce_delay", &xnet_coalesce_delay);
+	if (xnet_coalesce_delay < 0)
+		xnet_coalesce_delay = 0;
+
+	fi_param_define(&xnet_prov, "conn_idle_timeout", FI_PARAM_INT,
+			"Time in milliseconds after which an rdm connection "
+			"with no traffic is closed.  The connection is "
+			"reopened by the next transfer to the peer "
+			"(default: %d, disabled)", xnet_conn_idle_timeout);
+	fi_param_get_int(&xnet_prov, "conn_idle_timeout",
+			 &xnet_conn_idle_timeout);
+
+	fi_param_define(&xnet_prov, "max_conns", FI_PARAM_INT,
+			"Number of open rdm connections per progress "
+			"instance above which the least recently active "
+			"idle connections are closed (default: %d, "
+			"unlimited)", xnet_max_conns);
+	fi_param_get_int(&xnet_prov, "max_conns", &xnet_max_conns);
 }
 
 static void xnet_fini(void)
@@ -147,6 +147,26 @@ xnet_init_tx_iov(struct xnet_xfer_entry *tx_entry, size_t hdr_len,
 	}
 }
 
+static bool
+xnet_use_rts(struct xnet_ep *ep, struct xnet_xfer_entry *tx_entry)
+{
+	uint64_t msg_len;
+
+	msg_len = xnet_msg_len(&tx_entry->hdr);
+	if (tx_entry->hdr.base_hdr.op == xnet_op_tag) {
+		if (!(ep->util_ep.flags & XNET_EP_RENDEZVOUS))
+			return false;
+		/* The receiver will not buffer the message */
+		if (tx_entry->hdr.base_hdr.size > xnet_max_saved_size)
+			return true;
+	} else if (!(ep->util_ep.flags & XNET_EP_RENDEZVOUS_MSG)) {
+		return false;
+	}
+
+	/* Transfers that will be striped always use rendezvous */
+	return (msg_len > xnet_rndv_size) || xnet_can_stripe(ep, msg_len);
+}
+
 /* If the transfer should use rendezvous protocol
  * (ready-to-send-> + <-clear-to-send + data->),
  * reformat for RTS-CTS flow.
@@ -158,10 +178,10 @@ xnet_rts_check(struct xnet_ep *ep, struct xnet_xfer_entry *tx_entry)
 	uint8_t rts_ctx;
 
 	assert(xnet_progress_locked(xnet_ep2_progress(ep)));
-	assert(tx_entry->hdr.base_hdr.op == xnet_op_tag);
+	assert(tx_entry->hdr.base_hdr.op == xnet_op_tag ||
+	       tx_entry->hdr.base_hdr.op == xnet_op_msg);
 
-	if ((tx_entry->hdr.base_hdr.size <= xnet_max_saved_size) ||
-	    !(ep->util_ep.flags & XNET_EP_RENDEZVOUS))
+	if (!xnet_use_rts(ep, tx_entry))
 		return 0;
 
 	/* User data is iov[1+] */
@@ -176,7 +196,8 @@ xnet_rts_check(struct xnet_ep *ep, struct xnet_xfer_entry *tx_entry)
 	hdr_size = tx_entry->hdr.base_hdr.hdr_size;
 	*(uint64_t *) (((uint8_t *) &tx_entry->hdr) + hdr_size) = msg_len;
 
-	tx_entry->hdr.base_hdr.op = xnet_op_tag_rts;
+	tx_entry->hdr.base_hdr.op = (tx_entry->hdr.base_hdr.op == xnet_op_tag) ?
+				    xnet_op_tag_rts : xnet_op_msg_rts;
 	tx_entry->hdr.base_hdr.op_data = rts_ctx;
 	tx_entry->hdr.base_hdr.hdr_size += sizeof(msg_len);
 	tx_entry->hdr.base_hdr.size = tx_entry->hdr.base_hdr.hdr_size;
@@ -345,7 +366,9 @@ xnet_sendmsg(struct fid_ep *ep_fid, const struct fi_msg *msg, uint64_t flags)
 	xnet_set_ack_flags(tx_entry, flags);
 	tx_entry->context = msg->context;
 
-	xnet_tx_queue_insert(ep, tx_entry);
+	ret = xnet_rts_check(ep, tx_entry);
+	if (!ret)
+		xnet_tx_queue_insert(ep, tx_entry);
 unlock:
 	ofi_genlock_unlock(&xnet_ep2_progress(ep)->ep_lock);
 	return ret;
@@ -374,7 +397,9 @@ xnet_send(struct fid_ep *ep_fid, const void *buf, size_t len,
 			     FI_MSG | FI_SEND;
 	xnet_set_ack_flags(tx_entry, ep->util_ep.tx_op_flags);
 
-	xnet_tx_queue_insert(ep, tx_entry);
+	ret = xnet_rts_check(ep, tx_entry);
+	if (!ret)
+		xnet_tx_queue_insert(ep, tx_entry);
 unlock:
 	ofi_genlock_unlock(&xnet_ep2_progress(ep)->ep_lock);
 	return ret;
@@ -403,7 +428,9 @@ xnet_sendv(struct fid_ep *ep_fid, const struct iovec *iov,
 			     FI_MSG | FI_SEND;
 	xnet_set_ack_flags(tx_entry, ep->util_ep.tx_op_flags);
 
-	xnet_tx_queue_insert(ep, tx_entry);
+	ret = xnet_rts_check(ep, tx_entry);
+	if (!ret)
+		xnet_tx_queue_insert(ep, tx_entry);
 unlock:
 	ofi_genlock_unlock(&xnet_ep2_progress(ep)->ep_lock);
 	return ret;
@@ -466,7 +493,9 @@ xnet_senddata(struct fid_ep *ep_fid, const void *buf, size_t len,
 			     FI_MSG | FI_SEND;
 	xnet_set_ack_flags(tx_entry, ep->util_ep.tx_op_flags);
 
-	xnet_tx_queue_insert(ep, tx_entry);
+	ret = xnet_rts_check(ep, tx_entry);
+	if (!ret)
+		xnet_tx_queue_insert(ep, tx_entry);
 unlock:
 	ofi_genlock_unlock(&xnet_ep2_progress(ep)->ep_lock);
 	return ret;
@@ -39,6 +39,27 @@
 #ifdef HAVE_FABRIC_PROFILE
 #include <ofi_profile.h>
 
+static struct fi_profile_desc xnet_prof_vars[] = {
+	{
+	 .id = XNET_VAR_ZEROCOPY_HITS,
+	 .datatype_sel = fi_primitive_type,
+	 .datatype.primitive = FI_UINT64,
+	 .flags = 0,
+	 .size = 8,
+	 .name = "pvar_tcp_zerocopy_hits",
+	 .desc = "Zero copy sends completed without a copy"
+	},
+	{
+	 .id = XNET_VAR_ZEROCOPY_COPIED,
+	 .datatype_sel = fi_primitive_type,
+	 .datatype.primitive = FI_UINT64,
+	 .flags = 0,
+	 .size = 8,
+	 .name = "pvar_tcp_zerocopy_copied",
+	 .desc = "Zero copy sends copied by the kernel"
+	},
+};
+
 static int
 xnet_prof_init(struct fid *fid, uint64_t flags, void *context,
 	       struct fi_profile_ops *ops, struct xnet_profile **xnet_prof)
@@ -56,7 +77,8 @@ xnet_prof_init(struct fid *fid, uint64_t flags, void *context,
 
 	prof = &((*xnet_prof)->util_prof);
 	prof->prov = &xnet_prov;
-	ret = ofi_prof_init(prof, fid, flags, context, ops, 0, 0);
+	ret = ofi_prof_init(prof, fid, flags, context, ops,
+			    ARRAY_SIZE(xnet_prof_vars), 0);
 	if (ret) {
 		goto err;
 	}
@@ -64,6 +86,12 @@ xnet_prof_init(struct fid *fid, uint64_t flags, void *context,
 	ofi_prof_add_common_vars(prof);
 	ret = ofi_prof_add_var(prof, FI_VAR_UNEXP_MSG_CNT, NULL,
 			       &((*xnet_prof)->unexp_msg_cnt));
+	ret = ofi_prof_add_var(prof, XNET_VAR_ZEROCOPY_HITS,
+			       &xnet_prof_vars[0],
+			       &((*xnet_prof)->zerocopy_hits));
+	ret = ofi_prof_add_var(prof, XNET_VAR_ZEROCOPY_COPIED,
+			       &xnet_prof_vars[1],
+			       &((*xnet_prof)->zerocopy_copied));
 
 	ofi_prof_add_common_events(prof);
 
@@ -43,6 +43,10 @@
 #include <ofi_util.h>
 #include <ofi_iov.h>
 
+#ifdef HAVE_EPOLL
+#include <sys/ioctl.h>
+#endif
+
 
 static int (*xnet_start_op[xnet_op_max])(struct xnet_ep *ep);
 
@@ -86,7 +90,7 @@ static bool xnet_save_and_cont(struct xnet_ep *ep)
 {
 	assert(xnet_progress_locked(xnet_ep2_progress(ep)));
 	assert(ep->cur_rx.hdr.base_hdr.op == xnet_op_tag ||
-	       ep->cur_rx.hdr.base_hdr.op == xnet_op_tag_rts);
+	       xnet_is_rts(&ep->cur_rx.hdr));
 	assert(ep->srx);
 
 	if ((ep->cur_rx.data_left > xnet_max_saved_size) ||
@@ -100,6 +104,8 @@ static bool xnet_save_and_cont(struct xnet_ep *ep)
 			return false;
 	}
 
+	if (ep->cur_rx.hdr.base_hdr.op == xnet_op_msg_rts)
+		return (ep->saved_msg->rts_cnt < xnet_max_saved);
 	return (ep->saved_msg->cnt < xnet_max_saved);
 }
 
@@ -135,11 +141,18 @@ xnet_get_save_rx(struct xnet_ep *ep, uint64_t tag)
 		goto free_xfer;
 	}
 
-	slist_insert_tail(&rx_entry->entry, &ep->saved_msg->queue);
-	if (!ep->saved_msg->cnt++) {
-		assert(dlist_empty(&ep->saved_msg->entry));
-		dlist_insert_tail(&ep->saved_msg->entry,
-				  &progress->saved_tag_list);
+	if (ep->cur_rx.hdr.base_hdr.op == xnet_op_msg_rts) {
+		slist_insert_tail(&rx_entry->entry, &ep->srx->saved_rts);
+		ep->saved_msg->rts_cnt++;
+	} else {
+		slist_insert_tail(&rx_entry->entry, &ep->saved_msg->queue);
+		dlist_insert_tail(&rx_entry->tag_entry,
+				  xnet_tag_bucket(&ep->srx->saved_tag_table, tag));
+		if (!ep->saved_msg->cnt++) {
+			assert(dlist_empty(&ep->saved_msg->entry));
+			dlist_insert_tail(&ep->saved_msg->entry,
+					  &ep->srx->saved_tag_list);
+		}
 	}
 
 	xnet_prof_unexp_msg(ep->profile, 1);
@@ -186,7 +199,8 @@ static int xnet_queue_ack(struct xnet_ep *ep, uint8_t op, uint8_t op_data)
 	struct xnet_xfer_entry *resp;
 
 	assert(xnet_progress_locked(xnet_ep2_progress(ep)));
-	assert(op == xnet_op_msg || op == xnet_op_cts);
+	assert(op == xnet_op_msg || op == xnet_op_cts ||
+	       op == xnet_op_stripe_done || op == xnet_op_idle);
 	resp = xnet_alloc_xfer(xnet_ep2_progress(ep));
 	if (!resp)
 		return -FI_ENOMEM;
@@ -310,7 +324,7 @@ void xnet_recv_saved(struct xnet_rdm *rdm, struct xnet_xfer_entry *saved_entry,
 		saved_entry->iov_cnt = rx_entry->iov_cnt;
 	}
 
-	if (saved_entry->hdr.base_hdr.op == xnet_op_tag_rts) {
+	if (xnet_is_rts(&saved_entry->hdr)) {
 		ep = saved_entry->saving_ep;
 		(void) xnet_rts_matched(rdm, ep, saved_entry);
 		if (ep) {
@@ -500,7 +514,7 @@ static void xnet_need_cts(struct xnet_ep *ep, struct xnet_xfer_entry *tx_entry)
 	uint64_t msg_len;
 
 	assert(xnet_progress_locked(xnet_ep2_progress(ep)));
-	assert(tx_entry->hdr.base_hdr.op == xnet_op_tag_rts);
+	assert(xnet_is_rts(&tx_entry->hdr));
 
 	msg_len = xnet_msg_len(&tx_entry->hdr);
 	tx_entry->hdr.base_hdr.op = xnet_op_data;
@@ -626,15 +640,14 @@ static void xnet_pmem_commit(struct xnet_ep *ep, struct xnet_xfer_entry *rx_entr
 	}
 }
 
-static int xnet_alter_mrecv(struct xnet_ep *ep, struct xnet_xfer_entry *xfer,
+static int xnet_alter_mrecv(struct xnet_srx *srx, struct xnet_xfer_entry *xfer,
 			    size_t msg_len)
 {
 	struct xnet_xfer_entry *recv_entry;
 	size_t left;
 	int ret = FI_SUCCESS;
 
-	assert(ep->srx);
-	assert(xnet_progress_locked(xnet_ep2_progress(ep)));
+	assert(xnet_progress_locked(xnet_srx2_progress(srx)));
 
 	if ((msg_len && !xfer->iov_cnt) || (msg_len > xfer->iov[0].iov_len)) {
 		ret = -FI_ETRUNC;
@@ -642,11 +655,11 @@ static int xnet_alter_mrecv(struct xnet_ep *ep, struct xnet_xfer_entry *xfer,
 	}
 
 	left = xfer->iov[0].iov_len - msg_len;
-	if (!xfer->iov_cnt || (left < ep->srx->min_multi_recv_size))
+	if (!xfer->iov_cnt || (left < srx->min_multi_recv_size))
 		goto complete;
 
 	/* If we can't repost the remaining buffer, return it to the user. */
-	recv_entry = xnet_alloc_xfer(xnet_ep2_progress(ep));
+	recv_entry = xnet_alloc_xfer(xnet_srx2_progress(srx));
 	if (!recv_entry)
 		goto complete;
 
@@ -672,7 +685,7 @@ static int xnet_alter_mrecv(struct xnet_ep *ep, struct xnet_xfer_entry *xfer,
 	recv_entry->iov[0].iov_base = recv_entry->user_buf;
 	recv_entry->iov[0].iov_len = left;
 
-	slist_insert_head(&recv_entry->entry, &ep->srx->rx_queue);
+	slist_insert_head(&recv_entry->entry, &srx->rx_queue);
 	return 0;
 
 complete:
@@ -681,6 +694,37 @@ complete:
 	return ret;
 }
 
+/* Match posted untagged receives with saved rts requests.  An rts is
+ * only saved when no receive is posted, so it must be matched before
+ * any message from the same peer that is still waiting on its endpoint.
+ */
+void xnet_progress_saved_rts(struct xnet_srx *srx)
+{
+	struct xnet_xfer_entry *saved_entry, *rx_entry;
+	struct xnet_saved_msg *saved_msg;
+
+	assert(xnet_progress_locked(xnet_srx2_progress(srx)));
+	while (!slist_empty(&srx->saved_rts) && !slist_empty(&srx->rx_queue)) {
+		saved_entry = container_of(slist_remove_head(&srx->saved_rts),
+					   struct xnet_xfer_entry, entry);
+		rx_entry = container_of(slist_remove_head(&srx->rx_queue),
+					struct xnet_xfer_entry, entry);
+
+		saved_msg = ofi_array_at(&srx->saved_msgs, saved_entry->src_addr);
+		assert(saved_msg && saved_msg->rts_cnt);
+		saved_msg->rts_cnt--;
+		xnet_prof_unexp_msg(srx->profile, -1);
+
+		if (rx_entry->ctrl_flags & XNET_MULTI_RECV) {
+			(void) xnet_alter_mrecv(srx, rx_entry,
+						xnet_msg_len(&saved_entry->hdr));
+			saved_entry->ctrl_flags |= XNET_MULTI_RECV;
+			saved_entry->mrecv = rx_entry->mrecv;
+		}
+		xnet_recv_saved(srx->rdm, saved_entry, rx_entry);
+	}
+}
+
 static struct xnet_xfer_entry *xnet_get_rx_entry(struct xnet_ep *ep)
 {
 	struct xnet_xfer_entry *xfer;
@@ -734,7 +778,7 @@ int xnet_start_recv(struct xnet_ep *ep, struct xnet_xfer_entry *rx_entry)
 
 	assert(xnet_progress_locked(xnet_ep2_progress(ep)));
 	if (!dlist_empty(&ep->unexp_entry)) {
-		dlist_remove_init(&ep->unexp_entry);
+		xnet_clear_unexp(ep);
 		ret = xnet_update_pollflag(ep, POLLIN, true);
 		if (ret)
 			goto poll_err;
@@ -751,14 +795,16 @@ int xnet_start_recv(struct xnet_ep *ep, struct xnet_xfer_entry *rx_entry)
 	rx_entry->cntr = ep->util_ep.cntrs[CNTR_RX];
 
 	if (rx_entry->ctrl_flags & XNET_MULTI_RECV) {
-		assert(msg->hdr.base_hdr.op == xnet_op_msg);
-		(void) xnet_alter_mrecv(ep, rx_entry, recv_len);
+		assert(msg->hdr.base_hdr.op == xnet_op_msg ||
+		       msg->hdr.base_hdr.op == xnet_op_msg_rts);
+		(void) xnet_alter_mrecv(ep->srx, rx_entry,
+					xnet_msg_len(&msg->hdr));
 	}
 
 	ep->cur_rx.entry = rx_entry;
 	ep->cur_rx.handler = xnet_recv_msg_data;
 
-	if ((msg->hdr.base_hdr.op == xnet_op_tag_rts) &&
+	if (xnet_is_rts(&msg->hdr) &&
 	    !(rx_entry->ctrl_flags & XNET_SAVED_XFER)) {
 		ret = xnet_rts_matched(ep->srx->rdm, ep, rx_entry);
 		xnet_reset_rx(ep);
@@ -800,6 +846,37 @@ static int xnet_handle_msg(struct xnet_ep *ep)
 	return xnet_start_recv(ep, rx_entry);
 }
 
+/* An untagged rts carries no data, so it can be queued without blocking
+ * the connection when no receive buffer has been posted.
+ */
+static int xnet_handle_msg_rts(struct xnet_ep *ep)
+{
+	struct xnet_xfer_entry *rx_entry;
+	int ret;
+
+	assert(xnet_progress_locked(xnet_ep2_progress(ep)));
+	if (!ep->srx || !ep->srx->rdm)
+		return -FI_EIO;
+
+	rx_entry = xnet_get_rx_entry(ep);
+	if (rx_entry)
+		return xnet_start_recv(ep, rx_entry);
+
+	if (xnet_save_and_cont(ep)) {
+		rx_entry = xnet_get_save_rx(ep, 0);
+		if (rx_entry)
+			return xnet_start_recv(ep, rx_entry);
+	}
+	if (dlist_empty(&ep->unexp_entry)) {
+		dlist_insert_tail(&ep->unexp_entry,
+				  &xnet_ep2_progress(ep)->unexp_msg_list);
+		ret = xnet_update_pollflag(ep, POLLIN, false);
+		if (ret)
+			return ret;
+	}
+	return -FI_EAGAIN;
+}
+
 static int xnet_handle_tag(struct xnet_ep *ep)
 {
 	struct xnet_xfer_entry *rx_entry;
@@ -825,6 +902,8 @@ static int xnet_handle_tag(struct xnet_ep *ep)
 	if (dlist_empty(&ep->unexp_entry)) {
 		dlist_insert_tail(&ep->unexp_entry,
 				  &xnet_ep2_progress(ep)->unexp_tag_list);
+		dlist_insert_tail(&ep->unexp_tag_entry,
+				  xnet_tag_bucket(&ep->srx->unexp_tag_table, tag));
 		ret = xnet_update_pollflag(ep, POLLIN, false);
 		if (ret)
 			return ret;
@@ -832,25 +911,328 @@ static int xnet_handle_tag(struct xnet_ep *ep)
 	return -FI_EAGAIN;
 }
 
+static void
+xnet_stripe_put(struct xnet_progress *progress, struct xnet_xfer_entry *xfer)
+{
+	assert(xfer->stripe.ref > 0);
+	if (--xfer->stripe.ref)
+		return;
+
+	assert(!(xfer->ctrl_flags & XNET_STRIPED));
+	if (xfer->stripe.err) {
+		xnet_cntr_incerr(xfer);
+		xnet_report_error(xfer, xfer->stripe.err);
+	} else {
+		xnet_report_success(xfer);
+	}
+	xnet_free_xfer(progress, xfer);
+}
+
+/* The parent's rts/cts index was flushed */
+void xnet_stripe_abort(struct xnet_progress *progress,
+		       struct xnet_xfer_entry *xfer)
+{
+	assert(xfer->ctrl_flags & XNET_STRIPED);
+	xfer->ctrl_flags &= ~XNET_STRIPED;
+	if (!xfer->stripe.err)
+		xfer->stripe.err = FI_ECANCELED;
+	xnet_stripe_put(progress, xfer);
+}
+
+/* Called in place of reporting a chunk's completion.  A received
+ * transfer is done once all of its data has arrived, at which point the
+ * cts index is released and the sender is told.  The sender holds its
+ * rts index until then, so the index cannot be reused while chunks are
+ * still in flight on other connections.
+ */
+void xnet_stripe_done(struct xnet_xfer_entry *xfer, int err)
+{
+	struct xnet_xfer_entry *parent;
+	struct xnet_ep *ep;
+	uint8_t cts_ctx;
+
+	parent = xfer->chunk.parent;
+	ep = xfer->chunk.ep;
+	assert(xnet_progress_locked(xnet_ep2_progress(ep)));
+	xfer->ctrl_flags &= ~XNET_STRIPE_XFER;
+
+	if (err && !parent->stripe.err)
+		parent->stripe.err = err;
+	/* Truncated data is still removed from the stream */
+	if (!err || err == FI_ETRUNC)
+		parent->stripe.left -= xfer->chunk.len;
+
+	if ((parent->cq_flags & FI_RECV) && !parent->stripe.left &&
+	    (parent->ctrl_flags & XNET_STRIPED)) {
+		cts_ctx = parent->hdr.base_hdr.op_data;
+		ofi_byte_idx_clear(&ep->cts_queue, cts_ctx);
+		parent->ctrl_flags &= ~XNET_STRIPED;
+		if (xnet_queue_ack(ep, xnet_op_stripe_done, cts_ctx)) {
+			FI_WARN(&xnet_prov, FI_LOG_EP_DATA,
+				"Unable to complete striped transfer\n");
+			xnet_ep_disable(ep, 0, NULL, 0);
+		}
+		xnet_stripe_put(xnet_ep2_progress(ep), parent);
+	}
+	xnet_stripe_put(xnet_ep2_progress(ep), parent);
+}
+
+/* Split the data of a rendezvous send across the connected stripes of
+ * the peer.  The transfer is left on the rts_queue until the receiver
+ * reports that all data has arrived.
+ */
+static bool xnet_stripe_tx(struct xnet_ep *ep, struct xnet_xfer_entry *tx_entry)
+{
+	struct xnet_xfer_entry *chunk[XNET_MAX_STRIPES];
+	struct xnet_ep *stripe_ep[XNET_MAX_STRIPES];
+	struct xnet_conn *conn;
+	uint64_t msg_len, offset, len;
+	int i, cnt;
+
+	assert(xnet_progress_locked(xnet_ep2_progress(ep)));
+	/* Data must be received before an ack is sent */
+	if (tx_entry->ctrl_flags & XNET_NEED_ACK)
+		return false;
+
+	/* User data is iov[1+] */
+	msg_len = ofi_total_iov_len(&tx_entry->iov[1], tx_entry->iov_cnt - 1);
+	if (!xnet_can_stripe(ep, msg_len))
+		return false;
+
+	conn = xnet_ep2_conn(ep);
+	for (i = 0, cnt = 0; i < conn->stripe_cnt; i++) {
+		if (conn->stripe_ep[i]->state == XNET_CONNECTED)
+			stripe_ep[cnt++] = conn->stripe_ep[i];
+	}
+	if (!cnt)
+		return false;
+
+	for (i = 0; i < cnt; i++) {
+		chunk[i] = xnet_alloc_tx(stripe_ep[i]);
+		if (!chunk[i])
+			goto free;
+	}
+
+	len = (msg_len + cnt - 1) / cnt;
+	for (i = 0, offset = 0; i < cnt; i++, offset += len) {
+		if (len > msg_len - offset)
+			len = msg_len - offset;
+
+		chunk[i]->hdr.base_hdr.op = xnet_op_data_stripe;
+		chunk[i]->hdr.base_hdr.op_data = ep->cur_rx.hdr.base_hdr.op_data;
+		chunk[i]->hdr.base_hdr.hdr_size = sizeof(chunk[i]->hdr.stripe_hdr);
+		chunk[i]->hdr.base_hdr.size = sizeof(chunk[i]->hdr.stripe_hdr) +
+					      len;
+		chunk[i]->hdr.stripe_hdr.offset = offset;
+
+		chunk[i]->iov[0].iov_base = (void *) &chunk[i]->hdr;
+		chunk[i]->iov[0].iov_len = sizeof(chunk[i]->hdr.stripe_hdr);
+		chunk[i]->iov_cnt = tx_entry->iov_cnt - 1;
+		memcpy(&chunk[i]->iov[1], &tx_entry->iov[1],
+		       chunk[i]->iov_cnt * sizeof(chunk[i]->iov[1]));
+		ofi_consume_iov(&chunk[i]->iov[1], &chunk[i]->iov_cnt, offset);
+		(void) ofi_truncate_iov(&chunk[i]->iov[1], &chunk[i]->iov_cnt,
+					len);
+		chunk[i]->iov_cnt++;
+
+		chunk[i]->ctrl_flags = XNET_STRIPE_XFER;
+		chunk[i]->chunk.parent = tx_entry;
+		chunk[i]->chunk.ep = ep;
+		chunk[i]->chunk.len = len;
+	}
+
+	tx_entry->ctrl_flags |= XNET_STRIPED;
+	tx_entry->stripe.left = msg_len;
+	tx_entry->stripe.ref = cnt + 1;
+	tx_entry->stripe.err = 0;
+
+	for (i = 0; i < cnt; i++)
+		xnet_tx_queue_insert(stripe_ep[i], chunk[i]);
+	return true;
+
+free:
+	while (i--)
+		xnet_free_xfer(xnet_ep2_progress(ep), chunk[i]);
+	return false;
+}
+
+/* The messages in a coalesced frame are received one at a time through
+ * the regular receive path, see xnet_expand_coalesce_hdr().
+ */
+static int xnet_handle_coalesced(struct xnet_ep *ep)
+{
+	assert(xnet_progress_locked(xnet_ep2_progress(ep)));
+	if (ep->cur_rx.coalesce_left)
+		return -FI_EIO;
+
+	ep->cur_rx.coalesce_left = ep->cur_rx.data_left;
+	xnet_reset_rx(ep);
+	return FI_SUCCESS;
+}
+
 static int xnet_handle_cts(struct xnet_ep *ep)
 {
 	struct xnet_xfer_entry *tx_entry;
+	uint8_t rts_ctx;
 
 	assert(xnet_progress_locked(xnet_ep2_progress(ep)));
-	tx_entry = ofi_byte_idx_remove(&ep->rts_queue,
-				       ep->cur_rx.hdr.base_hdr.op_data);
-	if (!tx_entry) {
+	rts_ctx = ep->cur_rx.hdr.base_hdr.op_data;
+	tx_entry = ofi_byte_idx_lookup(&ep->rts_queue, rts_ctx);
+	if (!tx_entry || !(tx_entry->ctrl_flags & XNET_NEED_CTS)) {
 		FI_WARN(&xnet_prov, FI_LOG_EP_DATA, "Invalid cst index\n");
 		return -FI_EINVAL;
 	}
 
-	assert(tx_entry->ctrl_flags & XNET_NEED_CTS);
 	tx_entry->ctrl_flags &= ~XNET_NEED_CTS;
-	xnet_tx_queue_insert(ep, tx_entry);
+	if (!xnet_stripe_tx(ep, tx_entry)) {
+		(void) ofi_byte_idx_remove(&ep->rts_queue, rts_ctx);
+		xnet_tx_queue_insert(ep, tx_entry);
+	}
 	xnet_reset_rx(ep);
 	return 0;
 }
 
+static int xnet_handle_stripe_done(struct xnet_ep *ep)
+{
+	struct xnet_xfer_entry *tx_entry;
+	uint8_t rts_ctx;
+
+	assert(xnet_progress_locked(xnet_ep2_progress(ep)));
+	if (ep->cur_rx.hdr.base_hdr.size != sizeof(ep->cur_rx.hdr.base_hdr))
+		return -FI_EIO;
+
+	rts_ctx = ep->cur_rx.hdr.base_hdr.op_data;
+	tx_entry = ofi_byte_idx_lookup(&ep->rts_queue, rts_ctx);
+	if (!tx_entry || !(tx_entry->ctrl_flags & XNET_STRIPED)) {
+		FI_WARN(&xnet_prov, FI_LOG_EP_DATA, "Invalid stripe index\n");
+		return -FI_EINVAL;
+	}
+
+	(void) ofi_byte_idx_remove(&ep->rts_queue, rts_ctx);
+	tx_entry->ctrl_flags &= ~XNET_STRIPED;
+	xnet_stripe_put(xnet_ep2_progress(ep), tx_entry);
+	xnet_reset_rx(ep);
+	return 0;
+}
+
+static bool xnet_byte_idx_empty(struct ofi_byte_idx *idx)
+{
+	int i;
+
+	for (i = 1; idx->data && i <= UINT8_MAX; i++) {
+		if (ofi_byte_idx_lookup(idx, (uint8_t) i))
+			return false;
+	}
+	return true;
+}
+
+/* An ep is idle if nothing is in flight on it in either direction. */
+static bool xnet_ep_idle(struct xnet_ep *ep)
+{
+	return ep->state == XNET_CONNECTED && !ep->cur_tx.entry &&
+	       !ep->coalesce && !ep->cur_rx.hdr_done &&
+	       !ep->cur_rx.coalesce_left &&
+	       slist_empty(&ep->tx_queue) &&
+	       slist_empty(&ep->priority_queue) &&
+	       slist_empty(&ep->need_ack_queue) &&
+	       slist_empty(&ep->async_queue) &&
+	       slist_empty(&ep->rma_read_queue) &&
+	       !ofi_bsock_tosend(&ep->bsock) &&
+	       !ofi_bsock_readable(&ep->bsock) &&
+	       !ep->bsock.async_prefetch &&
+	       xnet_byte_idx_empty(&ep->rts_queue) &&
+	       xnet_byte_idx_empty(&ep->cts_queue) &&
+	       (!ep->saved_msg ||
+		(!ep->saved_msg->cnt && !ep->saved_msg->rts_cnt));
+}
+
+static bool xnet_conn_idle(struct xnet_conn *conn)
+{
+	int i;
+
+	if (!conn->ep || !(conn->ep->util_ep.flags & XNET_EP_IDLE_CLOSE) ||
+	    (conn->flags & (XNET_CONN_TX_LOOPBACK | XNET_CONN_RX_LOOPBACK)) ||
+	    conn->peer->firewall_addr || !xnet_ep_idle(conn->ep))
+		return false;
+
+	for (i = 0; i < conn->stripe_cnt; i++) {
+		if (!xnet_ep_idle(conn->stripe_ep[i]))
+			return false;
+	}
+	return true;
+}
+
+/* Idle conns are closed using a handshake on conn->ep, so that neither
+ * side closes a conn that the peer is sending over.  The side wanting to
+ * close sends a request.  The peer acks it if it is also idle, and stops
+ * sending over the conn.  If the requester is still idle when the ack
+ * arrives, it closes the conn, otherwise it nacks.  Each side reopens
+ * the conn on its next send, once the old connection has closed.
+ */
+static int xnet_handle_idle(struct xnet_ep *ep)
+{
+	struct xnet_conn *conn;
+	uint8_t type;
+	bool abort;
+	int ret = 0;
+
+	assert(xnet_progress_locked(xnet_ep2_progress(ep)));
+	conn = xnet_ep2_conn(ep);
+	if (!conn || conn->ep != ep ||
+	    ep->cur_rx.hdr.base_hdr.size != sizeof(ep->cur_rx.hdr.base_hdr)) {
+		FI_WARN(&xnet_prov, FI_LOG_EP_DATA, "Invalid idle request\n");
+		return -FI_EIO;
+	}
+
+	type = ep->cur_rx.hdr.base_hdr.op_data;
+	xnet_reset_rx(ep);
+
+	switch (type) {
+	case XNET_IDLE_REQ:
+		if ((conn->flags & XNET_CONN_IDLE_REQ) &&
+		    ofi_addr_cmp(&xnet_prov, &conn->peer->addr.sa,
+				 &conn->rdm->addr.sa) < 0) {
+			/* simultaneous requests, the peer answers ours */
+			break;
+		}
+
+		conn->flags &= ~(XNET_CONN_IDLE_REQ | XNET_CONN_IDLE_ABORT);
+		if (xnet_conn_idle(conn)) {
+			ret = xnet_queue_ack(ep, xnet_op_idle, XNET_IDLE_ACK);
+			if (!ret)
+				conn->flags |= XNET_CONN_IDLE_ACK;
+		} else {
+			ret = xnet_queue_ack(ep, xnet_op_idle, XNET_IDLE_NACK);
+		}
+		break;
+	case XNET_IDLE_ACK:
+		if (!(conn->flags & XNET_CONN_IDLE_REQ)) {
+			FI_WARN(&xnet_prov, FI_LOG_EP_DATA,
+				"Unexpected idle ack\n");
+			return -FI_EIO;
+		}
+
+		abort = conn->flags & XNET_CONN_IDLE_ABORT;
+		conn->flags &= ~(XNET_CONN_IDLE_REQ | XNET_CONN_IDLE_ABORT);
+		if (!abort && xnet_conn_idle(conn)) {
+			FI_INFO(&xnet_prov, FI_LOG_EP_CTRL,
+				"closing idle conn %p\n", conn);
+			xnet_ep_disable(ep, 0, NULL, 0);
+			return -FI_ENOTCONN;
+		}
+		ret = xnet_queue_ack(ep, xnet_op_idle, XNET_IDLE_NACK);
+		break;
+	case XNET_IDLE_NACK:
+		conn->flags &= ~(XNET_CONN_IDLE_REQ | XNET_CONN_IDLE_ACK |
+				 XNET_CONN_IDLE_ABORT);
+		break;
+	default:
+		FI_WARN(&xnet_prov, FI_LOG_EP_DATA, "Invalid idle request\n");
+		return -FI_EIO;
+	}
+	return ret;
+}
+
 static int xnet_handle_data(struct xnet_ep *ep)
 {
 	struct xnet_xfer_entry *rx_entry;
@@ -881,6 +1263,83 @@ static int xnet_handle_data(struct xnet_ep *ep)
 	return xnet_recv_msg_data(ep);
 }
 
+/* Data for a striped transfer may arrive on any connection to the peer,
+ * but the transfer is tracked by the connection that sent the cts.
+ */
+static int xnet_handle_data_stripe(struct xnet_ep *ep)
+{
+	struct xnet_xfer_entry *parent, *rx_entry;
+	struct xnet_active_rx *msg = &ep->cur_rx;
+	struct xnet_conn *conn;
+	uint64_t offset, len, msg_len;
+	size_t buf_len;
+	uint8_t cts_ctx;
+	int ret;
+
+	assert(xnet_progress_locked(xnet_ep2_progress(ep)));
+	conn = xnet_ep2_conn(ep);
+	if (!conn || !conn->ep ||
+	    msg->hdr.base_hdr.hdr_size != sizeof(msg->hdr.stripe_hdr)) {
+		FI_WARN(&xnet_prov, FI_LOG_EP_DATA, "Invalid stripe data\n");
+		return -FI_EIO;
+	}
+
+	cts_ctx = msg->hdr.base_hdr.op_data;
+	parent = ofi_byte_idx_lookup(&conn->ep->cts_queue, cts_ctx);
+	if (!parent) {
+		FI_WARN(&xnet_prov, FI_LOG_EP_DATA, "Invalid cts index\n");
+		return -FI_EINVAL;
+	}
+
+	offset = msg->hdr.stripe_hdr.offset;
+	len = msg->data_left;
+	msg_len = xnet_msg_len(&parent->hdr);
+	if (offset > msg_len || len > msg_len - offset) {
+		FI_WARN(&xnet_prov, FI_LOG_EP_DATA,
+			"rts - stripe data out of range\n");
+		return -FI_EIO;
+	}
+
+	rx_entry = xnet_alloc_xfer(xnet_ep2_progress(ep));
+	if (!rx_entry)
+		return -FI_ENOMEM;
+
+	if (!(parent->ctrl_flags & XNET_STRIPED)) {
+		parent->ctrl_flags |= XNET_STRIPED;
+		parent->stripe.left = msg_len;
+		parent->stripe.ref = 1;
+		parent->stripe.err = 0;
+	}
+	parent->stripe.ref++;
+
+	memcpy(&rx_entry->hdr, &msg->hdr, (size_t) msg->hdr.base_hdr.hdr_size);
+	rx_entry->ctrl_flags = XNET_STRIPE_XFER;
+	rx_entry->chunk.parent = parent;
+	rx_entry->chunk.ep = conn->ep;
+	rx_entry->chunk.len = len;
+
+	buf_len = ofi_total_iov_len(parent->iov, parent->iov_cnt);
+	if (buf_len > offset) {
+		rx_entry->iov_cnt = parent->iov_cnt;
+		memcpy(rx_entry->iov, parent->iov,
+		       parent->iov_cnt * sizeof(parent->iov[0]));
+		ofi_consume_iov(rx_entry->iov, &rx_entry->iov_cnt, offset);
+		(void) ofi_truncate_iov(rx_entry->iov, &rx_entry->iov_cnt, len);
+	} else {
+		rx_entry->iov_cnt = 0;
+	}
+
+	ep->cur_rx.entry = rx_entry;
+	ep->cur_rx.handler = xnet_recv_msg_data;
+	if (len && !rx_entry->iov_cnt) {
+		/* No buffer space left, discard the data */
+		ret = xnet_handle_truncate(ep);
+		if (ret)
+			return ret;
+	}
+	return xnet_recv_msg_data(ep);
+}
+
 static int xnet_handle_read_req(struct xnet_ep *ep)
 {
 	struct xnet_xfer_entry *resp;
@@ -1008,9 +1467,76 @@ static int xnet_handle_read_rsp(struct xnet_ep *ep)
 	return xnet_recv_msg_data(ep);
 }
 
+/* Rebuild the header of a message read from a coalesced frame.  Any
+ * cq_data and tag that follow the coalesce_hdr are read after base_hdr.
+ */
+static int xnet_expand_coalesce_hdr(struct xnet_ep *ep)
+{
+	struct xnet_active_rx *msg = &ep->cur_rx;
+	struct xnet_coalesce_hdr hdr;
+	size_t ext_len;
+	uint64_t size;
+
+	hdr = msg->hdr.coalesce_hdr;
+	hdr.flags = ntohs(hdr.flags);
+	hdr.size = ntohl(hdr.size);
+	ext_len = hdr.hdr_size - sizeof(hdr);
+	size = (uint64_t) hdr.hdr_size + hdr.size;
+
+	if ((hdr.op != xnet_op_msg && hdr.op != xnet_op_tag) ||
+	    (hdr.op == xnet_op_tag && !ep->srx) ||
+	    hdr.hdr_size < sizeof(hdr) || (ext_len & 7) ||
+	    ext_len > XNET_MAX_HDR - sizeof(msg->hdr.base_hdr) ||
+	    size > msg->coalesce_left) {
+		FI_WARN(&xnet_prov, FI_LOG_EP_DATA,
+			"Received invalid coalesced message\n");
+		return -FI_EIO;
+	}
+	msg->coalesce_left -= size;
+
+	memset(&msg->hdr.base_hdr, 0, sizeof(msg->hdr.base_hdr));
+	msg->hdr.base_hdr.version = XNET_HDR_VERSION;
+	msg->hdr.base_hdr.op = hdr.op;
+	msg->hdr.base_hdr.flags = hdr.flags;
+	msg->hdr.base_hdr.hdr_size = (uint8_t) (sizeof(msg->hdr.base_hdr) +
+						ext_len);
+	msg->hdr.base_hdr.size = msg->hdr.base_hdr.hdr_size + hdr.size;
+
+	msg->hdr_done = sizeof(msg->hdr.base_hdr);
+	msg->hdr_len = msg->hdr.base_hdr.hdr_size;
+	msg->coalesced = true;
+	return FI_SUCCESS;
+}
+
+static void xnet_coalesce_hdr_ntoh(struct xnet_ep *ep)
+{
+	uint64_t *cur;
+	int i, cnt;
+
+	cnt = (ep->cur_rx.hdr.base_hdr.hdr_size -
+	       sizeof(ep->cur_rx.hdr.base_hdr)) >> 3;
+	cur = (uint64_t *) (&ep->cur_rx.hdr.base_hdr + 1);
+	for (i = 0; i < cnt; i++)
+		cur[i] = ntohll(cur[i]);
+
+	if (xnet_trace_msg)
+		xnet_hdr_trace(ep, &ep->cur_rx.hdr.base_hdr);
+}
+
 static int xnet_progress_hdr(struct xnet_ep *ep)
 {
-	if (ep->cur_rx.hdr_done == sizeof(ep->cur_rx.hdr.base_hdr)) {
+	int ret;
+
+	if (ep->cur_rx.hdr_len == sizeof(ep->cur_rx.hdr.coalesce_hdr)) {
+		assert(ep->cur_rx.coalesce_left);
+		if (ep->cur_rx.hdr_done < ep->cur_rx.hdr_len)
+			return -FI_EAGAIN;
+
+		ret = xnet_expand_coalesce_hdr(ep);
+		if (ret)
+			return ret;
+	} else if (!ep->cur_rx.coalesced &&
+		   ep->cur_rx.hdr_done == sizeof(ep->cur_rx.hdr.base_hdr)) {
 		assert(ep->cur_rx.hdr_len == sizeof(ep->cur_rx.hdr.base_hdr));
 
 		if (ep->cur_rx.hdr.base_hdr.hdr_size > XNET_MAX_HDR) {
@@ -1024,15 +1550,20 @@ static int xnet_progress_hdr(struct xnet_ep *ep)
 	if (ep->cur_rx.hdr_done < ep->cur_rx.hdr_len)
 		return -FI_EAGAIN;
 
-	ep->hdr_bswap(ep, &ep->cur_rx.hdr.base_hdr);
+	if (ep->cur_rx.coalesced) {
+		/* The coalesced frame carried the sequence number */
+		xnet_coalesce_hdr_ntoh(ep);
+	} else {
+		ep->hdr_bswap(ep, &ep->cur_rx.hdr.base_hdr);
 
 #ifndef NDEBUG
-	if (ep->cur_rx.hdr.base_hdr.id != ep->rx_id++) {
-		FI_WARN(&xnet_prov, FI_LOG_EP_DATA,
-			"Received invalid hdr sequence number\n");
-		return -FI_EIO;
-	}
+		if (ep->cur_rx.hdr.base_hdr.id != ep->rx_id++) {
+			FI_WARN(&xnet_prov, FI_LOG_EP_DATA,
+				"Received invalid hdr sequence number\n");
+			return -FI_EIO;
+		}
 #endif
+	}
 
 	if (ep->cur_rx.hdr.base_hdr.op >= ARRAY_SIZE(xnet_start_op)) {
 		FI_WARN(&xnet_prov, FI_LOG_EP_DATA,
@@ -1095,7 +1626,7 @@ static void xnet_complete_rx(struct xnet_ep *ep, ssize_t ret)
 
 	if ((rx_entry->hdr.base_hdr.flags &
 	    (XNET_DELIVERY_COMPLETE | XNET_COMMIT_COMPLETE)) &&
-	    ((rx_entry->hdr.base_hdr.op != xnet_op_tag_rts) ||
+	    (!xnet_is_rts(&rx_entry->hdr) ||
 	     !(rx_entry->ctrl_flags & XNET_SAVED_XFER))) {
 		ret = xnet_queue_ack(ep, xnet_op_msg, XNET_OP_ACK);
 		if (ret)
@@ -1123,9 +1654,14 @@ cq_error:
 
 void xnet_progress_rx(struct xnet_ep *ep)
 {
+	struct xnet_conn *conn;
 	int ret;
 
 	assert(xnet_progress_locked(xnet_ep2_progress(ep)));
+	conn = xnet_ep2_conn(ep);
+	if (conn)
+		xnet_touch_conn(conn);
+
 	do {
 		assert(ep->state == XNET_CONNECTED);
 		if (ep->cur_rx.hdr_done < ep->cur_rx.hdr_len) {
@@ -1159,14 +1695,19 @@ void xnet_progress_rx(struct xnet_ep *ep)
 void xnet_progress_async(struct xnet_ep *ep)
 {
 	struct xnet_xfer_entry *xfer;
+	uint64_t hits, copied;
 	int ret;
 
 	assert(xnet_progress_locked(xnet_ep2_progress(ep)));
+	hits = ep->bsock.zc.hits;
+	copied = ep->bsock.zc.copied;
 	ret = ofi_bsock_async_done(&xnet_prov, &ep->bsock);
 	if (ret) {
 		xnet_ep_disable(ep, 0, NULL, 0);
 		return;
 	}
+	xnet_prof_zerocopy(ep->profile, ep->bsock.zc.hits - hits,
+			   ep->bsock.zc.copied - copied);
 
 	while (!slist_empty(&ep->async_queue)) {
 		xfer = container_of(ep->async_queue.head,
@@ -1415,7 +1956,7 @@ int xnet_uring_cancel(struct xnet_progress *progress,
 	return 0;
 }
 
-void xnet_tx_queue_insert(struct xnet_ep *ep,
+static void xnet_queue_tx(struct xnet_ep *ep,
 			  struct xnet_xfer_entry *tx_entry)
 {
 	struct xnet_progress *progress;
@@ -1438,6 +1979,202 @@ void xnet_tx_queue_insert(struct xnet_ep *ep,
 	}
 }
 
+void xnet_coalesce_done(struct xnet_xfer_entry *xfer, int err)
+{
+	struct xnet_xfer_entry *tx_entry;
+	struct xnet_progress *progress;
+
+	progress = xnet_ep2_progress(xfer->coalesce.ep);
+	assert(xnet_progress_locked(progress));
+	while (!slist_empty(&xfer->coalesce.queue)) {
+		tx_entry = container_of(slist_remove_head(&xfer->coalesce.queue),
+					struct xnet_xfer_entry, entry);
+		if (err) {
+			xnet_cntr_incerr(tx_entry);
+			xnet_report_error(tx_entry, err);
+		} else {
+			xnet_report_success(tx_entry);
+		}
+		xnet_free_xfer(progress, tx_entry);
+	}
+}
+
+static void xnet_flush_coalesce(struct xnet_ep *ep)
+{
+	struct xnet_xfer_entry *xfer;
+
+	assert(ep->coalesce);
+	xfer = ep->coalesce;
+	ep->coalesce = NULL;
+	dlist_remove_init(&ep->coalesce_entry);
+	xnet_queue_tx(ep, xfer);
+}
+
+static void xnet_progress_coalesce(struct xnet_progress *progress)
+{
+	struct dlist_entry *item, *tmp;
+	struct xnet_ep *ep;
+	uint64_t now;
+
+	now = xnet_coalesce_delay ? ofi_gettime_ns() : 0;
+	dlist_foreach_safe(&progress->coalesce_list, item, tmp) {
+		ep = container_of(item, struct xnet_ep, coalesce_entry);
+		/* Frames are listed in the order they were opened */
+		if (now - ep->coalesce_time < xnet_coalesce_delay * 1000ULL)
+			break;
+		xnet_flush_coalesce(ep);
+	}
+}
+
+/* Close conns that have been idle for conn_idle_timeout, and the least
+ * recently active idle conns while more than max_conns are open.
+ */
+static void xnet_reap_conns(struct xnet_progress *progress)
+{
+	struct xnet_conn *conn;
+	struct dlist_entry *tmp;
+	uint64_t now;
+	size_t excess;
+
+	assert(xnet_progress_locked(progress));
+	now = ofi_gettime_ms();
+	if (now < progress->reap_time)
+		return;
+	progress->reap_time = now + XNET_REAP_INTERVAL;
+
+	excess = (xnet_max_conns > 0 &&
+		  progress->conn_cnt > (size_t) xnet_max_conns) ?
+		 progress->conn_cnt - xnet_max_conns : 0;
+
+	dlist_foreach_container_safe(&progress->conn_lru, struct xnet_conn,
+				     conn, lru_entry, tmp) {
+		if (!excess && (xnet_conn_idle_timeout <= 0 ||
+		    now - conn->active_time < (uint64_t) xnet_conn_idle_timeout))
+			break;
+
+		if (excess)
+			excess--;
+
+		if (conn->flags & (XNET_CONN_IDLE_REQ | XNET_CONN_IDLE_ACK))
+			continue;
+
+		/* Busy conns are checked again after a full timeout */
+		if (!xnet_conn_idle(conn) ||
+		    xnet_queue_ack(conn->ep, xnet_op_idle, XNET_IDLE_REQ)) {
+			xnet_touch_conn(conn);
+			continue;
+		}
+
+		FI_DBG(&xnet_prov, FI_LOG_EP_CTRL,
+		       "requesting close of idle conn %p\n", conn);
+		conn->flags |= XNET_CONN_IDLE_REQ;
+	}
+}
+
+static struct xnet_xfer_entry *xnet_open_coalesce(struct xnet_ep *ep)
+{
+	struct xnet_progress *progress;
+	struct xnet_xfer_entry *xfer;
+
+	progress = xnet_ep2_progress(ep);
+	xfer = xnet_alloc_tx(ep);
+	if (!xfer)
+		return NULL;
+
+	xfer->hdr.base_hdr.op = xnet_op_coalesced;
+	xfer->hdr.base_hdr.hdr_size = sizeof(xfer->hdr.base_hdr);
+	xfer->hdr.base_hdr.size = sizeof(xfer->hdr.base_hdr);
+	xfer->iov[0].iov_base = &xfer->hdr;
+	xfer->iov[0].iov_len = sizeof(xfer->hdr.base_hdr);
+	xfer->iov_cnt = 1;
+	xfer->ctrl_flags = XNET_COALESCE_XFER;
+	slist_init(&xfer->coalesce.queue);
+	xfer->coalesce.ep = ep;
+
+	ep->coalesce = xfer;
+	ep->coalesce_time = xnet_coalesce_delay ? ofi_gettime_ns() : 0;
+	dlist_insert_tail(&ep->coalesce_entry, &progress->coalesce_list);
+	xnet_signal_progress(progress);
+	return xfer;
+}
+
+/* Small sends to a peer that accepts coalesced messages are copied into
+ * an open frame, which is sent once it is full, once it has been open
+ * for coalesce_delay, or before any other transfer is queued.  The sends
+ * complete when the frame has been sent.
+ */
+static bool
+xnet_coalesce_tx(struct xnet_ep *ep, struct xnet_xfer_entry *tx_entry)
+{
+	struct xnet_coalesce_hdr hdr;
+	struct xnet_xfer_entry *xfer;
+	uint64_t *ext, val;
+	size_t ext_len, data_len, len;
+	uint8_t *buf;
+	int i;
+
+	if (!xnet_coalesce_size || !(ep->util_ep.flags & XNET_EP_COALESCE) ||
+	    (tx_entry->hdr.base_hdr.op != xnet_op_msg &&
+	     tx_entry->hdr.base_hdr.op != xnet_op_tag) ||
+	    (tx_entry->ctrl_flags & (XNET_INTERNAL_XFER | XNET_NEED_ACK)) ||
+	    tx_entry->iov_cnt != 1)
+		return false;
+
+	ext_len = tx_entry->hdr.base_hdr.hdr_size -
+		  sizeof(tx_entry->hdr.base_hdr);
+	data_len = xnet_msg_len(&tx_entry->hdr);
+	len = sizeof(hdr) + ext_len + data_len;
+	if (len > xnet_coalesce_size)
+		return false;
+
+	if (ep->coalesce && ep->coalesce->hdr.base_hdr.size -
+	    sizeof(ep->coalesce->hdr.base_hdr) + len > xnet_coalesce_size)
+		xnet_flush_coalesce(ep);
+
+	xfer = ep->coalesce ? ep->coalesce : xnet_open_coalesce(ep);
+	if (!xfer)
+		return false;
+
+	if (xnet_trace_msg)
+		xnet_hdr_trace(ep, &tx_entry->hdr.base_hdr);
+
+	hdr.op = tx_entry->hdr.base_hdr.op;
+	hdr.hdr_size = (uint8_t) (sizeof(hdr) + ext_len);
+	hdr.flags = htons(tx_entry->hdr.base_hdr.flags);
+	hdr.size = htonl((uint32_t) data_len);
+
+	buf = (uint8_t *) &xfer->hdr + xfer->hdr.base_hdr.size;
+	memcpy(buf, &hdr, sizeof(hdr));
+	buf += sizeof(hdr);
+
+	ext = (uint64_t *) (&tx_entry->hdr.base_hdr + 1);
+	for (i = 0; i < ext_len >> 3; i++) {
+		val = htonll(ext[i]);
+		memcpy(buf, &val, sizeof(val));
+		buf += sizeof(val);
+	}
+	memcpy(buf, (uint8_t *) &tx_entry->hdr +
+	       tx_entry->hdr.base_hdr.hdr_size, data_len);
+
+	xfer->hdr.base_hdr.size += len;
+	xfer->iov[0].iov_len = xfer->hdr.base_hdr.size;
+	slist_insert_tail(&tx_entry->entry, &xfer->coalesce.queue);
+	return true;
+}
+
+void xnet_tx_queue_insert(struct xnet_ep *ep,
+			  struct xnet_xfer_entry *tx_entry)
+{
+	assert(xnet_progress_locked(xnet_ep2_progress(ep)));
+	if (xnet_coalesce_tx(ep, tx_entry))
+		return;
+
+	/* Keep coalesced messages ordered with other transfers */
+	if (ep->coalesce && !(tx_entry->ctrl_flags & XNET_INTERNAL_XFER))
+		xnet_flush_coalesce(ep);
+	xnet_queue_tx(ep, tx_entry);
+}
+
 static int (*xnet_start_op[xnet_op_max])(struct xnet_ep *ep) = {
 	[xnet_op_msg] = xnet_handle_msg,
 	[xnet_op_tag] = xnet_handle_tag,
@@ -1447,6 +2184,11 @@ static int (*xnet_start_op[xnet_op_max])(struct xnet_ep *ep) = {
 	[xnet_op_tag_rts] = xnet_handle_tag,
 	[xnet_op_cts] = xnet_handle_cts,
 	[xnet_op_data] = xnet_handle_data,
+	[xnet_op_data_stripe] = xnet_handle_data_stripe,
+	[xnet_op_stripe_done] = xnet_handle_stripe_done,
+	[xnet_op_msg_rts] = xnet_handle_msg_rts,
+	[xnet_op_coalesced] = xnet_handle_coalesced,
+	[xnet_op_idle] = xnet_handle_idle,
 };
 
 static void xnet_run_ep(struct xnet_ep *ep, bool pin, bool pout, bool perr)
@@ -1550,6 +2292,10 @@ void xnet_run_progress(struct xnet_progress *progress, bool clear_signal)
 	int nfds;
 
 	assert(ofi_genlock_held(progress->active_lock));
+	progress->comps.active = true;
+	if (!dlist_empty(&progress->coalesce_list))
+		xnet_progress_coalesce(progress);
+
 	if (xnet_io_uring) {
 		xnet_progress_uring(progress, &progress->tx_uring);
 		xnet_progress_uring(progress, &progress->rx_uring);
@@ -1561,6 +2307,14 @@ void xnet_run_progress(struct xnet_progress *progress, bool clear_signal)
 					ARRAY_SIZE(progress->events), 0);
 		xnet_handle_events(progress, &progress->events[0], nfds, clear_signal);
 	}
+
+	if (!dlist_empty(&progress->warmup_list))
+		rxm_warmup_progress(&progress->warmup_list,
+				    xnet_warmup_connect);
+	if (!dlist_empty(&progress->conn_lru))
+		xnet_reap_conns(progress);
+	xnet_flush_comps(progress);
+	progress->comps.active = false;
 }
 
 void xnet_progress(struct xnet_progress *progress, bool clear_signal)
@@ -1692,14 +2446,36 @@ int xnet_progress_wait(struct xnet_progress *progress, int timeout)
 static void *xnet_auto_progress(void *arg)
 {
 	struct xnet_progress *progress = arg;
-	int nfds;
+	int nfds, timeout;
 
 	FI_INFO(&xnet_prov, FI_LOG_DOMAIN, "progress thread starting\n");
+	if (progress->affinity &&
+	    ofi_set_thread_affinity(progress->affinity)) {
+		FI_WARN(&xnet_prov, FI_LOG_DOMAIN,
+			"unable to set progress thread affinity to %s\n",
+			progress->affinity);
+	}
+
 	ofi_genlock_lock(progress->active_lock);
 	while (progress->auto_progress) {
+		/* In busy poll mode the thread spins instead of sleeping.
+		 * Otherwise, it wakes up to send open coalesced frames,
+		 * to retry connections being warmed up, and to close idle
+		 * conns.
+		 */
+		if (xnet_busy_poll)
+			timeout = 0;
+		else if (!dlist_empty(&progress->coalesce_list))
+			timeout = (xnet_coalesce_delay + 999) / 1000;
+		else if (!dlist_empty(&progress->warmup_list))
+			timeout = RXM_WARMUP_RETRY;
+		else if (!dlist_empty(&progress->conn_lru))
+			timeout = XNET_REAP_INTERVAL;
+		else
+			timeout = -1;
 		ofi_genlock_unlock(progress->active_lock);
 
-		nfds = xnet_progress_wait(progress, -1);
+		nfds = xnet_progress_wait(progress, timeout);
 		ofi_genlock_lock(progress->active_lock);
 		if (nfds >= 0)
 			xnet_run_progress(progress, true);
@@ -1745,6 +2521,16 @@ int xnet_start_progress(struct xnet_progress *progress)
 	if (xnet_disable_autoprog)
 		return 0;
 
+	/* A spinning thread should own its core, pin it if possible.
+	 * Threads take the affinity entries in the order they start.
+	 */
+	if (xnet_busy_poll && !progress->affinity) {
+		ret = xnet_set_progress_affinity(progress,
+			ofi_atomic_inc32(&progress->fabric->progress_cnt) - 1);
+		if (ret)
+			return ret;
+	}
+
 	ofi_genlock_lock(progress->active_lock);
 	if (progress->auto_progress) {
 		ret = 0;
@@ -1766,6 +2552,23 @@ unlock:
 	return ret;
 }
 
+/* FI_TCP_PROGRESS_AFFINITY holds one CPU set per progress thread.
+ * Progress thread 'index' uses entry index modulo the number of entries.
+ */
+int xnet_set_progress_affinity(struct xnet_progress *progress, int index)
+{
+	char *cpuset;
+	int ret;
+
+	ret = ofi_affinity_entry(xnet_progress_affinity, index, &cpuset);
+	if (ret || !cpuset)
+		return ret;
+
+	free(progress->affinity);
+	progress->affinity = cpuset;
+	return 0;
+}
+
 void xnet_stop_progress(struct xnet_progress *progress)
 {
 	ofi_genlock_lock(progress->active_lock);
@@ -1810,6 +2613,31 @@ static int xnet_init_locks(struct xnet_progress *progress, struct fi_info *info)
 	return ret;
 }
 
+/* Let epoll_wait busy poll the device queues of the monitored sockets
+ * before sleeping.  Requires Linux 6.9 or later.
+ */
+static void xnet_set_epoll_busy_poll(struct xnet_progress *progress)
+{
+#if defined(HAVE_EPOLL) && defined(EPIOCSPARAMS)
+	struct epoll_params params = {
+		.busy_poll_usecs = xnet_busy_poll,
+		.busy_poll_budget = 0,
+		.prefer_busy_poll = 1,
+	};
+
+	if (progress->epoll_fd.type != OFI_DYNPOLL_EPOLL)
+		return;
+
+	if (ioctl(ofi_epoll_fd(progress->epoll_fd.ep), EPIOCSPARAMS, &params)) {
+		FI_INFO(&xnet_prov, FI_LOG_EP_CTRL,
+			"epoll busy poll not supported (%s)\n",
+			strerror(errno));
+	}
+#else
+	OFI_UNUSED(progress);
+#endif
+}
+
 static int xnet_init_uring(struct xnet_uring *uring, size_t entries,
 			   struct ofi_sockapi_uring *sockapi,
 			   struct ofi_dynpoll *dynpoll)
@@ -1849,15 +2677,24 @@ static void xnet_destroy_uring(struct xnet_uring *uring,
 	}
 }
 
-int xnet_init_progress(struct xnet_progress *progress, struct fi_info *info)
+int xnet_init_progress(struct xnet_progress *progress,
+		       struct xnet_fabric *fabric, struct fi_info *info)
 {
 	int ret;
 
 	progress->fid.fclass = XNET_CLASS_PROGRESS;
 	progress->auto_progress = false;
+	progress->affinity = NULL;
+	progress->fabric = fabric;
+	progress->comps.active = false;
+	progress->comps.count = 0;
 	dlist_init(&progress->unexp_msg_list);
 	dlist_init(&progress->unexp_tag_list);
-	dlist_init(&progress->saved_tag_list);
+	dlist_init(&progress->coalesce_list);
+	dlist_init(&progress->conn_lru);
+	progress->conn_cnt = 0;
+	progress->reap_time = 0;
+	dlist_init(&progress->warmup_list);
 	slist_init(&progress->event_list);
 
 	ret = fd_signal_init(&progress->signal);
@@ -1874,6 +2711,9 @@ int xnet_init_progress(struct xnet_progress *progress, struct fi_info *info)
 	if (ret)
 		goto err2;
 
+	if (xnet_busy_poll)
+		xnet_set_epoll_busy_poll(progress);
+
 	ret = ofi_bufpool_create(&progress->xfer_pool,
 			sizeof(struct xnet_xfer_entry) + xnet_buf_size,
 			16, 0, 1024, 0);
@@ -1934,7 +2774,9 @@ void xnet_close_progress(struct xnet_progress *progress)
 {
 	assert(dlist_empty(&progress->unexp_msg_list));
 	assert(dlist_empty(&progress->unexp_tag_list));
-	assert(dlist_empty(&progress->saved_tag_list));
+	assert(dlist_empty(&progress->coalesce_list));
+	assert(dlist_empty(&progress->conn_lru));
+	assert(dlist_empty(&progress->warmup_list));
 	assert(slist_empty(&progress->event_list));
 	xnet_stop_progress(progress);
 	if (xnet_io_uring) {
@@ -1947,4 +2789,5 @@ void xnet_close_progress(struct xnet_progress *progress)
 	ofi_genlock_destroy(&progress->ep_lock);
 	ofi_genlock_destroy(&progress->rdm_lock);
 	fd_signal_free(&progress->signal);
+	free(progress->affinity);
 }
@@ -57,15 +57,33 @@ enum {
 	xnet_op_tag_rts,
 	xnet_op_cts,
 	xnet_op_data,
+	xnet_op_data_stripe,
+	xnet_op_stripe_done,
+	xnet_op_msg_rts,
+	xnet_op_coalesced,
+	xnet_op_idle,
 	xnet_op_max
 };
 
 /* Version 1 adds support for tagged rendezvous transfers.
  * ops: tag_rts, cts, data
  * VERSION_FLAG set in a response indicates the peer checks the version
+ *
+ * Version 2 adds support for untagged rendezvous transfers.
+ * ops: msg_rts
+ *
+ * Version 3 adds support for coalescing small messages into one frame.
+ * ops: coalesced
+ *
+ * Version 4 adds graceful closing of idle connections.
+ * ops: idle
+ *
+ * Striped rendezvous data is only exchanged with peers that negotiated
+ * the striping connection feature.
+ * ops: data_stripe, stripe_done
  */
 #define XNET_RDM_VERSION_FLAG	(1 << 7)
-#define XNET_RDM_VERSION	1
+#define XNET_RDM_VERSION	4
 
 #define XNET_CTRL_HDR_VERSION	3
 
@@ -90,6 +108,13 @@ enum {
 	XNET_OP_ACK = 2, /* indicates ack message - should be a flag */
 };
 
+/* base_hdr::op_data for xnet_op_idle */
+enum {
+	XNET_IDLE_REQ,
+	XNET_IDLE_ACK,
+	XNET_IDLE_NACK,
+};
+
 /* Flags */
 #define XNET_REMOTE_CQ_DATA	(1 << 0)
 /* not used XNET_TRANSMIT_COMPLETE (1 << 1) */
@@ -146,6 +171,39 @@ struct xnet_tag_rts_data_hdr {
 	uint64_t		size;
 };
 
+/* RDM protocol version 2 */
+struct xnet_msg_rts_hdr {
+	struct xnet_base_hdr	base_hdr;
+	uint64_t		size;
+};
+
+/* RDM protocol version 2 */
+struct xnet_msg_rts_data_hdr {
+	struct xnet_base_hdr	base_hdr;
+	uint64_t		cq_data;
+	uint64_t		size;
+};
+
+/* RDM protocol version 3
+ * An xnet_op_coalesced frame is a base_hdr followed by a series of small
+ * msg or tag messages, each starting with this header.  The header is
+ * followed by cq_data, if XNET_REMOTE_CQ_DATA is set, the tag, for
+ * xnet_op_tag, and the message data.  Fields, including cq_data and tag,
+ * are always in network byte order.
+ */
+struct xnet_coalesce_hdr {
+	uint8_t			op;
+	uint8_t			hdr_size;
+	uint16_t		flags;
+	uint32_t		size;
+};
+
+/* Striped rendezvous data, op_data is the cts index */
+struct xnet_stripe_hdr {
+	struct xnet_base_hdr	base_hdr;
+	uint64_t		offset;
+};
+
 /* Maximum header is scatter RMA with CQ data */
 #define XNET_MAX_HDR (sizeof(struct xnet_cq_data_hdr) + \
 		     sizeof(struct ofi_rma_iov) * XNET_IOV_LIMIT)
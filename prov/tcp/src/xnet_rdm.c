@@ -855,6 +855,36 @@ static void xnet_set_subdomain(struct xnet_rdm *rdm, struct xnet_domain *domain,
 	}
 }
 
+static struct xnet_domain *xnet_find_shard(struct xnet_domain *domain)
+{
+	struct fid_list_entry *item;
+	struct xnet_domain *subdomain, *shard = NULL;
+
+	assert(ofi_genlock_held(&domain->util_domain.lock));
+	ofi_genlock_lock(&domain->subdomain_list_lock);
+	dlist_foreach_container(&domain->subdomain_list,
+				struct fid_list_entry, item, entry) {
+		subdomain = container_of(item->fid, struct xnet_domain,
+					 util_domain.domain_fid.fid);
+		if (!shard || ofi_atomic_get32(&subdomain->shard_ep_cnt) <
+			      ofi_atomic_get32(&shard->shard_ep_cnt))
+			shard = subdomain;
+	}
+	ofi_genlock_unlock(&domain->subdomain_list_lock);
+	return shard;
+}
+
+static int xnet_start_shard(struct xnet_domain *subdomain, int index)
+{
+	int ret;
+
+	ret = xnet_set_progress_affinity(&subdomain->progress, index);
+	if (ret)
+		return ret;
+
+	return xnet_start_progress(&subdomain->progress);
+}
+
 int xnet_rdm_resolve_domains(struct xnet_rdm *rdm)
 {
 	int ret;
@@ -865,10 +895,14 @@ int xnet_rdm_resolve_domains(struct xnet_rdm *rdm)
 	domain = container_of(rdm->util_ep.domain, struct xnet_domain, util_domain);
 	ofi_genlock_lock(&domain->util_domain.lock);
 	subdomain = xnet_find_subdomain(rdm);
+	if (!subdomain && xnet_progress_shards &&
+	    domain->subdomain_cnt >= xnet_progress_shards)
+		subdomain = xnet_find_shard(domain);
+
 	if (!subdomain) {
-		ret = fi_domain(&domain->util_domain.fabric->fabric_fid,
-				domain->subdomain_info,
-				&subdomain_fid, NULL);
+		ret = xnet_base_domain_open(&domain->util_domain.fabric->fabric_fid,
+					    domain->subdomain_info,
+					    &subdomain_fid, NULL);
 		if (ret)
 			goto out;
 
@@ -882,11 +916,20 @@ int xnet_rdm_resolve_domains(struct xnet_rdm *rdm)
 			goto out;
 		}
 
+		domain->subdomain_cnt++;
+
 		ret = ofi_rbmap_foreach(domain->util_domain.mr_map.rbtree,
 					domain->util_domain.mr_map.rbtree->root,
 					xnet_reg_subdomain_mr, subdomain);
 		if (ret)
 			goto out;
+
+		if (xnet_progress_shards) {
+			ret = xnet_start_shard(subdomain,
+					       domain->subdomain_cnt - 1);
+			if (ret)
+				goto out;
+		}
 	}
 
 	xnet_set_subdomain(rdm, domain, subdomain);
@@ -902,6 +945,11 @@ int xnet_rdm_resolve_domains(struct xnet_rdm *rdm)
 	ofi_atomic_inc32(&subdomain->util_domain.ref);
 	rdm->srx->domain = subdomain;
 
+	if (xnet_progress_shards) {
+		ofi_atomic_inc32(&subdomain->shard_ep_cnt);
+		rdm->shard = subdomain;
+	}
+
 out:
 	ofi_genlock_unlock(&domain->util_domain.lock);
 	return ret;
@@ -966,6 +1014,40 @@ unlock:
 	return ret;
 }
 
+/* The application waits for warm-up events on its EQ, so have the EQ
+ * drive progress on the domain that owns the connections.
+ */
+static int xnet_rdm_connect_peers(struct xnet_rdm *rdm,
+				  struct fi_connect_peers *attr)
+{
+	struct xnet_progress *progress;
+	struct xnet_domain *domain;
+	struct xnet_eq *eq;
+	int ret;
+
+	if (!rdm->util_ep.eq)
+		return -FI_ENOEQ;
+
+	if (rdm->pep->state != XNET_LISTENING)
+		return -FI_EOPBADSTATE;
+
+	eq = container_of(rdm->util_ep.eq, struct xnet_eq, util_eq);
+	domain = container_of(rdm->util_ep.domain, struct xnet_domain,
+			      util_domain);
+	ret = xnet_add_domain_progress(eq, domain);
+	if (ret)
+		return ret;
+
+	progress = xnet_rdm2_progress(rdm);
+	ofi_genlock_lock(&progress->rdm_lock);
+	ret = rxm_warmup_start(&rdm->util_ep, &progress->warmup_list, attr);
+	if (!ret)
+		rxm_warmup_progress(&progress->warmup_list,
+				    xnet_warmup_connect);
+	ofi_genlock_unlock(&progress->rdm_lock);
+	return ret;
+}
+
 static int xnet_rdm_ctrl(struct fid *fid, int command, void *arg)
 {
 	struct xnet_rdm *rdm;
@@ -980,6 +1062,8 @@ static int xnet_rdm_ctrl(struct fid *fid, int command, void *arg)
 			return -FI_ENOCQ;
 
 		return xnet_enable_rdm(rdm);
+	case FI_CONNECT_PEERS:
+		return xnet_rdm_connect_peers(rdm, arg);
 	default:
 		return -FI_ENOSYS;
 	}
@@ -1001,6 +1085,8 @@ static int xnet_rdm_close(struct fid *fid)
 		return ret;
 	}
 
+	rxm_warmup_cleanup(&xnet_rdm2_progress(rdm)->warmup_list,
+			   &rdm->util_ep);
 	xnet_freeall_conns(rdm);
 	ofi_genlock_unlock(&xnet_rdm2_progress(rdm)->rdm_lock);
 
@@ -1011,6 +1097,9 @@ static int xnet_rdm_close(struct fid *fid)
 		return ret;
 	}
 
+	if (rdm->shard)
+		ofi_atomic_dec32(&rdm->shard->shard_ep_cnt);
+
 	ofi_endpoint_close(&rdm->util_ep);
 	free(rdm);
 	return 0;
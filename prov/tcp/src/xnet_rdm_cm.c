@@ -55,9 +55,14 @@ struct xnet_rdm_cm {
  */
 enum {
 	XNET_RDM_FIREWALL_ADDR = 1 << 0,
+	/* Peer accepts additional connections for striped transfers */
+	XNET_RDM_STRIPE = 1 << 1,
+	/* Request is for an additional connection of an existing conn */
+	XNET_RDM_STRIPE_EP = 1 << 2,
 	XNET_RDM_RESERVED = 1 << 7,
 };
-#define XNET_RDM_FEATURES (XNET_RDM_FIREWALL_ADDR)
+#define XNET_RDM_FEATURES (XNET_RDM_FIREWALL_ADDR | XNET_RDM_STRIPE | \
+			   XNET_RDM_STRIPE_EP)
 
 static int xnet_match_event(struct slist_entry *item, const void *arg)
 {
@@ -70,13 +75,54 @@ static int xnet_match_event(struct slist_entry *item, const void *arg)
 	return event->cm_entry.fid == &ep->util_ep.ep_fid.fid;
 }
 
-static void xnet_close_conn(struct xnet_conn *conn)
+static void xnet_close_ep(struct xnet_rdm *rdm, struct xnet_ep *ep)
 {
 	struct xnet_event *event;
 	struct slist_entry *item;
 
+	do {
+		item = slist_remove_first_match(
+			&xnet_rdm2_progress(rdm)->event_list,
+			xnet_match_event, ep);
+		if (!item)
+			break;
+
+		event = container_of(item, struct xnet_event, list_entry);
+		free(event);
+	} while (item);
+
+	if (ep->peer)
+		util_put_peer(ep->peer);
+
+	fi_close(&ep->util_ep.ep_fid.fid);
+}
+
+static void xnet_del_stripe(struct xnet_conn *conn, struct xnet_ep *ep)
+{
+	int i;
+
+	for (i = 0; i < conn->stripe_cnt; i++) {
+		if (conn->stripe_ep[i] == ep) {
+			conn->stripe_ep[i] = conn->stripe_ep[--conn->stripe_cnt];
+			break;
+		}
+	}
+	xnet_close_ep(conn->rdm, ep);
+}
+
+static void xnet_close_conn(struct xnet_conn *conn)
+{
+	struct xnet_progress *progress = xnet_rdm2_progress(conn->rdm);
+
 	FI_DBG(&xnet_prov, FI_LOG_EP_CTRL, "closing conn %p\n", conn);
-	assert(xnet_progress_locked(xnet_rdm2_progress(conn->rdm)));
+	assert(xnet_progress_locked(progress));
+
+	if (!dlist_empty(&conn->lru_entry)) {
+		dlist_remove_init(&conn->lru_entry);
+		progress->conn_cnt--;
+	}
+	conn->flags &= ~(XNET_CONN_IDLE_REQ | XNET_CONN_IDLE_ACK |
+			 XNET_CONN_IDLE_ABORT);
 
 	if (conn->flags & XNET_CONN_RX_LOOPBACK) {
 		if (conn == conn->rdm->rx_loopback)
@@ -84,24 +130,14 @@ static void xnet_close_conn(struct xnet_conn *conn)
 		conn->flags &= ~XNET_CONN_RX_LOOPBACK;
 	}
 
+	/* Striped transfers are tracked by conn->ep, close stripes first */
+	while (conn->stripe_cnt)
+		xnet_close_ep(conn->rdm, conn->stripe_ep[--conn->stripe_cnt]);
+
 	if (!conn->ep)
 		return;
 
-	do {
-		item = slist_remove_first_match(
-			&xnet_rdm2_progress(conn->rdm)->event_list,
-			xnet_match_event, conn->ep);
-		if (!item)
-			break;
-
-		event = container_of(item, struct xnet_event, list_entry);
-		free(event);
-	} while (item);
-
-	if (conn->ep->peer)
-		util_put_peer(conn->ep->peer);
-
-	fi_close(&conn->ep->util_ep.ep_fid.fid);
+	xnet_close_ep(conn->rdm, conn->ep);
 	conn->ep = NULL;
 }
 
@@ -181,7 +217,8 @@ static int xnet_bind_conn(struct xnet_rdm *rdm, struct xnet_ep *ep)
 	return 0;
 }
 
-static int xnet_open_conn(struct xnet_conn *conn, struct fi_info *info)
+static int xnet_open_ep(struct xnet_conn *conn, struct fi_info *info,
+			struct xnet_ep **ep)
 {
 	struct fid_ep *ep_fid;
 	int ret;
@@ -194,14 +231,14 @@ static int xnet_open_conn(struct xnet_conn *conn, struct fi_info *info)
 		return ret;
 	}
 
-	conn->ep = container_of(ep_fid, struct xnet_ep, util_ep.ep_fid);
-	ret = xnet_bind_conn(conn->rdm, conn->ep);
+	*ep = container_of(ep_fid, struct xnet_ep, util_ep.ep_fid);
+	ret = xnet_bind_conn(conn->rdm, *ep);
 	if (ret)
 		goto err;
 
-	conn->ep->peer = conn->peer;
+	(*ep)->peer = conn->peer;
 	rxm_ref_peer(conn->peer);
-	ret = fi_enable(&conn->ep->util_ep.ep_fid);
+	ret = fi_enable(&(*ep)->util_ep.ep_fid);
 	if (ret) {
 		XNET_WARN_ERR(FI_LOG_EP_CTRL, "fi_enable", ret);
 		goto err;
@@ -210,36 +247,82 @@ static int xnet_open_conn(struct xnet_conn *conn, struct fi_info *info)
 	return 0;
 
 err:
-	fi_close(&conn->ep->util_ep.ep_fid.fid);
-	conn->ep = NULL;
+	fi_close(&(*ep)->util_ep.ep_fid.fid);
+	*ep = NULL;
 	return ret;
 }
 
-static int xnet_rdm_connect(struct xnet_conn *conn)
+static int xnet_open_conn(struct xnet_conn *conn, struct fi_info *info)
 {
-	struct xnet_rdm_cm msg;
-	struct fi_info *info;
+	struct xnet_progress *progress = xnet_rdm2_progress(conn->rdm);
 	int ret;
 
-	FI_DBG(&xnet_prov, FI_LOG_EP_CTRL, "connecting %p\n", conn);
-	assert(xnet_progress_locked(xnet_rdm2_progress(conn->rdm)));
+	ret = xnet_open_ep(conn, info, &conn->ep);
+	if (ret || !xnet_reap_enabled())
+		return ret;
+
+	assert(dlist_empty(&conn->lru_entry));
+	dlist_insert_tail(&conn->lru_entry, &progress->conn_lru);
+	progress->conn_cnt++;
+	conn->active_time = ofi_gettime_ms();
+	return 0;
+}
+
+static int xnet_add_stripe(struct xnet_conn *conn, struct fi_info *info,
+			   struct xnet_ep **ep)
+{
+	int ret;
+
+	assert(conn->stripe_cnt < XNET_MAX_STRIPES);
+	ret = xnet_open_ep(conn, info, ep);
+	if (ret)
+		return ret;
+
+	(*ep)->util_ep.flags |= XNET_EP_STRIPE;
+	conn->stripe_ep[conn->stripe_cnt++] = *ep;
+	return 0;
+}
+
+static struct fi_info *xnet_conn_info(struct xnet_conn *conn)
+{
+	struct fi_info *info;
 
 	info = conn->rdm->pep->info;
 	info->dest_addrlen = info->src_addrlen;
 
 	free(info->dest_addr);
 	info->dest_addr = mem_dup(&conn->peer->addr, info->dest_addrlen);
-	if (!info->dest_addr)
+	return info->dest_addr ? info : NULL;
+}
+
+static void xnet_init_cm(struct xnet_conn *conn, struct xnet_rdm_cm *msg)
+{
+	msg->version = XNET_RDM_VERSION;
+	msg->pid = htonl((uint32_t) getpid());
+	msg->features = xnet_firewall_addr ? XNET_RDM_FIREWALL_ADDR : 0;
+	msg->port = htons(ofi_addr_get_port(&conn->rdm->addr.sa));
+}
+
+static int xnet_rdm_connect(struct xnet_conn *conn)
+{
+	struct xnet_rdm_cm msg;
+	struct fi_info *info;
+	int ret;
+
+	FI_DBG(&xnet_prov, FI_LOG_EP_CTRL, "connecting %p\n", conn);
+	assert(xnet_progress_locked(xnet_rdm2_progress(conn->rdm)));
+
+	info = xnet_conn_info(conn);
+	if (!info)
 		return -FI_ENOMEM;
 
 	ret = xnet_open_conn(conn, info);
 	if (ret)
 		return ret;
 
-	msg.version = XNET_RDM_VERSION;
-	msg.pid = htonl((uint32_t) getpid());
-	msg.features = xnet_firewall_addr ? XNET_RDM_FIREWALL_ADDR : 0;
-	msg.port = htons(ofi_addr_get_port(&conn->rdm->addr.sa));
+	xnet_init_cm(conn, &msg);
+	if (xnet_stripes)
+		msg.features |= XNET_RDM_STRIPE;
 
 	ofi_straddr_dbg(&xnet_prov, FI_LOG_EP_CTRL, "rdm addr",
 			&conn->rdm->addr);
@@ -258,6 +341,42 @@ err:
 	return ret;
 }
 
+/* The active side of a conn opens the stripes once the peer has
+ * accepted the first connection.  Striping uses the stripes that are
+ * connected at the time of a transfer, so failures here are not fatal.
+ */
+static void xnet_connect_stripes(struct xnet_conn *conn)
+{
+	struct xnet_rdm_cm msg;
+	struct fi_info *info;
+	struct xnet_ep *ep;
+	int ret;
+
+	assert(xnet_progress_locked(xnet_rdm2_progress(conn->rdm)));
+	info = xnet_conn_info(conn);
+	if (!info)
+		return;
+
+	xnet_init_cm(conn, &msg);
+	msg.features |= XNET_RDM_STRIPE_EP;
+
+	while (conn->stripe_cnt < xnet_stripes) {
+		FI_DBG(&xnet_prov, FI_LOG_EP_CTRL, "connecting stripe %d of "
+		       "%p\n", conn->stripe_cnt, conn);
+		ret = xnet_add_stripe(conn, info, &ep);
+		if (ret)
+			break;
+
+		ret = fi_connect(&ep->util_ep.ep_fid, info->dest_addr, &msg,
+				 sizeof msg);
+		if (ret) {
+			XNET_WARN_ERR(FI_LOG_EP_CTRL, "fi_connect", ret);
+			xnet_del_stripe(conn, ep);
+			break;
+		}
+	}
+}
+
 static void xnet_free_conn(struct xnet_conn *conn)
 {
 	struct rxm_av *av;
@@ -322,6 +441,8 @@ static struct xnet_conn *xnet_alloc_conn(struct xnet_rdm *rdm,
 
 	conn->rdm = rdm;
 	conn->flags = 0;
+	conn->stripe_cnt = 0;
+	dlist_init(&conn->lru_entry);
 	conn->peer = peer;
 	rxm_ref_peer(peer);
 
@@ -383,7 +504,15 @@ ssize_t xnet_get_conn(struct xnet_rdm *rdm, fi_addr_t addr,
 			return ret;
 	}
 
-	if ((*conn)->ep->state != XNET_CONNECTED) {
+	if ((*conn)->ep->state != XNET_CONNECTED ||
+	    ((*conn)->flags & (XNET_CONN_IDLE_REQ | XNET_CONN_IDLE_ACK))) {
+		/* A conn that is closing because it was idle is reopened
+		 * once the close completes.  Ask the peer to keep it open
+		 * if we have not agreed to close it yet.
+		 */
+		if ((*conn)->flags & XNET_CONN_IDLE_REQ)
+			(*conn)->flags |= XNET_CONN_IDLE_ABORT;
+
 		/* Force progress for apps that simply retry sending without
 		 * trying to drive progress in between.
 		 */
@@ -391,9 +520,51 @@ ssize_t xnet_get_conn(struct xnet_rdm *rdm, fi_addr_t addr,
 		return -FI_EAGAIN;
 	}
 
+	xnet_touch_conn(*conn);
 	return 0;
 }
 
+/* Connect callback for FI_CONNECT_PEERS, see rxm_warmup_progress().
+ * Unlike xnet_get_conn(), this is called from progress, so must not
+ * drive progress itself.
+ */
+int xnet_warmup_connect(struct util_ep *util_ep, fi_addr_t addr, bool start)
+{
+	struct util_peer_addr **peer;
+	struct xnet_conn *conn;
+	struct xnet_rdm *rdm;
+	int ret;
+
+	rdm = container_of(util_ep, struct xnet_rdm, util_ep);
+	assert(xnet_progress_locked(xnet_rdm2_progress(rdm)));
+	peer = ofi_av_addr_context(rdm->util_ep.av, addr);
+	conn = ofi_idm_lookup(&rdm->conn_idx_map, (*peer)->index);
+	if (conn && conn->ep) {
+		return (conn->ep->state == XNET_CONNECTED &&
+			!(conn->flags & (XNET_CONN_IDLE_REQ |
+					 XNET_CONN_IDLE_ACK))) ?
+		       0 : -FI_EAGAIN;
+	}
+
+	if (!start)
+		return -FI_ENOTCONN;
+
+	if ((*peer)->firewall_addr)
+		return -FI_EHOSTUNREACH;
+
+	if (!conn) {
+		conn = xnet_add_conn(rdm, *peer);
+		if (!conn)
+			return -FI_ENOMEM;
+	}
+
+	/* A peer that refuses may not be listening yet, retry it */
+	ret = xnet_rdm_connect(conn);
+	if (ret)
+		return ret == -FI_ECONNREFUSED ? -FI_ENOTCONN : ret;
+	return -FI_EAGAIN;
+}
+
 struct xnet_ep *xnet_get_rx_ep(struct xnet_rdm *rdm, fi_addr_t addr)
 {
 	struct util_peer_addr **peer;
@@ -420,6 +591,15 @@ static void xnet_set_protocol(struct xnet_ep *ep, struct xnet_rdm_cm *msg)
 		return;
 
 	switch (msg->version & ~XNET_RDM_VERSION_FLAG) {
+	case 4:
+		ep->util_ep.flags |= XNET_EP_IDLE_CLOSE;
+		/* fall through */
+	case 3:
+		ep->util_ep.flags |= XNET_EP_COALESCE;
+		/* fall through */
+	case 2:
+		ep->util_ep.flags |= XNET_EP_RENDEZVOUS_MSG;
+		/* fall through */
 	case 1:
 		ep->util_ep.flags |= XNET_EP_RENDEZVOUS;
 		/* fall through */
@@ -438,6 +618,44 @@ static void xnet_set_rdm_version(struct xnet_rdm_cm *msg)
 	msg->version |= XNET_RDM_VERSION_FLAG;
 }
 
+static int xnet_accept_stripe(struct xnet_rdm *rdm,
+			      struct util_peer_addr *peer,
+			      struct fi_eq_cm_entry *cm_entry)
+{
+	struct xnet_rdm_cm *msg;
+	struct xnet_conn *conn;
+	struct xnet_ep *ep;
+	int ret;
+
+	msg = (struct xnet_rdm_cm *) cm_entry->data;
+	conn = ofi_idm_lookup(&rdm->conn_idx_map, peer->index);
+	if (!xnet_stripes || !conn || !conn->ep ||
+	    (conn->flags & XNET_CONN_TX_LOOPBACK) ||
+	    (conn->ep->state != XNET_ACCEPTING &&
+	     conn->ep->state != XNET_CONNECTED) ||
+	    (conn->remote_pid != ntohl(msg->pid)) ||
+	    (conn->stripe_cnt == XNET_MAX_STRIPES)) {
+		FI_INFO(&xnet_prov, FI_LOG_EP_CTRL,
+			"no conn for stripe, reject peer %p\n", conn);
+		return -FI_ECONNREFUSED;
+	}
+
+	FI_INFO(&xnet_prov, FI_LOG_EP_CTRL, "stripe connreq for %p\n", conn);
+	ret = xnet_add_stripe(conn, cm_entry->info, &ep);
+	if (ret)
+		return ret;
+
+	ep->util_ep.flags |= XNET_EP_ACCEPTED;
+	msg->features &= XNET_RDM_FEATURES;
+	msg->pid = htonl((uint32_t) getpid());
+	xnet_set_rdm_version(msg);
+
+	ret = fi_accept(&ep->util_ep.ep_fid, msg, sizeof(*msg));
+	if (ret)
+		xnet_del_stripe(conn, ep);
+	return ret;
+}
+
 static void xnet_process_connreq(struct fi_eq_cm_entry *cm_entry)
 {
 	struct xnet_rdm *rdm;
@@ -466,6 +684,16 @@ static void xnet_process_connreq(struct fi_eq_cm_entry *cm_entry)
 		goto reject;
 	}
 
+	if (msg->features & XNET_RDM_STRIPE_EP) {
+		ret = xnet_accept_stripe(rdm, peer, cm_entry);
+		if (ret)
+			goto put;
+
+		util_put_peer(peer);
+		fi_freeinfo(cm_entry->info);
+		return;
+	}
+
 	conn = xnet_add_conn(rdm, peer);
 	if (!conn)
 		goto put;
@@ -504,6 +732,17 @@ static void xnet_process_connreq(struct fi_eq_cm_entry *cm_entry)
 		break;
 	case XNET_ACCEPTING:
 	case XNET_CONNECTED:
+		/* We agreed to close an idle conn, and the peer reconnected
+		 * before we saw the old connection close.
+		 */
+		if (conn->flags & XNET_CONN_IDLE_ACK) {
+			FI_INFO(&xnet_prov, FI_LOG_EP_CTRL,
+				"idle connection closing, replacing %p\n",
+				conn);
+			xnet_close_conn(conn);
+			break;
+		}
+
 		/* If we have't set the remote_pid but we're already connected,
 		 * there's a CONNECTED event on the event list queued after this
 		 * CONNREQ event.  The peer has already accepted the current
@@ -541,7 +780,10 @@ accept:
 			peer->str_addr, msg->features & ~XNET_RDM_FEATURES);
 	}
 	msg->features &= XNET_RDM_FEATURES;
+	if (!xnet_stripes || (conn->flags & XNET_CONN_RX_LOOPBACK))
+		msg->features &= ~XNET_RDM_STRIPE;
 
+	conn->ep->util_ep.flags |= XNET_EP_ACCEPTED;
 	msg->pid = htonl((uint32_t) getpid());
 	xnet_set_rdm_version(msg);
 	xnet_set_protocol(conn->ep, msg);
@@ -569,14 +811,25 @@ static void xnet_process_connected(struct fi_eq_cm_entry *cm_entry)
 {
 	struct xnet_conn *conn;
 	struct xnet_rdm_cm *msg;
+	struct xnet_ep *ep;
 
 	conn = cm_entry->fid->context;
+	ep = container_of(cm_entry->fid, struct xnet_ep, util_ep.ep_fid.fid);
+
+	/* The accepting side has no cm data, the connreq carried it */
+	if (ep->util_ep.flags & (XNET_EP_ACCEPTED | XNET_EP_STRIPE))
+		return;
+
 	msg = (struct xnet_rdm_cm *) cm_entry->data;
 	conn->remote_pid = ntohl(msg->pid);
 	xnet_set_protocol(conn->ep, msg);
 
 	FI_INFO(&xnet_prov, FI_LOG_EP_CTRL, "peer %s feautre supported: %x\n",
 		conn->peer->str_addr, msg->features);
+
+	if (xnet_stripes && (msg->features & XNET_RDM_STRIPE) &&
+	    !(conn->flags & XNET_CONN_TX_LOOPBACK))
+		xnet_connect_stripes(conn);
 }
 
 void xnet_handle_event_list(struct xnet_progress *progress)
@@ -601,6 +854,9 @@ void xnet_handle_event_list(struct xnet_progress *progress)
 			xnet_process_connected(&event->cm_entry);
 			break;
 		case FI_SHUTDOWN:
+			/* Striped transfers cannot complete without all of the
+			 * connections, so losing any one closes the conn.
+			 */
 			conn = event->cm_entry.fid->context;
 			xnet_close_conn(conn);
 			xnet_free_conn(conn);
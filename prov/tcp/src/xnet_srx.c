@@ -39,6 +39,9 @@
 #include <ofi_iov.h>
 
 
+#define XNET_SRX_MIN_BUCKETS	64
+#define XNET_SRX_MAX_BUCKETS	(1 << 12)
+
 static struct xnet_xfer_entry *
 xnet_match_tag(struct xnet_srx *srx, struct xnet_ep *ep, uint64_t tag);
 
@@ -76,6 +79,13 @@ xnet_srx_msg(struct xnet_srx *srx, struct xnet_xfer_entry *recv_entry)
 	/* See comment with xnet_srx_tag(). */
 	slist_insert_tail(&recv_entry->entry, &srx->rx_queue);
 
+	/* Saved rendezvous requests arrived before any waiting message. */
+	if (!slist_empty(&srx->saved_rts)) {
+		xnet_progress_saved_rts(srx);
+		if (slist_empty(&srx->rx_queue))
+			return;
+	}
+
 	if (!dlist_empty(&progress->unexp_msg_list)) {
 		if (recv_entry->ctrl_flags & FI_MULTI_RECV) {
 			xnet_progress_unexp(progress, &progress->unexp_msg_list);
@@ -232,14 +242,30 @@ static int xnet_match_unexp(struct dlist_entry *item, const void *arg)
 	return xnet_match_msg(ep->cur_rx.claim_ctx, &ep->cur_rx.hdr, arg);
 }
 
+static int xnet_match_entry(struct slist_entry *item, const void *arg)
+{
+	return item == arg;
+}
+
+static void
+xnet_remove_saved(struct xnet_saved_msg *saved_msg,
+		  struct xnet_xfer_entry *saved_entry)
+{
+	dlist_remove(&saved_entry->tag_entry);
+	if (!--saved_msg->cnt) {
+		assert(!dlist_empty(&saved_msg->entry));
+		dlist_remove_init(&saved_msg->entry);
+	}
+}
+
 static struct xnet_xfer_entry *
-xnet_match_saved(struct xnet_progress *progress, struct xnet_saved_msg *saved_msg,
+xnet_match_saved(struct xnet_srx *srx, struct xnet_saved_msg *saved_msg,
 		 struct xnet_xfer_entry *rx_entry, bool remove)
 {
 	struct xnet_xfer_entry *saved_entry;
 	struct slist_entry *item, *prev;
 
-	assert(xnet_progress_locked(progress));
+	assert(xnet_progress_locked(xnet_srx2_progress(srx)));
 	assert(saved_msg->cnt);
 
 	slist_foreach(&saved_msg->queue, item, prev) {
@@ -248,10 +274,7 @@ xnet_match_saved(struct xnet_progress *progress, struct xnet_saved_msg *saved_ms
 				   rx_entry)) {
 			if (remove) {
 				slist_remove(&saved_msg->queue, item, prev);
-				if (!--saved_msg->cnt) {
-					assert(!dlist_empty(&saved_msg->entry));
-					dlist_remove_init(&saved_msg->entry);
-				}
+				xnet_remove_saved(saved_msg, saved_entry);
 			}
 			return saved_entry;
 		}
@@ -259,24 +282,78 @@ xnet_match_saved(struct xnet_progress *progress, struct xnet_saved_msg *saved_ms
 	return NULL;
 }
 
+/* Messages are saved per peer, in order, up to xnet_max_saved.  A
+ * receive with an exact tag takes the first matching message in its
+ * bucket, which is the oldest from any peer.  Removing it from the peer
+ * queue is bounded by xnet_max_saved, independent of the number of peers.
+ * A claim is paired with its message by context, so it walks every peer
+ * like a receive with ignore bits.
+ */
 static struct xnet_xfer_entry *
-xnet_search_saved(struct xnet_progress *progress,
-		  struct xnet_xfer_entry *rx_entry, bool remove)
+xnet_search_saved(struct xnet_srx *srx, struct xnet_xfer_entry *rx_entry,
+		  bool remove)
 {
 	struct xnet_xfer_entry *saved_entry;
 	struct xnet_saved_msg *saved_msg;
 	struct dlist_entry *item;
 
-	assert(ofi_genlock_held(progress->active_lock));
-	dlist_foreach(&progress->saved_tag_list, item) {
-		saved_msg = container_of(item, struct xnet_saved_msg, entry);
+	assert(xnet_progress_locked(xnet_srx2_progress(srx)));
+	if (rx_entry->ignore || (rx_entry->ctrl_flags & XNET_CLAIM_RECV)) {
+		dlist_foreach(&srx->saved_tag_list, item) {
+			saved_msg = container_of(item, struct xnet_saved_msg,
+						 entry);
+			saved_entry = xnet_match_saved(srx, saved_msg,
+						       rx_entry, remove);
+			if (saved_entry)
+				return saved_entry;
+		}
+		return NULL;
+	}
 
-		saved_entry = xnet_match_saved(progress, saved_msg,
-					       rx_entry, remove);
-		if (saved_entry)
-			return saved_entry;
+	dlist_foreach_container(xnet_tag_bucket(&srx->saved_tag_table,
+						rx_entry->tag),
+				struct xnet_xfer_entry, saved_entry, tag_entry) {
+		if (!xnet_match_msg(saved_entry->context, &saved_entry->hdr,
+				    rx_entry))
+			continue;
+
+		if (remove) {
+			saved_msg = ofi_array_at(&srx->saved_msgs,
+						 saved_entry->src_addr);
+			assert(saved_msg && saved_msg->cnt);
+			slist_remove_first_match(&saved_msg->queue,
+						 xnet_match_entry,
+						 &saved_entry->entry);
+			xnet_remove_saved(saved_msg, saved_entry);
+		}
+		return saved_entry;
+	}
+	return NULL;
+}
+
+static struct xnet_ep *
+xnet_search_unexp(struct xnet_srx *srx, struct xnet_xfer_entry *rx_entry)
+{
+	struct xnet_progress *progress;
+	struct dlist_entry *entry;
+	struct xnet_ep *ep;
+
+	progress = xnet_srx2_progress(srx);
+	assert(xnet_progress_locked(progress));
+	if (rx_entry->ignore || (rx_entry->ctrl_flags & XNET_CLAIM_RECV)) {
+		entry = dlist_find_first_match(&progress->unexp_tag_list,
+					       xnet_match_unexp, rx_entry);
+		return entry ? container_of(entry, struct xnet_ep,
+					    unexp_entry) : NULL;
 	}
 
+	dlist_foreach_container(xnet_tag_bucket(&srx->unexp_tag_table,
+						rx_entry->tag),
+				struct xnet_ep, ep, unexp_tag_entry) {
+		if (xnet_match_msg(ep->cur_rx.claim_ctx, &ep->cur_rx.hdr,
+				   rx_entry))
+			return ep;
+	}
 	return NULL;
 }
 
@@ -285,34 +362,28 @@ xnet_find_msg(struct xnet_srx *srx, struct xnet_xfer_entry *recv_entry,
 	      struct xnet_ep **ep, struct xnet_xfer_entry **saved_entry,
 	      bool remove)
 {
-	struct xnet_progress *progress;
 	struct xnet_saved_msg *saved_msg;
-	struct dlist_entry *entry;
 
-	progress = xnet_srx2_progress(srx);
-	assert(xnet_progress_locked(progress));
+	assert(xnet_progress_locked(xnet_srx2_progress(srx)));
 
 	*ep = NULL;
 	if ((srx->match_tag_rx == xnet_match_tag) ||
 	    (recv_entry->src_addr == FI_ADDR_UNSPEC)) {
-		*saved_entry = xnet_search_saved(progress, recv_entry, remove);
+		*saved_entry = xnet_search_saved(srx, recv_entry, remove);
 		if (*saved_entry) {
 			if (remove)
 				xnet_prof_unexp_msg(srx->profile, -1);
 			return true;
 		}
 
-		entry = dlist_find_first_match(&progress->unexp_tag_list,
-					       xnet_match_unexp, recv_entry);
-		if (!entry)
+		*ep = xnet_search_unexp(srx, recv_entry);
+		if (!*ep)
 			return false;
-
-		*ep = container_of(entry, struct xnet_ep, unexp_entry);
 	} else {
 		*saved_entry = NULL;
 		saved_msg = ofi_array_at(&srx->saved_msgs, recv_entry->src_addr);
 		if (saved_msg && saved_msg->cnt) {
-			*saved_entry = xnet_match_saved(progress, saved_msg,
+			*saved_entry = xnet_match_saved(srx, saved_msg,
 							recv_entry, remove);
 			if (*saved_entry) {
 				if (remove)
@@ -433,6 +504,7 @@ nomatch:
 	err_entry.flags = FI_RECV | FI_TAGGED;
 	err_entry.tag = recv_entry->tag;
 	err_entry.err = ret;
+	xnet_flush_comps(xnet_srx2_progress(srx));
 	ofi_cq_write_error(&srx->cq->util_cq, &err_entry);
 	xnet_free_xfer(xnet_srx2_progress(srx), recv_entry);
 	return FI_SUCCESS;
@@ -465,7 +537,7 @@ xnet_srx_tag(struct xnet_srx *srx, struct xnet_xfer_entry *recv_entry)
 
 	if ((srx->match_tag_rx == xnet_match_tag) ||
 	    (recv_entry->src_addr == FI_ADDR_UNSPEC)) {
-		saved_entry = xnet_search_saved(progress, recv_entry, true);
+		saved_entry = xnet_search_saved(srx, recv_entry, true);
 		if (saved_entry) {
 			xnet_prof_unexp_msg(srx->profile, -1);
 			xnet_recv_saved(srx->rdm, saved_entry, recv_entry);
@@ -474,13 +546,23 @@ xnet_srx_tag(struct xnet_srx *srx, struct xnet_xfer_entry *recv_entry)
 
 		slist_insert_tail(&recv_entry->entry, &srx->tag_queue);
 
-		/* The message could match any endpoint waiting. */
-		if (!dlist_empty(&progress->unexp_tag_list))
-			xnet_progress_unexp(progress, &progress->unexp_tag_list);
+		/* With ignore bits, the message could match any endpoint
+		 * waiting.  Otherwise, only the oldest endpoint in the tag
+		 * bucket can take the receive.
+		 */
+		if (recv_entry->ignore) {
+			if (!dlist_empty(&progress->unexp_tag_list))
+				xnet_progress_unexp(progress,
+						    &progress->unexp_tag_list);
+		} else {
+			ep = xnet_search_unexp(srx, recv_entry);
+			if (ep)
+				xnet_progress_rx(ep);
+		}
 	} else {
 		saved_msg = ofi_array_at(&srx->saved_msgs, recv_entry->src_addr);
 		if (saved_msg && saved_msg->cnt) {
-			saved_entry = xnet_match_saved(progress, saved_msg,
+			saved_entry = xnet_match_saved(srx, saved_msg,
 						       recv_entry, true);
 			if (saved_entry) {
 				xnet_prof_unexp_msg(srx->profile, -1);
@@ -841,9 +923,31 @@ xnet_srx_cleanup_saved(struct ofi_dyn_arr *arr, void *item, void *context)
 	dlist_remove_init(&saved_msg->entry);
 	xnet_srx_cleanup(srx, &saved_msg->queue);
 	saved_msg->cnt = 0;
+	saved_msg->rts_cnt = 0;
 	return 0;
 }
 
+static int xnet_match_table_init(struct util_match_table *table, size_t size)
+{
+	size_t i;
+
+	table->buckets = calloc(size, sizeof(*table->buckets));
+	if (!table->buckets)
+		return -FI_ENOMEM;
+
+	for (i = 0; i < size; i++)
+		dlist_init(&table->buckets[i]);
+	table->mask = size - 1;
+	return FI_SUCCESS;
+}
+
+static void xnet_match_table_cleanup(struct util_match_table *table)
+{
+	free(table->buckets);
+	table->buckets = NULL;
+	table->mask = 0;
+}
+
 static void
 xnet_init_saved_msg(struct ofi_dyn_arr *arr, void *item)
 {
@@ -852,6 +956,7 @@ xnet_init_saved_msg(struct ofi_dyn_arr *arr, void *item)
 	slist_init(&saved_msg->queue);
 	dlist_init(&saved_msg->entry);
 	saved_msg->cnt = 0;
+	saved_msg->rts_cnt = 0;
 }
 
 static int xnet_srx_close(struct fid *fid)
@@ -863,12 +968,15 @@ static int xnet_srx_close(struct fid *fid)
 	ofi_genlock_lock(xnet_srx2_progress(srx)->active_lock);
 	xnet_srx_cleanup(srx, &srx->rx_queue);
 	xnet_srx_cleanup(srx, &srx->tag_queue);
+	xnet_srx_cleanup(srx, &srx->saved_rts);
 	ofi_array_iter(&srx->src_tag_queues, srx, xnet_srx_cleanup_queues);
 	ofi_array_iter(&srx->saved_msgs, srx, xnet_srx_cleanup_saved);
 	ofi_genlock_unlock(xnet_srx2_progress(srx)->active_lock);
 
 	ofi_array_destroy(&srx->src_tag_queues);
 	ofi_array_destroy(&srx->saved_msgs);
+	xnet_match_table_cleanup(&srx->saved_tag_table);
+	xnet_match_table_cleanup(&srx->unexp_tag_table);
 
 	if (srx->cntr)
 		ofi_atomic_dec32(&srx->cntr->ref);
@@ -891,11 +999,26 @@ int xnet_srx_context(struct fid_domain *domain, struct fi_rx_attr *attr,
 		     struct fid_ep **rx_ep, void *context)
 {
 	struct xnet_srx *srx;
+	size_t size;
+	int ret;
 
 	srx = calloc(1, sizeof(*srx));
 	if (!srx)
 		return -FI_ENOMEM;
 
+	/* Buckets hold unexpected messages, not posted receives, so the
+	 * receive queue size only guides the table size.
+	 */
+	size = roundup_power_of_two(MIN(MAX(attr->size, XNET_SRX_MIN_BUCKETS),
+					XNET_SRX_MAX_BUCKETS));
+	ret = xnet_match_table_init(&srx->saved_tag_table, size);
+	if (ret)
+		goto free;
+
+	ret = xnet_match_table_init(&srx->unexp_tag_table, size);
+	if (ret)
+		goto cleanup;
+
 	srx->rx_fid.fid.fclass = FI_CLASS_SRX_CTX;
 	srx->rx_fid.fid.context = context;
 	srx->rx_fid.fid.ops = &xnet_srx_fid_ops;
@@ -905,6 +1028,8 @@ int xnet_srx_context(struct fid_domain *domain, struct fi_rx_attr *attr,
 	srx->rx_fid.tagged = &xnet_srx_tag_ops;
 	slist_init(&srx->rx_queue);
 	slist_init(&srx->tag_queue);
+	dlist_init(&srx->saved_tag_list);
+	slist_init(&srx->saved_rts);
 	ofi_array_init(&srx->src_tag_queues, sizeof(struct slist), NULL);
 	ofi_array_init(&srx->saved_msgs, sizeof(struct xnet_saved_msg),
 		       xnet_init_saved_msg);
@@ -918,4 +1043,10 @@ int xnet_srx_context(struct fid_domain *domain, struct fi_rx_attr *attr,
 	srx->min_multi_recv_size = XNET_MIN_MULTI_RECV;
 	*rx_ep = &srx->rx_fid;
 	return FI_SUCCESS;
+
+cleanup:
+	xnet_match_table_cleanup(&srx->saved_tag_table);
+free:
+	free(srx);
+	return ret;
 }
@@ -275,7 +275,7 @@ static int rxm_av_remove(struct fid_av *av_fid, fi_addr_t *fi_addr,
 
 		if (!ofi_atomic_dec32(&av_entry->use_cnt)) {
 			rxm_put_peer_addr(av, fi_addr[i]);
-			HASH_DELETE(hh, av->util_av.hash, av_entry);
+			ofi_av_index_remove(&av->util_av, fi_addr[i]);
 			ofi_ibuf_free(av_entry);
 		}
 	}
@@ -490,3 +490,179 @@ free:
 	free(av);
 	return ret;
 }
+
+#define RXM_WARMUP_DEF_PENDING	64
+
+static void rxm_warmup_report(struct rxm_warmup *warmup, size_t index,
+			      int err)
+{
+	struct fi_eq_err_entry err_entry = {0};
+	struct fi_eq_entry entry = {0};
+
+	if (err) {
+		FI_INFO(warmup->ep->domain->prov, FI_LOG_EP_CTRL,
+			"unable to connect to fi_addr %" PRIu64 ": %s\n",
+			warmup->addr[index], fi_strerror(-err));
+		err_entry.fid = &warmup->ep->ep_fid.fid;
+		err_entry.context = warmup->context;
+		err_entry.data = index;
+		err_entry.err = -err;
+		(void) fi_eq_write(&warmup->ep->eq->eq_fid, FI_CONNECTED,
+				   &err_entry, sizeof(err_entry),
+				   UTIL_FLAG_ERROR);
+	} else {
+		entry.fid = &warmup->ep->ep_fid.fid;
+		entry.context = warmup->context;
+		entry.data = warmup->connected;
+		(void) fi_eq_write(&warmup->ep->eq->eq_fid, FI_CONNECTED,
+				   &entry, sizeof(entry), 0);
+	}
+}
+
+static void rxm_warmup_free(struct rxm_warmup *warmup)
+{
+	dlist_remove(&warmup->entry);
+	free(warmup->pending);
+	free(warmup->addr);
+	free(warmup);
+}
+
+int rxm_warmup_start(struct util_ep *ep, struct dlist_entry *list,
+		     const struct fi_connect_peers *attr)
+{
+	struct rxm_warmup *warmup;
+	size_t i;
+
+	if (!ep->eq)
+		return -FI_ENOEQ;
+
+	if (!ep->av)
+		return -FI_EOPBADSTATE;
+
+	if (!attr || (attr->count && !attr->addr))
+		return -FI_EINVAL;
+
+	for (i = 0; i < attr->count; i++) {
+		if (!ofi_ip_av_is_valid(&ep->av->av_fid, attr->addr[i])) {
+			FI_WARN(ep->domain->prov, FI_LOG_EP_CTRL,
+				"invalid fi_addr %" PRIu64 "\n", attr->addr[i]);
+			return -FI_EINVAL;
+		}
+	}
+
+	warmup = calloc(1, sizeof(*warmup));
+	if (!warmup)
+		return -FI_ENOMEM;
+
+	warmup->max_pending = attr->max_pending ? attr->max_pending :
+			      RXM_WARMUP_DEF_PENDING;
+	warmup->max_pending = MIN(warmup->max_pending, attr->count);
+	warmup->addr = mem_dup(attr->addr, attr->count * sizeof(fi_addr_t));
+	warmup->pending = calloc(warmup->max_pending ? warmup->max_pending : 1,
+				 sizeof(*warmup->pending));
+	if ((attr->count && !warmup->addr) || !warmup->pending) {
+		free(warmup->pending);
+		free(warmup->addr);
+		free(warmup);
+		return -FI_ENOMEM;
+	}
+
+	warmup->ep = ep;
+	warmup->context = attr->context;
+	warmup->count = attr->count;
+	warmup->deadline = attr->timeout < 0 ? UINT64_MAX :
+			   ofi_gettime_ms() + attr->timeout;
+	dlist_insert_tail(&warmup->entry, list);
+	return 0;
+}
+
+/* Start connecting to the next peers, up to the concurrency limit, then
+ * check on the connections in progress.  Peers that are not connecting,
+ * because the connection was refused or lost, are retried periodically
+ * until the timeout expires.
+ */
+static bool rxm_warmup_run(struct rxm_warmup *warmup, uint64_t now,
+			   rxm_warmup_connect_func connect)
+{
+	struct rxm_warmup_slot *slot;
+	bool retry, expired;
+	size_t i;
+	int ret;
+
+	retry = now >= warmup->retry_time;
+	if (retry)
+		warmup->retry_time = now + RXM_WARMUP_RETRY;
+	expired = now >= warmup->deadline;
+
+	for (i = 0; i < warmup->pending_cnt; ) {
+		slot = &warmup->pending[i];
+		ret = connect(warmup->ep, warmup->addr[slot->index],
+			      retry && slot->idle && !expired);
+		if (ret == -FI_EAGAIN || ret == -FI_ENOTCONN) {
+			slot->idle = (ret == -FI_ENOTCONN);
+			if (!expired) {
+				i++;
+				continue;
+			}
+			ret = slot->idle ? -FI_ECONNREFUSED : -FI_ETIMEDOUT;
+		}
+
+		if (ret)
+			rxm_warmup_report(warmup, slot->index, ret);
+		else
+			warmup->connected++;
+		*slot = warmup->pending[--warmup->pending_cnt];
+	}
+
+	while (warmup->next < warmup->count &&
+	       warmup->pending_cnt < warmup->max_pending) {
+		if (expired) {
+			rxm_warmup_report(warmup, warmup->next++,
+					  -FI_ETIMEDOUT);
+			continue;
+		}
+
+		ret = connect(warmup->ep, warmup->addr[warmup->next], true);
+		if (ret == -FI_EAGAIN || ret == -FI_ENOTCONN) {
+			slot = &warmup->pending[warmup->pending_cnt++];
+			slot->index = warmup->next;
+			slot->idle = (ret == -FI_ENOTCONN);
+		} else if (ret) {
+			rxm_warmup_report(warmup, warmup->next, ret);
+		} else {
+			warmup->connected++;
+		}
+		warmup->next++;
+	}
+
+	return warmup->next == warmup->count && !warmup->pending_cnt;
+}
+
+void rxm_warmup_progress(struct dlist_entry *list,
+			 rxm_warmup_connect_func connect)
+{
+	struct rxm_warmup *warmup;
+	struct dlist_entry *tmp;
+	uint64_t now;
+
+	now = ofi_gettime_ms();
+	dlist_foreach_container_safe(list, struct rxm_warmup, warmup,
+				     entry, tmp) {
+		if (rxm_warmup_run(warmup, now, connect)) {
+			rxm_warmup_report(warmup, 0, 0);
+			rxm_warmup_free(warmup);
+		}
+	}
+}
+
+void rxm_warmup_cleanup(struct dlist_entry *list, struct util_ep *ep)
+{
+	struct rxm_warmup *warmup;
+	struct dlist_entry *tmp;
+
+	dlist_foreach_container_safe(list, struct rxm_warmup, warmup,
+				     entry, tmp) {
+		if (warmup->ep == ep)
+			rxm_warmup_free(warmup);
+	}
+}
@@ -1085,6 +1085,227 @@ static void ofi_log_atomic_info(const struct fi_provider *prov)
 
 #endif /* HAVE_BUILTIN_MM_ATOMICS */
 
+/*********************************************************************
+ * Reduction handlers
+ *
+ * Non-atomic counterparts of the write handlers for buffers that only
+ * the caller accesses, such as collective reduction scratch buffers.
+ * Dropping per-element atomicity lets the common ops run on whole
+ * vectors.  Kernels are built for the baseline ISA and, on x86-64, for
+ * AVX2 and AVX-512, with the widest one the CPU supports picked at first
+ * use.  Ops and datatypes without a kernel use the write handlers.
+ *********************************************************************/
+
+#define OFI_REDUCE_MIN(a, b)	((b) < (a) ? (b) : (a))
+#define OFI_REDUCE_MAX(a, b)	((a) < (b) ? (b) : (a))
+#define OFI_REDUCE_SUM(a, b)	((a) + (b))
+#define OFI_REDUCE_PROD(a, b)	((a) * (b))
+#define OFI_REDUCE_BOR(a, b)	((a) | (b))
+#define OFI_REDUCE_BAND(a, b)	((a) & (b))
+#define OFI_REDUCE_BXOR(a, b)	((a) ^ (b))
+
+/* C vector extensions have no ?: operator, so select using the mask
+ * returned by a vector compare.  The mask type is the signed integer
+ * type with the same width as the element.
+ */
+#define OFI_REDUCE_SELECT(vtype, mtype, mask, a, b)			\
+	((vtype) (((mtype) (a) & (mask)) | ((mtype) (b) & ~(mask))))
+
+#define OFI_REDUCE_MIN_VEC(vtype, mtype, a, b)				\
+	OFI_REDUCE_SELECT(vtype, mtype, (b) < (a), b, a)
+#define OFI_REDUCE_MAX_VEC(vtype, mtype, a, b)				\
+	OFI_REDUCE_SELECT(vtype, mtype, (a) < (b), b, a)
+#define OFI_REDUCE_SUM_VEC(vtype, mtype, a, b)	OFI_REDUCE_SUM(a, b)
+#define OFI_REDUCE_PROD_VEC(vtype, mtype, a, b)	OFI_REDUCE_PROD(a, b)
+#define OFI_REDUCE_BOR_VEC(vtype, mtype, a, b)	OFI_REDUCE_BOR(a, b)
+#define OFI_REDUCE_BAND_VEC(vtype, mtype, a, b)	OFI_REDUCE_BAND(a, b)
+#define OFI_REDUCE_BXOR_VEC(vtype, mtype, a, b)	OFI_REDUCE_BXOR(a, b)
+
+#if defined(__x86_64__) && defined(__GNUC__) && \
+    (defined(__clang__) || __GNUC__ >= 5)
+#define OFI_REDUCE_X86_ISA 1
+#else
+#define OFI_REDUCE_X86_ISA 0
+#endif
+
+enum {
+	OFI_REDUCE_ISA_BASE,
+#if OFI_REDUCE_X86_ISA
+	OFI_REDUCE_ISA_AVX2,
+	OFI_REDUCE_ISA_AVX512,
+#endif
+	OFI_REDUCE_ISA_CNT,
+};
+
+#define OFI_REDUCE_TARGET_base
+#define OFI_REDUCE_TARGET_avx2		__attribute__((target("avx2")))
+#define OFI_REDUCE_TARGET_avx512	\
+	__attribute__((target("avx512f,avx512bw")))
+
+#define OFI_DEF_REDUCE_NAME(op, type, mtype, isa)			\
+	ofi_reduce_## op ##_## type ##_## isa,
+
+#ifdef __GNUC__
+
+/* Vectors match the register width of each ISA.  Wider generic vectors
+ * get split by the compiler, which falls back to scalar code for the
+ * compare-and-select used by MIN and MAX.
+ */
+#define OFI_REDUCE_VEC_LEN_base		16
+#define OFI_REDUCE_VEC_LEN_avx2		32
+#define OFI_REDUCE_VEC_LEN_avx512	64
+
+#define OFI_DEF_REDUCE_FUNC(op, type, mtype, isa)			\
+	static OFI_REDUCE_TARGET_##isa void				\
+	ofi_reduce_## op ##_## type ##_## isa				\
+		(void *dst, const void *src, size_t cnt)		\
+	{								\
+		typedef type vtype					\
+			__attribute__((vector_size(OFI_REDUCE_VEC_LEN_##isa)));\
+		typedef mtype vmtype __attribute__((unused,		\
+			vector_size(OFI_REDUCE_VEC_LEN_##isa)));		\
+		const size_t vcnt = sizeof(vtype) / sizeof(type);	\
+		type *d = dst;						\
+		const type *s = src;					\
+		vtype vd, vs;						\
+		size_t i;						\
+									\
+		for (i = 0; i + vcnt <= cnt; i += vcnt) {		\
+			memcpy(&vd, &d[i], sizeof(vd));			\
+			memcpy(&vs, &s[i], sizeof(vs));			\
+			vd = op##_VEC(vtype, vmtype, vd, vs);		\
+			memcpy(&d[i], &vd, sizeof(vd));			\
+		}							\
+		for (; i < cnt; i++)					\
+			d[i] = op(d[i], s[i]);				\
+	}
+
+#else /* __GNUC__ */
+
+#define OFI_DEF_REDUCE_FUNC(op, type, mtype, isa)			\
+	static void ofi_reduce_## op ##_## type ##_## isa		\
+		(void *dst, const void *src, size_t cnt)		\
+	{								\
+		type *d = dst;						\
+		const type *s = src;					\
+		size_t i;						\
+									\
+		for (i = 0; i < cnt; i++)				\
+			d[i] = op(d[i], s[i]);				\
+	}
+
+#endif /* __GNUC__ */
+
+#define OFI_DEFINE_REDUCE_INT_HANDLERS(FUNCNAME, op, isa)		\
+	OFI_DEF_REDUCE_##FUNCNAME(op, int8_t, int8_t, isa)		\
+	OFI_DEF_REDUCE_##FUNCNAME(op, uint8_t, int8_t, isa)		\
+	OFI_DEF_REDUCE_##FUNCNAME(op, int16_t, int16_t, isa)		\
+	OFI_DEF_REDUCE_##FUNCNAME(op, uint16_t, int16_t, isa)		\
+	OFI_DEF_REDUCE_##FUNCNAME(op, int32_t, int32_t, isa)		\
+	OFI_DEF_REDUCE_##FUNCNAME(op, uint32_t, int32_t, isa)		\
+	OFI_DEF_REDUCE_##FUNCNAME(op, int64_t, int64_t, isa)		\
+	OFI_DEF_REDUCE_##FUNCNAME(op, uint64_t, int64_t, isa)		\
+	OFI_DEF_NOOP_##FUNCNAME						\
+	OFI_DEF_NOOP_##FUNCNAME						\
+	OFI_DEF_NOOP_##FUNCNAME						\
+	OFI_DEF_NOOP_##FUNCNAME						\
+	OFI_DEF_NOOP_##FUNCNAME						\
+	OFI_DEF_NOOP_##FUNCNAME						\
+	OFI_DEF_NOOP_##FUNCNAME						\
+	OFI_DEF_NOOP_##FUNCNAME
+
+#define OFI_DEFINE_REDUCE_REALNO_HANDLERS(FUNCNAME, op, isa)		\
+	OFI_DEF_REDUCE_##FUNCNAME(op, int8_t, int8_t, isa)		\
+	OFI_DEF_REDUCE_##FUNCNAME(op, uint8_t, int8_t, isa)		\
+	OFI_DEF_REDUCE_##FUNCNAME(op, int16_t, int16_t, isa)		\
+	OFI_DEF_REDUCE_##FUNCNAME(op, uint16_t, int16_t, isa)		\
+	OFI_DEF_REDUCE_##FUNCNAME(op, int32_t, int32_t, isa)		\
+	OFI_DEF_REDUCE_##FUNCNAME(op, uint32_t, int32_t, isa)		\
+	OFI_DEF_REDUCE_##FUNCNAME(op, int64_t, int64_t, isa)		\
+	OFI_DEF_REDUCE_##FUNCNAME(op, uint64_t, int64_t, isa)		\
+	OFI_DEF_REDUCE_##FUNCNAME(op, float, int32_t, isa)		\
+	OFI_DEF_REDUCE_##FUNCNAME(op, double, int64_t, isa)		\
+	OFI_DEF_NOOP_##FUNCNAME						\
+	OFI_DEF_NOOP_##FUNCNAME						\
+	OFI_DEF_NOOP_##FUNCNAME						\
+	OFI_DEF_NOOP_##FUNCNAME						\
+	OFI_DEF_NOOP_##FUNCNAME						\
+	OFI_DEF_NOOP_##FUNCNAME
+
+#define OFI_DEFINE_REDUCE_ISA_HANDLERS(FUNCNAME, isa)			\
+	OFI_DEFINE_REDUCE_REALNO_HANDLERS(FUNCNAME, OFI_REDUCE_MIN, isa)	\
+	OFI_DEFINE_REDUCE_REALNO_HANDLERS(FUNCNAME, OFI_REDUCE_MAX, isa)	\
+	OFI_DEFINE_REDUCE_REALNO_HANDLERS(FUNCNAME, OFI_REDUCE_SUM, isa)	\
+	OFI_DEFINE_REDUCE_REALNO_HANDLERS(FUNCNAME, OFI_REDUCE_PROD, isa) \
+	OFI_DEFINE_REDUCE_INT_HANDLERS(FUNCNAME, OFI_REDUCE_BOR, isa)	\
+	OFI_DEFINE_REDUCE_INT_HANDLERS(FUNCNAME, OFI_REDUCE_BAND, isa)	\
+	OFI_DEFINE_REDUCE_INT_HANDLERS(FUNCNAME, OFI_REDUCE_BXOR, isa)
+
+#define OFI_DEFINE_REDUCE_ISA_TABLE(isa)				\
+	{								\
+		{ OFI_DEFINE_REDUCE_REALNO_HANDLERS(NAME, OFI_REDUCE_MIN, isa) }, \
+		{ OFI_DEFINE_REDUCE_REALNO_HANDLERS(NAME, OFI_REDUCE_MAX, isa) }, \
+		{ OFI_DEFINE_REDUCE_REALNO_HANDLERS(NAME, OFI_REDUCE_SUM, isa) }, \
+		{ OFI_DEFINE_REDUCE_REALNO_HANDLERS(NAME, OFI_REDUCE_PROD, isa) }, \
+		{ OFI_OP_NOT_SUPPORTED(FI_LOR) },			\
+		{ OFI_OP_NOT_SUPPORTED(FI_LAND) },			\
+		{ OFI_DEFINE_REDUCE_INT_HANDLERS(NAME, OFI_REDUCE_BOR, isa) }, \
+		{ OFI_DEFINE_REDUCE_INT_HANDLERS(NAME, OFI_REDUCE_BAND, isa) }, \
+		{ OFI_OP_NOT_SUPPORTED(FI_LXOR) },			\
+		{ OFI_DEFINE_REDUCE_INT_HANDLERS(NAME, OFI_REDUCE_BXOR, isa) }, \
+	}
+
+OFI_DEFINE_REDUCE_ISA_HANDLERS(FUNC, base)
+#if OFI_REDUCE_X86_ISA
+OFI_DEFINE_REDUCE_ISA_HANDLERS(FUNC, avx2)
+OFI_DEFINE_REDUCE_ISA_HANDLERS(FUNC, avx512)
+#endif
+
+/* Indexed up to FI_BXOR; FI_ATOMIC_READ and FI_ATOMIC_WRITE never reduce */
+static void (*ofi_reduce_handlers[OFI_REDUCE_ISA_CNT][FI_BXOR + 1]
+				 [OFI_DATATYPE_CNT])
+	(void *dst, const void *src, size_t cnt) =
+{
+	OFI_DEFINE_REDUCE_ISA_TABLE(base),
+#if OFI_REDUCE_X86_ISA
+	OFI_DEFINE_REDUCE_ISA_TABLE(avx2),
+	OFI_DEFINE_REDUCE_ISA_TABLE(avx512),
+#endif
+};
+
+static int ofi_reduce_isa = -1;
+
+static int ofi_reduce_select_isa(void)
+{
+#if OFI_REDUCE_X86_ISA
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f") &&
+	    __builtin_cpu_supports("avx512bw"))
+		return OFI_REDUCE_ISA_AVX512;
+	if (__builtin_cpu_supports("avx2"))
+		return OFI_REDUCE_ISA_AVX2;
+#endif
+	return OFI_REDUCE_ISA_BASE;
+}
+
+void ofi_atomic_reduce_handler(enum fi_op op, enum fi_datatype datatype,
+			       void *dst, const void *src, size_t cnt)
+{
+	void (*handler)(void *dst, const void *src, size_t cnt) = NULL;
+
+	/* Racing threads select the same ISA, so a plain store is enough */
+	if (ofi_reduce_isa < 0)
+		ofi_reduce_isa = ofi_reduce_select_isa();
+
+	if (op <= FI_BXOR)
+		handler = ofi_reduce_handlers[ofi_reduce_isa][op][datatype];
+
+	if (handler)
+		handler(dst, src, cnt);
+	else
+		ofi_atomic_write_handler(op, datatype, dst, src, cnt);
+}
+
 int ofi_atomic_valid(const struct fi_provider *prov,
 		     enum fi_datatype datatype, enum fi_op op, uint64_t flags)
 {
@@ -49,6 +49,7 @@
 #endif
 
 #include <ofi_util.h>
+#include "fasthash.h"
 
 
 enum {
@@ -271,13 +272,186 @@ int ofi_verify_av_insert(struct util_av *av, uint64_t flags, void *context)
 	return 0;
 }
 
+/*
+ * The address hash supplies both the slot tag and the home position of
+ * an entry.  Taking the position from the tag bits lets the index be
+ * resized without touching the AV entries themselves.
+ */
+#define UTIL_AV_SLOT_TAG_MASK	(~(uint64_t) UINT32_MAX)
+#define UTIL_AV_SLOT_TOMB	UTIL_AV_SLOT_TAG_MASK
+
+static inline uint64_t util_av_slot_tag(const struct util_av *av,
+					const void *addr)
+{
+	return fasthash64(addr, av->addrlen, 0) & UTIL_AV_SLOT_TAG_MASK;
+}
+
+static inline size_t util_av_slot_home(uint64_t slot, size_t size)
+{
+	return (size_t) (slot >> 32) & (size - 1);
+}
+
+static inline uint32_t util_av_slot_index(uint64_t slot)
+{
+	return (uint32_t) slot;
+}
+
+static inline bool util_av_addr_equal(const struct util_av *av,
+				      const void *addr1, const void *addr2)
+{
+	uint64_t word1, word2, diff = 0;
+	size_t i;
+
+	if (av->addrlen & 7)
+		return !memcmp(addr1, addr2, av->addrlen);
+
+	/* Fixed 8-byte multiples (sockaddr_in, most native addresses)
+	 * compare branch-free, which compilers turn into vector compares.
+	 */
+	for (i = 0; i < av->addrlen; i += sizeof(uint64_t)) {
+		memcpy(&word1, (const char *) addr1 + i, sizeof(word1));
+		memcpy(&word2, (const char *) addr2 + i, sizeof(word2));
+		diff |= word1 ^ word2;
+	}
+	return !diff;
+}
+
+static int util_av_index_init(struct util_av_index *index, size_t cnt)
+{
+	index->size = roundup_power_of_two(cnt * 2);
+	index->used = 0;
+	index->tombs = 0;
+	index->slots = calloc(index->size, sizeof(*index->slots));
+	return index->slots ? 0 : -FI_ENOMEM;
+}
+
+static void util_av_index_cleanup(struct util_av_index *index)
+{
+	free(index->slots);
+	index->slots = NULL;
+	index->size = 0;
+}
+
+static int util_av_index_resize(struct util_av_index *index, size_t size)
+{
+	uint64_t *slots;
+	size_t i, j;
+
+	slots = calloc(size, sizeof(*slots));
+	if (!slots)
+		return -FI_ENOMEM;
+
+	for (i = 0; i < index->size; i++) {
+		if (!util_av_slot_index(index->slots[i]))
+			continue;
+
+		for (j = util_av_slot_home(index->slots[i], size); slots[j];
+		     j = (j + 1) & (size - 1))
+			;
+		slots[j] = index->slots[i];
+	}
+
+	free(index->slots);
+	index->slots = slots;
+	index->size = size;
+	index->tombs = 0;
+	return 0;
+}
+
+/* Keep the load factor, including tombstones, at or below 1/2 */
+static int util_av_index_reserve(struct util_av_index *index, size_t cnt)
+{
+	size_t size;
+
+	if ((index->used + index->tombs + cnt) * 2 <= index->size)
+		return 0;
+
+	size = roundup_power_of_two((index->used + cnt) * 2);
+	return util_av_index_resize(index, MAX(size, index->size));
+}
+
+static struct util_av_entry *
+util_av_index_find(struct util_av *av, const void *addr, uint64_t tag)
+{
+	struct util_av_index *index = &av->index;
+	struct util_av_entry *entry;
+	uint64_t slot;
+	size_t i;
+
+	if (!index->size)
+		return NULL;
+
+	for (i = util_av_slot_home(tag, index->size); (slot = index->slots[i]);
+	     i = (i + 1) & (index->size - 1)) {
+		if ((slot & UTIL_AV_SLOT_TAG_MASK) != tag ||
+		    !util_av_slot_index(slot))
+			continue;
+
+		entry = ofi_bufpool_get_ibuf(av->av_entry_pool,
+					     util_av_slot_index(slot) - 1);
+		if (util_av_addr_equal(av, entry->data, addr))
+			return entry;
+	}
+	return NULL;
+}
+
+static int util_av_index_insert(struct util_av *av, uint64_t tag,
+				size_t entry_index)
+{
+	struct util_av_index *index = &av->index;
+	size_t i;
+	int ret;
+
+	assert(entry_index < UINT32_MAX);
+	ret = util_av_index_reserve(index, 1);
+	if (ret)
+		return ret;
+
+	for (i = util_av_slot_home(tag, index->size);
+	     util_av_slot_index(index->slots[i]);
+	     i = (i + 1) & (index->size - 1))
+		;
+
+	if (index->slots[i])
+		index->tombs--;
+	index->slots[i] = tag | (entry_index + 1);
+	index->used++;
+	return 0;
+}
+
+void ofi_av_index_remove(struct util_av *av, fi_addr_t fi_addr)
+{
+	struct util_av_index *index = &av->index;
+	struct util_av_entry *entry;
+	uint64_t tag;
+	size_t i;
+
+	assert(ofi_genlock_held(&av->lock));
+	entry = ofi_bufpool_get_ibuf(av->av_entry_pool, fi_addr);
+	tag = util_av_slot_tag(av, entry->data);
+
+	for (i = util_av_slot_home(tag, index->size); index->slots[i];
+	     i = (i + 1) & (index->size - 1)) {
+		if (index->slots[i] == (tag | (fi_addr + 1))) {
+			index->slots[i] = UTIL_AV_SLOT_TOMB;
+			index->used--;
+			index->tombs++;
+			return;
+		}
+	}
+	assert(0);
+}
+
 int ofi_av_insert_addr_at(struct util_av *av, const void *addr, fi_addr_t fi_addr)
 {
-	struct util_av_entry *entry = NULL;
+	struct util_av_entry *entry;
+	uint64_t tag;
+	int ret;
 
 	assert(ofi_genlock_held(&av->lock));
 	ofi_av_straddr_log(av, FI_LOG_INFO, "inserting addr", addr);
-	HASH_FIND(hh, av->hash, addr, av->addrlen, entry);
+	tag = util_av_slot_tag(av, addr);
+	entry = util_av_index_find(av, addr, tag);
 	if (entry) {
 		if (fi_addr == ofi_buf_index(entry))
 			return FI_SUCCESS;
@@ -290,9 +464,14 @@ int ofi_av_insert_addr_at(struct util_av *av, const void *addr, fi_addr_t fi_add
 	if (!entry)
 		return -FI_ENOMEM;
 
+	ret = util_av_index_insert(av, tag, fi_addr);
+	if (ret) {
+		ofi_ibuf_free(entry);
+		return ret;
+	}
+
 	memcpy(entry->data, addr, av->addrlen);
 	ofi_atomic_initialize32(&entry->use_cnt, 1);
-	HASH_ADD(hh, av->hash, data, av->addrlen, entry);
 	FI_INFO(av->prov, FI_LOG_AV, "fi_addr: %" PRIu64 "\n",
 		ofi_buf_index(entry));
 	return 0;
@@ -300,11 +479,14 @@ int ofi_av_insert_addr_at(struct util_av *av, const void *addr, fi_addr_t fi_add
 
 int ofi_av_insert_addr(struct util_av *av, const void *addr, fi_addr_t *fi_addr)
 {
-	struct util_av_entry *entry = NULL;
+	struct util_av_entry *entry;
+	uint64_t tag;
+	int ret;
 
 	assert(ofi_genlock_held(&av->lock));
 	ofi_av_straddr_log(av, FI_LOG_INFO, "inserting addr", addr);
-	HASH_FIND(hh, av->hash, addr, av->addrlen, entry);
+	tag = util_av_slot_tag(av, addr);
+	entry = util_av_index_find(av, addr, tag);
 	if (entry) {
 		if (fi_addr)
 			*fi_addr = ofi_buf_index(entry);
@@ -313,21 +495,28 @@ int ofi_av_insert_addr(struct util_av *av, const void *addr, fi_addr_t *fi_addr)
 		}
 	} else {
 		entry = ofi_ibuf_alloc(av->av_entry_pool);
-		if (!entry) {
-			if (fi_addr)
-				*fi_addr = FI_ADDR_NOTAVAIL;
-			return -FI_ENOMEM;
+		if (!entry)
+			goto nomem;
+
+		ret = util_av_index_insert(av, tag, ofi_buf_index(entry));
+		if (ret) {
+			ofi_ibuf_free(entry);
+			goto nomem;
 		}
 
 		if (fi_addr)
 			*fi_addr = ofi_buf_index(entry);
 		memcpy(entry->data, addr, av->addrlen);
 		ofi_atomic_initialize32(&entry->use_cnt, 1);
-		HASH_ADD(hh, av->hash, data, av->addrlen, entry);
 		FI_INFO(av->prov, FI_LOG_AV, "fi_addr: %" PRIu64 "\n",
 			ofi_buf_index(entry));
 	}
 	return 0;
+
+nomem:
+	if (fi_addr)
+		*fi_addr = FI_ADDR_NOTAVAIL;
+	return -FI_ENOMEM;
 }
 
 int ofi_av_remove_addr(struct util_av *av, fi_addr_t fi_addr)
@@ -342,7 +531,7 @@ int ofi_av_remove_addr(struct util_av *av, fi_addr_t fi_addr)
 	if (ofi_atomic_dec32(&av_entry->use_cnt))
 		return FI_SUCCESS;
 
-	HASH_DELETE(hh, av->hash, av_entry);
+	ofi_av_index_remove(av, fi_addr);
 	FI_DBG(av->prov, FI_LOG_AV, "av_remove fi_addr: %" PRIu64 "\n", fi_addr);
 	ofi_ibuf_free(av_entry);
 	return 0;
@@ -350,9 +539,9 @@ int ofi_av_remove_addr(struct util_av *av, fi_addr_t fi_addr)
 
 fi_addr_t ofi_av_lookup_fi_addr_unsafe(struct util_av *av, const void *addr)
 {
-	struct util_av_entry *entry = NULL;
+	struct util_av_entry *entry;
 
-	HASH_FIND(hh, av->hash, addr, av->addrlen, entry);
+	entry = util_av_index_find(av, addr, util_av_slot_tag(av, addr));
 	return entry ? ofi_buf_index(entry) : FI_ADDR_NOTAVAIL;
 }
 
@@ -374,7 +563,7 @@ ofi_av_lookup_addr(struct util_av *av, fi_addr_t fi_addr, size_t *addrlen)
 
 static void util_av_close(struct util_av *av)
 {
-	HASH_CLEAR(hh, av->hash);
+	util_av_index_cleanup(&av->index);
 	ofi_bufpool_destroy(av->av_entry_pool);
 }
 
@@ -470,10 +659,16 @@ static int util_av_init(struct util_av *av, const struct fi_av_attr *attr,
 	av->addrlen = util_attr->addrlen;
 	av->context_offset = offset + av->addrlen;
 	av->flags = util_attr->flags | attr->flags;
-	av->hash = NULL;
+
+	ret = util_av_index_init(&av->index, orig_size);
+	if (ret)
+		return ret;
 
 	pool_attr.chunk_cnt = orig_size;
-	return ofi_bufpool_create_attr(&pool_attr, &av->av_entry_pool);
+	ret = ofi_bufpool_create_attr(&pool_attr, &av->av_entry_pool);
+	if (ret)
+		util_av_index_cleanup(&av->index);
+	return ret;
 }
 
 static int util_verify_av_attr(struct util_domain *domain,
@@ -589,10 +784,9 @@ static int ip_av_insert_addr(struct util_av *av, const void *addr,
 {
 	int ret;
 
+	assert(ofi_genlock_held(&av->lock));
 	if (ofi_valid_dest_ipaddr(addr)) {
-		ofi_genlock_lock(&av->lock);
 		ret = ofi_av_insert_addr(av, addr, fi_addr);
-		ofi_genlock_unlock(&av->lock);
 	} else {
 		ret = -FI_EADDRNOTAVAIL;
 		if (fi_addr)
@@ -636,6 +830,14 @@ int ofi_ip_av_insertv(struct util_av *av, const void *addr, size_t addrlen,
 		memset(sync_err, 0, sizeof(*sync_err) * count);
 	}
 
+	/* Size the index for the whole vector up front, so that inserting
+	 * a large job's address list does not rehash repeatedly.  If that
+	 * fails, the index still grows as each address is inserted.
+	 */
+	ofi_genlock_lock(&av->lock);
+	if (count > 1 && util_av_index_reserve(&av->index, count))
+		FI_INFO(av->prov, FI_LOG_AV, "unable to presize AV index\n");
+
 	for (i = 0; i < count; i++) {
 		ret = ip_av_insert_addr(av, (const char *) addr + i * addrlen,
 					fi_addr ? &fi_addr[i] : NULL, context);
@@ -644,6 +846,7 @@ int ofi_ip_av_insertv(struct util_av *av, const void *addr, size_t addrlen,
 		else if (sync_err)
 			sync_err[i] = -ret;
 	}
+	ofi_genlock_unlock(&av->lock);
 
 done:
 	FI_DBG(av->prov, FI_LOG_AV, "%d addresses successful\n", success_cnt);
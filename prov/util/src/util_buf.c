@@ -131,6 +131,38 @@ static void ofi_bufpool_region_free(struct ofi_bufpool_region *buf_region)
 	}
 }
 
+/*
+ * Thread cached pools may be indexed through ofi_bufpool_get_ibuf()
+ * without holding the pool lock, so an old region table is kept until the
+ * pool is destroyed rather than being released by realloc().
+ */
+static struct ofi_bufpool_region **
+ofi_bufpool_grow_table(struct ofi_bufpool *pool)
+{
+	struct ofi_bufpool_region **new_table;
+	struct ofi_bufpool_region ***retired;
+
+	if (pool->region_table) {
+		retired = realloc(pool->retired_tables,
+				  (pool->retired_cnt + 1) * sizeof(*retired));
+		if (!retired)
+			return NULL;
+		pool->retired_tables = retired;
+	}
+
+	new_table = malloc((pool->region_cnt + OFI_BUFPOOL_REGION_CHUNK_CNT) *
+			   sizeof(*pool->region_table));
+	if (!new_table)
+		return NULL;
+
+	if (pool->region_table) {
+		memcpy(new_table, pool->region_table,
+		       pool->region_cnt * sizeof(*pool->region_table));
+		pool->retired_tables[pool->retired_cnt++] = pool->region_table;
+	}
+	return new_table;
+}
+
 int ofi_bufpool_grow(struct ofi_bufpool *pool)
 {
 	struct ofi_bufpool_region *buf_region;
@@ -179,7 +211,10 @@ int ofi_bufpool_grow(struct ofi_bufpool *pool)
 	if (!(pool->region_cnt % OFI_BUFPOOL_REGION_CHUNK_CNT)) {
 		struct ofi_bufpool_region **new_table;
 
-		new_table = realloc(pool->region_table,
+		if (pool->attr.flags & OFI_BUFPOOL_THREAD_CACHE)
+			new_table = ofi_bufpool_grow_table(pool);
+		else
+			new_table = realloc(pool->region_table,
 				(pool->region_cnt + OFI_BUFPOOL_REGION_CHUNK_CNT) *
 				sizeof(*pool->region_table));
 		if (!new_table) {
@@ -238,6 +273,138 @@ err1:
 	return ret;
 }
 
+static int ofi_bufpool_mag_init(struct ofi_bufpool *pool)
+{
+	struct ofi_bufpool_mag *mag;
+	int i;
+
+	pool->mags = calloc(OFI_BUFPOOL_MAG_CNT, sizeof(*pool->mags));
+	if (!pool->mags)
+		return -FI_ENOMEM;
+
+	for (i = 0; i < OFI_BUFPOOL_MAG_CNT; i++) {
+		mag = &pool->mags[i].mag;
+		ofi_spin_init(&mag->lock);
+		slist_init(&mag->entries);
+	}
+	ofi_mutex_init(&pool->lock);
+	return 0;
+}
+
+static void ofi_bufpool_mag_cleanup(struct ofi_bufpool *pool)
+{
+	size_t i;
+
+	for (i = 0; i < OFI_BUFPOOL_MAG_CNT; i++)
+		ofi_spin_destroy(&pool->mags[i].mag.lock);
+	ofi_mutex_destroy(&pool->lock);
+	free(pool->mags);
+
+	for (i = 0; i < pool->retired_cnt; i++)
+		free(pool->retired_tables[i]);
+	free(pool->retired_tables);
+}
+
+static struct ofi_bufpool_mag *ofi_bufpool_get_mag(struct ofi_bufpool *pool)
+{
+	return &pool->mags[ofi_thread_idx() % OFI_BUFPOOL_MAG_CNT].mag;
+}
+
+/* Caller holds the magazine lock */
+static void ofi_bufpool_mag_refill(struct ofi_bufpool *pool,
+				   struct ofi_bufpool_mag *mag)
+{
+	struct ofi_bufpool_hdr *buf_hdr;
+	struct ofi_bufpool_region *buf_region;
+
+	ofi_mutex_lock(&pool->lock);
+	while (mag->cnt < OFI_BUFPOOL_MAG_BATCH) {
+		if (pool->attr.flags & OFI_BUFPOOL_INDEXED) {
+			if (ofi_ibufpool_empty(pool) && ofi_bufpool_grow(pool))
+				break;
+
+			buf_region = container_of(pool->free_list.regions.next,
+						  struct ofi_bufpool_region,
+						  entry);
+			dlist_pop_front(&buf_region->free_list,
+					struct ofi_bufpool_hdr, buf_hdr,
+					entry.dlist);
+			if (dlist_empty(&buf_region->free_list))
+				dlist_remove_init(&buf_region->entry);
+		} else {
+			if (ofi_bufpool_empty(pool) && ofi_bufpool_grow(pool))
+				break;
+
+			slist_remove_head_container(&pool->free_list.entries,
+					struct ofi_bufpool_hdr, buf_hdr,
+					entry.slist);
+		}
+		slist_insert_tail(&buf_hdr->entry.slist, &mag->entries);
+		mag->cnt++;
+	}
+	ofi_mutex_unlock(&pool->lock);
+}
+
+/* Caller holds the magazine lock */
+static void ofi_bufpool_mag_drain(struct ofi_bufpool *pool,
+				  struct ofi_bufpool_mag *mag)
+{
+	struct ofi_bufpool_hdr *buf_hdr;
+
+	ofi_mutex_lock(&pool->lock);
+	while (mag->cnt > OFI_BUFPOOL_MAG_SIZE - OFI_BUFPOOL_MAG_BATCH) {
+		slist_remove_head_container(&mag->entries,
+				struct ofi_bufpool_hdr, buf_hdr, entry.slist);
+		mag->cnt--;
+
+		if (pool->attr.flags & OFI_BUFPOOL_INDEXED)
+			ofi_ibuf_release(buf_hdr);
+		else
+			slist_insert_head(&buf_hdr->entry.slist,
+					  &pool->free_list.entries);
+	}
+	ofi_mutex_unlock(&pool->lock);
+}
+
+void *ofi_bufpool_mag_alloc(struct ofi_bufpool *pool)
+{
+	struct ofi_bufpool_mag *mag;
+	struct ofi_bufpool_hdr *buf_hdr;
+
+	mag = ofi_bufpool_get_mag(pool);
+	ofi_spin_lock(&mag->lock);
+	if (slist_empty(&mag->entries)) {
+		ofi_bufpool_mag_refill(pool, mag);
+		if (slist_empty(&mag->entries)) {
+			ofi_spin_unlock(&mag->lock);
+			return NULL;
+		}
+	}
+
+	slist_remove_head_container(&mag->entries, struct ofi_bufpool_hdr,
+				    buf_hdr, entry.slist);
+	mag->cnt--;
+	ofi_spin_unlock(&mag->lock);
+
+	assert(ofi_atomic_inc32(&buf_hdr->region->use_cnt));
+	buf_hdr->entry.slist.next = &buf_hdr->entry.slist;
+	return ofi_buf_data(buf_hdr);
+}
+
+void ofi_bufpool_mag_free(struct ofi_bufpool *pool, void *buf)
+{
+	struct ofi_bufpool_mag *mag;
+
+	mag = ofi_bufpool_get_mag(pool);
+	ofi_spin_lock(&mag->lock);
+	if (mag->cnt >= OFI_BUFPOOL_MAG_SIZE)
+		ofi_bufpool_mag_drain(pool, mag);
+
+	slist_insert_head(&ofi_buf_hdr(buf)->entry.slist, &mag->entries);
+	mag->cnt++;
+	ofi_spin_unlock(&mag->lock);
+}
+
 int ofi_bufpool_create_attr(struct ofi_bufpool_attr *attr,
 			      struct ofi_bufpool **buf_pool)
 {
@@ -266,6 +433,13 @@ int ofi_bufpool_create_attr(struct ofi_bufpool_attr *attr,
 	else
 		slist_init(&pool->free_list.entries);
 
+	if (pool->attr.flags & OFI_BUFPOOL_THREAD_CACHE) {
+		if (ofi_bufpool_mag_init(pool)) {
+			free(pool);
+			return -FI_ENOMEM;
+		}
+	}
+
 	pool->alloc_size = (pool->attr.chunk_cnt + 1) * pool->entry_size;
 	pool->region_size = pool->alloc_size - pool->entry_size;
 
@@ -296,6 +470,8 @@ void ofi_bufpool_destroy(struct ofi_bufpool *pool)
 		free(buf_region);
 	}
 	free(pool->region_table);
+	if (pool->attr.flags & OFI_BUFPOOL_THREAD_CACHE)
+		ofi_bufpool_mag_cleanup(pool);
 	free(pool);
 }
 
@@ -143,7 +143,7 @@ int ofi_cntr_seterr(struct fid_cntr *cntr_fid, uint64_t value)
 int ofi_cntr_wait(struct fid_cntr *cntr_fid, uint64_t threshold, int timeout)
 {
 	struct util_cntr *cntr;
-	uint64_t endtime, errcnt;
+	uint64_t endtime, errcnt, start = 0, spin_end = 0;
 	int ret, timeout_quantum;
 
 	cntr = container_of(cntr_fid, struct util_cntr, cntr_fid);
@@ -153,14 +153,30 @@ int ofi_cntr_wait(struct fid_cntr *cntr_fid, uint64_t threshold, int timeout)
 
 	do {
 		cntr->progress(cntr);
-		if (threshold <= (uint64_t)ofi_atomic_get64(&cntr->cnt))
-			return FI_SUCCESS;
+		if (threshold <= (uint64_t)ofi_atomic_get64(&cntr->cnt)) {
+			ret = FI_SUCCESS;
+			break;
+		}
+
+		if (errcnt != (uint64_t)ofi_atomic_get64(&cntr->err)) {
+			ret = -FI_EAVAIL;
+			break;
+		}
+
+		if (ofi_adjust_timeout(endtime, &timeout)) {
+			ret = -FI_ETIMEDOUT;
+			break;
+		}
 
-		if (errcnt != (uint64_t)ofi_atomic_get64(&cntr->err))
-			return -FI_EAVAIL;
+		if (!start) {
+			start = ofi_gettime_ns();
+			spin_end = start + ofi_wait_spin_time(cntr->wait);
+		}
 
-		if (ofi_adjust_timeout(endtime, &timeout))
-			return -FI_ETIMEDOUT;
+		if (ofi_gettime_ns() < spin_end) {
+			ret = 0;
+			continue;
+		}
 
 		/*
 		 * Temporary work-around to avoid a thread hanging in underlying
@@ -179,6 +195,9 @@ int ofi_cntr_wait(struct fid_cntr *cntr_fid, uint64_t threshold, int timeout)
 	} while (!ret || (ret == -FI_ETIMEDOUT &&
 			  (timeout < 0 || timeout_quantum < timeout)));
 
+	if (start)
+		ofi_wait_spin_update(cntr->wait, ofi_gettime_ns() - start);
+
 	return ret;
 }
 
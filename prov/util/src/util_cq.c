@@ -46,6 +46,13 @@ static void util_cq_insert_aux(struct util_cq *cq,
 			      struct util_cq_aux_entry *entry)
 {
 	assert(ofi_genlock_held(&cq->cq_lock));
+	if (cq->mpscq) {
+		entry->cq_slot = NULL;
+		slist_insert_tail(&entry->list_entry, &cq->aux_queue);
+		ofi_atomic_inc32(&cq->aux_cnt);
+		return;
+	}
+
 	if (!ofi_cirque_isfull(cq->cirq))
 		ofi_cirque_commit(cq->cirq);
 
@@ -62,7 +69,7 @@ int ofi_cq_write_overflow(struct util_cq *cq, void *context, uint64_t flags,
 
 	assert(ofi_genlock_held(&cq->cq_lock));
 	FI_DBG(cq->domain->prov, FI_LOG_CQ, "writing to CQ overflow list\n");
-	assert(ofi_cirque_freecnt(cq->cirq) <= 1);
+	assert(cq->mpscq || ofi_cirque_freecnt(cq->cirq) <= 1);
 
 	entry = calloc(1, sizeof(*entry));
 	if (!entry)
@@ -81,6 +88,67 @@ int ofi_cq_write_overflow(struct util_cq *cq, void *context, uint64_t flags,
 	return 0;
 }
 
+int ofi_cq_write_mpsc_overflow(struct util_cq *cq, void *context,
+			       uint64_t flags, size_t len, void *buf,
+			       uint64_t data, uint64_t tag, fi_addr_t src)
+{
+	int ret;
+
+	ofi_genlock_lock(&cq->cq_lock);
+	ret = ofi_cq_write_overflow(cq, context, flags, len, buf, data,
+				    tag, src);
+	ofi_genlock_unlock(&cq->cq_lock);
+	return ret;
+}
+
+/* Writes count completions under a single hold of the CQ lock.  src may
+ * be NULL if source addresses are not reported.  Returns the number of
+ * completions written, which is less than count if an entry could not be
+ * queued, or a negative error code if none were.
+ */
+ssize_t ofi_cq_write_batch(struct util_cq *cq,
+			   const struct fi_cq_tagged_entry *comp,
+			   const fi_addr_t *src, size_t count)
+{
+	fi_addr_t addr;
+	size_t i;
+	int ret = 0;
+
+	if (cq->mpscq) {
+		for (i = 0; i < count; i++) {
+			ret = ofi_cq_write_mpsc(cq, comp[i].op_context,
+					comp[i].flags, comp[i].len, comp[i].buf,
+					comp[i].data, comp[i].tag,
+					src ? src[i] : FI_ADDR_NOTAVAIL);
+			if (ret)
+				break;
+		}
+		return i ? i : ret;
+	}
+
+	ofi_genlock_lock(&cq->cq_lock);
+	for (i = 0; i < count; i++) {
+		addr = src ? src[i] : FI_ADDR_NOTAVAIL;
+		if (ofi_cirque_freecnt(cq->cirq) <= 1) {
+			ret = ofi_cq_write_overflow(cq, comp[i].op_context,
+					comp[i].flags, comp[i].len, comp[i].buf,
+					comp[i].data, comp[i].tag, addr);
+			if (ret)
+				break;
+		} else if (cq->src) {
+			ofi_cq_write_src_entry(cq, comp[i].op_context,
+					comp[i].flags, comp[i].len, comp[i].buf,
+					comp[i].data, comp[i].tag, addr);
+		} else {
+			ofi_cq_write_entry(cq, comp[i].op_context,
+					comp[i].flags, comp[i].len, comp[i].buf,
+					comp[i].data, comp[i].tag);
+		}
+	}
+	ofi_genlock_unlock(&cq->cq_lock);
+	return i ? i : ret;
+}
+
 static int util_cq_insert_error(struct util_cq *cq,
 				const struct fi_cq_err_entry *err_entry)
 {
@@ -260,6 +328,77 @@ static void util_cq_read_tagged(void **dst, void *src)
 	*(char **)dst += sizeof(struct fi_cq_tagged_entry);
 }
 
+/* A producer may have claimed a ring slot that it has not filled yet.
+ * Its later completions can already be in aux_queue, so aux_queue is only
+ * read once every claimed slot has been consumed.
+ */
+static bool util_cq_mpsc_drained(struct util_cq *cq)
+{
+	return ofi_atomic_load_explicit64(&cq->mpscq->write_pos,
+					  memory_order_acquire) ==
+	       ofi_atomic_load_explicit64(&cq->mpscq->read_pos,
+					  memory_order_relaxed);
+}
+
+/* The ring is drained before aux_queue.  cq_lock serializes readers, which
+ * keeps the ring single consumer.
+ */
+ssize_t ofi_cq_read_mpsc(struct util_cq *cq, void *buf, size_t count,
+			 fi_addr_t *src_addr)
+{
+	struct util_cq_mpsc_entry *entry;
+	struct util_cq_aux_entry *aux_entry;
+	int64_t pos;
+	ssize_t i;
+
+	ofi_genlock_lock(&cq->cq_lock);
+
+	if (cq->err_data) {
+		free(cq->err_data);
+		cq->err_data = NULL;
+	}
+
+	if (!count) {
+		i = util_comp_mpscq_isempty(cq->mpscq) &&
+		    slist_empty(&cq->aux_queue) ? -FI_EAGAIN : 0;
+		goto out;
+	}
+
+	for (i = 0; i < (ssize_t) count; i++) {
+		if (!util_comp_mpscq_head(cq->mpscq, &entry, &pos)) {
+			if (src_addr)
+				src_addr[i] = entry->src;
+			cq->read_entry(&buf, &entry->comp);
+			util_comp_mpscq_release(cq->mpscq, entry, pos);
+			continue;
+		}
+
+		if (slist_empty(&cq->aux_queue) || !util_cq_mpsc_drained(cq))
+			break;
+
+		aux_entry = container_of(cq->aux_queue.head,
+					 struct util_cq_aux_entry, list_entry);
+		if (aux_entry->comp.err) {
+			if (!i)
+				i = -FI_EAVAIL;
+			break;
+		}
+
+		if (src_addr)
+			src_addr[i] = aux_entry->src;
+		cq->read_entry(&buf, &aux_entry->comp);
+		slist_remove_head(&cq->aux_queue);
+		free(aux_entry);
+		ofi_atomic_dec32(&cq->aux_cnt);
+	}
+
+	if (!i)
+		i = -FI_EAGAIN;
+out:
+	ofi_genlock_unlock(&cq->cq_lock);
+	return i;
+}
+
 ssize_t ofi_cq_readfrom(struct fid_cq *cq_fid, void *buf, size_t count,
 			fi_addr_t *src_addr)
 {
@@ -296,8 +435,13 @@ ssize_t ofi_cq_readerr(struct fid_cq *cq_fid, struct fi_cq_err_entry *buf,
 		cq->err_data = NULL;
 	}
 
-	if (ofi_cirque_isempty(cq->cirq) ||
-	    !(ofi_cirque_head(cq->cirq)->flags & UTIL_FLAG_AUX)) {
+	if (cq->mpscq) {
+		if (slist_empty(&cq->aux_queue) || !util_cq_mpsc_drained(cq)) {
+			ret = -FI_EAGAIN;
+			goto unlock;
+		}
+	} else if (ofi_cirque_isempty(cq->cirq) ||
+		   !(ofi_cirque_head(cq->cirq)->flags & UTIL_FLAG_AUX)) {
 		ret = -FI_EAGAIN;
 		goto unlock;
 	}
@@ -305,7 +449,7 @@ ssize_t ofi_cq_readerr(struct fid_cq *cq_fid, struct fi_cq_err_entry *buf,
 	assert(!slist_empty(&cq->aux_queue));
 	aux_entry = container_of(cq->aux_queue.head,
 				 struct util_cq_aux_entry, list_entry);
-	assert(aux_entry->cq_slot == ofi_cirque_head(cq->cirq));
+	assert(cq->mpscq || aux_entry->cq_slot == ofi_cirque_head(cq->cirq));
 
 	if (!aux_entry->comp.err) {
 		ret = -FI_EAGAIN;
@@ -334,7 +478,9 @@ ssize_t ofi_cq_readerr(struct fid_cq *cq_fid, struct fi_cq_err_entry *buf,
 	if (aux_entry->comp.err_data_size)
 		free(aux_entry->comp.err_data);
 	free(aux_entry);
-	if (slist_empty(&cq->aux_queue)) {
+	if (cq->mpscq) {
+		ofi_atomic_dec32(&cq->aux_cnt);
+	} else if (slist_empty(&cq->aux_queue)) {
 		ofi_cirque_discard(cq->cirq);
 	} else {
 		aux_entry = container_of(cq->aux_queue.head,
@@ -353,7 +499,7 @@ ssize_t ofi_cq_sreadfrom(struct fid_cq *cq_fid, void *buf, size_t count,
 			 fi_addr_t *src_addr, const void *cond, int timeout)
 {
 	struct util_cq *cq;
-	uint64_t endtime;
+	uint64_t endtime, start = 0, spin_end = 0;
 	ssize_t ret;
 
 	cq = container_of(cq_fid, struct util_cq, cq_fid);
@@ -365,17 +511,32 @@ ssize_t ofi_cq_sreadfrom(struct fid_cq *cq_fid, void *buf, size_t count,
 		if (ret != -FI_EAGAIN)
 			break;
 
-		if (ofi_adjust_timeout(endtime, &timeout))
-			return -FI_EAGAIN;
+		if (ofi_adjust_timeout(endtime, &timeout)) {
+			ret = -FI_EAGAIN;
+			break;
+		}
 
 		if (ofi_atomic_get32(&cq->wakeup)) {
 			ofi_atomic_set32(&cq->wakeup, 0);
 			return -FI_EAGAIN;
 		}
 
+		if (!start) {
+			start = ofi_gettime_ns();
+			spin_end = start + ofi_wait_spin_time(cq->wait);
+		}
+
+		if (ofi_gettime_ns() < spin_end) {
+			ret = 0;
+			continue;
+		}
+
 		ret = ofi_wait(&cq->wait->wait_fid, timeout);
 	} while (!ret);
 
+	if (start)
+		ofi_wait_spin_update(cq->wait, ofi_gettime_ns() - start);
+
 	return ret == -FI_ETIMEDOUT ? -FI_EAGAIN : ret;
 }
 
@@ -423,7 +584,10 @@ static void util_peer_cq_cleanup(struct util_cq *cq)
 		free(err);
 	}
 
-	util_comp_cirq_free(cq->cirq);
+	if (cq->mpscq)
+		ofi_freealign(cq->mpscq);
+	else
+		util_comp_cirq_free(cq->cirq);
 	free(cq->src);
 	fi_close(&cq->peer_cq->fid);
 }
@@ -538,16 +702,7 @@ static ssize_t util_peer_cq_write(struct fid_peer_cq *cq, void *context,
 
 	util_cq = cq->fid.context;
 
-	ofi_genlock_lock(&util_cq->cq_lock);
-	if (ofi_cirque_freecnt(util_cq->cirq) > 1) {
-		ofi_cq_write_entry(util_cq, context, flags, len, buf, data,
-				     tag);
-		ret = 0;
-	} else {
-		ret = ofi_cq_write_overflow(util_cq, context, flags, len, buf,
-					      data, tag, FI_ADDR_NOTAVAIL);
-	}
-	ofi_genlock_unlock(&util_cq->cq_lock);
+	ret = ofi_cq_write(util_cq, context, flags, len, buf, data, tag);
 
 	if (util_cq->wait)
 		util_cq->wait->signal(util_cq->wait);
@@ -562,16 +717,23 @@ static ssize_t util_peer_cq_write_src(struct fid_peer_cq *cq, void *context,
 	struct util_cq *util_cq = cq->fid.context;
 	int ret;
 
-	ofi_genlock_lock(&util_cq->cq_lock);
-	if (ofi_cirque_freecnt(util_cq->cirq) > 1) {
-		ofi_cq_write_src_entry(util_cq, context, flags, len, buf, data,
-				       tag, src);
-		ret = 0;
-	} else {
-		ret = ofi_cq_write_overflow(util_cq, context, flags, len, buf,
-					      data, tag, src);
-	}
-	ofi_genlock_unlock(&util_cq->cq_lock);
+	ret = ofi_cq_write_src(util_cq, context, flags, len, buf, data, tag,
+			       src);
+
+	if (util_cq->wait)
+		util_cq->wait->signal(util_cq->wait);
+
+	return ret;
+}
+
+static ssize_t util_peer_cq_write_batch(struct fid_peer_cq *cq,
+		const struct fi_cq_tagged_entry *comp, const fi_addr_t *src,
+		size_t count)
+{
+	struct util_cq *util_cq = cq->fid.context;
+	ssize_t ret;
+
+	ret = ofi_cq_write_batch(util_cq, comp, src, count);
 
 	if (util_cq->wait)
 		util_cq->wait->signal(util_cq->wait);
@@ -599,12 +761,14 @@ static struct fi_ops_cq_owner util_peer_cq_owner_ops = {
 	.size = sizeof(struct fi_ops_cq_owner),
 	.write = &util_peer_cq_write,
 	.writeerr = &util_peer_cq_writeerr,
+	.write_batch = &util_peer_cq_write_batch,
 };
 
 static struct fi_ops_cq_owner util_peer_cq_src_owner_ops = {
 	.size = sizeof(struct fi_ops_cq_owner),
 	.write = &util_peer_cq_write_src,
 	.writeerr = &util_peer_cq_writeerr,
+	.write_batch = &util_peer_cq_write_batch,
 };
 
 /* For peer cq, just do progress */
@@ -644,7 +808,25 @@ static struct fi_ops util_peer_cq_fi_ops = {
 	.ops_open = fi_no_ops_open,
 };
 
-static int util_init_peer_cq(struct util_cq *cq, struct fi_cq_attr *attr)
+static int util_init_mpscq(struct util_cq *cq, size_t size)
+{
+	int ret;
+
+	size = roundup_power_of_two(size);
+	ret = ofi_memalign((void **) &cq->mpscq, OFI_CACHE_LINE_SIZE,
+			   sizeof(*cq->mpscq) +
+			   sizeof(struct util_comp_mpscq_entry) * size);
+	if (ret)
+		return -FI_ENOMEM;
+
+	memset(cq->mpscq, 0, sizeof(*cq->mpscq) +
+	       sizeof(struct util_comp_mpscq_entry) * size);
+	util_comp_mpscq_init(cq->mpscq, size);
+	return FI_SUCCESS;
+}
+
+static int util_init_peer_cq(struct util_cq *cq, struct fi_cq_attr *attr,
+			     bool mpsc)
 {
 	int ret;
 
@@ -674,6 +856,17 @@ static int util_init_peer_cq(struct util_cq *cq, struct fi_cq_attr *attr)
 		goto free;
 	}
 
+	ofi_atomic_initialize32(&cq->aux_cnt, 0);
+	if (mpsc) {
+		ret = util_init_mpscq(cq, attr->size == 0 ?
+				      UTIL_DEF_CQ_SIZE : attr->size);
+		if (ret)
+			goto free;
+
+		cq->peer_cq->owner_ops = &util_peer_cq_src_owner_ops;
+		goto out;
+	}
+
 	cq->cirq = util_comp_cirq_create(attr->size == 0 ? UTIL_DEF_CQ_SIZE : attr->size);
 	if (!cq->cirq) {
 		ret = -FI_ENOMEM;
@@ -692,6 +885,7 @@ static int util_init_peer_cq(struct util_cq *cq, struct fi_cq_attr *attr)
 		cq->peer_cq->owner_ops = &util_peer_cq_owner_ops;
 	}
 
+out:
 	cq->peer_cq->fid.fclass = FI_CLASS_PEER_CQ;
 	cq->peer_cq->fid.context = cq;
 	cq->peer_cq->fid.ops = &util_peer_cq_fi_ops;
@@ -702,9 +896,10 @@ free:
 	return ret;
 }
 
-int ofi_cq_init(const struct fi_provider *prov, struct fid_domain *domain,
-		 struct fi_cq_attr *attr, struct util_cq *cq,
-		 ofi_cq_progress_func progress, void *context)
+static int util_cq_init(const struct fi_provider *prov,
+			struct fid_domain *domain, struct fi_cq_attr *attr,
+			struct util_cq *cq, ofi_cq_progress_func progress,
+			void *context, bool mpsc)
 {
 	struct fi_wait_attr wait_attr;
 	struct fid_wait *wait;
@@ -721,6 +916,7 @@ int ofi_cq_init(const struct fi_provider *prov, struct fid_domain *domain,
 	cq->cq_fid.ops = &util_cq_ops;
 	cq->progress = progress;
 	cq->err_data = NULL;
+	cq->mpscq = NULL;
 
 	cq->domain = container_of(domain, struct util_domain, domain_fid);
 	ofi_atomic_initialize32(&cq->ref, 0);
@@ -751,7 +947,9 @@ int ofi_cq_init(const struct fi_provider *prov, struct fid_domain *domain,
 		cq->peer_cq = ((struct fi_peer_cq_context *) context)->cq;
 		cq->cq_fid.ops = &util_peer_cq_ops;
 	} else {
-		ret = util_init_peer_cq(cq, attr);
+		/* Without a CQ lock there is a single producer */
+		ret = util_init_peer_cq(cq, attr,
+					mpsc && cq_lock_type != OFI_LOCK_NOOP);
 		if (ret)
 			goto destroy2;
 	}
@@ -806,6 +1004,21 @@ destroy1:
 	return ret;
 }
 
+int ofi_cq_init(const struct fi_provider *prov, struct fid_domain *domain,
+		 struct fi_cq_attr *attr, struct util_cq *cq,
+		 ofi_cq_progress_func progress, void *context)
+{
+	return util_cq_init(prov, domain, attr, cq, progress, context, false);
+}
+
+int ofi_cq_init_mpsc(const struct fi_provider *prov,
+		     struct fid_domain *domain, struct fi_cq_attr *attr,
+		     struct util_cq *cq, ofi_cq_progress_func progress,
+		     void *context)
+{
+	return util_cq_init(prov, domain, attr, cq, progress, context, true);
+}
+
 uint64_t ofi_rx_flags[] = {
 	[ofi_op_msg] = FI_MSG | FI_RECV,
 	[ofi_op_tagged] = FI_RECV | FI_TAGGED,
@@ -268,6 +268,13 @@ void ofi_monitors_init(void)
 #endif
 			" is the default if available on the system. 'disabled'"
 			" option disables memory caching.");
+	fi_param_define(NULL, "mr_cache_policy", FI_PARAM_STRING,
+			"Defines the policy used to select idle memory regions"
+			" for eviction when the MR cache is full.  Options are:"
+			" lru, which evicts the least recently used region, and"
+			" lfu, which keeps regions that are reused often and are"
+			" expensive to register relative to their size."
+			" (default: lru)");
 	fi_param_define(NULL, "mr_cuda_cache_monitor_enabled", FI_PARAM_BOOL,
 			"Enable or disable the CUDA cache memory monitor."
 			"Enabled by default.");
@@ -281,6 +288,7 @@ void ofi_monitors_init(void)
 	fi_param_get_size_t(NULL, "mr_cache_max_size", &cache_params.max_size);
 	fi_param_get_size_t(NULL, "mr_cache_max_count", &cache_params.max_cnt);
 	fi_param_get_str(NULL, "mr_cache_monitor", &cache_params.monitor);
+	fi_param_get_str(NULL, "mr_cache_policy", &cache_params.policy);
 	fi_param_get_bool(NULL, "mr_cuda_cache_monitor_enabled",
 			  &cache_params.cuda_monitor_enabled);
 	fi_param_get_bool(NULL, "mr_rocr_cache_monitor_enabled",
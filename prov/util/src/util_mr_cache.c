@@ -42,7 +42,21 @@
 #include <ofi_list.h>
 #include <ofi_tree.h>
 #include <ofi_enosys.h>
+#include <rdma/fi_profile.h>
 
+#ifdef HAVE_FABRIC_PROFILE
+#include <ofi_profile.h>
+static inline void util_mr_cache_track(uint32_t var_id, size_t len)
+{
+	ofi_prof_inc_sys_var(var_id, (int64_t) len);
+}
+#else
+static inline void util_mr_cache_track(uint32_t var_id, size_t len)
+{
+	OFI_UNUSED(var_id);
+	OFI_UNUSED(len);
+}
+#endif
 
 struct ofi_mr_cache_params cache_params = {
 	.max_cnt = 1024,
@@ -87,6 +101,233 @@ static int util_mr_find_overlap(struct ofi_rbmap *map, void *key, void *data)
 	return 0;
 }
 
+/* Lockless hits may take a reference while mm_lock is held by another
+ * thread, so reference counts are updated atomically when possible.
+ */
+#if HAVE_BUILTIN_ATOMICS
+static inline int util_mr_entry_ref(struct ofi_mr_entry *entry)
+{
+	return ofi_atomic_add_and_fetch(32, &entry->use_cnt, 1);
+}
+
+static inline int util_mr_entry_unref(struct ofi_mr_entry *entry)
+{
+	return ofi_atomic_sub_and_fetch(32, &entry->use_cnt, 1);
+}
+
+/* Take a reference only if the entry is already in use */
+static inline bool util_mr_entry_ref_active(struct ofi_mr_entry *entry)
+{
+	int cnt;
+
+	do {
+		cnt = entry->use_cnt;
+		if (!cnt)
+			return false;
+	} while (!ofi_atomic_cas_bool(32, &entry->use_cnt, cnt, cnt + 1));
+	return true;
+}
+
+/* Drop a reference only if it is not the last one */
+static inline bool util_mr_entry_unref_active(struct ofi_mr_entry *entry)
+{
+	int cnt;
+
+	do {
+		cnt = entry->use_cnt;
+		if (cnt <= 1)
+			return false;
+	} while (!ofi_atomic_cas_bool(32, &entry->use_cnt, cnt, cnt - 1));
+	return true;
+}
+
+static inline void util_mr_entry_reuse(struct ofi_mr_entry *entry)
+{
+	(void) ofi_atomic_add_and_fetch(32, &entry->reuse_cnt, 1);
+}
+#else
+static inline int util_mr_entry_ref(struct ofi_mr_entry *entry)
+{
+	return ++entry->use_cnt;
+}
+
+static inline int util_mr_entry_unref(struct ofi_mr_entry *entry)
+{
+	return --entry->use_cnt;
+}
+
+static inline void util_mr_entry_reuse(struct ofi_mr_entry *entry)
+{
+	entry->reuse_cnt++;
+}
+#endif
+
+static inline struct ofi_mr_cache_shard *
+util_mr_cache_shard(struct ofi_mr_cache *cache)
+{
+	return &cache->shards[ofi_thread_idx() % OFI_MR_CACHE_SHARD_CNT].shard;
+}
+
+/* Caches set up outside of ofi_mr_cache_init() have no shards */
+static void util_mr_tree_lock(struct ofi_mr_cache *cache)
+{
+	int i;
+
+	if (!cache->shards)
+		return;
+
+	for (i = 0; i < OFI_MR_CACHE_SHARD_CNT; i++)
+		pthread_rwlock_wrlock(&cache->shards[i].shard.lock);
+}
+
+static void util_mr_tree_unlock(struct ofi_mr_cache *cache)
+{
+	int i;
+
+	if (!cache->shards)
+		return;
+
+	for (i = OFI_MR_CACHE_SHARD_CNT - 1; i >= 0; i--)
+		pthread_rwlock_unlock(&cache->shards[i].shard.lock);
+}
+
+static void util_mr_lru_insert(struct ofi_mr_cache *cache,
+			       struct ofi_mr_entry *entry)
+{
+	dlist_insert_tail(&entry->list_entry, &cache->lru_list);
+}
+
+static void util_mr_lru_remove(struct ofi_mr_cache *cache,
+			       struct ofi_mr_entry *entry)
+{
+	dlist_remove_init(&entry->list_entry);
+}
+
+static struct ofi_mr_entry *util_mr_lru_evict(struct ofi_mr_cache *cache)
+{
+	struct ofi_mr_entry *entry;
+
+	if (dlist_empty(&cache->lru_list))
+		return NULL;
+
+	dlist_pop_front(&cache->lru_list, struct ofi_mr_entry,
+			entry, list_entry);
+	dlist_init(&entry->list_entry);
+	return entry;
+}
+
+static const struct ofi_mr_cache_policy util_mr_lru_policy = {
+	.name = "lru",
+	.insert = util_mr_lru_insert,
+	.remove = util_mr_lru_remove,
+	.evict = util_mr_lru_evict,
+};
+
+/*
+ * Cost-weighted LFU, using the greedy dual frequency algorithm.  Idle
+ * entries are ordered by (reuse count * measured registration time), offset
+ * by a clock that advances to the priority of each evicted entry.  Entries
+ * that are reused often or are expensive to register are kept, while the
+ * clock ages out entries that stop being used.  Entries that cannot be
+ * added to the tree are kept on an overflow list and evicted first.
+ */
+static int util_mr_lfu_compare(struct ofi_rbmap *map, void *key, void *data)
+{
+	struct ofi_mr_entry *entry = data;
+	struct ofi_mr_entry *key_entry = key;
+
+	if (key_entry->priority < entry->priority)
+		return -1;
+	if (key_entry->priority > entry->priority)
+		return 1;
+	if ((uintptr_t) key_entry < (uintptr_t) entry)
+		return -1;
+	return (uintptr_t) key_entry > (uintptr_t) entry;
+}
+
+static void util_mr_lfu_insert(struct ofi_mr_cache *cache,
+			       struct ofi_mr_entry *entry)
+{
+	entry->priority = cache->evict_clock + (double) entry->reg_time *
+			  (entry->reuse_cnt + 1);
+
+	if (ofi_rbmap_insert(&cache->evict_tree, entry, entry,
+			     &entry->evict_node)) {
+		entry->evict_node = NULL;
+		dlist_insert_tail(&entry->list_entry, &cache->evict_overflow);
+	}
+}
+
+static void util_mr_lfu_remove(struct ofi_mr_cache *cache,
+			       struct ofi_mr_entry *entry)
+{
+	if (entry->evict_node) {
+		ofi_rbmap_delete(&cache->evict_tree, entry->evict_node);
+		entry->evict_node = NULL;
+	} else {
+		dlist_remove_init(&entry->list_entry);
+	}
+}
+
+static struct ofi_mr_entry *util_mr_lfu_evict(struct ofi_mr_cache *cache)
+{
+	struct ofi_mr_entry *entry;
+	struct ofi_rbnode *node;
+
+	if (!dlist_empty(&cache->evict_overflow)) {
+		dlist_pop_front(&cache->evict_overflow, struct ofi_mr_entry,
+				entry, list_entry);
+		dlist_init(&entry->list_entry);
+		return entry;
+	}
+
+	node = ofi_rbmap_get_min(&cache->evict_tree);
+	if (!node)
+		return NULL;
+
+	entry = node->data;
+	cache->evict_clock = entry->priority;
+	ofi_rbmap_delete(&cache->evict_tree, node);
+	entry->evict_node = NULL;
+	return entry;
+}
+
+static const struct ofi_mr_cache_policy util_mr_lfu_policy = {
+	.name = "lfu",
+	.insert = util_mr_lfu_insert,
+	.remove = util_mr_lfu_remove,
+	.evict = util_mr_lfu_evict,
+};
+
+static const struct ofi_mr_cache_policy *util_mr_policies[] = {
+	&util_mr_lru_policy,
+	&util_mr_lfu_policy,
+};
+
+/* Caches set up outside of ofi_mr_cache_init() use LRU */
+static inline const struct ofi_mr_cache_policy *
+util_mr_cache_policy(struct ofi_mr_cache *cache)
+{
+	return cache->policy ? cache->policy : &util_mr_lru_policy;
+}
+
+static const struct ofi_mr_cache_policy *util_mr_cache_get_policy(void)
+{
+	size_t i;
+
+	if (!cache_params.policy)
+		return &util_mr_lru_policy;
+
+	for (i = 0; i < ARRAY_SIZE(util_mr_policies); i++) {
+		if (!strcasecmp(cache_params.policy, util_mr_policies[i]->name))
+			return util_mr_policies[i];
+	}
+
+	FI_WARN(&core_prov, FI_LOG_MR,
+		"unknown MR cache policy %s, using lru\n", cache_params.policy);
+	return &util_mr_lru_policy;
+}
+
 static struct ofi_mr_entry *util_mr_entry_alloc(struct ofi_mr_cache *cache)
 {
 	struct ofi_mr_entry *entry;
@@ -128,8 +369,10 @@ static void util_mr_uncache_entry_storage(struct ofi_mr_cache *cache,
 	enum fi_hmem_iface iface = entry->info.iface;
 	struct ofi_mem_monitor *monitor = cache->monitors[iface];
 
+	util_mr_tree_lock(cache);
 	ofi_rbmap_delete(&cache->tree, entry->node);
 	entry->node = NULL;
+	util_mr_tree_unlock(cache);
 
 	/* Some memory monitors have a subscription context per MR. These
 	 * memory monitors require ofi_monitor_unsubscribe() to be called.
@@ -147,7 +390,7 @@ static void util_mr_uncache_entry(struct ofi_mr_cache *cache,
 	util_mr_uncache_entry_storage(cache, entry);
 
 	if (entry->use_cnt == 0) {
-		dlist_remove(&entry->list_entry);
+		util_mr_cache_policy(cache)->remove(cache, entry);
 		dlist_insert_tail(&entry->list_entry, &cache->dead_region_list);
 	} else {
 		cache->uncached_cnt++;
@@ -183,6 +426,47 @@ static struct ofi_mr_entry *ofi_mr_rbt_overlap(struct ofi_rbmap *tree,
 	return node->data;
 }
 
+/*
+ * Resolve a hit without taking mm_lock.  Only entries that are already
+ * referenced are handled here.  Idle entries are tracked by the eviction
+ * policy, which is protected by mm_lock, and are left to the locked path.
+ * Entries cannot be removed from the tree while a shard read lock is held.
+ */
+static struct ofi_mr_entry *
+util_mr_cache_find_lockless(struct ofi_mr_cache *cache,
+			    const struct ofi_mr_info *info)
+{
+#if HAVE_BUILTIN_ATOMICS
+	struct ofi_mr_cache_shard *shard;
+	struct ofi_mem_monitor *monitor;
+	struct ofi_mr_entry *entry;
+
+	if (!cache->shards)
+		return NULL;
+
+	shard = util_mr_cache_shard(cache);
+	pthread_rwlock_rdlock(&shard->lock);
+	entry = ofi_mr_rbt_find(&cache->tree, info);
+	if (!entry || !ofi_iov_within(&info->iov, &entry->info.iov))
+		goto miss;
+
+	monitor = cache->monitors[entry->info.iface];
+	if (!monitor->valid(monitor, info, entry) ||
+	    !util_mr_entry_ref_active(entry))
+		goto miss;
+
+	ofi_atomic_add_and_fetch(64, &shard->hit_cnt, 1);
+	util_mr_entry_reuse(entry);
+	pthread_rwlock_unlock(&shard->lock);
+	util_mr_cache_track(FI_VAR_MR_CACHE_HIT_BYTES, info->iov.iov_len);
+	return entry;
+
+miss:
+	pthread_rwlock_unlock(&shard->lock);
+#endif
+	return NULL;
+}
+
 /* Caller must hold ofi_mem_monitor lock as well as unsubscribe from the region */
 void ofi_mr_cache_notify(struct ofi_mr_cache *cache, const void *addr, size_t len)
 {
@@ -203,6 +487,7 @@ void ofi_mr_cache_notify(struct ofi_mr_cache *cache, const void *addr, size_t le
  */
 bool ofi_mr_cache_flush(struct ofi_mr_cache *cache, bool flush_lru)
 {
+	const struct ofi_mr_cache_policy *policy = util_mr_cache_policy(cache);
 	struct dlist_entry free_list;
 	struct ofi_mr_entry *entry;
 	bool entries_freed;
@@ -213,12 +498,11 @@ bool ofi_mr_cache_flush(struct ofi_mr_cache *cache, bool flush_lru)
 
 	dlist_splice_tail(&free_list, &cache->dead_region_list);
 
-	while (flush_lru && !dlist_empty(&cache->lru_list)) {
-		dlist_pop_front(&cache->lru_list, struct ofi_mr_entry,
-				entry, list_entry);
-		dlist_init(&entry->list_entry);
+	while (flush_lru && (entry = policy->evict(cache))) {
 		util_mr_uncache_entry_storage(cache, entry);
 		dlist_insert_tail(&entry->list_entry, &free_list);
+		util_mr_cache_track(FI_VAR_MR_CACHE_EVICT_BYTES,
+				    entry->info.iov.iov_len);
 
 		flush_lru = ofi_mr_cache_full(cache);
 	}
@@ -238,15 +522,33 @@ bool ofi_mr_cache_flush(struct ofi_mr_cache *cache, bool flush_lru)
 	return entries_freed;
 }
 
+/* Releasing a reference other than the last one does not hand the entry
+ * to the eviction policy, so it does not need mm_lock.
+ */
+static bool util_mr_cache_delete_lockless(struct ofi_mr_cache *cache,
+					  struct ofi_mr_entry *entry)
+{
+#if HAVE_BUILTIN_ATOMICS
+	if (cache->shards && util_mr_entry_unref_active(entry)) {
+		ofi_atomic_add_and_fetch(64, &util_mr_cache_shard(cache)->delete_cnt, 1);
+		return true;
+	}
+#endif
+	return false;
+}
+
 void ofi_mr_cache_delete(struct ofi_mr_cache *cache, struct ofi_mr_entry *entry)
 {
 	FI_DBG(cache->prov, FI_LOG_MR, "delete %p (len: %zu)\n",
 	       entry->info.iov.iov_base, entry->info.iov.iov_len);
 
+	if (util_mr_cache_delete_lockless(cache, entry))
+		return;
+
 	pthread_mutex_lock(&mm_lock);
 	cache->delete_cnt++;
 
-	if (--entry->use_cnt == 0) {
+	if (util_mr_entry_unref(entry) == 0) {
 		if (!entry->node) {
 			cache->uncached_cnt--;
 			cache->uncached_size -= entry->info.iov.iov_len;
@@ -254,7 +556,7 @@ void ofi_mr_cache_delete(struct ofi_mr_cache *cache, struct ofi_mr_entry *entry)
 			util_mr_free_entry(cache, entry);
 			return;
 		}
-		dlist_insert_tail(&entry->list_entry, &cache->lru_list);
+		util_mr_cache_policy(cache)->insert(cache, entry);
 	}
 	pthread_mutex_unlock(&mm_lock);
 }
@@ -274,6 +576,7 @@ util_mr_cache_create(struct ofi_mr_cache *cache, struct ofi_mr_info *info,
 		     struct ofi_mr_entry **entry)
 {
 	struct ofi_mr_entry *cur;
+	uint64_t start;
 	int ret;
 	struct ofi_mem_monitor *monitor = cache->monitors[info->iface];
 
@@ -289,10 +592,14 @@ util_mr_cache_create(struct ofi_mr_cache *cache, struct ofi_mr_info *info,
 	(*entry)->node = NULL;
 	(*entry)->info = *info;
 	(*entry)->use_cnt = 1;
+	(*entry)->reuse_cnt = 0;
+	(*entry)->evict_node = NULL;
 
+	start = ofi_gettime_ns();
 	ret = cache->add_region(cache, *entry);
 	if (ret)
 		goto free;
+	(*entry)->reg_time = ofi_gettime_ns() - start;
 
 	/* Providers may have expanded the MR. Update MR info input
 	 * accordingly.
@@ -307,12 +614,16 @@ util_mr_cache_create(struct ofi_mr_cache *cache, struct ofi_mr_info *info,
 		goto unlock;
 	}
 
+	util_mr_cache_track(FI_VAR_MR_CACHE_MISS_BYTES, info->iov.iov_len);
 	if (ofi_mr_cache_full(cache)) {
 		cache->uncached_cnt++;
 		cache->uncached_size += info->iov.iov_len;
 	} else {
-		if (ofi_rbmap_insert(&cache->tree, (void *) &(*entry)->info,
-				     (void *) *entry, &(*entry)->node)) {
+		util_mr_tree_lock(cache);
+		ret = ofi_rbmap_insert(&cache->tree, (void *) &(*entry)->info,
+				       (void *) *entry, &(*entry)->node);
+		util_mr_tree_unlock(cache);
+		if (ret) {
 			ret = -FI_ENOMEM;
 			goto unlock;
 		}
@@ -356,6 +667,10 @@ int ofi_mr_cache_search(struct ofi_mr_cache *cache, struct ofi_mr_info *info,
 	FI_DBG(cache->prov, FI_LOG_MR, "search %p (len: %zu)\n",
 	       info->iov.iov_base, info->iov.iov_len);
 
+	*entry = util_mr_cache_find_lockless(cache, info);
+	if (*entry)
+		return 0;
+
 	do {
 		pthread_mutex_lock(&mm_lock);
 		flush_lru = ofi_mr_cache_full(cache);
@@ -391,9 +706,12 @@ int ofi_mr_cache_search(struct ofi_mr_cache *cache, struct ofi_mr_info *info,
 
 hit:
 	cache->hit_cnt++;
-	if ((*entry)->use_cnt++ == 0)
-		dlist_remove_init(&(*entry)->list_entry);
+	if (util_mr_entry_ref(*entry) == 1) {
+		util_mr_cache_policy(cache)->remove(cache, *entry);
+		util_mr_entry_reuse(*entry);
+	}
 	pthread_mutex_unlock(&mm_lock);
+	util_mr_cache_track(FI_VAR_MR_CACHE_HIT_BYTES, info->iov.iov_len);
 	return 0;
 }
 
@@ -409,6 +727,12 @@ struct ofi_mr_entry *ofi_mr_cache_find(struct ofi_mr_cache *cache,
 	FI_DBG(cache->prov, FI_LOG_MR, "find %p (len: %zu)\n",
 	       attr->mr_iov->iov_base, attr->mr_iov->iov_len);
 
+	info.peer_id = 0;
+	ofi_mr_info_get_iov_from_mr_attr(&info, attr, flags);
+	entry = util_mr_cache_find_lockless(cache, &info);
+	if (entry)
+		return entry;
+
 	pthread_mutex_lock(&mm_lock);
 
 	if (!dlist_empty(&cache->dead_region_list)) {
@@ -418,9 +742,6 @@ struct ofi_mr_entry *ofi_mr_cache_find(struct ofi_mr_cache *cache,
 	}
 
 	cache->search_cnt++;
-
-	info.peer_id = 0;
-	ofi_mr_info_get_iov_from_mr_attr(&info, attr, flags);
 	entry = ofi_mr_rbt_find(&cache->tree, &info);
 	if (!entry) {
 		goto unlock;
@@ -431,8 +752,12 @@ struct ofi_mr_entry *ofi_mr_cache_find(struct ofi_mr_cache *cache,
 	if (ofi_iov_within(attr->mr_iov, &entry->info.iov) &&
 	    monitor->valid(monitor, entry->info.iov.iov_base, entry)) {
 		cache->hit_cnt++;
-		if ((entry)->use_cnt++ == 0)
-			dlist_remove_init(&(entry)->list_entry);
+		if (util_mr_entry_ref(entry) == 1) {
+			util_mr_cache_policy(cache)->remove(cache, entry);
+			util_mr_entry_reuse(entry);
+		}
+		util_mr_cache_track(FI_VAR_MR_CACHE_HIT_BYTES,
+				    attr->mr_iov->iov_len);
 	} else {
 		while (entry) {
 			util_mr_uncache_entry(cache, entry);
@@ -482,15 +807,52 @@ buf_free:
 	return ret;
 }
 
+static int util_mr_cache_init_shards(struct ofi_mr_cache *cache)
+{
+	int i;
+
+	cache->shards = calloc(OFI_MR_CACHE_SHARD_CNT, sizeof(*cache->shards));
+	if (!cache->shards)
+		return -FI_ENOMEM;
+
+	for (i = 0; i < OFI_MR_CACHE_SHARD_CNT; i++)
+		pthread_rwlock_init(&cache->shards[i].shard.lock, NULL);
+	return 0;
+}
+
+static void util_mr_cache_cleanup_shards(struct ofi_mr_cache *cache)
+{
+	int i;
+
+	if (!cache->shards)
+		return;
+
+	for (i = 0; i < OFI_MR_CACHE_SHARD_CNT; i++)
+		pthread_rwlock_destroy(&cache->shards[i].shard.lock);
+	free(cache->shards);
+	cache->shards = NULL;
+}
+
 void ofi_mr_cache_cleanup(struct ofi_mr_cache *cache)
 {
+	size_t lockless_hits = 0, lockless_deletes = 0;
+	int i;
+
 	/* If we don't have a prov, initialization failed */
 	if (!cache->prov)
 		return;
 
-	FI_INFO(cache->prov, FI_LOG_MR, "MR cache stats: "
-		"searches %zu, deletes %zu, hits %zu notify %zu\n",
-		cache->search_cnt, cache->delete_cnt, cache->hit_cnt,
+	for (i = 0; cache->shards && i < OFI_MR_CACHE_SHARD_CNT; i++) {
+		lockless_hits += cache->shards[i].shard.hit_cnt;
+		lockless_deletes += cache->shards[i].shard.delete_cnt;
+	}
+
+	FI_INFO(cache->prov, FI_LOG_MR, "MR cache stats: policy %s, "
+		"searches %zu, deletes %zu, hits %zu (lockless %zu) "
+		"notify %zu\n", util_mr_cache_policy(cache)->name,
+		cache->search_cnt + lockless_hits,
+		cache->delete_cnt + lockless_deletes,
+		cache->hit_cnt + lockless_hits, lockless_hits,
 		cache->notify_cnt);
 
 	while (ofi_mr_cache_flush(cache, true))
@@ -499,9 +861,11 @@ void ofi_mr_cache_cleanup(struct ofi_mr_cache *cache)
 	pthread_mutex_destroy(&cache->lock);
 	ofi_monitors_del_cache(cache);
 	ofi_rbmap_cleanup(&cache->tree);
+	ofi_rbmap_cleanup(&cache->evict_tree);
 	if (cache->domain)
 		ofi_atomic_dec32(&cache->domain->ref);
 	ofi_bufpool_destroy(cache->entry_pool);
+	util_mr_cache_cleanup_shards(cache);
 	assert(cache->cached_cnt == 0);
 	assert(cache->cached_size == 0);
 	assert(cache->uncached_cnt == 0);
@@ -522,6 +886,10 @@ int ofi_mr_cache_init(struct util_domain *domain,
 	pthread_mutex_init(&cache->lock, NULL);
 	dlist_init(&cache->lru_list);
 	dlist_init(&cache->dead_region_list);
+	dlist_init(&cache->evict_overflow);
+	ofi_rbmap_init(&cache->evict_tree, util_mr_lfu_compare);
+	cache->evict_clock = 0;
+	cache->policy = util_mr_cache_get_policy();
 	cache->cached_cnt = 0;
 	cache->cached_size = 0;
 	cache->cached_max_cnt = cache_params.max_cnt;
@@ -541,6 +909,13 @@ int ofi_mr_cache_init(struct util_domain *domain,
 	}
 
 	ofi_rbmap_init(&cache->tree, util_mr_find_within);
+#ifdef HAVE_FABRIC_PROFILE
+	ofi_prof_sys_init();
+#endif
+	ret = util_mr_cache_init_shards(cache);
+	if (ret)
+		goto destroy;
+
 	ret = ofi_monitors_add_cache(monitors, cache);
 	if (ret)
 		goto destroy;
@@ -556,7 +931,9 @@ int ofi_mr_cache_init(struct util_domain *domain,
 del:
 	ofi_monitors_del_cache(cache);
 destroy:
+	util_mr_cache_cleanup_shards(cache);
 	ofi_rbmap_cleanup(&cache->tree);
+	ofi_rbmap_cleanup(&cache->evict_tree);
 	if (domain) {
 		ofi_atomic_dec32(&cache->domain->ref);
 		cache->domain = NULL;
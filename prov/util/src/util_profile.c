@@ -56,6 +56,16 @@ enum fi_prof_var_scope {
 	FI_SYS_VAR,
 };
 
+enum {
+	SYS_VAR_MEM = 0,
+	SYS_VAR_MR_CACHE_HIT,
+	SYS_VAR_MR_CACHE_MISS,
+	SYS_VAR_MR_CACHE_EVICT,
+	SYS_VAR_MAX,
+};
+
+#define OFI_SYS_VAR_FLAGS(idx)	(FI_SYS_VAR | ((uint64_t) (idx) << 32))
+
 struct fi_profile_desc  ofi_common_vars[] = {
 	{
 	 .id = FI_VAR_UNEXP_MSG_CNT,
@@ -129,6 +139,33 @@ struct fi_profile_desc  ofi_common_vars[] = {
 	 .name = "pvar_ofi_mem_alloc(MB)",
 	 .desc = "Memory pools allocated by OFI"
 	},
+	{
+	 .id = FI_VAR_MR_CACHE_HIT_BYTES,
+	 .datatype_sel = fi_defined_type,
+	 .datatype.defined = FI_TYPE_ATOMIC_TYPE,
+	 .flags = OFI_SYS_VAR_FLAGS(SYS_VAR_MR_CACHE_HIT),
+	 .size = 8,
+	 .name = "pvar_mr_cache_hit_bytes",
+	 .desc = "Bytes of registrations found in the MR cache"
+	},
+	{
+	 .id = FI_VAR_MR_CACHE_MISS_BYTES,
+	 .datatype_sel = fi_defined_type,
+	 .datatype.defined = FI_TYPE_ATOMIC_TYPE,
+	 .flags = OFI_SYS_VAR_FLAGS(SYS_VAR_MR_CACHE_MISS),
+	 .size = 8,
+	 .name = "pvar_mr_cache_miss_bytes",
+	 .desc = "Bytes of registrations missing from the MR cache"
+	},
+	{
+	 .id = FI_VAR_MR_CACHE_EVICT_BYTES,
+	 .datatype_sel = fi_defined_type,
+	 .datatype.defined = FI_TYPE_ATOMIC_TYPE,
+	 .flags = OFI_SYS_VAR_FLAGS(SYS_VAR_MR_CACHE_EVICT),
+	 .size = 8,
+	 .name = "pvar_mr_cache_evict_bytes",
+	 .desc = "Bytes of idle registrations evicted from the MR cache"
+	},
 };
 
 struct fi_profile_desc  ofi_common_events[] = {
@@ -155,11 +192,7 @@ struct fi_profile_desc  ofi_common_events[] = {
 size_t ofi_common_var_count = ARRAY_SIZE(ofi_common_vars);
 size_t ofi_common_event_count = ARRAY_SIZE(ofi_common_events);
 
-enum {
-	SYS_VAR_MEM = 0,
-};
-
-static ofi_atomic64_t  ofi_sys_vars[1];
+static ofi_atomic64_t  ofi_sys_vars[SYS_VAR_MAX];
 size_t ofi_sys_var_count = ARRAY_SIZE(ofi_sys_vars);
 
 static bool ofi_sys_var_enabled = false;
@@ -171,6 +204,12 @@ ofi_prof_var2_sys_idx(uint32_t var_id)
 		switch (var_id) {
 		case FI_VAR_OFI_MEM:
 			return SYS_VAR_MEM;
+		case FI_VAR_MR_CACHE_HIT_BYTES:
+			return SYS_VAR_MR_CACHE_HIT;
+		case FI_VAR_MR_CACHE_MISS_BYTES:
+			return SYS_VAR_MR_CACHE_MISS;
+		case FI_VAR_MR_CACHE_EVICT_BYTES:
+			return SYS_VAR_MR_CACHE_EVICT;
 		default:
 			break;
 		}
@@ -214,6 +253,9 @@ ofi_prof_event2_desc(struct util_profile *prof, uint32_t event_id)
 
 void ofi_prof_sys_init()
 {
+	if (ofi_sys_var_enabled)
+		return;
+
 	for (int i = 0; i < ofi_sys_var_count; i++)
                 ofi_atomic_initialize64(&ofi_sys_vars[i], 0);
 
@@ -35,6 +35,10 @@
 #include "ofi_enosys.h"
 #include "ofi_iov.h"
 #include "ofi_util.h"
+#include "fasthash.h"
+
+#define UTIL_SRX_MIN_BUCKETS	64
+#define UTIL_SRX_MAX_BUCKETS	(1 << 16)
 
 static struct util_rx_entry *util_alloc_rx_entry(struct util_srx_ctx *srx)
 {
@@ -157,6 +161,89 @@ static struct util_rx_entry *util_process_multi_recv(struct util_srx_ctx *srx,
 	return util_entry;
 }
 
+static inline struct dlist_entry *
+util_match_bucket(struct util_match_table *table, uint64_t tag, fi_addr_t addr)
+{
+	uint64_t key[2] = { tag, (uint64_t) addr };
+
+	return &table->buckets[fasthash64(key, sizeof(key), 0) & table->mask];
+}
+
+static int util_match_table_init(struct util_match_table *table, size_t size)
+{
+	size_t i;
+
+	table->buckets = calloc(size, sizeof(*table->buckets));
+	if (!table->buckets)
+		return -FI_ENOMEM;
+
+	for (i = 0; i < size; i++)
+		dlist_init(&table->buckets[i]);
+	table->mask = size - 1;
+	return FI_SUCCESS;
+}
+
+static void util_match_table_cleanup(struct util_match_table *table)
+{
+	free(table->buckets);
+	table->buckets = NULL;
+	table->mask = 0;
+}
+
+/* Unexpected entries are rehashed when their source address is resolved
+ * and must stay in arrival order within the bucket.  The new entry is
+ * usually the most recent, so search from the tail.
+ */
+static void util_insert_ordered(struct dlist_entry *bucket,
+				struct util_rx_entry *rx_entry)
+{
+	struct dlist_entry *item;
+	struct util_rx_entry *cur;
+
+	dlist_foreach_reverse(bucket, item) {
+		cur = container_of(item, struct util_rx_entry, hash_entry);
+		if (cur->seq_no < rx_entry->seq_no)
+			break;
+	}
+	dlist_insert_after(&rx_entry->hash_entry, item);
+}
+
+static struct util_rx_entry *
+util_match_exp_hash(struct util_srx_ctx *srx, uint64_t tag, fi_addr_t addr)
+{
+	struct dlist_entry *bucket;
+	struct util_rx_entry *rx_entry;
+
+	bucket = util_match_bucket(&srx->exp_tag_table, tag, addr);
+	dlist_foreach_container(bucket, struct util_rx_entry, rx_entry,
+				hash_entry) {
+		if (rx_entry->peer_entry.tag == tag &&
+		    rx_entry->peer_entry.addr == addr)
+			return rx_entry;
+	}
+	return NULL;
+}
+
+static void util_queue_trecv(struct util_srx_ctx *srx,
+			     struct util_rx_entry *rx_entry)
+{
+	struct slist *queue;
+
+	if (srx->match_mode == UTIL_SRX_MATCH_HASH && !rx_entry->ignore) {
+		dlist_insert_tail(&rx_entry->hash_entry,
+				  util_match_bucket(&srx->exp_tag_table,
+						    rx_entry->peer_entry.tag,
+						    rx_entry->peer_entry.addr));
+		return;
+	}
+
+	queue = rx_entry->peer_entry.addr == FI_ADDR_UNSPEC ? &srx->tag_queue :
+		ofi_array_at(&srx->src_trecv_queues, rx_entry->peer_entry.addr);
+	assert(queue);
+	slist_insert_tail((struct slist_entry *) (&rx_entry->peer_entry),
+			  queue);
+}
+
 static int util_match_msg(struct fid_peer_srx *srx,
 			  struct fi_peer_match_attr *attr,
 			  struct fi_peer_rx_entry **rx_entry)
@@ -277,9 +364,9 @@ out:
 	return ret;
 }
 
-static int util_get_tag(struct fid_peer_srx *srx,
-			struct fi_peer_match_attr *attr,
-			struct fi_peer_rx_entry **rx_entry)
+static int util_get_tag_list(struct fid_peer_srx *srx,
+			     struct fi_peer_match_attr *attr,
+			     struct fi_peer_rx_entry **rx_entry)
 {
 	struct util_srx_ctx *srx_ctx;
 	struct slist *queue;
@@ -329,6 +416,83 @@ check_any:
 	return ret;
 }
 
+static int util_get_tag_hash(struct fid_peer_srx *srx,
+			     struct fi_peer_match_attr *attr,
+			     struct fi_peer_rx_entry **rx_entry)
+{
+	struct util_srx_ctx *srx_ctx;
+	struct util_rx_entry *util_entry = NULL, *any_entry, *wild_entry;
+	struct slist *queues[2], *match_queue = NULL;
+	struct slist_entry *item, *prev, *match_item = NULL, *match_prev = NULL;
+	int i, ret = FI_SUCCESS;
+
+	srx_ctx = srx->ep_fid.fid.context;
+	assert(ofi_genlock_held(srx_ctx->lock));
+
+	if (attr->addr != FI_ADDR_UNSPEC)
+		util_entry = util_match_exp_hash(srx_ctx, attr->tag, attr->addr);
+	any_entry = util_match_exp_hash(srx_ctx, attr->tag, FI_ADDR_UNSPEC);
+	if (any_entry && (!util_entry || any_entry->seq_no < util_entry->seq_no))
+		util_entry = any_entry;
+
+	/* Receives with ignore bits must be checked in posting order, but
+	 * only up to the oldest exact match found so far.
+	 */
+	queues[0] = attr->addr == FI_ADDR_UNSPEC ? NULL :
+		    ofi_array_at(&srx_ctx->src_trecv_queues, attr->addr);
+	queues[1] = &srx_ctx->tag_queue;
+	for (i = 0; i < 2; i++) {
+		if (!queues[i])
+			continue;
+
+		slist_foreach(queues[i], item, prev) {
+			wild_entry = container_of(item, struct util_rx_entry,
+						  peer_entry);
+			if (util_entry && wild_entry->seq_no > util_entry->seq_no)
+				break;
+
+			if (ofi_match_tag(wild_entry->peer_entry.tag,
+					  wild_entry->ignore, attr->tag)) {
+				util_entry = wild_entry;
+				match_queue = queues[i];
+				match_item = item;
+				match_prev = prev;
+				break;
+			}
+		}
+	}
+
+	if (!util_entry) {
+		util_entry = util_init_unexp(srx_ctx, attr, FI_TAGGED | FI_RECV);
+		if (!util_entry)
+			return -FI_ENOMEM;
+		ret = -FI_ENOENT;
+	} else {
+		if (match_queue)
+			slist_remove(match_queue, match_item, match_prev);
+		else
+			dlist_remove(&util_entry->hash_entry);
+		srx_ctx->update_func(srx_ctx, util_entry);
+	}
+	util_entry->peer_entry.srx = srx;
+	util_entry->peer_entry.msg_size = MIN(util_entry->peer_entry.msg_size,
+					      attr->msg_size);
+	*rx_entry = &util_entry->peer_entry;
+	return ret;
+}
+
+static int util_get_tag(struct fid_peer_srx *srx,
+			struct fi_peer_match_attr *attr,
+			struct fi_peer_rx_entry **rx_entry)
+{
+	struct util_srx_ctx *srx_ctx = srx->ep_fid.fid.context;
+
+	if (srx_ctx->match_mode == UTIL_SRX_MATCH_HASH)
+		return util_get_tag_hash(srx, attr, rx_entry);
+
+	return util_get_tag_list(srx, attr, rx_entry);
+}
+
 static int util_queue_msg(struct fi_peer_rx_entry *rx_entry)
 {
 	struct util_srx_ctx *srx_ctx = rx_entry->srx->ep_fid.fid.context;
@@ -352,6 +516,28 @@ static int util_queue_msg(struct fi_peer_rx_entry *rx_entry)
 	return FI_SUCCESS;
 }
 
+static void util_queue_unexp_hash(struct util_srx_ctx *srx,
+				  struct util_rx_entry *rx_entry)
+{
+	rx_entry->seq_no = srx->unexp_seq_no++;
+	dlist_insert_tail(&rx_entry->hash_entry,
+			  util_match_bucket(&srx->unexp_tag_table,
+					    rx_entry->peer_entry.tag,
+					    rx_entry->peer_entry.addr));
+	dlist_insert_tail(&rx_entry->tag_entry,
+			  util_match_bucket(&srx->unexp_any_table,
+					    rx_entry->peer_entry.tag,
+					    FI_ADDR_UNSPEC));
+	dlist_insert_tail(&rx_entry->order_entry, &srx->unexp_tag_list);
+}
+
+static void util_remove_unexp_hash(struct util_rx_entry *rx_entry)
+{
+	dlist_remove(&rx_entry->hash_entry);
+	dlist_remove(&rx_entry->tag_entry);
+	dlist_remove(&rx_entry->order_entry);
+}
+
 static int util_queue_tag(struct fi_peer_rx_entry *rx_entry)
 {
 	struct util_srx_ctx *srx_ctx = rx_entry->srx->ep_fid.fid.context;
@@ -359,7 +545,10 @@ static int util_queue_tag(struct fi_peer_rx_entry *rx_entry)
 
 	assert(ofi_genlock_held(srx_ctx->lock));
 
-	if (rx_entry->addr == FI_ADDR_UNSPEC) {
+	if (srx_ctx->match_mode == UTIL_SRX_MATCH_HASH) {
+		util_queue_unexp_hash(srx_ctx, container_of(rx_entry,
+					struct util_rx_entry, peer_entry));
+	} else if (rx_entry->addr == FI_ADDR_UNSPEC) {
 		dlist_insert_tail((struct dlist_entry *) rx_entry,
 				  &srx_ctx->unspec_unexp_tag_queue);
 	} else {
@@ -402,6 +591,29 @@ static void util_free_entry(struct fi_peer_rx_entry *entry)
 	ofi_buf_free(util_entry);
 }
 
+static void util_foreach_unspec_hash(struct util_srx_ctx *srx,
+		fi_addr_t (*get_addr)(struct fi_peer_rx_entry *))
+{
+	struct util_rx_entry *rx_entry;
+	fi_addr_t addr;
+
+	dlist_foreach_container(&srx->unexp_tag_list, struct util_rx_entry,
+				rx_entry, order_entry) {
+		if (rx_entry->peer_entry.addr != FI_ADDR_UNSPEC)
+			continue;
+
+		addr = get_addr(&rx_entry->peer_entry);
+		if (addr == FI_ADDR_UNSPEC)
+			continue;
+
+		rx_entry->peer_entry.addr = addr;
+		dlist_remove(&rx_entry->hash_entry);
+		util_insert_ordered(util_match_bucket(&srx->unexp_tag_table,
+					rx_entry->peer_entry.tag, addr),
+				    rx_entry);
+	}
+}
+
 static void util_foreach_unspec(struct fid_peer_srx *srx,
 		fi_addr_t (*get_addr)(struct fi_peer_rx_entry *))
 {
@@ -430,6 +642,11 @@ static void util_foreach_unspec(struct fid_peer_srx *srx,
 					  &srx_ctx->unexp_peers);
 	}
 
+	if (srx_ctx->match_mode == UTIL_SRX_MATCH_HASH) {
+		util_foreach_unspec_hash(srx_ctx, get_addr);
+		goto out;
+	}
+
 	dlist_foreach_safe(&srx_ctx->unspec_unexp_tag_queue, item, tmp) {
 		rx_entry = (struct fi_peer_rx_entry *) item;
 		rx_entry->addr = get_addr(rx_entry);
@@ -446,6 +663,7 @@ static void util_foreach_unspec(struct fid_peer_srx *srx,
 			dlist_insert_tail(&unexp_peer->entry,
 					  &srx_ctx->unexp_peers);
 	}
+out:
 	ofi_genlock_unlock(srx_ctx->lock);
 }
 
@@ -601,6 +819,51 @@ static struct util_rx_entry *util_search_peer_tag(struct util_unexp_peer *peer,
 	return NULL;
 }
 
+static struct util_rx_entry *util_search_unexp_tag_hash(
+		struct util_srx_ctx *srx, fi_addr_t addr, uint64_t tag,
+		uint64_t ignore, bool remove)
+{
+	struct util_rx_entry *rx_entry;
+	struct dlist_entry *bucket;
+
+	if (ignore) {
+		dlist_foreach_container(&srx->unexp_tag_list,
+					struct util_rx_entry, rx_entry,
+					order_entry) {
+			if ((addr == FI_ADDR_UNSPEC ||
+			     rx_entry->peer_entry.addr == addr) &&
+			    ofi_match_tag(tag, ignore, rx_entry->peer_entry.tag))
+				goto found;
+		}
+		return NULL;
+	}
+
+	if (addr == FI_ADDR_UNSPEC) {
+		bucket = util_match_bucket(&srx->unexp_any_table, tag,
+					   FI_ADDR_UNSPEC);
+		dlist_foreach_container(bucket, struct util_rx_entry,
+					rx_entry, tag_entry) {
+			if (rx_entry->peer_entry.tag == tag)
+				goto found;
+		}
+		return NULL;
+	}
+
+	bucket = util_match_bucket(&srx->unexp_tag_table, tag, addr);
+	dlist_foreach_container(bucket, struct util_rx_entry, rx_entry,
+				hash_entry) {
+		if (rx_entry->peer_entry.tag == tag &&
+		    rx_entry->peer_entry.addr == addr)
+			goto found;
+	}
+	return NULL;
+
+found:
+	if (remove)
+		util_remove_unexp_hash(rx_entry);
+	return rx_entry;
+}
+
 static struct util_rx_entry *util_search_unexp_tag(struct util_srx_ctx *srx,
 		fi_addr_t addr, uint64_t tag, uint64_t ignore, bool remove)
 {
@@ -608,6 +871,10 @@ static struct util_rx_entry *util_search_unexp_tag(struct util_srx_ctx *srx,
 	struct util_unexp_peer *unexp_peer;
 	struct dlist_entry *entry;
 
+	if (srx->match_mode == UTIL_SRX_MATCH_HASH)
+		return util_search_unexp_tag_hash(srx, addr, tag, ignore,
+						  remove);
+
 	if (addr == FI_ADDR_UNSPEC) {
 		dlist_foreach(&srx->unspec_unexp_tag_queue, entry) {
 			rx_entry = container_of(entry, struct util_rx_entry,
@@ -678,7 +945,6 @@ ssize_t util_srx_generic_trecv(struct fid_ep *ep_fid, const struct iovec *iov,
 {
 	struct util_srx_ctx *srx;
 	struct util_rx_entry *rx_entry;
-	struct slist *queue;
 	ssize_t ret = FI_SUCCESS;
 
 	srx = container_of(ep_fid, struct util_srx_ctx, peer_srx.ep_fid);
@@ -715,9 +981,6 @@ ssize_t util_srx_generic_trecv(struct fid_ep *ep_fid, const struct iovec *iov,
 	} else {
 		rx_entry = util_search_unexp_tag(srx, addr, tag, ignore, true);
 		if (!rx_entry) {
-			queue = addr == FI_ADDR_UNSPEC ? &srx->tag_queue:
-				ofi_array_at(&srx->src_trecv_queues, addr);
-			assert(queue);
 			rx_entry = util_get_recv_entry(srx, iov, desc,
 						iov_count, addr, context, tag,
 						ignore,
@@ -725,9 +988,7 @@ ssize_t util_srx_generic_trecv(struct fid_ep *ep_fid, const struct iovec *iov,
 			if (!rx_entry)
 				ret = -FI_ENOMEM;
 			else
-				slist_insert_tail((struct slist_entry *)
-						  (&rx_entry->peer_entry),
-						  queue);
+				util_queue_trecv(srx, rx_entry);
 			goto out;
 		}
 	}
@@ -943,6 +1204,35 @@ static int util_cleanup_queues(struct ofi_dyn_arr *arr, void *list,
 	return FI_SUCCESS;
 }
 
+static void util_cleanup_tables(struct util_srx_ctx *srx)
+{
+	struct util_rx_entry *rx_entry;
+	size_t i;
+
+	while (!dlist_empty(&srx->unexp_tag_list)) {
+		dlist_pop_front(&srx->unexp_tag_list, struct util_rx_entry,
+				rx_entry, order_entry);
+		dlist_remove(&rx_entry->hash_entry);
+		dlist_remove(&rx_entry->tag_entry);
+		rx_entry->peer_entry.srx->peer_ops->discard_tag(
+							&rx_entry->peer_entry);
+		ofi_buf_free(rx_entry);
+	}
+
+	for (i = 0; i < srx->table_size; i++) {
+		while (!dlist_empty(&srx->exp_tag_table.buckets[i])) {
+			dlist_pop_front(&srx->exp_tag_table.buckets[i],
+					struct util_rx_entry, rx_entry,
+					hash_entry);
+			ofi_buf_free(rx_entry);
+		}
+	}
+
+	util_match_table_cleanup(&srx->exp_tag_table);
+	util_match_table_cleanup(&srx->unexp_tag_table);
+	util_match_table_cleanup(&srx->unexp_any_table);
+}
+
 int util_srx_close(struct fid *fid)
 {
 	struct util_srx_ctx *srx;
@@ -1014,6 +1304,9 @@ int util_srx_close(struct fid *fid)
 
 	ofi_array_destroy(&srx->src_unexp_peers);
 
+	if (srx->match_mode == UTIL_SRX_MATCH_HASH)
+		util_cleanup_tables(srx);
+
 	ofi_atomic_dec32(&srx->cq->ref);
 	ofi_bufpool_destroy(srx->rx_pool);
 
@@ -1056,6 +1349,28 @@ static int util_cancel_recv(struct util_srx_ctx *srx, struct slist *queue,
 	return -FI_ENOENT;
 }
 
+/* Cancel is not a fast path operation, so walk every bucket. */
+static int util_cancel_hash(struct util_srx_ctx *srx, void *context)
+{
+	struct util_rx_entry *rx_entry;
+	size_t i;
+
+	assert(ofi_genlock_held(srx->lock));
+	for (i = 0; i < srx->table_size; i++) {
+		dlist_foreach_container(&srx->exp_tag_table.buckets[i],
+					struct util_rx_entry, rx_entry,
+					hash_entry) {
+			if (rx_entry->peer_entry.context == context) {
+				dlist_remove(&rx_entry->hash_entry);
+				util_cancel_entry(srx, FI_TAGGED | FI_RECV,
+						  rx_entry);
+				return FI_SUCCESS;
+			}
+		}
+	}
+	return -FI_ENOENT;
+}
+
 static int util_cancel_src(struct ofi_dyn_arr *arr, void *list, void *context)
 {
 	struct util_srx_ctx *srx;
@@ -1087,6 +1402,10 @@ static ssize_t util_srx_cancel(fid_t ep_fid, void *context)
 	if (ret != -FI_ENOENT)
 		goto out;
 
+	if (srx->match_mode == UTIL_SRX_MATCH_HASH &&
+	    util_cancel_hash(srx, context) != -FI_ENOENT)
+		goto out;
+
 	if (ofi_array_iter(&srx->src_trecv_queues, context, util_cancel_src) ||
 	    ofi_array_iter(&srx->src_recv_queues, context, util_cancel_src)) {
 		/* nothing to do, always return success */
@@ -1163,6 +1482,75 @@ static void util_srx_init_unexp_peer(struct ofi_dyn_arr *arr, void *item)
 	unexp_peer->cnt = 0;
 }
 
+static bool util_srx_idle(struct util_srx_ctx *srx)
+{
+	return !srx->rx_seq_no && dlist_empty(&srx->unexp_peers) &&
+	       dlist_empty(&srx->unspec_unexp_msg_queue) &&
+	       dlist_empty(&srx->unspec_unexp_tag_queue) &&
+	       dlist_empty(&srx->unexp_tag_list);
+}
+
+static int util_srx_init_tables(struct util_srx_ctx *srx)
+{
+	int ret;
+
+	ret = util_match_table_init(&srx->exp_tag_table, srx->table_size);
+	if (ret)
+		return ret;
+
+	ret = util_match_table_init(&srx->unexp_tag_table, srx->table_size);
+	if (ret)
+		goto free_exp;
+
+	ret = util_match_table_init(&srx->unexp_any_table, srx->table_size);
+	if (ret)
+		goto free_unexp;
+
+	return FI_SUCCESS;
+
+free_unexp:
+	util_match_table_cleanup(&srx->unexp_tag_table);
+free_exp:
+	util_match_table_cleanup(&srx->exp_tag_table);
+	return ret;
+}
+
+/*
+ * Select the tag matching engine of an SRX.  The default comes from
+ * FI_SRX_TAG_HASH.  The mode can only be changed before any receive has
+ * been posted or any message has been queued.
+ */
+int util_srx_set_match(struct fid_ep *rx_ep, enum util_srx_match mode)
+{
+	struct util_srx_ctx *srx;
+	int ret = FI_SUCCESS;
+
+	srx = container_of(rx_ep, struct util_srx_ctx, peer_srx.ep_fid);
+
+	ofi_genlock_lock(srx->lock);
+	if (srx->match_mode == mode)
+		goto out;
+
+	if (!util_srx_idle(srx)) {
+		ret = -FI_EBUSY;
+		goto out;
+	}
+
+	if (mode == UTIL_SRX_MATCH_HASH) {
+		ret = util_srx_init_tables(srx);
+		if (ret)
+			goto out;
+	} else {
+		util_match_table_cleanup(&srx->exp_tag_table);
+		util_match_table_cleanup(&srx->unexp_tag_table);
+		util_match_table_cleanup(&srx->unexp_any_table);
+	}
+	srx->match_mode = mode;
+out:
+	ofi_genlock_unlock(srx->lock);
+	return ret;
+}
+
 int util_ep_srx_context(struct util_domain *domain, size_t rx_size,
 			size_t iov_limit, size_t default_min_multi_recv,
 			ofi_update_func_t update_func,
@@ -1189,6 +1577,7 @@ int util_ep_srx_context(struct util_domain *domain, size_t rx_size,
 
 	slist_init(&srx->msg_queue);
 	slist_init(&srx->tag_queue);
+	dlist_init(&srx->unexp_tag_list);
 
 	//each entry has the iovs and descriptors stored at the end of the entry
 	//calculate how much space each entry needs based on provider iov limits
@@ -1212,6 +1601,18 @@ int util_ep_srx_context(struct util_domain *domain, size_t rx_size,
 	srx->update_func = update_func;
 	srx->lock = lock;
 
+	srx->table_size = roundup_power_of_two(MIN(MAX(rx_size,
+				UTIL_SRX_MIN_BUCKETS), UTIL_SRX_MAX_BUCKETS));
+	if (ofi_srx_tag_hash) {
+		ret = util_srx_init_tables(srx);
+		if (ret) {
+			ofi_bufpool_destroy(srx->rx_pool);
+			free(srx);
+			return ret;
+		}
+		srx->match_mode = UTIL_SRX_MATCH_HASH;
+	}
+
 	srx->peer_srx.owner_ops = &util_srx_owner_ops;
 	srx->peer_srx.peer_ops = NULL;
 
@@ -157,6 +157,14 @@ int ofi_wait_init(struct util_fabric *fabric, struct fi_wait_attr *attr,
 	wait->pollset = container_of(poll_fid, struct util_poll, poll_fid);
 	ofi_mutex_init(&wait->lock);
 	dlist_init(&wait->fid_list);
+
+	/* Spinning gains nothing with FI_WAIT_YIELD, which never sleeps,
+	 * and on a single CPU it only delays whoever posts the completion.
+	 */
+	if (wait->wait_obj != FI_WAIT_YIELD &&
+	    ofi_sysconf(_SC_NPROCESSORS_ONLN) > 1)
+		wait->spin_max_ns = (uint64_t) ofi_wait_spin_us * 1000;
+	wait->spin_avg_ns = wait->spin_max_ns / 2;
 	wait->fabric = fabric;
 	ofi_atomic_inc32(&fabric->ref);
 	return 0;
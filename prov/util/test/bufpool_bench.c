@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Compares buffer pool alloc/free throughput between a pool serialized by
+ * a caller lock, which is how endpoints share their pools today, and a
+ * pool created with OFI_BUFPOOL_THREAD_CACHE.  Each thread allocates a
+ * burst of buffers and then frees them, for 1 up to the maximum number
+ * of threads in powers of 2.
+ */
+
+#include <config.h>
+
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <ofi.h>
+#include <ofi_mem.h>
+
+static int max_threads = 64;
+static int iterations = 100000;
+static int burst = 16;
+static size_t buf_size = 256;
+
+struct bench_ctx {
+	struct ofi_bufpool	*pool;
+	ofi_mutex_t		lock;
+	bool			locked;
+	pthread_barrier_t	barrier;
+};
+
+static void *bench_thread(void *arg)
+{
+	struct bench_ctx *ctx = arg;
+	void **bufs;
+	int i, j;
+
+	bufs = calloc(burst, sizeof(*bufs));
+	if (!bufs)
+		return (void *) (intptr_t) -FI_ENOMEM;
+
+	pthread_barrier_wait(&ctx->barrier);
+	for (i = 0; i < iterations; i++) {
+		for (j = 0; j < burst; j++) {
+			if (ctx->locked)
+				ofi_mutex_lock(&ctx->lock);
+			bufs[j] = ofi_buf_alloc(ctx->pool);
+			if (ctx->locked)
+				ofi_mutex_unlock(&ctx->lock);
+			if (!bufs[j])
+				goto err;
+		}
+		for (j = 0; j < burst; j++) {
+			if (ctx->locked)
+				ofi_mutex_lock(&ctx->lock);
+			ofi_buf_free(bufs[j]);
+			if (ctx->locked)
+				ofi_mutex_unlock(&ctx->lock);
+		}
+	}
+	free(bufs);
+	return NULL;
+err:
+	while (j--)
+		ofi_buf_free(bufs[j]);
+	free(bufs);
+	return (void *) (intptr_t) -FI_ENOMEM;
+}
+
+static int bench_run(int thread_cnt, bool locked, double *mops)
+{
+	struct bench_ctx ctx = { .locked = locked };
+	pthread_t *threads;
+	uint64_t start;
+	void *thread_ret;
+	int i, ret;
+
+	threads = calloc(thread_cnt, sizeof(*threads));
+	if (!threads)
+		return -FI_ENOMEM;
+
+	ret = ofi_bufpool_create(&ctx.pool, buf_size, 0, 0, 0,
+				 locked ? 0 : OFI_BUFPOOL_THREAD_CACHE);
+	if (ret)
+		goto free_threads;
+
+	ofi_mutex_init(&ctx.lock);
+	pthread_barrier_init(&ctx.barrier, NULL, thread_cnt + 1);
+
+	for (i = 0; i < thread_cnt; i++) {
+		ret = pthread_create(&threads[i], NULL, bench_thread, &ctx);
+		if (ret) {
+			fprintf(stderr, "pthread_create: %s\n", strerror(ret));
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	pthread_barrier_wait(&ctx.barrier);
+	start = ofi_gettime_ns();
+	for (i = 0; i < thread_cnt; i++) {
+		pthread_join(threads[i], &thread_ret);
+		if (thread_ret)
+			ret = (int) (intptr_t) thread_ret;
+	}
+	*mops = (double) thread_cnt * iterations * burst * 1000.0 /
+		(ofi_gettime_ns() - start);
+
+	pthread_barrier_destroy(&ctx.barrier);
+	ofi_mutex_destroy(&ctx.lock);
+	ofi_bufpool_destroy(ctx.pool);
+free_threads:
+	free(threads);
+	return ret;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [OPTIONS]\n", name);
+	fprintf(stderr, "  -t <threads>   maximum thread count (default 64)\n");
+	fprintf(stderr, "  -n <iters>     iterations per thread (default 100000)\n");
+	fprintf(stderr, "  -b <burst>     buffers allocated per iteration "
+		"(default 16)\n");
+	fprintf(stderr, "  -s <size>      buffer size (default 256)\n");
+}
+
+int main(int argc, char **argv)
+{
+	double locked_mops, cached_mops;
+	int op, threads, ret;
+
+	while ((op = getopt(argc, argv, "t:n:b:s:h")) != -1) {
+		switch (op) {
+		case 't':
+			max_threads = atoi(optarg);
+			break;
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		case 'b':
+			burst = atoi(optarg);
+			break;
+		case 's':
+			buf_size = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (max_threads < 1 || iterations < 1 || burst < 1) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	/* State normally set up by fi_ini() that the pool relies on */
+	fi_log_init();
+	ofi_mem_init();
+
+	printf("%-10s %16s %16s\n", "threads", "locked(Mops/s)",
+	       "cached(Mops/s)");
+	for (threads = 1; threads <= max_threads; threads <<= 1) {
+		ret = bench_run(threads, true, &locked_mops);
+		if (!ret)
+			ret = bench_run(threads, false, &cached_mops);
+		if (ret) {
+			fprintf(stderr, "bufpool error: %s\n", fi_strerror(-ret));
+			return EXIT_FAILURE;
+		}
+		printf("%-10d %16.2f %16.2f\n", threads, locked_mops,
+		       cached_mops);
+	}
+	return EXIT_SUCCESS;
+}
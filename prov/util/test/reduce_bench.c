@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Compares the element-wise atomic write handlers with the vectorized
+ * reduction handlers for each reduction op and datatype.  Both run over
+ * the same inputs, and the results must match.  Bandwidth is reported as
+ * bytes of the destination buffer reduced per second.
+ */
+
+#include <config.h>
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <ofi.h>
+#include <ofi_atomic.h>
+
+static size_t count = 1 << 20;
+static int iterations = 20;
+
+static const enum fi_op bench_ops[] = {
+	FI_MIN, FI_MAX, FI_SUM, FI_PROD, FI_BOR, FI_BAND, FI_BXOR,
+};
+
+static const enum fi_datatype bench_types[] = {
+	FI_INT8, FI_UINT8, FI_INT16, FI_UINT16, FI_INT32, FI_UINT32,
+	FI_INT64, FI_UINT64, FI_FLOAT, FI_DOUBLE,
+};
+
+typedef void (*reduce_fn)(enum fi_op op, enum fi_datatype datatype,
+			  void *dst, const void *src, size_t cnt);
+
+static void write_handler(enum fi_op op, enum fi_datatype datatype,
+			  void *dst, const void *src, size_t cnt)
+{
+	ofi_atomic_write_handler(op, datatype, dst, src, cnt);
+}
+
+static void fill(void *buf, enum fi_datatype datatype, size_t cnt)
+{
+	size_t i;
+
+	/* Small values keep PROD from overflowing floats to inf */
+	for (i = 0; i < cnt; i++) {
+		switch (datatype) {
+		case FI_FLOAT:
+			((float *) buf)[i] = (float) (rand() % 200 - 100) / 64;
+			break;
+		case FI_DOUBLE:
+			((double *) buf)[i] = (double) (rand() % 200 - 100) / 64;
+			break;
+		default:
+			((uint8_t *) buf)[i * ofi_datatype_size(datatype)] =
+				(uint8_t) rand();
+			memset((uint8_t *) buf +
+			       i * ofi_datatype_size(datatype) + 1,
+			       rand() & 0xff, ofi_datatype_size(datatype) - 1);
+			break;
+		}
+	}
+}
+
+static double bench_run(reduce_fn fn, enum fi_op op,
+			enum fi_datatype datatype, void *dst,
+			const void *init, const void *src)
+{
+	size_t size = count * ofi_datatype_size(datatype);
+	uint64_t start, elapsed = 0;
+	int i;
+
+	for (i = 0; i < iterations; i++) {
+		memcpy(dst, init, size);
+		start = ofi_gettime_ns();
+		fn(op, datatype, dst, src, count);
+		elapsed += ofi_gettime_ns() - start;
+	}
+	return (double) size * iterations / elapsed;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [OPTIONS]\n", name);
+	fprintf(stderr, "  -c <count>     elements per reduction "
+		"(default 1048576)\n");
+	fprintf(stderr, "  -n <iters>     iterations per op (default 20)\n");
+}
+
+int main(int argc, char **argv)
+{
+	char op_str[32], type_str[32];
+	double write_gbps, reduce_gbps;
+	void *src, *init, *dst, *check;
+	enum fi_datatype datatype;
+	enum fi_op op;
+	size_t i, j, size;
+	int opt, ret = EXIT_SUCCESS;
+
+	while ((opt = getopt(argc, argv, "c:n:h")) != -1) {
+		switch (opt) {
+		case 'c':
+			count = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!count || iterations < 1) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	size = count * sizeof(uint64_t);
+	src = malloc(size);
+	init = malloc(size);
+	dst = malloc(size);
+	check = malloc(size);
+	if (!src || !init || !dst || !check) {
+		fprintf(stderr, "unable to allocate buffers\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("%-10s %-10s %16s %16s\n", "op", "datatype", "write(GB/s)",
+	       "reduce(GB/s)");
+	for (i = 0; i < ARRAY_SIZE(bench_ops); i++) {
+		op = bench_ops[i];
+		for (j = 0; j < ARRAY_SIZE(bench_types); j++) {
+			datatype = bench_types[j];
+			if (!ofi_atomic_write_handlers[op][datatype])
+				continue;
+
+			size = count * ofi_datatype_size(datatype);
+			fill(src, datatype, count);
+			fill(init, datatype, count);
+
+			write_gbps = bench_run(write_handler, op, datatype,
+					       check, init, src);
+			reduce_gbps = bench_run(ofi_atomic_reduce_handler, op,
+						datatype, dst, init, src);
+			fi_tostr_r(op_str, sizeof(op_str), &op,
+				   FI_TYPE_ATOMIC_OP);
+			fi_tostr_r(type_str, sizeof(type_str), &datatype,
+				   FI_TYPE_ATOMIC_TYPE);
+			printf("%-10s %-10s %16.2f %16.2f\n", op_str,
+			       type_str, write_gbps, reduce_gbps);
+
+			if (memcmp(dst, check, size)) {
+				fprintf(stderr, "result mismatch\n");
+				ret = EXIT_FAILURE;
+			}
+		}
+	}
+
+	free(check);
+	free(dst);
+	free(init);
+	free(src);
+	return ret;
+}
@@ -210,6 +210,9 @@ vrb_prof_init_ep(struct fid *fid, uint64_t flags, void *context,
 			&(cntrs[vrb_prof_var2_cntr(FI_VAR_CONN_ACCEPT)]));
 	ret = ofi_prof_add_var(prof, FI_VAR_CONN_REJECT, NULL,
 			&(cntrs[vrb_prof_var2_cntr(FI_VAR_CONN_REJECT)]));
+	ret = ofi_prof_add_var(prof, FI_VAR_MR_CACHE_HIT_BYTES, NULL, NULL);
+	ret = ofi_prof_add_var(prof, FI_VAR_MR_CACHE_MISS_BYTES, NULL, NULL);
+	ret = ofi_prof_add_var(prof, FI_VAR_MR_CACHE_EVICT_BYTES, NULL, NULL);
 
 	FI_TRACE(&vrb_prov, FI_LOG_EP_CTRL,
 		"vrb_profile_init: flags 0x%lx, "
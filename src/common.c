@@ -86,6 +86,8 @@ struct ofi_common_locks common_locks = {
 
 size_t ofi_universe_size = 1024;
 int ofi_av_remove_cleanup;
+int ofi_srx_tag_hash;
+int ofi_wait_spin_us;
 char *ofi_offload_coll_prov_name = NULL;
 
 
@@ -330,6 +332,52 @@ uint64_t ofi_gettime_ns(void)
 	return now.tv_sec * 1000000000 + now.tv_nsec;
 }
 
+int ofi_thread_idx(void)
+{
+	static pthread_mutex_t idx_lock = PTHREAD_MUTEX_INITIALIZER;
+	static int next_idx;
+	static OFI_THREAD_LOCAL int idx = -1;
+
+	if (OFI_UNLIKELY(idx < 0)) {
+		pthread_mutex_lock(&idx_lock);
+		idx = next_idx++;
+		pthread_mutex_unlock(&idx_lock);
+	}
+	return idx;
+}
+
+/* Affinity variables hold one CPU set per thread, separated by ';'.
+ * Return a copy of entry 'index', modulo the number of entries, in
+ * *cpuset, or NULL if the list or the entry is empty.
+ */
+int ofi_affinity_entry(const char *list, size_t index, char **cpuset)
+{
+	const char *start, *end;
+	size_t cnt;
+
+	*cpuset = NULL;
+	if (!list || !*list)
+		return 0;
+
+	for (cnt = 1, start = list; *start; start++) {
+		if (*start == ';')
+			cnt++;
+	}
+
+	start = list;
+	for (index %= cnt; index; index--)
+		start = strchr(start, ';') + 1;
+
+	end = strchr(start, ';');
+	if (!end)
+		end = start + strlen(start);
+	if (end == start)
+		return 0;
+
+	*cpuset = strndup(start, end - start);
+	return *cpuset ? 0 : -FI_ENOMEM;
+}
+
 uint64_t ofi_gettime_us(void)
 {
 	return ofi_gettime_ns() / 1000;
@@ -1167,10 +1215,57 @@ int ofi_bsock_flush_sync(struct ofi_bsock *bsock)
 	return ofi_bsock_tosend(bsock) ? -FI_EAGAIN : 0;
 }
 
+static void ofi_ewma(uint64_t *avg, uint64_t val)
+{
+	*avg = *avg ? (*avg * 7 + val) / 8 : val;
+}
+
+static void ofi_bsock_zc_select(struct ofi_bsock_zc *zc)
+{
+	if (zc->copying)
+		zc->enabled = false;
+	else if (zc->send_cost && zc->copy_cost)
+		zc->enabled = (zc->send_cost + zc->harvest_cost) <=
+			      zc->copy_cost;
+}
+
+/* Returns true if a send of len bytes should use MSG_ZEROCOPY. */
+static bool ofi_bsock_zerocopy(struct ofi_bsock *bsock, size_t len)
+{
+	struct ofi_bsock_zc *zc = &bsock->zc;
+
+	if (len <= bsock->zerocopy_size)
+		return false;
+
+	if (--zc->probe)
+		return zc->enabled;
+
+	zc->probe = zc->enabled ? OFI_ZC_PROBE_MIN : zc->backoff;
+	return !zc->enabled;
+}
+
+static void ofi_bsock_zc_update(struct ofi_bsock *bsock, bool zerocopy,
+				size_t len, uint64_t start)
+{
+	struct ofi_bsock_zc *zc = &bsock->zc;
+	uint64_t cost;
+
+	cost = (ofi_gettime_ns() - start) * 1024 / len;
+	if (zerocopy) {
+		ofi_ewma(&zc->send_cost, cost);
+		zc->pending += len;
+	} else {
+		ofi_ewma(&zc->copy_cost, cost);
+	}
+	ofi_bsock_zc_select(zc);
+}
+
 int ofi_bsock_send(struct ofi_bsock *bsock, const void *buf, size_t *len)
 {
 	size_t avail;
 	ssize_t ret;
+	uint64_t start;
+	bool zerocopy;
 	int err;
 
 	avail = ofi_bsock_tosend(bsock);
@@ -1190,10 +1285,14 @@ int ofi_bsock_send(struct ofi_bsock *bsock, const void *buf, size_t *len)
 
 	assert(!ofi_bsock_tosend(bsock));
 	if (*len > bsock->zerocopy_size) {
+		zerocopy = ofi_bsock_zerocopy(bsock, *len);
+		start = ofi_gettime_ns();
 		ret = bsock->sockapi->send(bsock->sockapi, bsock->sock, buf, *len,
-					   MSG_NOSIGNAL | OFI_ZEROCOPY,
-					   &bsock->tx_sockctx);
-		if (ret >= 0) {
+					   zerocopy ? MSG_NOSIGNAL | OFI_ZEROCOPY :
+					   MSG_NOSIGNAL, &bsock->tx_sockctx);
+		if (ret > 0)
+			ofi_bsock_zc_update(bsock, zerocopy, ret, start);
+		if (ret >= 0 && zerocopy) {
 			bsock->async_index++;
 			*len = ret;
 			return -OFI_EINPROGRESS_ASYNC;
@@ -1207,7 +1306,8 @@ int ofi_bsock_send(struct ofi_bsock *bsock, const void *buf, size_t *len)
 			return ret;
 
 		if (OFI_SOCK_TRY_SND_RCV_AGAIN(-ret) &&
-		    *len < ofi_byteq_writeable(&bsock->sq)) {
+		    *len < ofi_byteq_writeable(&bsock->sq) &&
+		    ofi_byteq_alloc(&bsock->sq)) {
 			ofi_byteq_write(&bsock->sq, buf, *len);
 			return 0;
 		}
@@ -1224,6 +1324,8 @@ int ofi_bsock_sendv(struct ofi_bsock *bsock, const struct iovec *iov,
 {
 	size_t avail;
 	ssize_t ret;
+	uint64_t start;
+	bool zerocopy;
 	int err;
 
 	if (cnt == 1) {
@@ -1250,10 +1352,14 @@ int ofi_bsock_sendv(struct ofi_bsock *bsock, const struct iovec *iov,
 	assert(!ofi_bsock_tosend(bsock));
 
 	if (*len > bsock->zerocopy_size) {
+		zerocopy = ofi_bsock_zerocopy(bsock, *len);
+		start = ofi_gettime_ns();
 		ret = bsock->sockapi->sendv(bsock->sockapi, bsock->sock, iov, cnt,
-					    MSG_NOSIGNAL | OFI_ZEROCOPY,
-					    &bsock->tx_sockctx);
-		if (ret >= 0) {
+					    zerocopy ? MSG_NOSIGNAL | OFI_ZEROCOPY :
+					    MSG_NOSIGNAL, &bsock->tx_sockctx);
+		if (ret > 0)
+			ofi_bsock_zc_update(bsock, zerocopy, ret, start);
+		if (ret >= 0 && zerocopy) {
 			bsock->async_index++;
 			*len = ret;
 			return -OFI_EINPROGRESS_ASYNC;
@@ -1267,7 +1373,8 @@ int ofi_bsock_sendv(struct ofi_bsock *bsock, const struct iovec *iov,
 			return ret;
 
 		if (OFI_SOCK_TRY_SND_RCV_AGAIN(-ret) &&
-		    *len < ofi_byteq_writeable(&bsock->sq)) {
+		    *len < ofi_byteq_writeable(&bsock->sq) &&
+		    ofi_byteq_alloc(&bsock->sq)) {
 			ofi_byteq_writev(&bsock->sq, iov, cnt);
 			return 0;
 		}
@@ -1295,7 +1402,7 @@ int ofi_bsock_recv(struct ofi_bsock *bsock, void *buf, size_t *len)
 	}
 
 	assert(!ofi_bsock_readable(bsock));
-	if (*len < (bsock->rq.size >> 1)) {
+	if (*len < (bsock->rq.size >> 1) && ofi_byteq_alloc(&bsock->rq)) {
 		avail = ofi_byteq_writeable(&bsock->rq);
 		assert(avail);
 		ret = bsock->sockapi->recv(bsock->sockapi, bsock->sock,
@@ -1354,7 +1461,7 @@ int ofi_bsock_recvv(struct ofi_bsock *bsock, struct iovec *iov, size_t cnt,
 	}
 
 	assert(!ofi_bsock_readable(bsock));
-	if (*len < (bsock->rq.size >> 1)) {
+	if (*len < (bsock->rq.size >> 1) && ofi_byteq_alloc(&bsock->rq)) {
 		avail = ofi_byteq_writeable(&bsock->rq);
 		assert(avail);
 		ret = bsock->sockapi->recv(bsock->sockapi, bsock->sock,
@@ -1408,15 +1515,20 @@ void ofi_bsock_prefetch_done(struct ofi_bsock *bsock, size_t len)
 }
 
 #ifdef MSG_ZEROCOPY
+/* Drain all zero copy completion ranges queued on the socket. */
 int ofi_bsock_async_done(const struct fi_provider *prov,
 			 struct ofi_bsock *bsock)
 {
-	struct msghdr msg = {};
+	struct ofi_bsock_zc *zc = &bsock->zc;
+	struct msghdr msg;
 	struct sock_extended_err *serr;
 	struct cmsghdr *cmsg;
 	/* x2 is arbitrary but avoids truncation */
 	uint8_t ctrl[CMSG_SPACE(sizeof(*serr) * 2)];
-	int ret;
+	uint64_t start;
+	uint32_t cnt;
+	bool copied = false;
+	int ret, ranges = 0;
 
 	int val = 0;
 	socklen_t len = sizeof(val);
@@ -1432,43 +1544,78 @@ int ofi_bsock_async_done(const struct fi_provider *prov,
 		return -val;
 	}
 
-	msg.msg_control = &ctrl;
-	msg.msg_controllen = sizeof(ctrl);
-	ret = recvmsg(bsock->sock, &msg, MSG_ERRQUEUE);
-	if (ret < 0) {
-		if (OFI_SOCK_TRY_SND_RCV_AGAIN(errno))
-			return 0;
+	start = ofi_gettime_ns();
+	for (;;) {
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control = &ctrl;
+		msg.msg_controllen = sizeof(ctrl);
+		ret = recvmsg(bsock->sock, &msg, MSG_ERRQUEUE);
+		if (ret < 0) {
+			if (OFI_SOCK_TRY_SND_RCV_AGAIN(errno))
+				break;
 
-		FI_WARN(prov, FI_LOG_EP_DATA,
-			"Error reading MSG_ERRQUEUE (%s)\n", strerror(errno));
-		return -errno;
-	}
+			FI_WARN(prov, FI_LOG_EP_DATA,
+				"Error reading MSG_ERRQUEUE (%s)\n",
+				strerror(errno));
+			return -errno;
+		}
 
-	assert(!(msg.msg_flags & MSG_CTRUNC));
-	cmsg = CMSG_FIRSTHDR(&msg);
-	if ((cmsg->cmsg_level != SOL_IP && cmsg->cmsg_type != IP_RECVERR) &&
-	    (cmsg->cmsg_level != SOL_IPV6 && cmsg->cmsg_type != IPV6_RECVERR)) {
-		FI_WARN(prov, FI_LOG_EP_DATA,
-			"Unexpected cmsg level (!IP) or type (!RECVERR)\n");
-		return -FI_EINVAL;
+		assert(!(msg.msg_flags & MSG_CTRUNC));
+		cmsg = CMSG_FIRSTHDR(&msg);
+		if ((cmsg->cmsg_level != SOL_IP && cmsg->cmsg_type != IP_RECVERR) &&
+		    (cmsg->cmsg_level != SOL_IPV6 && cmsg->cmsg_type != IPV6_RECVERR)) {
+			FI_WARN(prov, FI_LOG_EP_DATA,
+				"Unexpected cmsg level (!IP) or type (!RECVERR)\n");
+			return -FI_EINVAL;
+		}
+
+		serr = (void *) CMSG_DATA(cmsg);
+		if ((serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) || serr->ee_errno) {
+			FI_WARN(prov, FI_LOG_EP_DATA,
+				"Unexpected sock err origin or errno\n");
+			return -FI_EINVAL;
+		}
+
+		/* Each notification covers sends ee_info through ee_data */
+		cnt = serr->ee_data - serr->ee_info + 1;
+		if (ofi_val32_gt(serr->ee_data, bsock->done_index))
+			bsock->done_index = serr->ee_data;
+		if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+			copied = true;
+			zc->copied += cnt;
+		} else {
+			zc->hits += cnt;
+		}
+		ranges++;
 	}
 
-	serr = (void *) CMSG_DATA(cmsg);
-	if ((serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) || serr->ee_errno) {
-		FI_WARN(prov, FI_LOG_EP_DATA,
-			"Unexpected sock err origin or errno\n");
-		return -FI_EINVAL;
+	if (!ranges)
+		return 0;
+
+	if (zc->pending) {
+		ofi_ewma(&zc->harvest_cost,
+			 (ofi_gettime_ns() - start) * 1024 / zc->pending);
+		zc->pending = 0;
 	}
 
-	bsock->done_index = serr->ee_data;
-	if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
-		FI_WARN(prov, FI_LOG_EP_DATA,
-			"Zerocopy data was copied\n");
-		if (bsock->zerocopy_size != SIZE_MAX) {
-			FI_WARN(prov, FI_LOG_EP_DATA, "disabling zerocopy\n");
-			bsock->zerocopy_size = SIZE_MAX;
+	/* Back off while the kernel copies any of the data, but keep
+	 * probing in case the copies were transient (e.g. the route changed).
+	 */
+	if (copied) {
+		if (!zc->copying) {
+			FI_INFO(prov, FI_LOG_EP_DATA,
+				"Zerocopy data was copied, backing off\n");
+			zc->copying = true;
+			zc->probe = zc->backoff;
+		} else if (zc->backoff < OFI_ZC_PROBE_MAX) {
+			zc->backoff <<= 1;
+			zc->probe = zc->backoff;
 		}
+	} else {
+		zc->copying = false;
+		zc->backoff = OFI_ZC_PROBE_MIN;
 	}
+	ofi_bsock_zc_select(zc);
 	return 0;
 }
 #else
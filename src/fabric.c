@@ -969,6 +969,26 @@ void fi_ini(void)
 			"(default: false)");
 	fi_param_get_bool(NULL, "av_remove_cleanup", &ofi_av_remove_cleanup);
 
+	fi_param_define(NULL, "srx_tag_hash", FI_PARAM_BOOL,
+			"Match tagged receives in the shared receive context "
+			"used by rxm, shm and efa through hash tables keyed "
+			"by tag and source instead of walking the receive "
+			"queues.  Improves matching with deep posted or "
+			"unexpected queues.  (default: false)");
+	fi_param_get_bool(NULL, "srx_tag_hash", &ofi_srx_tag_hash);
+
+	fi_param_define(NULL, "wait_spin", FI_PARAM_INT,
+			"Maximum time in microseconds that fi_cq_sread and "
+			"fi_cntr_wait on util based CQs and counters poll "
+			"for completions before blocking on the wait object.  "
+			"The spin time adapts to how long recent waits took, "
+			"and drops to zero when completions arrive less "
+			"often than this limit.  (default: 0, block "
+			"immediately)");
+	fi_param_get_int(NULL, "wait_spin", &ofi_wait_spin_us);
+	if (ofi_wait_spin_us < 0)
+		ofi_wait_spin_us = 0;
+
 	fi_param_define(NULL, "offload_coll_provider", FI_PARAM_STRING,
 			"The name of a colective offload provider (default: \
 			empty - no provider)");
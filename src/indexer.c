@@ -115,7 +115,7 @@ void *ofi_idx_remove(struct indexer *idx, int index)
 
 void *ofi_idx_remove_ordered(struct indexer *idx, int index)
 {
-	struct ofi_idx_entry *chunk;
+	struct ofi_idx_entry *chunk, *prev;
 	void *item;
 	int temp_index;
 	int offset = ofi_idx_offset(index);
@@ -128,12 +128,16 @@ void *ofi_idx_remove_ordered(struct indexer *idx, int index)
 		idx->free_list = index;
 		return item;
 	}
+	/* Free entries may live in other chunks; 0 terminates the list */
 	temp_index = idx->free_list;
-	while (chunk[ofi_idx_offset(temp_index)].next < index) {
-		temp_index = chunk[ofi_idx_offset(temp_index)].next;
+	prev = ofi_idx_chunk(idx, temp_index) + ofi_idx_offset(temp_index);
+	while (prev->next && prev->next < index) {
+		temp_index = prev->next;
+		prev = ofi_idx_chunk(idx, temp_index) +
+		       ofi_idx_offset(temp_index);
 	}
-	chunk[offset].next = chunk[ofi_idx_offset(temp_index)].next;
-	chunk[ofi_idx_offset(temp_index)].next = index;
+	chunk[offset].next = prev->next;
+	prev->next = index;
 
 	return item;
 }
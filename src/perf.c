@@ -37,8 +37,10 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <inttypes.h>
+#include <time.h>
 
 #include <rdma/fi_errno.h>
+#include <ofi.h>
 #include <ofi_perf.h>
 #include <rdma/providers/fi_log.h>
 
@@ -46,6 +48,8 @@
 enum ofi_perf_domain	perf_domain = OFI_PMU_CPU;
 uint32_t		perf_cntr = OFI_PMC_CPU_INSTR;
 uint32_t		perf_flags;
+char			*perf_dump_file;
+int			perf_dump_interval;
 
 
 void ofi_perf_init(void)
@@ -55,6 +59,21 @@ void ofi_perf_init(void)
 	fi_param_define(NULL, "perf_cntr", FI_PARAM_STRING,
 			"Performance counter to analyze (default: cpu_instr). "
 			"Options: cpu_instr, cpu_cycles.");
+	fi_param_define(NULL, "perf_dump_file", FI_PARAM_STRING,
+			"File to which performance data is appended, in "
+			"addition to being logged at trace level (default: "
+			"none).");
+	fi_param_define(NULL, "perf_dump_interval", FI_PARAM_INT,
+			"Interval in seconds at which performance data is "
+			"appended to FI_PERF_DUMP_FILE while the fabric is "
+			"open.  A value of 0 only writes the data when the "
+			"fabric is closed (default: 0).");
+
+	fi_param_get_str(NULL, "perf_dump_file", &perf_dump_file);
+	fi_param_get_int(NULL, "perf_dump_interval", &perf_dump_interval);
+	if (perf_dump_interval < 0)
+		perf_dump_interval = 0;
+
 	fi_param_get_str(NULL, "perf_cntr", &param_val);
 	if (!param_val)
 		return;
@@ -65,6 +84,44 @@ void ofi_perf_init(void)
 	}
 }
 
+static uint64_t ofi_perf_hist_value(size_t index, uint64_t max)
+{
+	uint64_t value;
+	int shift;
+
+	if (index < OFI_PERF_HIST_SUB)
+		return index;
+
+	/* Report the highest value that maps to the bucket */
+	shift = (int) (index >> OFI_PERF_HIST_SUB_BITS) - 1;
+	value = ((uint64_t) (OFI_PERF_HIST_SUB +
+			     (index & (OFI_PERF_HIST_SUB - 1))) << shift) +
+		((1ULL << shift) - 1);
+	return MIN(value, max);
+}
+
+uint64_t ofi_perf_percentile(const struct ofi_perf_data *data, double pct)
+{
+	uint64_t total = 0, rank, count = 0;
+	size_t i;
+
+	for (i = 0; i < OFI_PERF_HIST_SIZE; i++)
+		total += data->hist[i];
+	if (!total)
+		return 0;
+
+	rank = (uint64_t) (total * pct / 100.0 + 0.5);
+	if (!rank)
+		rank = 1;
+
+	for (i = 0; i < OFI_PERF_HIST_SIZE; i++) {
+		count += data->hist[i];
+		if (count >= rank)
+			return ofi_perf_hist_value(i, data->max);
+	}
+	return data->max;
+}
+
 int ofi_perfset_create(const struct fi_provider *prov,
 		       struct ofi_perfset *set, size_t size,
 		       enum ofi_perf_domain domain, uint32_t cntr_id,
@@ -133,19 +190,54 @@ static const char *ofi_perf_name(void)
 
 void ofi_perfset_log(struct ofi_perfset *set, const char *names[])
 {
+	struct ofi_perf_data *data;
 	size_t i;
 
 	FI_TRACE(set->prov, FI_LOG_CORE, "\n");
 	FI_TRACE(set->prov, FI_LOG_CORE, "\tPERF: %s\n", ofi_perf_name());
-	FI_TRACE(set->prov, FI_LOG_CORE, "\t%-20s%-10s%s\n", "Name", "Avg", "Events");
+	FI_TRACE(set->prov, FI_LOG_CORE, "\t%-20s%-10s%-10s%-10s%-10s%-10s%s\n",
+		 "Name", "Avg", "p50", "p99", "p99.9", "Max", "Events");
+
+	for (i = 0; i < set->size; i++) {
+		data = &set->data[i];
+		if (!data->events)
+			continue;
+
+		FI_TRACE(set->prov, FI_LOG_CORE, "\t%-20s%-10g%-10" PRIu64
+			 "%-10" PRIu64 "%-10" PRIu64 "%-10" PRIu64 "%" PRIu64 "\n",
+			 names && names[i] ? names[i] : "unknown",
+			 (double) data->sum / data->events,
+			 ofi_perf_percentile(data, 50.0),
+			 ofi_perf_percentile(data, 99.0),
+			 ofi_perf_percentile(data, 99.9),
+			 data->max, data->events);
+	}
+}
+
+void ofi_perfset_dump(struct ofi_perfset *set, const char *names[], FILE *file)
+{
+	struct ofi_perf_data *data;
+	size_t i;
+
+	fprintf(file, "PERF: %s pid %d time %lld\n", ofi_perf_name(),
+		(int) getpid(), (long long) time(NULL));
+	fprintf(file, "%-20s%-10s%-10s%-10s%-10s%-10s%s\n",
+		"Name", "Avg", "p50", "p99", "p99.9", "Max", "Events");
 
 	for (i = 0; i < set->size; i++) {
-		if (!set->data[i].events)
+		data = &set->data[i];
+		if (!data->events)
 			continue;
 
-		FI_TRACE(set->prov, FI_LOG_CORE, "\t%-20s%-10g%" PRIu64 "\n",
+		fprintf(file, "%-20s%-10g%-10" PRIu64 "%-10" PRIu64 "%-10" PRIu64
+			"%-10" PRIu64 "%" PRIu64 "\n",
 			names && names[i] ? names[i] : "unknown",
-			(double) set->data[i].sum / set->data[i].events,
-			set->data[i].events);
+			(double) data->sum / data->events,
+			ofi_perf_percentile(data, 50.0),
+			ofi_perf_percentile(data, 99.0),
+			ofi_perf_percentile(data, 99.9),
+			data->max, data->events);
 	}
+	fprintf(file, "\n");
+	fflush(file);
 }
@@ -401,6 +401,19 @@ struct ofi_rbnode *ofi_rbmap_get_root(struct ofi_rbmap *map)
 	return map->root;
 }
 
+struct ofi_rbnode *ofi_rbmap_get_min(struct ofi_rbmap *map)
+{
+	struct ofi_rbnode *node;
+
+	if (ofi_rbmap_empty(map))
+		return NULL;
+
+	node = map->root;
+	while (node->left != &map->sentinel)
+		node = node->left;
+	return node;
+}
+
 struct ofi_rbnode *ofi_rbmap_find(struct ofi_rbmap *map, void *key)
 {
 	struct ofi_rbnode *node;